@@ -27,6 +27,9 @@ dependent_configuration_feature(LOG_TIMESTAMPS  LOGGING "If set, the system will
 dependent_configuration_feature(SEMIHOSTING     LOGGING "Uses ARM semihosting to live-print log information over JTAG/SWD when a debugger is connected." ON)
 dependent_configuration_feature(DEBUG_RING      LOGGING "Keeps a local ringbuffer that allows debug logs to be fetched over e.g. USB. Uses a bit of memory; but very useful." ON)
 
+# Power options.
+configuration_feature(IDLE_SLEEP "Sleeps the core with WFI whenever no wakeable task has work. Only safe if no polled DEFINE_TASK needs to run between interrupts." OFF)
+
 # Set the default log level for GreatFET.
 # TODO: bring this down to 5 for non-debug builds?
 set(DEBUG_DEFAULT_LOG_LEVEL 6 CACHE STRING "The default log-level for GreatFET; higher = more logs. 5-6 is a normal informational level.")
@@ -0,0 +1,155 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Fixed-point CIC decimation, with optional DC removal, for streams of 8-bit ADC samples.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "cic_decimator.h"
+
+enum {
+	// Our inputs are offset-binary; this is the code for a zero input.
+	CIC_DECIMATOR_INPUT_MIDSCALE = 0x80,
+	CIC_DECIMATOR_INPUT_BITS     = 8,
+	CIC_DECIMATOR_OUTPUT_BITS    = 16,
+
+	// Fractional bits kept in our DC estimate.
+	CIC_DECIMATOR_DC_FRACTION_BITS = 8,
+};
+
+
+/**
+ * @return The smallest n for which 2^n >= value.
+ */
+static uint8_t ceil_log2(uint32_t value)
+{
+	uint8_t bits = 0;
+
+	while ((1UL << bits) < value) {
+		++bits;
+	}
+
+	return bits;
+}
+
+
+/**
+ * Sets up a decimator.
+ */
+int cic_decimator_init(cic_decimator_t *decimator, uint32_t ratio, uint8_t dc_time_constant)
+{
+	int growth;
+
+	if (!ratio || (ratio > CIC_DECIMATOR_MAX_RATIO)) {
+		return EINVAL;
+	}
+	if (dc_time_constant > CIC_DECIMATOR_MAX_DC_TIME_CONSTANT) {
+		return EINVAL;
+	}
+
+	memset(decimator, 0, sizeof(*decimator));
+
+	// The filter's gain is ratio^order; scale its output back down to fit in 16 bits.
+	growth = CIC_DECIMATOR_INPUT_BITS + (CIC_DECIMATOR_ORDER * ceil_log2(ratio)) - CIC_DECIMATOR_OUTPUT_BITS;
+
+	decimator->ratio            = ratio;
+	decimator->output_shift     = (growth > 0) ? growth : 0;
+	decimator->dc_time_constant = dc_time_constant;
+
+	return 0;
+}
+
+
+/**
+ * Subtracts our running DC estimate from a sample, and updates the estimate.
+ */
+static int32_t cic_decimator_remove_dc(cic_decimator_t *decimator, int32_t sample)
+{
+	int32_t scaled = sample * (1 << CIC_DECIMATOR_DC_FRACTION_BITS);
+
+	decimator->dc_estimate += (scaled - decimator->dc_estimate) >> decimator->dc_time_constant;
+	return sample - (decimator->dc_estimate >> CIC_DECIMATOR_DC_FRACTION_BITS);
+}
+
+
+/**
+ * Runs our comb stages on the latest integrator output, and produces a single output sample.
+ */
+static int16_t cic_decimator_produce(cic_decimator_t *decimator, uint32_t integrated)
+{
+	int32_t sample;
+	uint32_t value = integrated;
+
+	for (unsigned stage = 0; stage < CIC_DECIMATOR_ORDER; ++stage) {
+		uint32_t delayed = decimator->comb_delays[stage];
+
+		decimator->comb_delays[stage] = value;
+		value -= delayed;
+	}
+
+	sample = (int32_t)value >> decimator->output_shift;
+
+	if (decimator->dc_time_constant) {
+		sample = cic_decimator_remove_dc(decimator, sample);
+	}
+
+	// Our gain scaling can leave a little headroom short for non-power-of-two ratios, and DC removal
+	// can push a full-scale sample past the rails; so saturate rather than wrap.
+	if (sample > INT16_MAX) {
+		sample = INT16_MAX;
+	} else if (sample < INT16_MIN) {
+		sample = INT16_MIN;
+	}
+
+	return sample;
+}
+
+
+/**
+ * Decimates a block of unsigned 8-bit samples into signed 16-bit samples.
+ */
+uint32_t cic_decimator_process(cic_decimator_t *decimator, const uint8_t *input, uint32_t input_count,
+	int16_t *output)
+{
+	uint32_t produced = 0;
+
+	// Keep our integrators in locals, so the compiler can hold them in registers across the hot loop.
+	// (The loop below is unrolled for CIC_DECIMATOR_ORDER stages.)
+	uint32_t integrator0 = decimator->integrators[0];
+	uint32_t integrator1 = decimator->integrators[1];
+	uint32_t integrator2 = decimator->integrators[2];
+	uint32_t phase       = decimator->phase;
+	uint32_t ratio       = decimator->ratio;
+
+	while (input_count) {
+
+		// Integrate as many samples as we can before our next output is due.
+		uint32_t run = ratio - phase;
+		if (run > input_count) {
+			run = input_count;
+		}
+
+		input_count -= run;
+		phase       += run;
+
+		while (run--) {
+			integrator0 += (int32_t)*input++ - CIC_DECIMATOR_INPUT_MIDSCALE;
+			integrator1 += integrator0;
+			integrator2 += integrator1;
+		}
+
+		if (phase == ratio) {
+			output[produced++] = cic_decimator_produce(decimator, integrator2);
+			phase = 0;
+		}
+	}
+
+	decimator->integrators[0] = integrator0;
+	decimator->integrators[1] = integrator1;
+	decimator->integrators[2] = integrator2;
+	decimator->phase          = phase;
+
+	return produced;
+}
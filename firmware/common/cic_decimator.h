@@ -0,0 +1,74 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Fixed-point CIC decimation, with optional DC removal, for streams of 8-bit ADC samples.
+ */
+
+#ifndef __CIC_DECIMATOR_H__
+#define __CIC_DECIMATOR_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * The number of integrator/comb stages. Each stage adds log2(ratio) bits of growth; with 8-bit
+ * input, three stages let us decimate by up to 256 while keeping our arithmetic in 32 bits.
+ */
+#define CIC_DECIMATOR_ORDER     (3)
+#define CIC_DECIMATOR_MAX_RATIO (256)
+
+/**
+ * The largest supported DC-removal time constant; see cic_decimator_init.
+ */
+#define CIC_DECIMATOR_MAX_DC_TIME_CONSTANT (16)
+
+
+/**
+ * State for a single decimator.
+ */
+typedef struct {
+
+	// Configuration.
+	uint32_t ratio;
+	uint8_t output_shift;
+	uint8_t dc_time_constant;
+
+	// Filter state. Integrators wrap freely; a CIC's output is correct modulo 2^32
+	// as long as the true output fits in 32 bits.
+	uint32_t integrators[CIC_DECIMATOR_ORDER];
+	uint32_t comb_delays[CIC_DECIMATOR_ORDER];
+
+	// The number of input samples accumulated toward the next output.
+	uint32_t phase;
+
+	// Running estimate of the DC offset of our output, with 8 fractional bits.
+	int32_t dc_estimate;
+
+} cic_decimator_t;
+
+
+/**
+ * Sets up a decimator.
+ *
+ * @param ratio The number of input samples per output sample; 1 to CIC_DECIMATOR_MAX_RATIO.
+ * @param dc_time_constant If non-zero, enables DC removal; the offset is tracked by a single-pole filter
+ *		with a time constant of roughly 2^dc_time_constant output samples.
+ * @return 0 on success, or EINVAL if the configuration isn't supported.
+ */
+int cic_decimator_init(cic_decimator_t *decimator, uint32_t ratio, uint8_t dc_time_constant);
+
+
+/**
+ * Decimates a block of unsigned 8-bit samples into signed 16-bit samples.
+ * Filter state carries over between calls; so a stream can be processed in arbitrary pieces.
+ *
+ * @param input The samples to be decimated.
+ * @param input_count The number of input samples.
+ * @param output Buffer to receive the decimated samples; must have room for
+ *		(input_count / ratio) + 1 samples.
+ * @return The number of output samples produced.
+ */
+uint32_t cic_decimator_process(cic_decimator_t *decimator, const uint8_t *input, uint32_t input_count,
+	int16_t *output);
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Simple CRC32 implementation, for validating data exchanged with the host.
+ */
+
+#include "crc32.h"
+
+
+/**
+ * Nibble-wise lookup table for the reflected CRC32 polynomial.
+ * This is a good compromise between the size of a full 256-entry table and the speed
+ * of a bitwise implementation.
+ */
+static const uint32_t crc32_nibble_table[16] = {
+	0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+	0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+	0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+	0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
+
+
+/**
+ * Updates a running CRC32 with the given data.
+ */
+uint32_t crc32_update(uint32_t crc, const void *data, size_t length)
+{
+	const uint8_t *bytes = data;
+
+	crc = ~crc;
+
+	for (size_t i = 0; i < length; ++i) {
+		crc ^= bytes[i];
+		crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0f];
+		crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0f];
+	}
+
+	return ~crc;
+}
@@ -0,0 +1,27 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Simple CRC32 implementation, for validating data exchanged with the host.
+ */
+
+#ifndef __CRC32_H__
+#define __CRC32_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Updates a running CRC32 with the given data.
+ *
+ * Uses the same (reflected, 0x04C11DB7) polynomial as zlib's crc32(), so the host
+ * can validate results using zlib.crc32().
+ *
+ * @param crc The CRC computed so far; or 0 to start a new computation.
+ * @param data The data to be included in the CRC.
+ * @param length The length of the data, in bytes.
+ *
+ * @return The updated CRC.
+ */
+uint32_t crc32_update(uint32_t crc, const void *data, size_t length);
+
+#endif/*__CRC32_H__*/
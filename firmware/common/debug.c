@@ -366,7 +366,6 @@ void debug_putc(char c)
 void vprintk(int loglevel, char *fmt, va_list list)
 {
 	int core_level = loglevel & LOG_LEVEL_MASK;
-	bool skip_header = (loglevel & LOG_CONTINUE);
 
 	// If this statement is above the maximum level to be displayed,
 	// bail out.
@@ -375,6 +374,8 @@ void vprintk(int loglevel, char *fmt, va_list list)
 
 
 #ifdef CONFIG_ENABLE_LOG_TIMESTAMPS
+	bool skip_header = (loglevel & LOG_CONTINUE);
+
 	if (!skip_header) {
 		printf("[%12" PRIu32 "] ", get_time());
 	}
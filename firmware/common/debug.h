@@ -80,6 +80,14 @@ bool debug_ring_full(void);
 bool debug_ring_empty(void);
 
 
+#ifdef __RUNNING_ON_HOST__
+/**
+ * Resets the debug ring to empty. Provided by the host test stubs, for tests that need a clean ring.
+ */
+void debug_init(void);
+#endif
+
+
 
 /**
  * Reads a set of raw bytes from the system's debug ringbuffer.
@@ -0,0 +1,40 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Access to the Cortex-M4's DWT cycle counter; which counts every core clock cycle.
+ */
+
+#ifndef __GREATFET_DWT_H__
+#define __GREATFET_DWT_H__
+
+#include <stdint.h>
+
+#define DWT_CTRL               (*(volatile uint32_t *)0xE0001000)
+#define DWT_CYCCNT             (*(volatile uint32_t *)0xE0001004)
+#define DWT_CTRL_CYCCNTENA     (1 << 0)
+
+// The debug exception and monitor control register; which gates power to the DWT.
+#define SCS_DEMCR              (*(volatile uint32_t *)0xE000EDFC)
+#define SCS_DEMCR_TRCENA       (1 << 24)
+
+
+/**
+ * Starts the cycle counter, if it's not already running. Safe to call repeatedly;
+ * the count is never reset, so multiple users can share the counter.
+ */
+static inline void dwt_cycle_counter_enable(void)
+{
+	SCS_DEMCR |= SCS_DEMCR_TRCENA;
+	DWT_CTRL  |= DWT_CTRL_CYCCNTENA;
+}
+
+
+/**
+ * @return The current value of the free-running cycle counter. Wraps every 2^32 core clock cycles.
+ */
+static inline uint32_t dwt_cycle_count(void)
+{
+	return DWT_CYCCNT;
+}
+
+#endif
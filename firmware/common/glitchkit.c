@@ -12,10 +12,13 @@
 #include <gpio.h>
 #include <gpio_lpc.h>
 #include <gpio_scu.h>
+#include <wakeable_task.h>
 
 #include <libopencm3/lpc43xx/scu.h>
 #include <libopencm3/lpc43xx/cgu.h>
 
+DECLARE_WAKEABLE_TASK(service_glitchkit);
+
 // FIXME: make synchronization explicit using atomic operations :)
 // [even though these are currently all atomic due to bus configuration]
 
@@ -242,6 +245,7 @@ void glitchkit_trigger() {
 		//... and then schedule it to turn off later.
 		// FIXME: This should really be on a timer.
 		glitchkit.triggered = true;
+		task_wake(WAKEABLE_TASK(service_glitchkit));
 }
 
 
@@ -297,4 +301,4 @@ void service_glitchkit() {
 		}
 }
 
-DEFINE_TASK(service_glitchkit);
+DEFINE_WAKEABLE_TASK(service_glitchkit, TASK_PRIORITY_HIGH);
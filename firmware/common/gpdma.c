@@ -32,6 +32,10 @@ int gpdma_channel_interrupt_is_error(const uint_fast8_t channel) {
 	return (GPDMA_INTERRSTAT & (1 << channel));
 }
 
+int gpdma_channel_is_enabled(const uint_fast8_t channel) {
+	return (GPDMA_ENBLDCHNS & GPDMA_ENBLDCHNS_ENABLEDCHANNELS(1 << channel)) != 0;
+}
+
 void gpdma_lli_enable_interrupt(gpdma_lli_t* const lli) {
 	lli->ccontrol |= GPDMA_CCONTROL_I(1);
 }
@@ -47,3 +51,7 @@ void gpdma_lli_create_oneshot(gpdma_lli_t* const lli, const size_t lli_count) {
 	gpdma_lli_create_loop(lli, lli_count);
 	lli[lli_count - 1].clli &= ~GPDMA_CLLI_LLI_MASK;
 }
+
+void gpdma_lli_set_next(gpdma_lli_t* const lli, const gpdma_lli_t* const next_lli) {
+	lli->clli = (lli->clli & ~GPDMA_CLLI_LLI_MASK) | GPDMA_CLLI_LLI((uint32_t)next_lli >> 2);
+}
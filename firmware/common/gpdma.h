@@ -18,10 +18,16 @@ void gpdma_channel_disable(const uint_fast8_t channel);
 void gpdma_channel_interrupt_tc_clear(const uint_fast8_t channel);
 void gpdma_channel_interrupt_error_clear(const uint_fast8_t channel);
 int gpdma_channel_interrupt_is_error(const uint_fast8_t channel);
+int gpdma_channel_is_enabled(const uint_fast8_t channel);
 
 void gpdma_lli_enable_interrupt(gpdma_lli_t* const lli);
 
 void gpdma_lli_create_loop(gpdma_lli_t* const lli, const size_t lli_count);
 void gpdma_lli_create_oneshot(gpdma_lli_t* const lli, const size_t lli_count);
 
+/**
+ * Points an LLI at the one that should follow it; or, if next_lli is NULL, makes it the end of its chain.
+ */
+void gpdma_lli_set_next(gpdma_lli_t* const lli, const gpdma_lli_t* const next_lli);
+
 #endif/*__GPDMA_H__*/
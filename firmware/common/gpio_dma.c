@@ -20,6 +20,20 @@ void gpio_dma_config_lli(
 	void* const target_buffer,
 	const size_t transfer_bytes
 ) {
+	gpio_dma_config_lli_with_width(lli, lli_count, buffer, target_buffer, transfer_bytes, 1);
+}
+
+void gpio_dma_config_lli_with_width(
+	gpdma_lli_t* const lli,
+	const size_t lli_count,
+	void* const buffer,
+	void* const target_buffer,
+	const size_t transfer_bytes,
+	const size_t bytes_per_request
+) {
+	// Each DMA request writes a single byte or halfword to the port.
+	const uint32_t destination_width = (bytes_per_request == 2) ? 1 : 0;
+
 	gpdma_lli_create_loop(lli, lli_count);
 
 	for(size_t i=0; i<lli_count; i++) {
@@ -34,7 +48,7 @@ void gpio_dma_config_lli(
 			GPDMA_CCONTROL_SBSIZE(1) |
 			GPDMA_CCONTROL_DBSIZE(0) |
 			GPDMA_CCONTROL_SWIDTH(2) | // Four bytes
-			GPDMA_CCONTROL_DWIDTH(0) | // One byte
+			GPDMA_CCONTROL_DWIDTH(destination_width) |
 			GPDMA_CCONTROL_S(1) |
 			GPDMA_CCONTROL_D(1) |
 			GPDMA_CCONTROL_SI(1) |
@@ -96,6 +110,10 @@ int gpio_dma_irq_is_error() {
 	return gpdma_channel_interrupt_is_error(dma_channel_gpio);
 }
 
+int gpio_dma_is_running() {
+	return gpdma_channel_is_enabled(dma_channel_gpio);
+}
+
 void gpio_dma_stop() {
 	gpdma_channel_disable(dma_channel_gpio);
 }
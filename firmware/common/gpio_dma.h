@@ -17,11 +17,26 @@ void gpio_dma_config_lli(
 	const size_t transfer_bytes
 );
 
+/**
+ * Variant of gpio_dma_config_lli that writes wider samples to the target on each DMA request.
+ *
+ * @param bytes_per_request The size of each write to the target; 1 or 2 bytes.
+ */
+void gpio_dma_config_lli_with_width(
+	gpdma_lli_t* const lli,
+	const size_t lli_count,
+	void* const buffer,
+	void* const target_buffer,
+	const size_t transfer_bytes,
+	const size_t bytes_per_request
+);
+
 void gpio_dma_init();
 void gpio_dma_tx_start(const gpdma_lli_t* const start_lli);
 void gpio_dma_irq_err_clear();
 void gpio_dma_irq_tc_acknowledge();
 int gpio_dma_irq_is_error();
+int gpio_dma_is_running();
 void gpio_dma_stop();
 
 size_t gpio_dma_current_transfer_index(
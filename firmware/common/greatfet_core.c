@@ -72,6 +72,8 @@ spi_bus_t spi_bus_ssp0 = {
 	.transfer_data = spi_ssp_transfer_data,
 	.transfer_gather = spi_ssp_transfer_gather,
 	.transfer_gather_partial = spi_ssp_transfer_gather_partial,
+	.transmit_data = spi_ssp_transmit_data,
+	.receive_data = spi_ssp_receive_data,
 };
 
 const ssp_config_t ssp1_config_spi = {
@@ -89,6 +91,8 @@ spi_bus_t spi_bus_ssp1 = {
 	.transfer_data = spi_ssp_transfer_data,
 	.transfer_gather = spi_ssp_transfer_gather,
 	.transfer_gather_partial = spi_ssp_transfer_gather_partial,
+	.transmit_data = spi_ssp_transmit_data,
+	.receive_data = spi_ssp_receive_data,
 };
 
 #define DELAY_CLK_SPEED 204000000
@@ -0,0 +1,91 @@
+/*
+ * This file is part of GreatFET
+ *
+ * M4-side support for the M4/M0 shared-memory mailbox.
+ */
+
+#include <errno.h>
+
+#include <drivers/arm_vectors.h>
+#include <libopencm3/lpc43xx/m4/nvic.h>
+
+#include "m0_mailbox.h"
+
+// Storage for our rings; kept in the M4's memory, which is equally visible to the M0.
+static uint8_t command_ring_storage[M0_MAILBOX_COMMAND_RING_SIZE];
+static uint8_t data_ring_storage[M0_MAILBOX_DATA_RING_SIZE];
+
+static m0_mailbox_t *mailbox;
+
+
+/**
+ * Interrupt handler for the M0's TXEV; which the M0 raises whenever it's produced data.
+ *
+ * We only need to acknowledge the event: being interrupted is enough to wake the M4, and
+ * our consumers check the data ring directly.
+ */
+static void m0_event_isr(void)
+{
+	M0_MAILBOX_M0TXEVENT = 0;
+}
+
+
+/**
+ * Sets up the mailbox at the top of the M0's memory region. Should be called with the M0 halted.
+ */
+m0_mailbox_t *m0_mailbox_init(void *region, uint32_t region_size)
+{
+	mailbox = M0_MAILBOX_FOR_REGION(region, region_size);
+
+	mailbox->commands.head = 0;
+	mailbox->commands.tail = 0;
+	mailbox->commands.size = sizeof(command_ring_storage);
+	mailbox->commands.data = command_ring_storage;
+
+	mailbox->data.head = 0;
+	mailbox->data.tail = 0;
+	mailbox->data.size = sizeof(data_ring_storage);
+	mailbox->data.data = data_ring_storage;
+
+	// Publish the mailbox only once it's fully set up.
+	m0_mailbox_memory_barrier();
+	mailbox->magic = M0_MAILBOX_MAGIC;
+
+	// Clear any stale event from a previous loadable, and listen for new ones.
+	M0_MAILBOX_M0TXEVENT = 0;
+	vector_table.irqs[NVIC_M0CORE_IRQ] = m0_event_isr;
+	nvic_set_priority(NVIC_M0CORE_IRQ, 255);
+	nvic_enable_irq(NVIC_M0CORE_IRQ);
+
+	return mailbox;
+}
+
+
+/**
+ * @return The active mailbox; or NULL if none has been set up.
+ */
+m0_mailbox_t *m0_mailbox_get(void)
+{
+	return mailbox;
+}
+
+
+/**
+ * Sends a command to the M0, and wakes it.
+ */
+int m0_mailbox_send_command(const void *command, uint32_t length)
+{
+	if (!mailbox) {
+		return ENODEV;
+	}
+
+	// Only send whole commands, so the M0 never has to reassemble a partial one.
+	if (length > m0_ring_bytes_free(&mailbox->commands)) {
+		return ENOSPC;
+	}
+
+	m0_ring_write(&mailbox->commands, command, length);
+	m0_mailbox_signal_other_core();
+
+	return 0;
+}
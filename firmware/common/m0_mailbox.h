@@ -0,0 +1,233 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Shared-memory mailbox for exchanging data between the M4 and M0 cores.
+ *
+ * This header is self-contained, so M0 loadables can include it directly: the ring
+ * operations are all inline, and need nothing from the main firmware.
+ */
+
+#ifndef __M0_MAILBOX_H__
+#define __M0_MAILBOX_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * Value placed in the mailbox's magic field once the M4 has set it up.
+ */
+#define M0_MAILBOX_MAGIC (0x4d304d42) // 'M0MB'
+
+/**
+ * Space reserved for the mailbox at the very top of the M0's memory region.
+ *
+ * An M0 region is laid out as:
+ *
+ *     [ loadable image ... | <- stack grows down | mailbox (M0_MAILBOX_RESERVED_SIZE bytes) ]
+ *
+ * so a loadable's initial stack pointer must be no higher than M0_STACK_TOP_FOR_REGION(); otherwise,
+ * its first push would overwrite the mailbox. The M4 refuses to start images that get this wrong.
+ */
+#define M0_MAILBOX_RESERVED_SIZE (64)
+
+/**
+ * Sizes of the rings that back the mailbox. Each must be a power of two.
+ */
+#define M0_MAILBOX_COMMAND_RING_SIZE (256)
+#define M0_MAILBOX_DATA_RING_SIZE    (32768)
+
+/**
+ * CREG registers used to acknowledge each core's TXEV; which are raised whenever the
+ * relevant core executes a SEV instruction. The M0's events are acknowledged by the M4,
+ * and vice versa.
+ */
+#define M0_MAILBOX_M4TXEVENT (*(volatile uint32_t *)0x40043130)
+#define M0_MAILBOX_M0TXEVENT (*(volatile uint32_t *)0x40043400)
+
+
+/**
+ * Lock-free ring buffer with a single producer and a single consumer.
+ *
+ * The head and tail are free-running byte counts; each is only ever written by one side,
+ * so the two cores never need to lock the ring.
+ */
+typedef struct {
+
+	// Total number of bytes ever written to the ring; only modified by the producer.
+	volatile uint32_t head;
+
+	// Total number of bytes ever read from the ring; only modified by the consumer.
+	volatile uint32_t tail;
+
+	// The size of the ring's storage, in bytes. Always a power of two.
+	uint32_t size;
+
+	// The storage backing the ring.
+	uint8_t *data;
+
+} m0_ring_t;
+
+
+/**
+ * Mailbox shared between the two cores.
+ *
+ * The M4 places the mailbox in the reserved space at the top of the M0's memory region before
+ * starting the M0; so a loadable can locate it using M0_MAILBOX_FOR_REGION().
+ */
+typedef struct {
+	volatile uint32_t magic;
+
+	// Commands sent from the host (via the M4) to the M0.
+	m0_ring_t commands;
+
+	// Data produced by the M0, to be shipped to the host by the M4.
+	m0_ring_t data;
+
+} m0_mailbox_t;
+
+_Static_assert(sizeof(m0_mailbox_t) <= M0_MAILBOX_RESERVED_SIZE, "the M0 mailbox has outgrown its reserved space");
+
+/**
+ * The highest initial stack pointer a loadable may use, for an M0 region with the given start address and size.
+ */
+#define M0_STACK_TOP_FOR_REGION(start, size) \
+	((uintptr_t)(start) + (size) - M0_MAILBOX_RESERVED_SIZE)
+
+/**
+ * Locates the mailbox for an M0 region with the given start address and size; which sits just above the M0's stack.
+ */
+#define M0_MAILBOX_FOR_REGION(start, size) \
+	((m0_mailbox_t *)M0_STACK_TOP_FOR_REGION(start, size))
+
+
+/**
+ * Ensures all memory accesses before the barrier are visible to the other core before any after it.
+ */
+static inline void m0_mailbox_memory_barrier(void)
+{
+	__asm__ volatile ("dmb" ::: "memory");
+}
+
+
+/**
+ * Wakes the other core, by raising our TXEV.
+ */
+static inline void m0_mailbox_signal_other_core(void)
+{
+	__asm__ volatile ("dsb\n\tsev" ::: "memory");
+}
+
+
+/**
+ * @return The number of bytes waiting to be read from the ring.
+ */
+static inline uint32_t m0_ring_bytes_used(m0_ring_t *ring)
+{
+	return ring->head - ring->tail;
+}
+
+
+/**
+ * @return The number of bytes that can currently be written to the ring.
+ */
+static inline uint32_t m0_ring_bytes_free(m0_ring_t *ring)
+{
+	return ring->size - m0_ring_bytes_used(ring);
+}
+
+
+/**
+ * Adds data to the ring. Must only be called by the ring's producer.
+ *
+ * @return The number of bytes actually written; which may be less than requested if the ring fills.
+ */
+static inline uint32_t m0_ring_write(m0_ring_t *ring, const void *data, uint32_t length)
+{
+	const uint8_t *source = data;
+	uint32_t head = ring->head;
+	uint32_t position = head & (ring->size - 1);
+	uint32_t until_wrap = ring->size - position;
+
+	if (length > m0_ring_bytes_free(ring)) {
+		length = m0_ring_bytes_free(ring);
+	}
+
+	// Copy in the data, wrapping around the end of the ring if necessary...
+	if (length <= until_wrap) {
+		memcpy(&ring->data[position], source, length);
+	} else {
+		memcpy(&ring->data[position], source, until_wrap);
+		memcpy(ring->data, &source[until_wrap], length - until_wrap);
+	}
+
+	// ... and only then publish it to the consumer.
+	m0_mailbox_memory_barrier();
+	ring->head = head + length;
+
+	return length;
+}
+
+
+/**
+ * Removes data from the ring. Must only be called by the ring's consumer.
+ *
+ * @return The number of bytes actually read; which may be less than requested if the ring empties.
+ */
+static inline uint32_t m0_ring_read(m0_ring_t *ring, void *data, uint32_t length)
+{
+	uint8_t *destination = data;
+	uint32_t tail = ring->tail;
+	uint32_t position = tail & (ring->size - 1);
+	uint32_t until_wrap = ring->size - position;
+
+	if (length > m0_ring_bytes_used(ring)) {
+		length = m0_ring_bytes_used(ring);
+	}
+
+	// Ensure we don't read the data before the producer's write to the head is visible...
+	m0_mailbox_memory_barrier();
+
+	if (length <= until_wrap) {
+		memcpy(destination, &ring->data[position], length);
+	} else {
+		memcpy(destination, &ring->data[position], until_wrap);
+		memcpy(&destination[until_wrap], ring->data, length - until_wrap);
+	}
+
+	// ... and that we've finished with the data before handing the space back.
+	m0_mailbox_memory_barrier();
+	ring->tail = tail + length;
+
+	return length;
+}
+
+
+#ifndef GREATFET_M0_LOADABLE
+
+/**
+ * Sets up the mailbox at the top of the M0's memory region. Should be called with the M0 halted.
+ *
+ * @param region The start of the M0's memory region.
+ * @param region_size The size of the M0's memory region, in bytes.
+ * @return The mailbox that's been set up.
+ */
+m0_mailbox_t *m0_mailbox_init(void *region, uint32_t region_size);
+
+/**
+ * @return The active mailbox; or NULL if none has been set up.
+ */
+m0_mailbox_t *m0_mailbox_get(void);
+
+/**
+ * Sends a command to the M0, and wakes it.
+ *
+ * Commands are delivered whole: if the command ring can't fit the full command, nothing is sent.
+ *
+ * @return 0 on success, or an error code on failure.
+ */
+int m0_mailbox_send_command(const void *command, uint32_t length);
+
+#endif
+
+#endif/*__M0_MAILBOX_H__*/
@@ -106,3 +106,125 @@ void one_wire_write(uint8_t byte)
     gpio_write(&dq, 1);
     gpio_input(&dq);
 }
+
+uint8_t one_wire_crc8(const uint8_t *data, uint32_t length)
+{
+    uint8_t crc = 0;
+
+    while (length--) {
+        uint8_t byte = *data++;
+
+        for (int i = 0; i < 8; i++) {
+            uint8_t mix = (crc ^ byte) & 0x01;
+            crc >>= 1;
+            if (mix) {
+                crc ^= 0x8C;
+            }
+            byte >>= 1;
+        }
+    }
+
+    return crc;
+}
+
+one_wire_search_result_t one_wire_search_next(one_wire_search_t *search)
+{
+    uint8_t last_zero = 0;
+
+    // A search that hasn't found anything yet hasn't made any choices.
+    bool first_step = !search->last_device_found && !search->last_discrepancy;
+
+    if (search->last_device_found) {
+        return ONE_WIRE_SEARCH_DONE;
+    }
+
+    // If no one answers the very first reset, the bus is empty; later on, someone's gone missing.
+    if (!one_wire_init_target()) {
+        return first_step ? ONE_WIRE_SEARCH_DONE : ONE_WIRE_SEARCH_FAILED;
+    }
+
+    one_wire_write(ONE_WIRE_COMMAND_SEARCH_ROM);
+
+    for (uint8_t bit_number = 1; bit_number <= 64; bit_number++) {
+        uint8_t byte_index = (bit_number - 1) / 8;
+        uint8_t mask = 1 << ((bit_number - 1) % 8);
+        uint8_t direction;
+
+        // Every device still participating sends its bit, and then its complement.
+        uint8_t id_bit = one_wire_read_bit();
+        uint8_t complement_bit = one_wire_read_bit();
+
+        // If nothing answered, the devices we were following went away mid-search. We haven't yet touched
+        // last_discrepancy, so this step can be retried from the top; the ROM bits we've already written
+        // are only ever replayed up to that point, and those are unchanged.
+        if (id_bit && complement_bit) {
+            gpio_write(&dq, 1);
+            gpio_input(&dq);
+            return ONE_WIRE_SEARCH_FAILED;
+        }
+
+        if (id_bit != complement_bit) {
+            // All remaining devices agree on this bit.
+            direction = id_bit;
+        } else {
+            // Devices disagree: repeat our previous choice before the last discrepancy, take the 1 branch at it,
+            // and the 0 branch past it.
+            if (bit_number < search->last_discrepancy) {
+                direction = (search->rom[byte_index] & mask) ? 1 : 0;
+            } else {
+                direction = (bit_number == search->last_discrepancy);
+            }
+
+            if (!direction) {
+                last_zero = bit_number;
+            }
+        }
+
+        if (direction) {
+            search->rom[byte_index] |= mask;
+        } else {
+            search->rom[byte_index] &= ~mask;
+        }
+
+        // Devices whose bit doesn't match drop out of this search.
+        one_wire_write_bit(direction);
+    }
+
+    // Reset state to idle
+    gpio_write(&dq, 1);
+    gpio_input(&dq);
+
+    // Only advance the search once we've got a good ROM code, so a corrupted one is retried, not skipped.
+    if (one_wire_crc8(search->rom, sizeof(search->rom)) != 0) {
+        return ONE_WIRE_SEARCH_FAILED;
+    }
+
+    search->last_discrepancy = last_zero;
+    search->last_device_found = (last_zero == 0);
+
+    return ONE_WIRE_SEARCH_FOUND;
+}
+
+bool one_wire_select(const uint8_t *rom)
+{
+    if (!one_wire_init_target()) {
+        return false;
+    }
+
+    one_wire_write(ONE_WIRE_COMMAND_MATCH_ROM);
+    for (int i = 0; i < 8; i++) {
+        one_wire_write(rom[i]);
+    }
+
+    return true;
+}
+
+void one_wire_strong_pullup(bool enable)
+{
+    if (enable) {
+        gpio_write(&dq, 1);
+        gpio_output(&dq);
+    } else {
+        gpio_input(&dq);
+    }
+}
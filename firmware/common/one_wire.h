@@ -5,8 +5,50 @@
 #ifndef __ONE_WIRE_H__
 #define __ONE_WIRE_H__
 
+#include <stdbool.h>
 #include <stdint.h>
 
+/**
+ * ROM and function commands common to 1-Wire devices.
+ */
+enum {
+	ONE_WIRE_COMMAND_SEARCH_ROM   = 0xF0,
+	ONE_WIRE_COMMAND_MATCH_ROM    = 0x55,
+	ONE_WIRE_COMMAND_SKIP_ROM     = 0xCC,
+};
+
+/**
+ * State for a ROM search; zero it to start a new search.
+ */
+typedef struct {
+
+	// The ROM code of the most recently found device; family code first, CRC last.
+	uint8_t rom[8];
+
+	// The bit position (1-64) at which the last search took the 0 branch of a conflict,
+	// or 0 if there were no conflicts left to explore.
+	uint8_t last_discrepancy;
+
+	// True once the last device on the bus has been found.
+	bool last_device_found;
+
+} one_wire_search_t;
+
+/**
+ * Outcomes of a single step of a ROM search.
+ */
+typedef enum {
+	// A device was found, and its ROM code placed in the search state.
+	ONE_WIRE_SEARCH_FOUND = 0,
+
+	// Every device has been found; or the bus was empty.
+	ONE_WIRE_SEARCH_DONE = 1,
+
+	// The step was disrupted -- no device answered partway through, or the ROM code failed its CRC.
+	// The search state is left as it was, so the same step can simply be retried.
+	ONE_WIRE_SEARCH_FAILED = 2,
+} one_wire_search_result_t;
+
 void one_wire_init(void);
 void one_wire_delay_us(uint32_t us);
 
@@ -16,4 +58,31 @@ uint8_t one_wire_read(void);
 
 void one_wire_write(uint8_t byte);
 
+uint8_t one_wire_read_bit(void);
+void one_wire_write_bit(uint8_t bit);
+
+/**
+ * Computes the Dallas/Maxim CRC8 of a block of data; which is zero for a block that ends in its own valid CRC.
+ */
+uint8_t one_wire_crc8(const uint8_t *data, uint32_t length);
+
+/**
+ * Finds the next device on the bus, using the Search ROM algorithm; one call per device.
+ */
+one_wire_search_result_t one_wire_search_next(one_wire_search_t *search);
+
+/**
+ * Resets the bus, and addresses a single device by its ROM code.
+ *
+ * @return True iff any device responded to the reset.
+ */
+bool one_wire_select(const uint8_t *rom);
+
+/**
+ * Drives the bus high (rather than leaving it to the pull-up), or releases it again. Parasite-powered
+ * devices need this strong pull-up for the whole of a conversion, applied right after the command that
+ * starts it; the weak pull-up can't supply them.
+ */
+void one_wire_strong_pullup(bool enable);
+
 #endif/* __ONE_WIRE_H__ */
@@ -0,0 +1,117 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Hardware timestamping of input edges, using the State Configurable Timer's capture registers.
+ */
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/lpc43xx/memorymap.h>
+#include <libopencm3/lpc43xx/ccu.h>
+#include <libopencm3/lpc43xx/rgu.h>
+
+#include "sct_timestamp.h"
+
+// SCT registers; we only use the handful we need for a unified counter with capture.
+#define SCT_CONFIG             MMIO32(SCT_BASE + 0x000)
+#define SCT_CTRL               MMIO32(SCT_BASE + 0x004)
+#define SCT_COUNT              MMIO32(SCT_BASE + 0x040)
+#define SCT_REGMODE            MMIO32(SCT_BASE + 0x04C)
+#define SCT_EVEN               MMIO32(SCT_BASE + 0x0F0)
+#define SCT_EVFLAG             MMIO32(SCT_BASE + 0x0F4)
+#define SCT_CAP(n)             MMIO32(SCT_BASE + 0x100 + ((n) * 4))
+#define SCT_CAPCTRL(n)         MMIO32(SCT_BASE + 0x200 + ((n) * 4))
+#define SCT_EV_STATE(n)        MMIO32(SCT_BASE + 0x300 + ((n) * 8))
+#define SCT_EV_CTRL(n)         MMIO32(SCT_BASE + 0x304 + ((n) * 8))
+
+enum {
+	SCT_CONFIG_UNIFY          = (1 << 0),
+
+	// Synchronize all eight inputs to the bus clock.
+	SCT_CONFIG_INSYNC_ALL     = (0xFF << 9),
+
+	SCT_CTRL_HALT_L           = (1 << 2),
+	SCT_CTRL_CLRCTR_L         = (1 << 3),
+
+	SCT_EV_CTRL_IOSEL_SHIFT   = 6,
+	SCT_EV_CTRL_IOCOND_SHIFT  = 10,
+	SCT_EV_CTRL_COMBMODE_IO   = (2 << 12),
+
+	// We never change the SCT's state; so our events only need to be enabled in state 0.
+	SCT_EV_STATE_0            = (1 << 0),
+
+	CCU_CLK_RUN               = (1 << 0),
+};
+
+
+/**
+ * Starts the SCT as a free-running 32-bit counter, and sets up our capture channels.
+ */
+void sct_timestamp_start(uint8_t start_input, sct_timestamp_edge_t start_edge,
+	uint8_t end_input, sct_timestamp_edge_t end_edge)
+{
+	const uint8_t inputs[SCT_TIMESTAMP_CHANNEL_COUNT] = { start_input, end_input };
+	const sct_timestamp_edge_t edges[SCT_TIMESTAMP_CHANNEL_COUNT] = { start_edge, end_edge };
+
+	CCU1_CLK_M4_SCT_CFG |= CCU_CLK_RUN;
+	RESET_CTRL1 = RESET_CTRL1_SCT_RST;
+
+	// Count the bus clock, as a single 32-bit counter; with no limit, it wraps naturally.
+	SCT_CONFIG = SCT_CONFIG_UNIFY | SCT_CONFIG_INSYNC_ALL;
+	SCT_CTRL   = SCT_CTRL_HALT_L | SCT_CTRL_CLRCTR_L;
+
+	// Use each channel's match/capture register as a capture register; loaded by an event that fires
+	// on its input edge. Channel n uses event n and capture register n.
+	for (unsigned channel = 0; channel < SCT_TIMESTAMP_CHANNEL_COUNT; ++channel) {
+		SCT_EV_STATE(channel) = SCT_EV_STATE_0;
+		SCT_EV_CTRL(channel)  = SCT_EV_CTRL_COMBMODE_IO |
+			((inputs[channel] & 0x7) << SCT_EV_CTRL_IOSEL_SHIFT) |
+			(edges[channel] << SCT_EV_CTRL_IOCOND_SHIFT);
+
+		SCT_CAPCTRL(channel) = (1 << channel);
+		SCT_REGMODE |= (1 << channel);
+	}
+
+	// We poll for captures rather than taking interrupts on them.
+	SCT_EVEN   = 0;
+	SCT_EVFLAG = (1 << SCT_TIMESTAMP_CHANNEL_COUNT) - 1;
+
+	SCT_CTRL &= ~SCT_CTRL_HALT_L;
+}
+
+
+/**
+ * Halts the SCT counter.
+ */
+void sct_timestamp_stop(void)
+{
+	SCT_CTRL |= SCT_CTRL_HALT_L;
+}
+
+
+/**
+ * @return The current value of the counter.
+ */
+uint32_t sct_timestamp_now(void)
+{
+	return SCT_COUNT;
+}
+
+
+/**
+ * Fetches the timestamp captured by a channel, if it's seen a new edge since the last call.
+ */
+bool sct_timestamp_take(sct_timestamp_channel_t channel, uint32_t *timestamp)
+{
+	uint32_t flag = (1 << channel);
+
+	if (!(SCT_EVFLAG & flag)) {
+		return false;
+	}
+
+	// Clear the flag before reading, so an edge that lands between the two is reported next time
+	// rather than lost.
+	SCT_EVFLAG = flag;
+	*timestamp = SCT_CAP(channel);
+
+	return true;
+}
@@ -0,0 +1,72 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Hardware timestamping of input edges, using the State Configurable Timer's capture registers.
+ */
+
+#ifndef __SCT_TIMESTAMP_H__
+#define __SCT_TIMESTAMP_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Our timestamps count cycles of the SCT's bus clock, which runs with the M4 core.
+ */
+#define SCT_TIMESTAMP_FREQUENCY (204000000)
+
+
+/**
+ * The edges on which a timestamp can be captured.
+ */
+typedef enum {
+	SCT_TIMESTAMP_RISING_EDGE  = 1,
+	SCT_TIMESTAMP_FALLING_EDGE = 2,
+} sct_timestamp_edge_t;
+
+
+/**
+ * The SCT channels we capture on; each captures the counter on a single input edge.
+ */
+typedef enum {
+	SCT_TIMESTAMP_CHANNEL_START = 0,
+	SCT_TIMESTAMP_CHANNEL_END   = 1,
+
+	SCT_TIMESTAMP_CHANNEL_COUNT
+} sct_timestamp_channel_t;
+
+
+/**
+ * Starts the SCT as a free-running 32-bit counter, and sets up each of our channels to capture
+ * the count on an edge of one of its CTIN inputs. The caller is responsible for routing each
+ * input to its pin.
+ *
+ * @param start_input, end_input The CTIN input (0-7) to watch for each channel.
+ * @param start_edge, end_edge The edge on which each channel should capture.
+ */
+void sct_timestamp_start(uint8_t start_input, sct_timestamp_edge_t start_edge,
+	uint8_t end_input, sct_timestamp_edge_t end_edge);
+
+
+/**
+ * Halts the SCT counter.
+ */
+void sct_timestamp_stop(void);
+
+
+/**
+ * @return The current value of the counter; which wraps every 2^32 ticks.
+ */
+uint32_t sct_timestamp_now(void);
+
+
+/**
+ * Fetches the timestamp captured by a channel, if it's seen a new edge since the last call.
+ * Captures aren't queued: if several edges arrive between calls, only the latest is reported.
+ *
+ * @param timestamp Receives the captured count.
+ * @return True iff a new timestamp was available.
+ */
+bool sct_timestamp_take(sct_timestamp_channel_t channel, uint32_t *timestamp);
+
+#endif
@@ -28,3 +28,12 @@ void spi_bus_transfer_gather(spi_target_t* target, const spi_transfer_t* const t
 void spi_bus_transfer_gather_partial(spi_target_t* target, const spi_transfer_t* const transfers, const size_t count) {
 	target->bus->transfer_gather_partial(target, transfers, count);
 }
+
+
+void spi_bus_transmit_data(spi_target_t* target, const void* const data, const size_t count) {
+	target->bus->transmit_data(target, data, count);
+}
+
+void spi_bus_receive_data(spi_target_t* target, void* const data, const size_t count, const uint16_t fill) {
+	target->bus->receive_data(target, data, count, fill);
+}
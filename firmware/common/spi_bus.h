@@ -6,6 +6,7 @@
 #define __SPI_BUS_H__
 
 #include <stddef.h>
+#include <stdint.h>
 #include "gpio.h"
 
 typedef struct {
@@ -35,6 +36,8 @@ struct spi_bus_t {
 	void (*transfer_data)(spi_target_t* target, void* const data, const size_t count);
 	void (*transfer_gather)(spi_target_t* target, const spi_transfer_t* const transfers, const size_t count);
 	void (*transfer_gather_partial)(spi_target_t* target, const spi_transfer_t* const transfers, const size_t count);
+	void (*transmit_data)(spi_target_t* target, const void* const data, const size_t count);
+	void (*receive_data)(spi_target_t* target, void* const data, const size_t count, const uint16_t fill);
 };
 
 void spi_bus_start(spi_target_t* target, const void* const config);
@@ -43,6 +46,8 @@ void spi_bus_transfer(spi_target_t* target, void* const data, const size_t count
 void spi_bus_transfer_gather(spi_target_t* target, const spi_transfer_t* const transfers, const size_t count);
 void spi_bus_transfer_data(spi_target_t* target, void* const data, const size_t count);
 void spi_bus_transfer_gather_partial(spi_target_t* target, const spi_transfer_t* const transfers, const size_t count);
+void spi_bus_transmit_data(spi_target_t* target, const void* const data, const size_t count);
+void spi_bus_receive_data(spi_target_t* target, void* const data, const size_t count, const uint16_t fill);
 
 
 #endif/*__SPI_BUS_H__*/
@@ -7,6 +7,9 @@
 #include <libopencm3/lpc43xx/rgu.h>
 #include <libopencm3/lpc43xx/ssp.h>
 
+/* Depth of the SSP transmit and receive FIFOs, in words. */
+#define SSP_FIFO_DEPTH 8
+
 void spi_ssp_start(spi_target_t* target, const void* const _config) {
 	spi_bus_t* const bus = target->bus;
 	const ssp_config_t* const config = _config;
@@ -115,3 +118,63 @@ void spi_ssp_transfer_data(spi_target_t* target, void* const data,
 	spi_ssp_transfer_gather_partial(target, transfers, 1);
 }
 
+
+/**
+ * Transmit-only variant of spi_ssp_transfer_data. Received data is discarded, which
+ * lets us keep the transmit FIFO full rather than waiting for each word to complete.
+ * Does not assert or de-assert chip select.
+ */
+void spi_ssp_transmit_data(spi_target_t* target, const void* const data,
+					  const size_t count) {
+
+	spi_bus_t* const bus = target->bus;
+	const bool word_size_u16 = (SSP_CR0(bus->obj) & 0xf) > SSP_DATA_8BITS;
+
+	for(size_t i=0; i<count; i++) {
+		spi_ssp_wait_for_tx_fifo_not_full(bus);
+		SSP_DR(bus->obj) = word_size_u16 ? ((const uint16_t *)data)[i] : ((const uint8_t *)data)[i];
+
+		// Discard any received data, so the receive FIFO never overruns.
+		while( SSP_SR(bus->obj) & SSP_SR_RNE ) {
+			(void)SSP_DR(bus->obj);
+		}
+	}
+
+	// Wait for the last of our data to leave the FIFO, and then drain anything it clocked in.
+	spi_ssp_wait_for_not_busy(bus);
+	while( SSP_SR(bus->obj) & SSP_SR_RNE ) {
+		(void)SSP_DR(bus->obj);
+	}
+}
+
+
+/**
+ * Receive-only variant of spi_ssp_transfer_data: clocks out a constant fill word, and captures
+ * the data received. Keeps up to a FIFO's worth of words in flight, rather than waiting for
+ * each word to complete. Does not assert or de-assert chip select.
+ */
+void spi_ssp_receive_data(spi_target_t* target, void* const data,
+					  const size_t count, const uint16_t fill) {
+
+	spi_bus_t* const bus = target->bus;
+	const bool word_size_u16 = (SSP_CR0(bus->obj) & 0xf) > SSP_DATA_8BITS;
+	size_t sent = 0, received = 0;
+
+	while( received < count ) {
+
+		// Top up the transmit FIFO; but never have more words in flight than the receive FIFO can hold.
+		while( (sent < count) && ((sent - received) < SSP_FIFO_DEPTH) && (SSP_SR(bus->obj) & SSP_SR_TNF) ) {
+			SSP_DR(bus->obj) = fill;
+			sent++;
+		}
+
+		while( (received < sent) && (SSP_SR(bus->obj) & SSP_SR_RNE) ) {
+			if( word_size_u16 ) {
+				((uint16_t *)data)[received++] = SSP_DR(bus->obj);
+			} else {
+				((uint8_t *)data)[received++] = SSP_DR(bus->obj);
+			}
+		}
+	}
+}
+
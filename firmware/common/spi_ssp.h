@@ -31,5 +31,9 @@ void spi_ssp_transfer_gather_partial(spi_target_t* target,
 	const spi_transfer_t* const transfers, const size_t count);
 void spi_ssp_transfer_data(spi_target_t* target, void* const data,
 					  const size_t count);
+void spi_ssp_transmit_data(spi_target_t* target, const void* const data,
+					  const size_t count);
+void spi_ssp_receive_data(spi_target_t* target, void* const data,
+					  const size_t count, const uint16_t fill);
 
 #endif/*__SPI_SSP_H__*/
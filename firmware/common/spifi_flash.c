@@ -0,0 +1,323 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Quad-I/O access to a serial NOR flash on the LPC43xx's SPIFI pins.
+ */
+
+#include <errno.h>
+
+#include <libopencm3/lpc43xx/rgu.h>
+#include <libopencm3/lpc43xx/scu.h>
+
+#include "spifi.h"
+#include "spifi_flash.h"
+
+enum {
+	SPIFI_FLASH_WRITE_ENABLE          = 0x06,
+	SPIFI_FLASH_VOLATILE_WRITE_ENABLE = 0x50,
+	SPIFI_FLASH_WRITE_STATUS          = 0x01,
+	SPIFI_FLASH_READ_STATUS1          = 0x05,
+	SPIFI_FLASH_READ_STATUS2          = 0x35,
+
+	SPIFI_FLASH_QUAD_OUTPUT_READ      = 0x6B,
+	SPIFI_FLASH_QUAD_PAGE_PROGRAM     = 0x32,
+	SPIFI_FLASH_SECTOR_ERASE          = 0x20,
+};
+
+enum {
+	SPIFI_FLASH_STATUS1_BUSY = 0x01,
+	SPIFI_FLASH_STATUS2_QE   = 0x02,
+};
+
+/**
+ * Layouts for the opcode and address fields of a SPIFI command.
+ */
+enum {
+	SPIFI_FRAME_OPCODE_ONLY      = 1,
+	SPIFI_FRAME_OPCODE_3B_ADDR   = 4,
+};
+
+/**
+ * Which fields of a SPIFI command are sent serially, and which over all four data lines.
+ */
+enum {
+	SPIFI_FIELDS_ALL_SERIAL      = 0,
+	SPIFI_FIELDS_DATA_QUAD       = 1,
+};
+
+enum {
+	// The most data a single SPIFI command can carry.
+	SPIFI_MAX_DATA_LENGTH = 0x3FFF,
+
+	// The largest flash we can address with 3-byte addresses.
+	SPIFI_FLASH_MAX_SIZE  = 16 * 1024 * 1024,
+
+	// Let the SPIFI's memory mode idle for as long as it likes; and give the flash its longest CS# high time.
+	SPIFI_CTRL_DEFAULTS   = SPIFI_CTRL_TIMEOUT(0xFFFF) | SPIFI_CTRL_CSHIGH(0xF) | SPIFI_CTRL_FBCLK,
+};
+
+
+/**
+ * Configures the SPIFI pins for use by the SPIFI peripheral.
+ */
+static void spifi_flash_set_up_pins(void)
+{
+	scu_pinmux(P3_3, (SCU_SSP_IO | SCU_CONF_FUNCTION3)); // SPIFI_SCK
+	scu_pinmux(P3_4, (SCU_SSP_IO | SCU_CONF_FUNCTION3)); // SPIFI_SIO3
+	scu_pinmux(P3_5, (SCU_SSP_IO | SCU_CONF_FUNCTION3)); // SPIFI_SIO2
+	scu_pinmux(P3_6, (SCU_SSP_IO | SCU_CONF_FUNCTION3)); // SPIFI_MISO / SIO1
+	scu_pinmux(P3_7, (SCU_SSP_IO | SCU_CONF_FUNCTION3)); // SPIFI_MOSI / SIO0
+	scu_pinmux(P3_8, (SCU_SSP_IO | SCU_CONF_FUNCTION3)); // SPIFI_CS
+}
+
+
+/**
+ * Leaves memory-mapped mode, if we're in it, so we can issue commands.
+ */
+static void spifi_flash_enter_command_mode(spifi_flash_t *flash)
+{
+	if (!flash->memory_mapped) {
+		return;
+	}
+
+	SPIFI_STAT = SPIFI_STAT_RESET;
+	while (SPIFI_STAT & SPIFI_STAT_RESET);
+
+	flash->memory_mapped = false;
+}
+
+
+/**
+ * Issues a single SPIFI command. The caller then reads or writes any data via SPIFI_DATA,
+ * and calls spifi_flash_wait_for_command.
+ */
+static void spifi_flash_command(uint8_t opcode, uint8_t frame_form, uint8_t field_form, uint32_t address,
+	uint8_t intermediate_bytes, bool data_out, uint32_t data_length)
+{
+	SPIFI_ADDR  = address;
+	SPIFI_IDATA = 0;
+	SPIFI_CMD   =
+		SPIFI_CMD_OPCODE(opcode) |
+		SPIFI_CMD_FRAMEFORM(frame_form) |
+		SPIFI_CMD_FIELDFORM(field_form) |
+		SPIFI_CMD_INTLEN(intermediate_bytes) |
+		(data_out ? SPIFI_CMD_DOUT : 0) |
+		SPIFI_CMD_DATALEN(data_length);
+}
+
+
+static void spifi_flash_wait_for_command(void)
+{
+	while (SPIFI_STAT & SPIFI_STAT_CMD);
+}
+
+
+/**
+ * Issues a command that has no address or data.
+ */
+static void spifi_flash_simple_command(uint8_t opcode)
+{
+	spifi_flash_command(opcode, SPIFI_FRAME_OPCODE_ONLY, SPIFI_FIELDS_ALL_SERIAL, 0, 0, false, 0);
+	spifi_flash_wait_for_command();
+}
+
+
+static uint8_t spifi_flash_read_register(uint8_t opcode)
+{
+	uint8_t value;
+
+	spifi_flash_command(opcode, SPIFI_FRAME_OPCODE_ONLY, SPIFI_FIELDS_ALL_SERIAL, 0, 0, false, 1);
+	value = SPIFI_DATA_BYTE;
+	spifi_flash_wait_for_command();
+
+	return value;
+}
+
+
+/**
+ * @return True iff the flash is still busy with an erase or program operation.
+ */
+bool spifi_flash_busy(spifi_flash_t *flash)
+{
+	spifi_flash_enter_command_mode(flash);
+	return spifi_flash_read_register(SPIFI_FLASH_READ_STATUS1) & SPIFI_FLASH_STATUS1_BUSY;
+}
+
+
+static void spifi_flash_wait_while_busy(spifi_flash_t *flash)
+{
+	while (spifi_flash_busy(flash));
+}
+
+
+/**
+ * Waits for any previous operation to finish, and then enables writes for the next one.
+ */
+static void spifi_flash_write_enable(spifi_flash_t *flash)
+{
+	spifi_flash_wait_while_busy(flash);
+	spifi_flash_simple_command(SPIFI_FLASH_WRITE_ENABLE);
+}
+
+
+/**
+ * Sets the flash's quad-enable bit, if it's not already set.
+ *
+ * The bit is only set in the flash's volatile copy of its status registers; so the flash's non-volatile
+ * configuration is never changed, and quad mode goes away again on the next power cycle.
+ */
+static int spifi_flash_enable_quad_mode(spifi_flash_t *flash)
+{
+	uint8_t status1, status2;
+
+	status2 = spifi_flash_read_register(SPIFI_FLASH_READ_STATUS2);
+	if (status2 & SPIFI_FLASH_STATUS2_QE) {
+		return 0;
+	}
+
+	status1 = spifi_flash_read_register(SPIFI_FLASH_READ_STATUS1);
+
+	// Target the volatile status registers, rather than the non-volatile ones a plain write enable would.
+	spifi_flash_wait_while_busy(flash);
+	spifi_flash_simple_command(SPIFI_FLASH_VOLATILE_WRITE_ENABLE);
+
+	// Write both status registers at once; which every part with a QE bit in SR2 accepts.
+	spifi_flash_command(SPIFI_FLASH_WRITE_STATUS, SPIFI_FRAME_OPCODE_ONLY, SPIFI_FIELDS_ALL_SERIAL, 0, 0, true, 2);
+	SPIFI_DATA_BYTE = status1;
+	SPIFI_DATA_BYTE = status2 | SPIFI_FLASH_STATUS2_QE;
+	spifi_flash_wait_for_command();
+
+	spifi_flash_wait_while_busy(flash);
+
+	status2 = spifi_flash_read_register(SPIFI_FLASH_READ_STATUS2);
+	return (status2 & SPIFI_FLASH_STATUS2_QE) ? 0 : EIO;
+}
+
+
+/**
+ * Takes over the SPIFI pins, resets the SPIFI, and enables quad mode on the attached flash.
+ */
+int spifi_flash_init(spifi_flash_t *flash)
+{
+	if (flash->num_bytes > SPIFI_FLASH_MAX_SIZE) {
+		return EINVAL;
+	}
+
+	RESET_CTRL1 = RESET_CTRL1_SPIFI_RST;
+	flash->memory_mapped = false;
+
+	spifi_flash_set_up_pins();
+	SPIFI_CTRL = SPIFI_CTRL_DEFAULTS;
+
+	return spifi_flash_enable_quad_mode(flash);
+}
+
+
+/**
+ * Leaves memory-mapped mode and resets the SPIFI.
+ */
+void spifi_flash_release(spifi_flash_t *flash)
+{
+	spifi_flash_enter_command_mode(flash);
+	RESET_CTRL1 = RESET_CTRL1_SPIFI_RST;
+}
+
+
+/**
+ * Reads from the flash using quad-output fast reads.
+ */
+void spifi_flash_read(spifi_flash_t *flash, uint32_t address, uint32_t length, uint8_t *data)
+{
+	spifi_flash_wait_while_busy(flash);
+
+	while (length) {
+		uint32_t chunk = (length > SPIFI_MAX_DATA_LENGTH) ? SPIFI_MAX_DATA_LENGTH : length;
+		uint32_t remaining = chunk;
+
+		// Quad output reads send their opcode and address serially, followed by a dummy byte.
+		spifi_flash_command(SPIFI_FLASH_QUAD_OUTPUT_READ, SPIFI_FRAME_OPCODE_3B_ADDR, SPIFI_FIELDS_DATA_QUAD, address, 1, false, chunk);
+
+		// Read whole words where we can; which is four times fewer bus accesses.
+		while (remaining >= sizeof(uint32_t)) {
+			uint32_t word = SPIFI_DATA;
+
+			data[0] = word;
+			data[1] = word >> 8;
+			data[2] = word >> 16;
+			data[3] = word >> 24;
+
+			data      += sizeof(uint32_t);
+			remaining -= sizeof(uint32_t);
+		}
+		while (remaining--) {
+			*data++ = SPIFI_DATA_BYTE;
+		}
+
+		spifi_flash_wait_for_command();
+
+		address += chunk;
+		length  -= chunk;
+	}
+}
+
+
+/**
+ * Starts programming a page (or partial page) using quad-input page programming.
+ */
+void spifi_flash_page_program(spifi_flash_t *flash, uint32_t address, uint32_t length, const uint8_t *data)
+{
+	// Do nothing if asked to write across a page boundary, or past the end of the flash.
+	if (((address % flash->page_len) + length) > flash->page_len) {
+		return;
+	}
+	if ((address + length) > flash->num_bytes) {
+		return;
+	}
+
+	spifi_flash_write_enable(flash);
+
+	spifi_flash_command(SPIFI_FLASH_QUAD_PAGE_PROGRAM, SPIFI_FRAME_OPCODE_3B_ADDR, SPIFI_FIELDS_DATA_QUAD, address, 0, true, length);
+	while (length--) {
+		SPIFI_DATA_BYTE = *data++;
+	}
+	spifi_flash_wait_for_command();
+}
+
+
+/**
+ * Starts erasing the 4KiB sector containing the given address.
+ */
+void spifi_flash_sector_erase(spifi_flash_t *flash, uint32_t address)
+{
+	if (address >= flash->num_bytes) {
+		return;
+	}
+
+	spifi_flash_write_enable(flash);
+
+	spifi_flash_command(SPIFI_FLASH_SECTOR_ERASE, SPIFI_FRAME_OPCODE_3B_ADDR, SPIFI_FIELDS_ALL_SERIAL, address, 0, false, 0);
+	spifi_flash_wait_for_command();
+}
+
+
+/**
+ * Switches the SPIFI into memory-mapped mode.
+ */
+const uint8_t *spifi_flash_memory_map(spifi_flash_t *flash)
+{
+	if (!flash->memory_mapped) {
+		spifi_flash_wait_while_busy(flash);
+
+		// Memory mode issues the same quad output read we use in command mode; the SPIFI handles addressing.
+		SPIFI_MCMD =
+			SPIFI_MCMD_OPCODE(SPIFI_FLASH_QUAD_OUTPUT_READ) |
+			SPIFI_MCMD_FRAMEFORM(SPIFI_FRAME_OPCODE_3B_ADDR) |
+			SPIFI_MCMD_FIELDFORM(SPIFI_FIELDS_DATA_QUAD) |
+			SPIFI_MCMD_INTLEN(1);
+		while (!(SPIFI_STAT & SPIFI_STAT_MCINIT));
+
+		flash->memory_mapped = true;
+	}
+
+	return (const uint8_t *)SPIFI_FLASH_MEMORY_BASE;
+}
@@ -0,0 +1,87 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Quad-I/O access to a serial NOR flash on the LPC43xx's SPIFI pins.
+ */
+
+#ifndef __SPIFI_FLASH_H__
+#define __SPIFI_FLASH_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * The SPIFI maps the attached flash into memory here; reads from this region are performed in hardware
+ * with quad-output reads. We use 3-byte addresses, so flashes of up to 16MiB are supported.
+ */
+#define SPIFI_FLASH_MEMORY_BASE   (0x14000000)
+
+
+/**
+ * Describes a flash attached to the SPIFI.
+ */
+typedef struct {
+
+	// The flash's size, and the size of its programming pages.
+	uint32_t num_bytes;
+	uint32_t page_len;
+
+	// True iff we've put the SPIFI into memory-mapped mode.
+	bool memory_mapped;
+
+} spifi_flash_t;
+
+
+/**
+ * Takes over the SPIFI pins, resets the SPIFI, and enables quad mode on the attached flash.
+ * Quad mode is enabled via the QE bit in status register 2, as used by Winbond and GigaDevice parts;
+ * only the volatile copy of the bit is set, so the flash's stored configuration is left untouched.
+ *
+ * The caller is responsible for making sure it owns the SPIFI pins -- including SIO2 and SIO3 (P3_5
+ * and P3_4), which double as user header pins on some boards.
+ *
+ * @return 0 on success; EINVAL if the flash is too large to address; or EIO if it couldn't be put into quad mode.
+ */
+int spifi_flash_init(spifi_flash_t *flash);
+
+
+/**
+ * Leaves memory-mapped mode and resets the SPIFI; so its pins can be reclaimed by e.g. an SSP driver.
+ */
+void spifi_flash_release(spifi_flash_t *flash);
+
+
+/**
+ * Reads from the flash using quad-output fast reads.
+ */
+void spifi_flash_read(spifi_flash_t *flash, uint32_t address, uint32_t length, uint8_t *data);
+
+
+/**
+ * Starts programming a page (or partial page) using quad-input page programming; the data must not
+ * cross a page boundary. Returns without waiting for the program to complete.
+ */
+void spifi_flash_page_program(spifi_flash_t *flash, uint32_t address, uint32_t length, const uint8_t *data);
+
+
+/**
+ * Starts erasing the 4KiB sector containing the given address. Returns without waiting for the erase to complete.
+ */
+void spifi_flash_sector_erase(spifi_flash_t *flash, uint32_t address);
+
+
+/**
+ * @return True iff the flash is still busy with an erase or program operation.
+ */
+bool spifi_flash_busy(spifi_flash_t *flash);
+
+
+/**
+ * Switches the SPIFI into memory-mapped mode; after which the flash can be read directly from memory.
+ * Any other spifi_flash operation leaves memory-mapped mode, invalidating the returned pointer.
+ *
+ * @return A pointer to the start of the flash's contents.
+ */
+const uint8_t *spifi_flash_memory_map(spifi_flash_t *flash);
+
+#endif
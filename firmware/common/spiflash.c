@@ -27,6 +27,9 @@ enum {
 	SPIFLASH_FAST_READ     = 0x0b,
 	SPIFLASH_WRITE_ENABLE  = 0x06,
 	SPIFLASH_CHIP_ERASE    = 0xC7,
+	SPIFLASH_SECTOR_ERASE  = 0x20,
+	SPIFLASH_BLOCK_ERASE_32K = 0x52,
+	SPIFLASH_BLOCK_ERASE_64K = 0xD8,
 	SPIFLASH_WRITE_STATUS  = 0x01,
 	SPIFLASH_READ_STATUS1  = 0x05,
 	SPIFLASH_READ_STATUS2  = 0x35,
@@ -153,8 +156,76 @@ void spiflash_chip_erase(spiflash_driver_t* const drv)
 	spi_bus_transfer(drv->target, data, ARRAY_SIZE(data));
 }
 
+/* start an erase with the given opcode at the given address; returns without waiting */
+static void spiflash_start_erase(spiflash_driver_t* const drv, uint8_t opcode, uint32_t addr)
+{
+	spiflash_write_enable(drv);
+	spiflash_wait_while_busy(drv);
+
+	uint8_t data[] = {
+		opcode,
+		(addr & 0xFF0000) >> 16,
+		(addr & 0xFF00) >> 8,
+		addr & 0xFF
+	};
+	spi_bus_transfer(drv->target, data, ARRAY_SIZE(data));
+}
+
+/* start erasing the 4 KiB sector containing the given address; returns without waiting */
+void spiflash_sector_erase(spiflash_driver_t* const drv, uint32_t addr)
+{
+	if (addr >= drv->num_bytes)
+		return;
+
+	spiflash_start_erase(drv, SPIFLASH_SECTOR_ERASE, addr);
+}
+
+/**
+ * Populates the driver's list of erase commands with the common 4K/32K/64K erase opcodes.
+ */
+void spiflash_use_default_erase_types(spiflash_driver_t* const drv)
+{
+	const spiflash_erase_type_t defaults[] = {
+		{ .size = 4 * 1024,  .opcode = SPIFLASH_SECTOR_ERASE },
+		{ .size = 32 * 1024, .opcode = SPIFLASH_BLOCK_ERASE_32K },
+		{ .size = 64 * 1024, .opcode = SPIFLASH_BLOCK_ERASE_64K },
+	};
+
+	memset(drv->erase_types, 0, sizeof(drv->erase_types));
+	memcpy(drv->erase_types, defaults, sizeof(defaults));
+}
+
+/**
+ * Starts erasing a block of flash using the erase command with the given size.
+ */
+int spiflash_erase_block(spiflash_driver_t* const drv, uint32_t addr, uint32_t size)
+{
+	for (unsigned i = 0; i < SPIFLASH_MAX_ERASE_TYPES; ++i) {
+		const spiflash_erase_type_t *type = &drv->erase_types[i];
+
+		if (!type->size || (type->size != size)) {
+			continue;
+		}
+
+		// Check the bounds without computing addr + size, which a host-supplied address could wrap.
+		if ((addr % size) || (size > drv->num_bytes) || (addr > drv->num_bytes - size)) {
+			return EINVAL;
+		}
+
+		spiflash_start_erase(drv, type->opcode, addr);
+		return 0;
+	}
+
+	return EINVAL;
+}
+
+bool spiflash_busy(spiflash_driver_t* const drv)
+{
+	return spiflash_get_status(drv) & SPIFLASH_STATUS_BUSY;
+}
+
 /* write up a 256 byte page or partial page */
-static void spiflash_page_program(spiflash_driver_t* const drv, const uint32_t addr, const uint16_t len, uint8_t* data)
+void spiflash_page_program(spiflash_driver_t* const drv, const uint32_t addr, const uint16_t len, uint8_t* data)
 {
 	/* do nothing if asked to write beyond a page boundary */
 	if (((addr & 0xFF) + len) > drv->page_len)
@@ -333,3 +404,48 @@ int spiflash_read_sfdp_info(spiflash_driver_t *const drv, spi_flash_sfdp_info_t
 			info, sizeof(*info));
 	return 0;
 }
+
+
+/**
+ * Populates the driver's list of erase commands from the flash's SFDP tables.
+ */
+int spiflash_read_erase_types(spiflash_driver_t* const drv)
+{
+	spi_flash_sfdp_info_t info;
+	int rc;
+
+	rc = spiflash_read_sfdp_info(drv, &info);
+	if (rc) {
+		spiflash_use_default_erase_types(drv);
+		return rc;
+	}
+
+	// Each sector type's size is given as a power of two; a size of zero marks an unused entry.
+	const uint8_t size_orders[SPIFLASH_MAX_ERASE_TYPES] = {
+		info.sector_type1_size, info.sector_type2_size, info.sector_type3_size, info.sector_type4_size
+	};
+	const uint8_t opcodes[SPIFLASH_MAX_ERASE_TYPES] = {
+		info.sector_type1_erase_opcode, info.sector_type2_erase_opcode,
+		info.sector_type3_erase_opcode, info.sector_type4_erase_opcode
+	};
+
+	bool found_erase_type = false;
+
+	memset(drv->erase_types, 0, sizeof(drv->erase_types));
+
+	for (unsigned i = 0; i < SPIFLASH_MAX_ERASE_TYPES; ++i) {
+		if (size_orders[i] && (size_orders[i] < 32)) {
+			drv->erase_types[i].size   = (1UL << size_orders[i]);
+			drv->erase_types[i].opcode = opcodes[i];
+			found_erase_type = true;
+		}
+	}
+
+	// If the table doesn't describe any erase commands, don't trust it.
+	if (!found_erase_type) {
+		spiflash_use_default_erase_types(drv);
+		return ENOTSUP;
+	}
+
+	return 0;
+}
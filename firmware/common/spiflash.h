@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include <toolchain.h>
 
 #include "spi_bus.h"
@@ -18,6 +19,20 @@ typedef union
 	uint8_t id_8b[8]; /* 8*8bits 64bits Unique ID */
 } spiflash_unique_id_t;
 
+/**
+ * The most distinct erase granularities a flash can advertise via SFDP.
+ */
+#define SPIFLASH_MAX_ERASE_TYPES (4)
+
+/**
+ * Describes one of the erase commands supported by a flash.
+ */
+typedef struct {
+	// The size of the region erased, in bytes; or 0 if this entry is unused.
+	uint32_t size;
+	uint8_t opcode;
+} spiflash_erase_type_t;
+
 struct spiflash_driver_t {
 	spi_target_t* target;
 	void (*target_init)(spi_target_t* const drv);
@@ -25,6 +40,9 @@ struct spiflash_driver_t {
 	size_t num_pages;
 	size_t num_bytes;
 	uint8_t device_id;
+
+	// The erase commands we can use on this flash; see spiflash_read_erase_types.
+	spiflash_erase_type_t erase_types[SPIFLASH_MAX_ERASE_TYPES];
 };
 
 
@@ -110,7 +128,7 @@ typedef struct ATTR_PACKED {
 		uint32_t sector_type3_size         : 8;
 		uint32_t sector_type3_erase_opcode : 8;
 		uint32_t sector_type4_size         : 8;
-		uint32_t sector_type5_erase_opcode : 8;
+		uint32_t sector_type4_erase_opcode : 8;
 	};
 
 	// 10th DWORD
@@ -162,6 +180,57 @@ void spiflash_get_unique_id(spiflash_driver_t* const drv, spiflash_unique_id_t*
 void spiflash_read(spiflash_driver_t* const drv, uint32_t addr, uint32_t len, uint8_t* const data);
 
 
+/**
+ * The size of the smallest erasable region of our flash.
+ */
+#define SPIFLASH_SECTOR_SIZE (4096)
+
+/**
+ * Starts erasing the sector that contains the given address. Returns without waiting
+ * for the erase to complete; use spiflash_busy to check for completion.
+ */
+void spiflash_sector_erase(spiflash_driver_t* const drv, uint32_t addr);
+
+
+/**
+ * Populates the driver's list of erase commands with the common 4K/32K/64K erase opcodes.
+ */
+void spiflash_use_default_erase_types(spiflash_driver_t* const drv);
+
+
+/**
+ * Populates the driver's list of erase commands from the flash's SFDP tables. If the flash doesn't
+ * support SFDP, falls back to the common 4K/32K/64K erase opcodes.
+ *
+ * @return 0 if the erase types were read from SFDP, or ENOTSUP if the defaults were used.
+ */
+int spiflash_read_erase_types(spiflash_driver_t* const drv);
+
+
+/**
+ * Starts erasing a block of flash using the erase command with the given size. Returns without
+ * waiting for the erase to complete; use spiflash_busy to check for completion.
+ *
+ * @param addr The address of the block to erase; must be aligned to its size.
+ * @param size The size of the block; must match one of the driver's erase types.
+ * @return 0 on success, or EINVAL if the block isn't one we can erase.
+ */
+int spiflash_erase_block(spiflash_driver_t* const drv, uint32_t addr, uint32_t size);
+
+
+/**
+ * Starts programming a page (or partial page); which must not cross a page boundary.
+ * Returns without waiting for the program to complete.
+ */
+void spiflash_page_program(spiflash_driver_t* const drv, const uint32_t addr, const uint16_t len, uint8_t* data);
+
+
+/**
+ * @return True iff the flash is still busy with an erase or program operation.
+ */
+bool spiflash_busy(spiflash_driver_t* const drv);
+
+
 /**
  * Reads the JEDEC-specified device ID from the target device.
  */
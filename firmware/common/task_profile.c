@@ -0,0 +1,227 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Cycle-accurate runtime profiling for scheduler tasks and selected interrupts.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include <drivers/arm_vectors.h>
+#include <libopencm3/lpc43xx/m4/nvic.h>
+
+#include "dwt.h"
+#include "task_profile.h"
+
+// Our cycle counter runs at the core clock.
+#define TASK_PROFILE_CYCLE_FREQUENCY (204000000)
+
+typedef void (*task_profile_isr_t)(void);
+
+/**
+ * An interrupt whose handler we time. Drivers install their handlers whenever they like; so we
+ * keep our trampoline in the vector table, and call through to whatever handler was last installed.
+ */
+typedef struct {
+	uint8_t irq;
+	task_profile_isr_t trampoline;
+	volatile task_profile_isr_t handler;
+	task_profile_t profile;
+} profiled_interrupt_t;
+
+static task_profile_t *first_profile;
+static task_profile_t *last_profile;
+
+// The total cycles spent in profiled interrupts; used to exclude interrupt time from whatever they preempt.
+static volatile uint32_t interrupt_cycles;
+
+// The time taken by each pass through the scheduler, including any tasks and interrupts we don't profile.
+static task_profile_t scheduler_pass_profile = { .name = "scheduler_pass" };
+static uint32_t last_pass_start;
+
+
+static void task_profile_register(task_profile_t *profile)
+{
+	profile->next = NULL;
+
+	if (last_profile) {
+		last_profile->next = profile;
+	} else {
+		first_profile = profile;
+	}
+
+	last_profile = profile;
+	profile->registered = true;
+}
+
+
+static void task_profile_record(task_profile_t *profile, uint32_t cycles)
+{
+	int bin = (31 - __builtin_clz(cycles | 1)) - TASK_PROFILE_HISTOGRAM_FIRST_BIN;
+
+	if (bin < 0) {
+		bin = 0;
+	}
+	if (bin >= TASK_PROFILE_HISTOGRAM_BINS) {
+		bin = TASK_PROFILE_HISTOGRAM_BINS - 1;
+	}
+
+	profile->calls++;
+	profile->total_cycles += cycles;
+	profile->histogram[bin]++;
+
+	if (cycles > profile->max_cycles) {
+		profile->max_cycles = cycles;
+	}
+}
+
+
+/**
+ * Runs a handler, and records the time it took -- less any time spent in profiled interrupts.
+ *
+ * @return The total cycles the handler took, including any interrupts.
+ */
+static uint32_t task_profile_time(task_profile_t *profile, task_profile_isr_t handler)
+{
+	uint32_t interrupt_cycles_before = interrupt_cycles;
+	uint32_t start = dwt_cycle_count();
+	uint32_t elapsed, interrupted;
+
+	handler();
+
+	elapsed     = dwt_cycle_count() - start;
+	interrupted = interrupt_cycles - interrupt_cycles_before;
+
+	task_profile_record(profile, elapsed - interrupted);
+	return elapsed - interrupted;
+}
+
+
+/**
+ * Runs a task, and records its execution time in the given profile.
+ */
+void task_profile_run(task_profile_t *profile, void (*task)(void))
+{
+	if (!profile->registered) {
+		dwt_cycle_counter_enable();
+		task_profile_register(profile);
+	}
+
+	task_profile_time(profile, task);
+}
+
+
+/**
+ * Generates the trampoline for a profiled interrupt, which times the interrupt's real handler.
+ */
+#define PROFILED_INTERRUPT_TRAMPOLINE(n) \
+	static void profiled_interrupt##n##_trampoline(void) \
+	{ \
+		profiled_interrupt_t *interrupt = &profiled_interrupts[n]; \
+		interrupt_cycles += task_profile_time(&interrupt->profile, interrupt->handler); \
+	}
+
+static void profiled_interrupt0_trampoline(void);
+static void profiled_interrupt1_trampoline(void);
+
+static profiled_interrupt_t profiled_interrupts[] = {
+	{ .irq = NVIC_USB0_IRQ,  .trampoline = profiled_interrupt0_trampoline, .profile = { .name = "usb0_isr" } },
+	{ .irq = NVIC_SGPIO_IRQ, .trampoline = profiled_interrupt1_trampoline, .profile = { .name = "sgpio_isr" } },
+};
+
+PROFILED_INTERRUPT_TRAMPOLINE(0)
+PROFILED_INTERRUPT_TRAMPOLINE(1)
+
+
+/**
+ * Ensures each of our profiled interrupts is routed through its trampoline; capturing any
+ * handler a driver has installed since we last checked.
+ */
+static void task_profile_hook_interrupts(void)
+{
+	for (size_t i = 0; i < sizeof(profiled_interrupts) / sizeof(*profiled_interrupts); ++i) {
+		profiled_interrupt_t *interrupt = &profiled_interrupts[i];
+		task_profile_isr_t installed = (task_profile_isr_t)vector_table.irqs[interrupt->irq];
+
+		if (installed == interrupt->trampoline) {
+			continue;
+		}
+
+		// Point our trampoline at the new handler before we route the interrupt through it.
+		interrupt->handler = installed;
+		vector_table.irqs[interrupt->irq] = interrupt->trampoline;
+
+		if (!interrupt->profile.registered) {
+			task_profile_register(&interrupt->profile);
+		}
+	}
+}
+
+
+/**
+ * Task that measures each pass through the scheduler, and keeps our interrupt hooks in place.
+ */
+static void service_task_profiler(void)
+{
+	uint32_t now = dwt_cycle_count();
+
+	if (!scheduler_pass_profile.registered) {
+		dwt_cycle_counter_enable();
+		task_profile_register(&scheduler_pass_profile);
+	} else {
+		task_profile_record(&scheduler_pass_profile, now - last_pass_start);
+	}
+
+	last_pass_start = now;
+	task_profile_hook_interrupts();
+}
+DEFINE_TASK(service_task_profiler);
+
+
+/**
+ * @return The first profile in the list of active profiles; or NULL if none have been used yet.
+ */
+task_profile_t *task_profile_first(void)
+{
+	return first_profile;
+}
+
+
+/**
+ * @return The profile with the given position in the list of active profiles; or NULL if there isn't one.
+ */
+task_profile_t *task_profile_get(uint32_t index)
+{
+	task_profile_t *profile = first_profile;
+
+	while (profile && index--) {
+		profile = profile->next;
+	}
+
+	return profile;
+}
+
+
+/**
+ * Clears the statistics for every active profile.
+ */
+void task_profile_reset(void)
+{
+	for (task_profile_t *profile = first_profile; profile; profile = profile->next) {
+		profile->calls        = 0;
+		profile->total_cycles = 0;
+		profile->max_cycles   = 0;
+		memset(profile->histogram, 0, sizeof(profile->histogram));
+	}
+
+	last_pass_start = dwt_cycle_count();
+}
+
+
+/**
+ * @return The frequency at which profile cycle counts increment, in Hz.
+ */
+uint32_t task_profile_cycle_frequency(void)
+{
+	return TASK_PROFILE_CYCLE_FREQUENCY;
+}
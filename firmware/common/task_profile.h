@@ -0,0 +1,87 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Cycle-accurate runtime profiling for scheduler tasks and selected interrupts.
+ */
+
+#ifndef __TASK_PROFILE_H__
+#define __TASK_PROFILE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <scheduler.h>
+
+/**
+ * Each profile keeps a histogram of execution times. Bin 0 counts runs shorter than
+ * 2^(TASK_PROFILE_HISTOGRAM_FIRST_BIN + 1) cycles; each later bin covers twice the range of the last,
+ * and the final bin counts everything longer.
+ */
+#define TASK_PROFILE_HISTOGRAM_BINS      (16)
+#define TASK_PROFILE_HISTOGRAM_FIRST_BIN (6)
+
+/**
+ * Runtime statistics for a single task or interrupt.
+ */
+typedef struct task_profile {
+
+	// The name reported to the host.
+	const char *name;
+
+	// The number of times the task has run, and the cycles it's spent running.
+	// Time spent in profiled interrupts is excluded.
+	uint32_t calls;
+	uint64_t total_cycles;
+	uint32_t max_cycles;
+	uint32_t histogram[TASK_PROFILE_HISTOGRAM_BINS];
+
+	// Profiles are added to a list the first time they're used.
+	bool registered;
+	struct task_profile *next;
+
+} task_profile_t;
+
+
+/**
+ * Defines a scheduler task, as DEFINE_TASK does; but records how long each run of the task takes.
+ */
+#define DEFINE_PROFILED_TASK(task) \
+	static task_profile_t task##_profile = { .name = #task }; \
+	static void task##_profiled(void) \
+	{ \
+		task_profile_run(&task##_profile, task); \
+	} \
+	DEFINE_TASK(task##_profiled)
+
+
+/**
+ * Runs a task, and records its execution time in the given profile.
+ */
+void task_profile_run(task_profile_t *profile, void (*task)(void));
+
+
+/**
+ * @return The first profile in the list of active profiles; or NULL if none have been used yet.
+ *		Subsequent profiles can be found by following each profile's next pointer.
+ */
+task_profile_t *task_profile_first(void);
+
+
+/**
+ * @return The profile with the given position in the list of active profiles; or NULL if there isn't one.
+ */
+task_profile_t *task_profile_get(uint32_t index);
+
+
+/**
+ * Clears the statistics for every active profile.
+ */
+void task_profile_reset(void);
+
+
+/**
+ * @return The frequency at which profile cycle counts increment, in Hz.
+ */
+uint32_t task_profile_cycle_frequency(void);
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Micro-benchmarks for firmware hot paths, built for the host against simulated hardware.
+ * Absolute numbers won't match the LPC43xx; but relative changes show up performance regressions.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define HAVE_CYCLE_COUNTER
+#endif
+
+#include "host_stubs.h"
+
+extern "C" {
+    #include <debug.h>
+    #include <cic_decimator.h>
+    #include <usb_streaming.h>
+    #include <usb_endpoint.h>
+}
+
+
+// Each benchmark is run for at least this long.
+static const double MINIMUM_RUN_SECONDS = 0.25;
+
+
+static inline uint64_t read_cycle_counter()
+{
+#ifdef HAVE_CYCLE_COUNTER
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+/**
+ * Runs a benchmark body repeatedly, and reports its throughput.
+ *
+ * @param name The name to report the benchmark as.
+ * @param bytes_per_iteration The number of bytes each run of the body processes.
+ * @param body The code to benchmark.
+ */
+template <typename Body>
+static void run_benchmark(const char *name, uint64_t bytes_per_iteration, Body body)
+{
+    using clock = std::chrono::steady_clock;
+
+    uint64_t iterations = 1;
+    double seconds;
+    uint64_t cycles;
+
+    // Warm up...
+    body();
+
+    // ... and then keep doubling our run length until it's long enough to time reliably.
+    while (true) {
+        clock::time_point start = clock::now();
+        uint64_t start_cycles = read_cycle_counter();
+
+        for (uint64_t i = 0; i < iterations; ++i) {
+            body();
+        }
+
+        cycles = read_cycle_counter() - start_cycles;
+        seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+        if (seconds >= MINIMUM_RUN_SECONDS) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    double total_bytes = (double)bytes_per_iteration * iterations;
+
+#ifdef HAVE_CYCLE_COUNTER
+    std::printf("%-40s %12.2f MB/s %10.3f cycles/byte\n", name, total_bytes / seconds / 1e6, cycles / total_bytes);
+#else
+    (void)cycles;
+    std::printf("%-40s %12.2f MB/s %10s cycles/byte\n", name, total_bytes / seconds / 1e6, "n/a");
+#endif
+}
+
+
+static void benchmark_debug_ring()
+{
+    char line[64];
+
+    std::memset(line, 'x', sizeof(line));
+    line[sizeof(line) - 1] = '\n';
+
+    // Once the ring fills, every write also has to reclaim a line; which is the steady state on a device.
+    debug_init();
+    run_benchmark("debug_ring_write (64-byte lines)", sizeof(line), [&]() {
+        debug_ring_write(line, sizeof(line));
+    });
+
+    run_benchmark("debug_ring_read (2 KiB, no clear)", 2048, [&]() {
+        static char buffer[2048];
+        debug_ring_read(buffer, sizeof(buffer), false);
+    });
+}
+
+
+static void benchmark_submit_ring()
+{
+    std::vector<uint8_t> samples(512, 0x55);
+
+    // Data submitted from periodic callbacks; each submission is read by the host straight away.
+    host_usb_reset();
+    usb_streaming_start_periodic_data_gathering(1000, NULL, NULL);
+
+    run_benchmark("usb_streaming_send_data (512 B)", samples.size(), [&]() {
+        usb_streaming_send_data(samples.data(), samples.size());
+        host_usb_complete_transfer(&usb0_endpoint_bulk_in, NULL, samples.size());
+    });
+
+    usb_streaming_stop_periodic_gathering();
+}
+
+
+static int generate_nothing(void *data, uint32_t *length, void *user_data)
+{
+    (void)data;
+    (void)length;
+    (void)user_data;
+    return 0;
+}
+
+
+static void benchmark_generator()
+{
+    // Measures the streaming machinery alone; the generator doesn't touch its buffers.
+    host_usb_reset();
+    usb_streaming_start_generating_for_host(0, generate_nothing, NULL);
+
+    run_benchmark("generated stream (16 KiB blocks)", USB_STREAMING_BUFFER_SIZE, [&]() {
+        task_usb_streaming();
+        task_usb_streaming();
+        host_usb_complete_transfer(&usb0_endpoint_bulk_in, NULL, USB_STREAMING_BUFFER_SIZE);
+    });
+
+    usb_streaming_stop_generating_for_host();
+}
+
+
+static void benchmark_sgpio_stream()
+{
+    // Stand-in for the SGPIO interrupt: moves one 32-byte slice of samples into the streaming
+    // buffer per interrupt, as the logic analyzer does.
+    static const uint32_t SLICE_SIZE = 32;
+    static volatile uint32_t position_in_buffer;
+    static volatile uint32_t data_in_buffer;
+    uint8_t slice[SLICE_SIZE];
+
+    std::memset(slice, 0xA5, sizeof(slice));
+
+    host_usb_reset();
+    position_in_buffer = 0;
+    data_in_buffer = 0;
+    usb_streaming_start_streaming_to_host(&position_in_buffer, &data_in_buffer);
+
+    run_benchmark("SGPIO stream to host (32-byte slices)", SLICE_SIZE, [&]() {
+        std::memcpy(&usb_bulk_buffer[position_in_buffer], slice, SLICE_SIZE);
+        position_in_buffer = (position_in_buffer + SLICE_SIZE) % (USB_STREAMING_NUM_BUFFERS * USB_STREAMING_BUFFER_SIZE);
+        data_in_buffer += SLICE_SIZE;
+
+        task_usb_streaming();
+
+        // The host reads each buffer as soon as it's sent.
+        host_usb_complete_transfer(&usb0_endpoint_bulk_in, NULL, USB_STREAMING_BUFFER_SIZE);
+    });
+
+    usb_streaming_stop_streaming_to_host();
+}
+
+
+static void benchmark_cic_decimator()
+{
+    std::vector<uint8_t> input(64 * 1024);
+    std::vector<int16_t> output(input.size() + 1);
+    cic_decimator_t decimator;
+
+    for (size_t i = 0; i < input.size(); ++i) {
+        input[i] = (i * 13) & 0xff;
+    }
+
+    cic_decimator_init(&decimator, 16, 8);
+    run_benchmark("cic_decimator_process (ratio 16)", input.size(), [&]() {
+        cic_decimator_process(&decimator, input.data(), input.size(), output.data());
+    });
+}
+
+
+int main(void)
+{
+    benchmark_debug_ring();
+    benchmark_submit_ring();
+    benchmark_generator();
+    benchmark_sgpio_stream();
+    benchmark_cic_decimator();
+
+    return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Host-side stand-ins for the hardware the firmware modules under test expect.
+ */
+
+#include <string.h>
+#include <stdbool.h>
+
+#include <drivers/reset.h>
+#include <drivers/timer.h>
+#include <drivers/usb/usb.h>
+
+#include <debug.h>
+#include <greatfet_core.h>
+#include <wakeable_task.h>
+
+#include "host_stubs.h"
+
+// Stand-ins for the firmware's USB endpoints and streaming buffer.
+usb_endpoint_t usb0_endpoint_bulk_in  = { .address = 0x81 };
+usb_endpoint_t usb0_endpoint_bulk_out = { .address = 0x02 };
+uint8_t usb_bulk_buffer[32768];
+
+// The debug ring's indices; see debug.c.
+extern unsigned int debug_read_index;
+extern unsigned int debug_write_index;
+
+
+typedef struct {
+	const usb_endpoint_t *endpoint;
+	uint8_t *data;
+	uint32_t length;
+	transfer_completion_cb completion_cb;
+	void *user_data;
+} host_usb_transfer_t;
+
+// Transfers scheduled on the simulated controller, oldest first.
+static host_usb_transfer_t pending[HOST_USB_MAX_PENDING_TRANSFERS];
+static uint32_t pending_count;
+
+
+void debug_init(void)
+{
+	debug_read_index = 0;
+	debug_write_index = 0;
+}
+
+
+void host_usb_reset(void)
+{
+	pending_count = 0;
+
+	usb0_endpoint_bulk_in.enabled  = true;
+	usb0_endpoint_bulk_in.stalled  = false;
+	usb0_endpoint_bulk_out.enabled = true;
+	usb0_endpoint_bulk_out.stalled = false;
+}
+
+
+uint32_t host_usb_pending_transfers(const usb_endpoint_t *endpoint)
+{
+	uint32_t count = 0;
+
+	for (uint32_t i = 0; i < pending_count; ++i) {
+		if (pending[i].endpoint == endpoint) {
+			++count;
+		}
+	}
+
+	return count;
+}
+
+
+int host_usb_complete_transfer(const usb_endpoint_t *endpoint, void *host_data, uint32_t length)
+{
+	host_usb_transfer_t transfer;
+	uint32_t i;
+
+	for (i = 0; i < pending_count; ++i) {
+		if (pending[i].endpoint == endpoint) {
+			break;
+		}
+	}
+	if (i == pending_count) {
+		return -1;
+	}
+
+	transfer = pending[i];
+	memmove(&pending[i], &pending[i + 1], (pending_count - i - 1) * sizeof(pending[0]));
+	--pending_count;
+
+	if (length > transfer.length) {
+		length = transfer.length;
+	}
+
+	if (endpoint->address & 0x80) {
+		if (host_data) {
+			memcpy(host_data, transfer.data, length);
+		}
+	} else {
+		memcpy(transfer.data, host_data, length);
+	}
+
+	if (transfer.completion_cb) {
+		transfer.completion_cb(transfer.user_data, length);
+	}
+
+	return length;
+}
+
+
+int usb_transfer_schedule(const usb_endpoint_t *const endpoint, void *const data, const uint32_t maximum_length,
+	const transfer_completion_cb completion_cb, void *const user_data)
+{
+	if (pending_count == HOST_USB_MAX_PENDING_TRANSFERS) {
+		return -1;
+	}
+
+	pending[pending_count++] = (host_usb_transfer_t){
+		.endpoint = endpoint, .data = data, .length = maximum_length,
+		.completion_cb = completion_cb, .user_data = user_data
+	};
+	return 0;
+}
+
+
+void usb_endpoint_init(const usb_endpoint_t *endpoint)
+{
+	((usb_endpoint_t *)endpoint)->enabled = true;
+}
+
+
+void usb_endpoint_stall(const usb_endpoint_t *endpoint)
+{
+	((usb_endpoint_t *)endpoint)->stalled = true;
+}
+
+
+void usb_endpoint_clear_stall(const usb_endpoint_t *endpoint)
+{
+	((usb_endpoint_t *)endpoint)->stalled = false;
+}
+
+
+void usb_endpoint_disable(const usb_endpoint_t *endpoint)
+{
+	uint32_t kept = 0;
+
+	// Disabling an endpoint cancels its transfers, without completing them.
+	for (uint32_t i = 0; i < pending_count; ++i) {
+		if (pending[i].endpoint != endpoint) {
+			pending[kept++] = pending[i];
+		}
+	}
+	pending_count = kept;
+
+	((usb_endpoint_t *)endpoint)->enabled = false;
+}
+
+
+// Tasks are run by calling them directly; so there's nothing to schedule.
+void task_wake(wakeable_task_t *task)
+{
+	(void)task;
+}
+
+
+void task_set_polling(wakeable_task_t *task, bool polling)
+{
+	(void)task;
+	(void)polling;
+}
+
+
+void task_wake_every(wakeable_task_t *task, uint32_t interval_ms)
+{
+	(void)task;
+	(void)interval_ms;
+}
+
+
+int acquire_timer(hw_timer_t *timer)
+{
+	(void)timer;
+	return 0;
+}
+
+
+void release_timer(hw_timer_t *timer)
+{
+	(void)timer;
+}
+
+
+void call_function_periodically(hw_timer_t *timer, uint32_t frequency, timer_callback_t callback, void *argument)
+{
+	(void)timer;
+	(void)frequency;
+	(void)callback;
+	(void)argument;
+}
+
+
+void cancel_periodic_function_calls(hw_timer_t *timer)
+{
+	(void)timer;
+}
+
+
+bool system_persistent_memory_likely_intact(void)
+{
+	return false;
+}
+
+
+const char *system_get_reset_reason_string(void)
+{
+	return "host test start";
+}
+
+
+void led_on(const led_t led)
+{
+	(void)led;
+}
+
+
+void led_off(const led_t led)
+{
+	(void)led;
+}
+
+
+void led_toggle(const led_t led)
+{
+	(void)led;
+}
@@ -0,0 +1,49 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Host-side stand-ins for the hardware the firmware modules under test expect; including a simulated
+ * USB controller that holds each scheduled transfer until the test (playing the part of the USB host)
+ * completes it.
+ */
+
+#ifndef __HOST_STUBS_H__
+#define __HOST_STUBS_H__
+
+#include <stdint.h>
+
+#include <drivers/usb/usb_type.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The most transfers the simulated controller will hold at once; further schedules fail.
+ */
+#define HOST_USB_MAX_PENDING_TRANSFERS (4)
+
+/**
+ * Drops every pending transfer, and re-enables all endpoints.
+ */
+void host_usb_reset(void);
+
+/**
+ * @return The number of transfers currently scheduled on the given endpoint.
+ */
+uint32_t host_usb_pending_transfers(const usb_endpoint_t *endpoint);
+
+/**
+ * Completes the oldest transfer scheduled on an endpoint, calling its completion callback.
+ *
+ * For IN endpoints, up to length bytes are copied out of the transfer into host_data; for OUT
+ * endpoints, up to length bytes are copied from host_data into the transfer.
+ *
+ * @return The number of bytes transferred, or -1 if no transfer was pending.
+ */
+int host_usb_complete_transfer(const usb_endpoint_t *endpoint, void *host_data, uint32_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
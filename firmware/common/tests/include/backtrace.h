@@ -0,0 +1,25 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Host stand-in for libgreat's backtrace.h; used by host tests.
+ */
+
+#ifndef __BACKTRACE_H__
+#define __BACKTRACE_H__
+
+#include <stdint.h>
+
+struct backtrace_frame {
+	uint32_t fp;
+	uint32_t sp;
+	uint32_t lr;
+	uint32_t pc;
+};
+
+typedef struct {
+	const char *name;
+	const void *function;
+	const void *address;
+} backtrace_t;
+
+#endif
@@ -0,0 +1,17 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Host stand-in for the firmware's build configuration; used by host tests.
+ */
+
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+#define CONFIG_ENABLE_LOGGING
+#define CONFIG_ENABLE_DEBUG_RING
+#define CONFIG_DEBUG_RING_SIZE (2048)
+
+// Keep log output from drowning out test results.
+#define CONFIG_ENABLE_QUIET_LOGGING
+
+#endif
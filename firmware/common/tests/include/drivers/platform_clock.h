@@ -0,0 +1,10 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Host stand-in for libgreat's platform_clock driver. The modules built for host tests include it, but use nothing from it.
+ */
+
+#ifndef __DRIVERS_PLATFORM_CLOCK_H__
+#define __DRIVERS_PLATFORM_CLOCK_H__
+
+#endif
@@ -0,0 +1,15 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Host stand-in for libgreat's reset driver; used by host tests.
+ */
+
+#ifndef __DRIVERS_RESET_H__
+#define __DRIVERS_RESET_H__
+
+#include <stdbool.h>
+
+bool system_persistent_memory_likely_intact(void);
+const char *system_get_reset_reason_string(void);
+
+#endif
@@ -0,0 +1,10 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Host stand-in for libgreat's sgpio driver. The modules built for host tests include it, but use nothing from it.
+ */
+
+#ifndef __DRIVERS_SGPIO_H__
+#define __DRIVERS_SGPIO_H__
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Host stand-in for libgreat's timer driver; used by host tests. Periodic calls are never made.
+ */
+
+#ifndef __DRIVERS_TIMER_H__
+#define __DRIVERS_TIMER_H__
+
+#include <stdint.h>
+
+typedef void (*timer_callback_t)(void *argument);
+
+typedef struct {
+	uint32_t number;
+} hw_timer_t;
+
+int acquire_timer(hw_timer_t *timer);
+void release_timer(hw_timer_t *timer);
+void call_function_periodically(hw_timer_t *timer, uint32_t frequency, timer_callback_t callback, void *argument);
+void cancel_periodic_function_calls(hw_timer_t *timer);
+
+#endif
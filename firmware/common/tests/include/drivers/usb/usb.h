@@ -0,0 +1,18 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Host stand-in for libgreat's USB stack; used by host tests. See host_stubs.h for the simulated controller.
+ */
+
+#ifndef __DRIVERS_USB_USB_H__
+#define __DRIVERS_USB_USB_H__
+
+#include <drivers/usb/usb_type.h>
+#include <drivers/usb/usb_queue.h>
+
+void usb_endpoint_init(const usb_endpoint_t *endpoint);
+void usb_endpoint_stall(const usb_endpoint_t *endpoint);
+void usb_endpoint_clear_stall(const usb_endpoint_t *endpoint);
+void usb_endpoint_disable(const usb_endpoint_t *endpoint);
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Host stand-in for libgreat's USB transfer queues; used by host tests. Transfers are held by a simulated
+ * controller until the test completes them; see host_stubs.h.
+ */
+
+#ifndef __DRIVERS_USB_USB_QUEUE_H__
+#define __DRIVERS_USB_USB_QUEUE_H__
+
+#include <stdint.h>
+#include <drivers/usb/usb_type.h>
+
+typedef void (*transfer_completion_cb)(void *user_data, unsigned int transferred);
+
+typedef struct _usb_queue_t {
+	const usb_endpoint_t *endpoint;
+} usb_queue_t;
+
+#define USB_DECLARE_QUEUE(endpoint_name) usb_queue_t endpoint_name##_queue
+
+int usb_transfer_schedule(const usb_endpoint_t *const endpoint, void *const data, const uint32_t maximum_length,
+	const transfer_completion_cb completion_cb, void *const user_data);
+
+#endif
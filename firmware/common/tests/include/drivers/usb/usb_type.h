@@ -0,0 +1,21 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Host stand-in for libgreat's USB types; used by host tests.
+ */
+
+#ifndef __DRIVERS_USB_USB_TYPE_H__
+#define __DRIVERS_USB_USB_TYPE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct usb_endpoint {
+	uint8_t address;
+
+	// Simulated endpoint state.
+	bool enabled;
+	bool stalled;
+} usb_endpoint_t;
+
+#endif
@@ -0,0 +1,12 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Host stand-in for the board pin definitions; used by host tests.
+ */
+
+#ifndef __PINS_H__
+#define __PINS_H__
+
+#include <greatfet_core.h>
+
+#endif
@@ -0,0 +1,12 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Host stand-in for libgreat's scheduler.h; used by host tests, which run tasks by calling them directly.
+ */
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#define DEFINE_TASK(function)
+
+#endif
@@ -0,0 +1,30 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Host stand-in for libgreat's toolchain.h; used when building firmware modules for host tests.
+ */
+
+#ifndef __TOOLCHAIN_H__
+#define __TOOLCHAIN_H__
+
+#define ATTR_PACKED       __attribute__((packed))
+#define ATTR_ALIGNED(x)   __attribute__((aligned(x)))
+#define ATTR_SECTION(x)
+#define ATTR_WEAK         __attribute__((weak))
+#define ATTR_PRINTF       __attribute__((format(printf, 1, 2)))
+#define ATTR_PRINTF_N(n)  __attribute__((format(printf, n, n + 1)))
+
+// There's no persistent memory on the host; and initializers are run explicitly by the tests.
+#define ATTR_PERSISTENT
+#define CALL_ON_PREINIT(function)
+#define CALL_ON_INIT(function)
+
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+#endif
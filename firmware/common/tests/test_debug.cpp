@@ -2,6 +2,8 @@
  * This file is part of GreatFET
  */
 
+#include <cstring>
+
 #include "catch.hpp"
 
 extern "C" {
@@ -0,0 +1,159 @@
+/*
+ * This file is part of GreatFET
+ */
+
+#include <vector>
+
+#include "catch.hpp"
+#include "host_stubs.h"
+
+extern "C" {
+    #include <usb_streaming.h>
+    #include <usb_endpoint.h>
+}
+
+
+// Generator used by our tests: produces an incrementing byte pattern.
+static int generate_pattern(void *data, uint32_t *length, void *user_data)
+{
+    uint8_t *buffer = (uint8_t *)data;
+    uint32_t *next_value = (uint32_t *)user_data;
+
+    for (uint32_t i = 0; i < *length; ++i) {
+        buffer[i] = (*next_value)++ & 0xff;
+    }
+
+    return 0;
+}
+
+
+// Consumer used by our tests: appends everything it's given to a vector.
+static int consume_into_vector(void *data, uint32_t length, void *user_data)
+{
+    std::vector<uint8_t> *received = (std::vector<uint8_t> *)user_data;
+    uint8_t *bytes = (uint8_t *)data;
+
+    received->insert(received->end(), bytes, bytes + length);
+    return 0;
+}
+
+
+SCENARIO("data is generated and streamed to the host", "[usb_streaming]") {
+
+    GIVEN("a bounded generated stream") {
+        host_usb_reset();
+
+        uint32_t next_value = 0;
+        const uint32_t total_length = 5 * USB_STREAMING_BUFFER_SIZE + 123;
+        usb_streaming_start_generating_for_host(total_length, generate_pattern, &next_value);
+
+        WHEN("the host reads everything") {
+            std::vector<uint8_t> received;
+            uint8_t block[USB_STREAMING_BUFFER_SIZE];
+
+            for (int pass = 0; (pass < 1000) && (usb_streaming_to_host_status(NULL) == EINPROGRESS); ++pass) {
+                task_usb_streaming();
+
+                int transferred = host_usb_complete_transfer(&usb0_endpoint_bulk_in, block, sizeof(block));
+                if (transferred > 0) {
+                    received.insert(received.end(), block, block + transferred);
+                }
+            }
+
+            THEN("the stream completes") {
+                uint32_t bytes_sent;
+                REQUIRE(usb_streaming_to_host_status(&bytes_sent) == 0);
+                REQUIRE(bytes_sent == total_length);
+            }
+
+            THEN("the data arrives intact and in order") {
+                REQUIRE(received.size() == total_length);
+                for (uint32_t i = 0; i < received.size(); ++i) {
+                    if (received[i] != (i & 0xff)) {
+                        FAIL("stream mismatch at index " << i);
+                    }
+                }
+            }
+        }
+
+        WHEN("the stream is stopped early") {
+            task_usb_streaming();
+            usb_streaming_stop_generating_for_host();
+
+            THEN("it's reported as cancelled") {
+                REQUIRE(usb_streaming_to_host_status(NULL) == ECANCELED);
+                REQUIRE(host_usb_pending_transfers(&usb0_endpoint_bulk_in) == 0);
+            }
+        }
+    }
+}
+
+
+SCENARIO("data is streamed from the host", "[usb_streaming]") {
+
+    GIVEN("a bounded stream from the host") {
+        host_usb_reset();
+
+        std::vector<uint8_t> received;
+        const uint32_t total_length = 3 * USB_STREAMING_BUFFER_SIZE + 17;
+        usb_streaming_start_streaming_from_host(total_length, consume_into_vector, &received);
+
+        WHEN("the host sends everything") {
+            std::vector<uint8_t> sent(total_length);
+            uint32_t position = 0;
+
+            for (uint32_t i = 0; i < total_length; ++i) {
+                sent[i] = (i * 7) & 0xff;
+            }
+
+            for (int pass = 0; (pass < 1000) && (usb_streaming_from_host_status(NULL) == EINPROGRESS); ++pass) {
+                task_usb_streaming();
+
+                int transferred = host_usb_complete_transfer(&usb0_endpoint_bulk_out, &sent[position], total_length - position);
+                if (transferred > 0) {
+                    position += transferred;
+                }
+            }
+
+            THEN("the consumer sees all of it, in order") {
+                REQUIRE(usb_streaming_from_host_status(NULL) == 0);
+                REQUIRE(received == sent);
+            }
+        }
+    }
+}
+
+
+SCENARIO("data is submitted to the streaming ring", "[usb_streaming]") {
+
+    GIVEN("a ring that's about to wrap") {
+        host_usb_reset();
+        usb_streaming_start_periodic_data_gathering(1000, NULL, NULL);
+
+        std::vector<uint8_t> filler(sizeof(usb_bulk_buffer) - 100, 0xAA);
+        usb_streaming_send_data(filler.data(), filler.size());
+        host_usb_complete_transfer(&usb0_endpoint_bulk_in, NULL, filler.size());
+
+        WHEN("a write wraps around the end of the ring") {
+            std::vector<uint8_t> sample(300);
+            std::vector<uint8_t> received(sample.size());
+
+            for (uint32_t i = 0; i < sample.size(); ++i) {
+                sample[i] = i & 0xff;
+            }
+            usb_streaming_send_data(sample.data(), sample.size());
+
+            THEN("the part up to the end of the ring is sent first, and the rest follows") {
+                int first = host_usb_complete_transfer(&usb0_endpoint_bulk_in, &received[0], received.size());
+                REQUIRE(first == 100);
+
+                // The remainder goes out with the next submission.
+                usb_streaming_send_data(sample.data(), 0);
+                int second = host_usb_complete_transfer(&usb0_endpoint_bulk_in, &received[first], received.size() - first);
+                REQUIRE(second == 200);
+
+                REQUIRE(received == sample);
+            }
+        }
+    }
+}
@@ -0,0 +1,258 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Event-driven tasks: tasks that sleep until they're woken by an interrupt or a timer,
+ * and that are run in priority order. If the build allows it, the core sleeps when no task has work to do.
+ */
+
+#include <stddef.h>
+
+#include <config.h>
+#include <debug.h>
+#include <drivers/arm_vectors.h>
+
+#include <libopencm3/cm3/systick.h>
+
+#include "wakeable_task.h"
+
+// Our tick is counted out from the core clock.
+#define WAKEABLE_TASK_CORE_CLOCK_FREQUENCY (204000000)
+
+// All registered tasks, from highest to lowest priority.
+static wakeable_task_t *first_task;
+
+// The number of scheduler passes so far; used to run each task at most once per pass.
+static uint32_t current_pass;
+
+// True iff SysTick is currently providing our tick.
+static volatile bool tick_running;
+
+static void wakeable_task_start_tick(void);
+
+
+static inline uint32_t wakeable_task_disable_interrupts(void)
+{
+	uint32_t primask;
+
+	__asm__ volatile ("mrs %0, primask\n\tcpsid i" : "=r" (primask) :: "memory");
+	return primask;
+}
+
+
+static inline void wakeable_task_restore_interrupts(uint32_t primask)
+{
+	__asm__ volatile ("msr primask, %0" :: "r" (primask) : "memory");
+}
+
+
+/**
+ * Adds a task to our list, in priority order. Must be called with interrupts disabled.
+ */
+static void wakeable_task_register(wakeable_task_t *task)
+{
+	wakeable_task_t **position = &first_task;
+
+	while (*position && ((*position)->priority >= task->priority)) {
+		position = &(*position)->next;
+	}
+
+	task->next = *position;
+	*position = task;
+	task->registered = true;
+}
+
+
+/**
+ * Requests that a task run on the next scheduler pass. Safe to call from interrupts.
+ */
+void task_wake(wakeable_task_t *task)
+{
+	if (!task->registered) {
+		uint32_t primask = wakeable_task_disable_interrupts();
+
+		if (!task->registered) {
+			wakeable_task_register(task);
+		}
+
+		wakeable_task_restore_interrupts(primask);
+	}
+
+	task->pending = true;
+}
+
+
+/**
+ * Sets whether a task should run on every scheduler pass.
+ */
+void task_set_polling(wakeable_task_t *task, bool polling)
+{
+	task->polling = polling;
+	task_wake(task);
+}
+
+
+/**
+ * Wakes a task periodically.
+ */
+void task_wake_every(wakeable_task_t *task, uint32_t interval_ms)
+{
+	task->ticks_since_wake = 0;
+	task->wake_interval = (interval_ms * WAKEABLE_TASK_TICK_FREQUENCY) / 1000;
+
+	if (interval_ms && !task->wake_interval) {
+		task->wake_interval = 1;
+	}
+
+	// Periodic wakeups are driven by our tick; so make sure it's running.
+	if (interval_ms) {
+		wakeable_task_start_tick();
+	}
+
+	task_wake(task);
+}
+
+
+/**
+ * Tick handler: wakes any tasks whose periods have elapsed. Merely being called also wakes the
+ * core, which gives our polled tasks a chance to run.
+ */
+static void wakeable_task_tick(void)
+{
+	bool periodic_tasks = false;
+
+	for (wakeable_task_t *task = first_task; task; task = task->next) {
+		if (!task->wake_interval) {
+			continue;
+		}
+
+		periodic_tasks = true;
+		if (++task->ticks_since_wake >= task->wake_interval) {
+			task->ticks_since_wake = 0;
+			task->pending = true;
+		}
+	}
+
+#ifndef CONFIG_ENABLE_IDLE_SLEEP
+	// If nothing needs waking any more, stop ticking until something does.
+	if (!periodic_tasks) {
+		systick_interrupt_disable();
+		systick_counter_disable();
+		tick_running = false;
+	}
+#else
+	(void)periodic_tasks;
+#endif
+}
+
+
+#ifdef CONFIG_ENABLE_IDLE_SLEEP
+/**
+ * @return True iff any task is waiting to run.
+ */
+static bool wakeable_task_work_pending(void)
+{
+	for (wakeable_task_t *task = first_task; task; task = task->next) {
+		if (task->pending || task->polling) {
+			return true;
+		}
+	}
+
+	return false;
+}
+#endif
+
+
+/**
+ * @return The highest-priority task that's waiting to run, and hasn't yet run this pass; or NULL if there isn't one.
+ */
+static wakeable_task_t *wakeable_task_next_runnable(void)
+{
+	for (wakeable_task_t *task = first_task; task; task = task->next) {
+		if ((task->pending || task->polling) && (task->last_pass != current_pass)) {
+			return task;
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Ensures our tick is running. The tick comes from SysTick, rather than from a libgreat timer, so we
+ * never hold one of the hardware timers that other drivers and classes rely on.
+ */
+static void wakeable_task_start_tick(void)
+{
+	uint32_t primask;
+
+	if (tick_running) {
+		return;
+	}
+
+	primask = wakeable_task_disable_interrupts();
+
+	vector_table.systick = wakeable_task_tick;
+
+	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB);
+	systick_set_reload((WAKEABLE_TASK_CORE_CLOCK_FREQUENCY / WAKEABLE_TASK_TICK_FREQUENCY) - 1);
+	systick_clear();
+	systick_interrupt_enable();
+	systick_counter_enable();
+
+	tick_running = true;
+	wakeable_task_restore_interrupts(primask);
+}
+
+
+/**
+ * Sleeps until the next interrupt, if no task has work to do.
+ *
+ * Ordinary (DEFINE_TASK) tasks are polled, and can't tell us whether they have work; so sleeping would
+ * hold them to our tick rate. We only sleep in builds that enable IDLE_SLEEP, which declares that the
+ * build's polled tasks only ever have work after an interrupt.
+ */
+static void wakeable_task_idle(void)
+{
+#ifdef CONFIG_ENABLE_IDLE_SLEEP
+	uint32_t primask;
+
+	// Our tick bounds how long we sleep; so make sure it's running.
+	wakeable_task_start_tick();
+
+	// Check for work with interrupts masked, so a wakeup can't slip in between our check and our sleep.
+	// A pending interrupt still wakes us from WFI; and it's serviced as soon as we unmask interrupts.
+	primask = wakeable_task_disable_interrupts();
+
+	if (!wakeable_task_work_pending()) {
+		__asm__ volatile ("dsb\n\twfi" ::: "memory");
+	}
+
+	wakeable_task_restore_interrupts(primask);
+#endif
+}
+
+
+/**
+ * Runs each task that's been woken, highest priority first. After each task, we look again from
+ * the top of the list, so a high-priority task woken mid-pass doesn't wait behind lower ones.
+ */
+static void service_wakeable_tasks(void)
+{
+	wakeable_task_t *task;
+	bool ran_task = false;
+
+	++current_pass;
+
+	while ((task = wakeable_task_next_runnable())) {
+		task->pending   = false;
+		task->last_pass = current_pass;
+
+		task_profile_run(&task->profile, task->task);
+		ran_task = true;
+	}
+
+	if (!ran_task) {
+		wakeable_task_idle();
+	}
+}
+DEFINE_TASK(service_wakeable_tasks);
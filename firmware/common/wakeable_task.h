@@ -0,0 +1,103 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Event-driven tasks: tasks that sleep until they're woken by an interrupt or a timer,
+ * and that are run in priority order. If the build allows it, the core sleeps when no task has work to do.
+ */
+
+#ifndef __WAKEABLE_TASK_H__
+#define __WAKEABLE_TASK_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "task_profile.h"
+
+/**
+ * The rate of our SysTick-driven tick; which sets the resolution of task_wake_every, and, in builds
+ * with IDLE_SLEEP, bounds how long any polled (DEFINE_TASK) task can go without running.
+ */
+#define WAKEABLE_TASK_TICK_FREQUENCY (1000)
+
+/**
+ * Task priorities. When several tasks are waiting to run, the highest priority runs first.
+ */
+typedef enum {
+	TASK_PRIORITY_LOW      = 0,
+	TASK_PRIORITY_NORMAL   = 1,
+	TASK_PRIORITY_HIGH     = 2,
+	TASK_PRIORITY_REALTIME = 3,
+} task_priority_t;
+
+
+/**
+ * A task that runs only when it's been woken, or while it's polling.
+ */
+typedef struct wakeable_task {
+
+	// The routine that performs the task's work.
+	void (*task)(void);
+	task_priority_t priority;
+
+	// True iff the task has been woken since it last ran.
+	volatile bool pending;
+
+	// True iff the task should run on every scheduler pass, e.g. because it's polling hardware.
+	volatile bool polling;
+
+	// If non-zero, the task is woken each time this many ticks have passed.
+	volatile uint32_t wake_interval;
+	uint32_t ticks_since_wake;
+
+	// The scheduler pass on which the task last ran; used to run each task at most once per pass.
+	uint32_t last_pass;
+
+	// Execution statistics; these share the name of the task.
+	task_profile_t profile;
+
+	// Tasks are added to a priority-ordered list the first time they're woken.
+	bool registered;
+	struct wakeable_task *next;
+
+} wakeable_task_t;
+
+
+/**
+ * Defines a wakeable task, with the given priority. Unlike DEFINE_TASK, the task
+ * isn't run until something calls task_wake, task_set_polling or task_wake_every.
+ */
+#define DEFINE_WAKEABLE_TASK(function, task_priority) \
+	wakeable_task_t function##_wakeable = { .task = function, .priority = task_priority, .profile = { .name = #function } }
+
+/**
+ * Declares a wakeable task; so it can be woken from code that precedes its definition, or from other files.
+ */
+#define DECLARE_WAKEABLE_TASK(function) extern wakeable_task_t function##_wakeable
+
+/**
+ * Finds the wakeable task object for a task function defined with DEFINE_WAKEABLE_TASK.
+ */
+#define WAKEABLE_TASK(function) (&function##_wakeable)
+
+
+/**
+ * Requests that a task run on the next scheduler pass. Safe to call from interrupts.
+ */
+void task_wake(wakeable_task_t *task);
+
+
+/**
+ * Sets whether a task should run on every scheduler pass; which also keeps the core from sleeping.
+ * Intended for tasks that need to poll, e.g. while a stream is active.
+ */
+void task_set_polling(wakeable_task_t *task, bool polling);
+
+
+/**
+ * Wakes a task periodically.
+ *
+ * @param interval_ms The period between wakeups, in milliseconds; or 0 to stop waking the task.
+ */
+void task_wake_every(wakeable_task_t *task, uint32_t interval_ms);
+
+#endif
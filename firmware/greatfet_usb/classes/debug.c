@@ -3,11 +3,14 @@
  */
 
 #include <stddef.h>
+#include <string.h>
 #include <greatfet_core.h>
 #include <debug.h>
 
 #include <drivers/comms.h>
 
+#include "../loadables.h"
+
 #define CLASS_NUMBER_DEBUG (0x10)
 
 
@@ -58,6 +61,139 @@ static int verb_poke(struct command_transaction *trans)
 	}
 
 	*address = value;
+	loadables_note_memory_write((uintptr_t)address, sizeof(value));
+	return 0;
+}
+
+
+/**
+ * @return True iff the given access width is one we support, and the address and length are aligned to it.
+ */
+static bool memory_access_valid(uint32_t address, uint32_t length, uint8_t width)
+{
+	if ((width != 1) && (width != 2) && (width != 4)) {
+		return false;
+	}
+
+	return !(address % width) && !(length % width);
+}
+
+
+static int verb_read_memory(struct command_transaction *trans)
+{
+	uint32_t address = comms_argument_parse_uint32_t(trans);
+	uint32_t length  = comms_argument_parse_uint32_t(trans);
+	uint8_t width    = comms_argument_parse_uint8_t(trans);
+	uint8_t *response;
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	if (!memory_access_valid(address, length, width)) {
+		return EINVAL;
+	}
+
+	response = comms_response_reserve_space(trans, length);
+	if (!response) {
+		return ENOMEM;
+	}
+
+	// Read using exactly the requested access width, as peripheral registers may care.
+	for (uint32_t offset = 0; offset < length; offset += width) {
+		switch (width) {
+			case 1: {
+				uint8_t value = *(volatile uint8_t *)(address + offset);
+				response[offset] = value;
+				break;
+			}
+			case 2: {
+				uint16_t value = *(volatile uint16_t *)(address + offset);
+				memcpy(&response[offset], &value, sizeof(value));
+				break;
+			}
+			case 4: {
+				uint32_t value = *(volatile uint32_t *)(address + offset);
+				memcpy(&response[offset], &value, sizeof(value));
+				break;
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+static int verb_write_memory(struct command_transaction *trans)
+{
+	uint32_t length;
+	uint32_t address = comms_argument_parse_uint32_t(trans);
+	uint8_t width    = comms_argument_parse_uint8_t(trans);
+	uint8_t *data    = comms_argument_read_buffer(trans, -1, &length);
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	if (!memory_access_valid(address, length, width)) {
+		return EINVAL;
+	}
+
+	// Write using exactly the requested access width, as peripheral registers may care.
+	for (uint32_t offset = 0; offset < length; offset += width) {
+		switch (width) {
+			case 1:
+				*(volatile uint8_t *)(address + offset) = data[offset];
+				break;
+			case 2: {
+				uint16_t value;
+				memcpy(&value, &data[offset], sizeof(value));
+				*(volatile uint16_t *)(address + offset) = value;
+				break;
+			}
+			case 4: {
+				uint32_t value;
+				memcpy(&value, &data[offset], sizeof(value));
+				*(volatile uint32_t *)(address + offset) = value;
+				break;
+			}
+		}
+	}
+
+	loadables_note_memory_write(address, length);
+	return 0;
+}
+
+
+static int verb_peek_multiple(struct command_transaction *trans)
+{
+	uint32_t length;
+	uint8_t *addresses = comms_argument_read_buffer(trans, -1, &length);
+	uint8_t *response;
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	// Addresses are packed as whole 32-bit words.
+	if (length % sizeof(uint32_t)) {
+		return EINVAL;
+	}
+
+	response = comms_response_reserve_space(trans, length);
+	if (!response) {
+		return ENOMEM;
+	}
+
+	// Read each of the requested words, in order.
+	for (uint32_t offset = 0; offset < length; offset += sizeof(uint32_t)) {
+		uint32_t address, value;
+
+		memcpy(&address, &addresses[offset], sizeof(address));
+		value = *(volatile uint32_t *)address;
+		memcpy(&response[offset], &value, sizeof(value));
+	}
+
 	return 0;
 }
 
@@ -87,6 +223,20 @@ struct comms_verb debug_verbs[] = {
 		.in_signature = "<II", .out_signature="", .in_param_names = "address, value", .out_param_names = "",
 		.doc = "Writes a raw LPC4330 memory address; for debug."
 	},
+	{ .name = "read_memory",  .handler = verb_read_memory,
+		.in_signature = "<IIB", .out_signature="<*X", .in_param_names = "address, length, access_width",
+		.out_param_names = "data",
+		.doc = "Reads a block of LPC4330 memory, using accesses of the given width (1, 2, or 4 bytes); for debug."
+	},
+	{ .name = "write_memory",  .handler = verb_write_memory,
+		.in_signature = "<IB*X", .out_signature="", .in_param_names = "address, access_width, data",
+		.out_param_names = "",
+		.doc = "Writes a block of LPC4330 memory, using accesses of the given width (1, 2, or 4 bytes); for debug."
+	},
+	{ .name = "peek_multiple",  .handler = verb_peek_multiple,
+		.in_signature = "<*I", .out_signature="<*I", .in_param_names = "addresses", .out_param_names = "values",
+		.doc = "Reads a raw LPC4330 memory address for each of the given addresses; for debug."
+	},
 	{} // Sentinel
 };
 COMMS_DEFINE_SIMPLE_CLASS(debug_api, CLASS_NUMBER_DEBUG, "debug", debug_verbs,
@@ -0,0 +1,451 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Timestamped edge capture: records each transition on a handful of GPIO pins, and streams
+ * the resulting events to the host. Far cheaper than full-rate sampling for sparse signals.
+ */
+
+#include <debug.h>
+
+#include <drivers/comms.h>
+#include <drivers/gpio.h>
+
+#include <stddef.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <toolchain.h>
+
+#include <dwt.h>
+#include <gpio_int.h>
+#include <gpio_lpc.h>
+
+#include "../pin_manager.h"
+#include "../usb_streaming.h"
+
+#define CLASS_NUMBER_SELF (0x118)
+
+enum {
+	// We can watch one pin per GPIO pin interrupt.
+	EDGE_CAPTURE_MAX_CHANNELS = GPIO_NUM_INTERRUPTS,
+
+	// The number of events we can hold before the host collects them. Must be a power of two.
+	EDGE_CAPTURE_RING_SIZE = 1024,
+
+	// Events are sent to the host in batches of at least this many; unless they've been
+	// waiting for longer than our flush interval, in which case we send what we have.
+	EDGE_CAPTURE_BATCH_SIZE = 64,
+	EDGE_CAPTURE_FLUSH_INTERVAL_US = 5000,
+
+	// If we've gone this many cycles without an event, we insert a heartbeat event; which ensures
+	// the host can always detect wraps of our 32-bit timestamps.
+	EDGE_CAPTURE_HEARTBEAT_CYCLES = 0x40000000,
+
+	// Timestamps come from the DWT cycle counter, which runs at the core clock.
+	EDGE_CAPTURE_TIMESTAMP_CLOCK = 204000000,
+
+	// Our pin interrupts preempt everything else, to keep their timestamps as tight as possible.
+	EDGE_CAPTURE_INTERRUPT_PRIORITY = 0,
+
+	// The size of a bulk packet; see edge_capture_generate_events.
+	EDGE_CAPTURE_MAX_PACKET_SIZE = 512,
+};
+
+/**
+ * Flags that annotate an edge event.
+ */
+enum {
+	// The event doesn't represent an edge; it only marks the passage of time.
+	EDGE_EVENT_HEARTBEAT = (1 << 0),
+
+	// Events were dropped immediately before this one, as the host wasn't keeping up.
+	EDGE_EVENT_AFTER_OVERFLOW = (1 << 1),
+};
+
+
+/**
+ * A single captured event, exactly as it's sent to the host.
+ */
+typedef struct ATTR_PACKED {
+
+	// The value of the cycle counter when the edge was seen.
+	uint32_t timestamp;
+
+	// The channel on which the edge occurred, and the level the channel changed to.
+	uint8_t channel;
+	uint8_t level;
+
+	// A set of EDGE_EVENT_* flags.
+	uint8_t flags;
+	uint8_t reserved;
+
+} edge_event_t;
+
+
+/**
+ * State for our edge capture engine.
+ */
+typedef struct {
+
+	// The pins we're watching, and the word registers used to read their levels.
+	uint8_t channel_count;
+	gpio_pin_t pins[EDGE_CAPTURE_MAX_CHANNELS];
+	volatile uint32_t *level_registers[EDGE_CAPTURE_MAX_CHANNELS];
+
+	// Free-running counts of events added to (by our ISRs) and removed from (by the main loop) our ring.
+	volatile uint32_t head;
+	volatile uint32_t tail;
+
+	// The timestamp of the most recent event; used to decide when we need a heartbeat.
+	volatile uint32_t last_timestamp;
+
+	// Set when we've had to drop an event, so the next recorded event can be flagged.
+	volatile bool overflow_pending;
+
+	// Statistics for the current capture.
+	volatile uint32_t events_captured;
+	volatile uint32_t events_dropped;
+
+	// The time, in microseconds, at which we last sent events to the host.
+	uint32_t last_flush_time;
+
+	bool configured;
+	bool running;
+
+} edge_capture_t;
+
+static edge_capture_t edge_capture;
+static edge_event_t event_ring[EDGE_CAPTURE_RING_SIZE];
+
+
+static inline void edge_capture_disable_interrupts(void)
+{
+	__asm__ volatile ("cpsid i" ::: "memory");
+}
+
+static inline void edge_capture_enable_interrupts(void)
+{
+	__asm__ volatile ("cpsie i" ::: "memory");
+}
+
+
+/**
+ * Adds an event to our ring, if there's room for it. Must be called from our ISRs, or with interrupts disabled.
+ */
+static inline void edge_capture_add_event(uint32_t timestamp, uint8_t channel, uint8_t level, uint8_t flags)
+{
+	uint32_t head = edge_capture.head;
+	edge_event_t *event;
+
+	if ((head - edge_capture.tail) >= EDGE_CAPTURE_RING_SIZE) {
+		edge_capture.events_dropped++;
+		edge_capture.overflow_pending = true;
+		return;
+	}
+
+	event = &event_ring[head & (EDGE_CAPTURE_RING_SIZE - 1)];
+	event->timestamp = timestamp;
+	event->channel   = channel;
+	event->level     = level;
+	event->flags     = flags | (edge_capture.overflow_pending ? EDGE_EVENT_AFTER_OVERFLOW : 0);
+
+	edge_capture.overflow_pending = false;
+	edge_capture.last_timestamp   = timestamp;
+	edge_capture.head             = head + 1;
+}
+
+
+/**
+ * Records an edge on the given channel. Called from our pin interrupts, as soon as they've been timestamped.
+ */
+static inline void edge_capture_record_edge(uint8_t channel, uint32_t timestamp)
+{
+	const uint32_t mask = (1 << channel);
+	bool rose = GPIO_PIN_INTERRUPT_RISE & mask;
+	bool fell = GPIO_PIN_INTERRUPT_FALL & mask;
+	uint8_t level;
+
+	// Acknowledge the edge; which re-arms the detector for the next one.
+	GPIO_PIN_INTERRUPT_IST = mask;
+
+	// If we saw only one kind of edge, it tells us the new level. If we saw both, the pin
+	// moved twice before we could service it; so the best we can do is read its current level.
+	if (rose != fell) {
+		level = rose;
+	} else {
+		level = (*edge_capture.level_registers[channel] != 0);
+	}
+
+	edge_capture.events_captured++;
+	edge_capture_add_event(timestamp, channel, level, 0);
+}
+
+
+/**
+ * Generates the interrupt handler for a single channel. Each handler grabs its timestamp
+ * before doing anything else, so our stamps are offset by only a fixed interrupt latency.
+ */
+#define EDGE_CAPTURE_ISR(n) \
+	static void edge_capture_channel##n##_isr(void) \
+	{ \
+		edge_capture_record_edge(n, dwt_cycle_count()); \
+	}
+
+EDGE_CAPTURE_ISR(0)
+EDGE_CAPTURE_ISR(1)
+EDGE_CAPTURE_ISR(2)
+EDGE_CAPTURE_ISR(3)
+EDGE_CAPTURE_ISR(4)
+EDGE_CAPTURE_ISR(5)
+EDGE_CAPTURE_ISR(6)
+EDGE_CAPTURE_ISR(7)
+
+static void (* const channel_isrs[EDGE_CAPTURE_MAX_CHANNELS])(void) = {
+	edge_capture_channel0_isr, edge_capture_channel1_isr, edge_capture_channel2_isr, edge_capture_channel3_isr,
+	edge_capture_channel4_isr, edge_capture_channel5_isr, edge_capture_channel6_isr, edge_capture_channel7_isr,
+};
+
+
+/**
+ * Inserts a heartbeat event if our channels have been quiet for a long time; so the host can
+ * unwrap our timestamps by assuming no two consecutive events are more than a wrap apart.
+ */
+static void edge_capture_add_heartbeat_if_needed(void)
+{
+	// Block our ISRs, so the heartbeat's timestamp is ordered correctly against real events.
+	edge_capture_disable_interrupts();
+
+	uint32_t now = dwt_cycle_count();
+	if ((now - edge_capture.last_timestamp) >= EDGE_CAPTURE_HEARTBEAT_CYCLES) {
+		edge_capture_add_event(now, 0, 0, EDGE_EVENT_HEARTBEAT);
+	}
+
+	edge_capture_enable_interrupts();
+}
+
+
+/**
+ * Moves batches of captured events into the USB streaming buffers.
+ */
+static int edge_capture_generate_events(void *data, uint32_t *length, void *user_data)
+{
+	edge_event_t *events = data;
+	uint32_t pending, count, position, until_wrap;
+	(void)user_data;
+
+	edge_capture_add_heartbeat_if_needed();
+
+	pending = edge_capture.head - edge_capture.tail;
+	if (!pending) {
+		return EAGAIN;
+	}
+
+	// Batch up events while they're arriving quickly; but don't leave sparse ones sitting around.
+	if ((pending < EDGE_CAPTURE_BATCH_SIZE) && (get_time_since(edge_capture.last_flush_time) < EDGE_CAPTURE_FLUSH_INTERVAL_US)) {
+		return EAGAIN;
+	}
+
+	count = *length / sizeof(edge_event_t);
+	if (count > pending) {
+		count = pending;
+	}
+
+	// A transfer that's a whole number of packets doesn't end with a short packet; so the host would
+	// keep waiting for more data. Hold one event back for the next batch to avoid that.
+	if (((count * sizeof(edge_event_t)) % EDGE_CAPTURE_MAX_PACKET_SIZE) == 0) {
+		count--;
+	}
+
+	// Copy out the events, wrapping around the end of the ring if necessary.
+	position   = edge_capture.tail & (EDGE_CAPTURE_RING_SIZE - 1);
+	until_wrap = EDGE_CAPTURE_RING_SIZE - position;
+
+	if (count <= until_wrap) {
+		memcpy(events, &event_ring[position], count * sizeof(edge_event_t));
+	} else {
+		memcpy(events, &event_ring[position], until_wrap * sizeof(edge_event_t));
+		memcpy(&events[until_wrap], event_ring, (count - until_wrap) * sizeof(edge_event_t));
+	}
+
+	edge_capture.tail += count;
+	edge_capture.last_flush_time = get_time();
+
+	*length = count * sizeof(edge_event_t);
+	return 0;
+}
+
+
+static void edge_capture_halt(void)
+{
+	for (uint8_t channel = 0; channel < edge_capture.channel_count; ++channel) {
+		gpio_interrupt_disable(channel);
+	}
+
+	edge_capture.running = false;
+}
+
+
+static int verb_configure(struct command_transaction *trans)
+{
+	uint8_t channel_count = 0;
+	gpio_pin_t pins[EDGE_CAPTURE_MAX_CHANNELS];
+	int rc;
+
+	if (edge_capture.running) {
+		return EBUSY;
+	}
+
+	while (comms_argument_data_remaining(trans)) {
+		if (channel_count == EDGE_CAPTURE_MAX_CHANNELS) {
+			pr_error("edge_capture: can only watch up to %d pins\n", EDGE_CAPTURE_MAX_CHANNELS);
+			return EINVAL;
+		}
+
+		pins[channel_count].port = comms_argument_parse_uint8_t(trans);
+		pins[channel_count].pin  = comms_argument_parse_uint8_t(trans);
+		++channel_count;
+	}
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	if (!channel_count) {
+		return EINVAL;
+	}
+
+	// Claim each of our pins, and set them up as inputs.
+	for (uint8_t channel = 0; channel < channel_count; ++channel) {
+		gpio_pin_t gpio_pin = pins[channel];
+
+		uint8_t scu_group = gpio_get_group_number(gpio_pin);
+		uint8_t scu_pin   = gpio_get_pin_number(gpio_pin);
+
+		if ((scu_group == 0xff) || (scu_pin == 0xff)) {
+			pr_error("edge_capture: GPIO%d[%d] isn't available on this board\n", gpio_pin.port, gpio_pin.pin);
+			return EINVAL;
+		}
+
+		if (!pin_ensure_reservation(scu_group, scu_pin, CLASS_NUMBER_SELF)) {
+			pr_warning("edge_capture: couldn't reserve busy pin GPIO%d[%d]!\n", gpio_pin.port, gpio_pin.pin);
+			return EBUSY;
+		}
+
+		rc = gpio_configure_pinmux(gpio_pin);
+		if (rc) {
+			return rc;
+		}
+
+		rc = gpio_set_pin_direction(gpio_pin, false);
+		if (rc) {
+			return rc;
+		}
+
+		// Route the pin to its own pin interrupt, but leave it disabled until we start.
+		gpio_interrupt_configure(channel, gpio_pin.port, gpio_pin.pin, EDGE_SENSITIVE_BOTH,
+			channel_isrs[channel], EDGE_CAPTURE_INTERRUPT_PRIORITY);
+
+		edge_capture.pins[channel]            = gpio_pin;
+		edge_capture.level_registers[channel] = GPIO_LPC_W(gpio_pin.port, gpio_pin.pin);
+	}
+
+	edge_capture.channel_count = channel_count;
+	edge_capture.configured    = true;
+
+	dwt_cycle_counter_enable();
+
+	comms_response_add_uint32_t(trans, EDGE_CAPTURE_TIMESTAMP_CLOCK);
+	return 0;
+}
+
+
+static int verb_start(struct command_transaction *trans)
+{
+	(void)trans;
+
+	if (!edge_capture.configured) {
+		pr_error("edge_capture: must be configured before capturing\n");
+		return EINVAL;
+	}
+
+	edge_capture_halt();
+
+	edge_capture.head             = 0;
+	edge_capture.tail             = 0;
+	edge_capture.overflow_pending = false;
+	edge_capture.events_captured  = 0;
+	edge_capture.events_dropped   = 0;
+	edge_capture.last_flush_time  = get_time();
+
+	// Mark the start of capture with a heartbeat, so the host has a reference for its timestamps.
+	edge_capture_add_event(dwt_cycle_count(), 0, 0, EDGE_EVENT_HEARTBEAT);
+
+	usb_streaming_start_generating_for_host(0, edge_capture_generate_events, NULL);
+
+	// Discard any edges seen before the capture started, and then start listening.
+	GPIO_PIN_INTERRUPT_IST = (1 << edge_capture.channel_count) - 1;
+	for (uint8_t channel = 0; channel < edge_capture.channel_count; ++channel) {
+		gpio_interrupt_enable(channel);
+	}
+
+	edge_capture.running = true;
+
+	comms_response_add_uint8_t(trans, USB_STREAMING_IN_ADDRESS);
+	return 0;
+}
+
+
+static int verb_stop(struct command_transaction *trans)
+{
+	(void)trans;
+
+	edge_capture_halt();
+	usb_streaming_stop_generating_for_host();
+
+	return 0;
+}
+
+
+static int verb_get_status(struct command_transaction *trans)
+{
+	int status = usb_streaming_to_host_status(NULL);
+
+	// If the stream failed, report the failure directly.
+	if (edge_capture.running && status && (status != EINPROGRESS)) {
+		return status;
+	}
+
+	comms_response_add_uint8_t(trans, edge_capture.running);
+	comms_response_add_uint32_t(trans, edge_capture.events_captured);
+	comms_response_add_uint32_t(trans, edge_capture.events_dropped);
+	return 0;
+}
+
+
+static struct comms_verb _verbs[] = {
+		{ .name = "configure", .handler = verb_configure,
+			.in_signature = "<*(BB)", .out_signature = "<I",
+			.in_param_names = "pins", .out_param_names = "timestamp_frequency",
+			.doc =
+				"Configures the GPIO pins whose edges should be captured, as a list of (port, pin) pairs.\n"
+				"\n"
+				"Up to eight pins can be watched; each is reported as the channel matching its position\n"
+				"in the list. Returns the frequency of the clock used to timestamp events." },
+		{ .name = "start", .handler = verb_start,
+			.in_signature = "", .out_signature = "<B",
+			.out_param_names = "pipe_id",
+			.doc =
+				"Starts capturing edges; events are streamed to the given bulk pipe until capture is stopped.\n"
+				"\n"
+				"Each event is eight bytes: a 32-bit timestamp, the channel, its new level, and a set of flags." },
+		{ .name = "stop", .handler = verb_stop,
+			.in_signature = "", .out_signature = "",
+			.doc = "Stops any active edge capture." },
+		{ .name = "get_status", .handler = verb_get_status,
+			.in_signature = "", .out_signature = "<?II",
+			.out_param_names = "running, events_captured, events_dropped",
+			.doc = "Reports whether a capture is running, and how many events it's seen and dropped." },
+		{} // Sentinel
+};
+COMMS_DEFINE_SIMPLE_CLASS(edge_capture, CLASS_NUMBER_SELF, "edge_capture", _verbs,
+		"Captures timestamped edges on up to eight GPIO pins.");
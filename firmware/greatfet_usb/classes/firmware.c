@@ -6,15 +6,30 @@
 #include <debug.h>
 
 #include <stddef.h>
+#include <string.h>
 #include <errno.h>
 
+#include <crc32.h>
 #include <greatfet_core.h>
 #include <spiflash.h>
 #include <spiflash_target.h>
+#include <spifi_flash.h>
 #include <gpio_lpc.h>
 #include <pins.h>
 
+#include "../pin_manager.h"
+#include "../usb_streaming.h"
+
 #define CLASS_NUMBER_FIRMWARE (0x1)
+#define CLASS_NUMBER_FIRMWARE_BULK (0x11A)
+
+enum {
+	// The most sector CRCs we'll return in a single response.
+	FIRMWARE_MAX_CRCS_PER_REQUEST = 64,
+
+	// The size of the chunks in which we read back sectors to checksum them.
+	FIRMWARE_CRC_CHUNK_SIZE       = 256,
+};
 
 /**
  * Configuration for the SPI bus we used to
@@ -40,6 +55,103 @@ static spiflash_driver_t spi_flash_drv = {
     .device_id   = ONBOARD_FLASH_DEVICE_ID
 };
 
+/**
+ * The same flash, accessed via the SPIFI; which lets us read it four bits at a time, and map it into memory.
+ * The SPIFI and SSP0 share the flash's pins; so only one can be in use at a time.
+ */
+static spifi_flash_t spifi_flash = {
+	.num_bytes = ONBOARD_FLASH_NUM_BYTES,
+	.page_len  = ONBOARD_FLASH_PAGE_LEN,
+};
+static bool onboard_flash_on_spifi;
+
+/**
+ * The SPIFI's extra data lines, SIO3 and SIO2. Unlike the flash's other pins, these double as user
+ * header pins; so we reserve them before we take them over.
+ */
+static const struct {
+	uint8_t group;
+	uint8_t pin;
+} spifi_shared_pins[] = { { 3, 4 }, { 3, 5 } };
+
+
+static void firmware_release_spifi_pins(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(spifi_shared_pins); ++i) {
+		if (pin_get_owning_class(spifi_shared_pins[i].group, spifi_shared_pins[i].pin) == CLASS_NUMBER_FIRMWARE) {
+			pin_release_reservation(spifi_shared_pins[i].group, spifi_shared_pins[i].pin);
+		}
+	}
+}
+
+
+/**
+ * Reserves the SPIFI's shared pins for our use.
+ *
+ * @return True iff we now own both pins; if another class owns either, we reserve neither.
+ */
+static bool firmware_reserve_spifi_pins(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(spifi_shared_pins); ++i) {
+		if (!pin_ensure_reservation(spifi_shared_pins[i].group, spifi_shared_pins[i].pin, CLASS_NUMBER_FIRMWARE)) {
+			firmware_release_spifi_pins();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/**
+ * Hands the onboard flash's pins to SSP0, for the single-bit spiflash driver.
+ */
+static void firmware_use_ssp(void)
+{
+	if (!onboard_flash_on_spifi) {
+		return;
+	}
+
+	spifi_flash_release(&spifi_flash);
+	firmware_release_spifi_pins();
+
+	spi_flash_drv.target_init(spi_flash_drv.target);
+	spi_bus_start(spi_flash_drv.target, &ssp_config_spi);
+
+	onboard_flash_on_spifi = false;
+}
+
+
+/**
+ * Hands the onboard flash's pins to the SPIFI, and maps the flash into memory.
+ *
+ * @return A pointer to the flash's contents; or NULL if the SPIFI's pins are in use by another class,
+ *		or the flash couldn't be put into quad mode.
+ */
+static const uint8_t *firmware_use_spifi(void)
+{
+	if (!onboard_flash_on_spifi) {
+
+		if (!firmware_reserve_spifi_pins()) {
+			pr_info("firmware: not using the SPIFI; its SIO2/SIO3 pins are owned by another class\n");
+			return NULL;
+		}
+
+		// Let any pending program or erase finish before we take the pins away from SSP0.
+		while (spiflash_busy(&spi_flash_drv));
+
+		if (spifi_flash_init(&spifi_flash)) {
+			onboard_flash_on_spifi = true;
+			firmware_use_ssp();
+			return NULL;
+		}
+
+		onboard_flash_on_spifi = true;
+	}
+
+	return spifi_flash_memory_map(&spifi_flash);
+}
+
 
 /**
  * Command to initialize use of the SPIFlash class / API and configure
@@ -48,6 +160,10 @@ static spiflash_driver_t spi_flash_drv = {
 int firmware_verb_initialize(struct command_transaction *trans)
 {
 	// Set up the flash to be written.
+    spifi_flash_release(&spifi_flash);
+    firmware_release_spifi_pins();
+    onboard_flash_on_spifi = false;
+
     spi_bus_start(spi_flash_drv.target, &ssp_config_spi);
     spiflash_setup(&spi_flash_drv);
 
@@ -63,6 +179,7 @@ int firmware_verb_initialize(struct command_transaction *trans)
 int firmware_verb_full_erase(struct command_transaction *trans)
 {
     (void)trans;
+    firmware_use_ssp();
     spiflash_chip_erase(&spi_flash_drv);
 	return 0;
 }
@@ -100,6 +217,7 @@ int firmware_verb_write_page(struct command_transaction *trans)
         return EINVAL;
     }
 
+    firmware_use_ssp();
     spiflash_program(&spi_flash_drv, address, length, data_to_write);
     return 0;
 }
@@ -131,7 +249,269 @@ int firmware_verb_read_page(struct command_transaction *trans)
         return EINVAL;
     }
 
+    firmware_use_ssp();
     spiflash_read(&spi_flash_drv, address, spi_flash_drv.page_len, target_buffer);
     return 0;
 }
 
+
+
+/**
+ * State for an in-progress bulk write.
+ */
+static struct {
+
+	// The next address to be programmed, and the address at which the write ends.
+	uint32_t address;
+	uint32_t end_address;
+
+	// True iff we've already erased the sector containing our next address.
+	bool sector_erased;
+
+	// How far we are into the host's current block.
+	uint32_t block_offset;
+
+} bulk_write;
+
+
+/**
+ * Command that computes the CRC32 of each of a range of flash sectors; allowing the host to skip
+ * sectors that already hold the data it would write.
+ */
+static int firmware_verb_get_sector_crcs(struct command_transaction *trans)
+{
+	uint8_t chunk[FIRMWARE_CRC_CHUNK_SIZE];
+
+	uint32_t address = comms_argument_parse_uint32_t(trans);
+	uint32_t count   = comms_argument_parse_uint32_t(trans);
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	if ((address % SPIFLASH_SECTOR_SIZE) || (count > FIRMWARE_MAX_CRCS_PER_REQUEST)) {
+		return EINVAL;
+	}
+	if ((address + (count * SPIFLASH_SECTOR_SIZE)) > spi_flash_drv.num_bytes) {
+		pr_warning("firmware: rejecting CRC request that extends past the end of flash!\n");
+		return EINVAL;
+	}
+
+	// If we can, read the flash through the SPIFI's memory mapping; which is much faster than reading over SSP.
+	const uint8_t *flash_contents = firmware_use_spifi();
+
+	for (uint32_t sector = 0; sector < count; ++sector) {
+		uint32_t crc = 0;
+
+		if (flash_contents) {
+			crc = crc32_update(crc, &flash_contents[address], SPIFLASH_SECTOR_SIZE);
+		} else {
+			for (uint32_t offset = 0; offset < SPIFLASH_SECTOR_SIZE; offset += sizeof(chunk)) {
+				spiflash_read(&spi_flash_drv, address + offset, sizeof(chunk), chunk);
+				crc = crc32_update(crc, chunk, sizeof(chunk));
+			}
+		}
+
+		comms_response_add_uint32_t(trans, crc);
+		address += SPIFLASH_SECTOR_SIZE;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Programs data streamed from the host. Each sector is erased as we reach it. Rather than waiting
+ * on the flash, we return EAGAIN while it's busy, so the next block can arrive over USB meanwhile.
+ */
+static int firmware_bulk_handle_data(void *data, uint32_t length, void *user_data)
+{
+	uint8_t *block = data;
+	(void)user_data;
+
+	while (bulk_write.block_offset < length) {
+		uint32_t to_program;
+
+		if (spiflash_busy(&spi_flash_drv)) {
+			return EAGAIN;
+		}
+
+		// Erase each sector the first time we write to it.
+		if (!bulk_write.sector_erased) {
+			spiflash_sector_erase(&spi_flash_drv, bulk_write.address);
+			bulk_write.sector_erased = true;
+			return EAGAIN;
+		}
+
+		// Program up to the end of the current page.
+		to_program = spi_flash_drv.page_len - (bulk_write.address % spi_flash_drv.page_len);
+		if (to_program > (length - bulk_write.block_offset)) {
+			to_program = length - bulk_write.block_offset;
+		}
+		if (to_program > (bulk_write.end_address - bulk_write.address)) {
+			return EMSGSIZE;
+		}
+
+		spiflash_page_program(&spi_flash_drv, bulk_write.address, to_program, &block[bulk_write.block_offset]);
+		bulk_write.address      += to_program;
+		bulk_write.block_offset += to_program;
+
+		if (!(bulk_write.address % SPIFLASH_SECTOR_SIZE)) {
+			bulk_write.sector_erased = false;
+		}
+	}
+
+	bulk_write.block_offset = 0;
+	return 0;
+}
+
+
+/**
+ * Command that starts erasing and programming a range of sectors with data streamed over bulk OUT.
+ */
+static int firmware_verb_start_bulk_write(struct command_transaction *trans)
+{
+	uint32_t address = comms_argument_parse_uint32_t(trans);
+	uint32_t length  = comms_argument_parse_uint32_t(trans);
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	// We erase as we go; so writes must start on a sector boundary.
+	if ((address % SPIFLASH_SECTOR_SIZE) || !length) {
+		return EINVAL;
+	}
+	if ((address + length) > spi_flash_drv.num_bytes) {
+		pr_warning("firmware: rejecting write that extends past the end of flash! (%d > %d)\n",
+				address + length, spi_flash_drv.num_bytes);
+		return EINVAL;
+	}
+
+	firmware_use_ssp();
+
+	bulk_write.address       = address;
+	bulk_write.end_address   = address + length;
+	bulk_write.sector_erased = false;
+	bulk_write.block_offset  = 0;
+
+	usb_streaming_start_streaming_from_host(length, firmware_bulk_handle_data, NULL);
+	comms_response_add_uint8_t(trans, USB_STREAMING_OUT_ADDRESS);
+	return 0;
+}
+
+
+/**
+ * State for an in-progress bulk read.
+ */
+static struct {
+	const uint8_t *source;
+	uint32_t remaining;
+} bulk_read;
+
+
+/**
+ * Copies the next block of a bulk read out of the memory-mapped flash.
+ */
+static int firmware_bulk_generate_data(void *data, uint32_t *length, void *user_data)
+{
+	(void)user_data;
+
+	if (*length > bulk_read.remaining) {
+		*length = bulk_read.remaining;
+	}
+
+	memcpy(data, bulk_read.source, *length);
+	bulk_read.source    += *length;
+	bulk_read.remaining -= *length;
+
+	return 0;
+}
+
+
+/**
+ * Command that starts streaming a range of flash to the host over bulk IN.
+ */
+static int firmware_verb_start_bulk_read(struct command_transaction *trans)
+{
+	const uint8_t *flash_contents;
+
+	uint32_t address = comms_argument_parse_uint32_t(trans);
+	uint32_t length  = comms_argument_parse_uint32_t(trans);
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	if (!length || (address + length) > spi_flash_drv.num_bytes) {
+		pr_warning("firmware: rejecting read that extends past the end of flash! (%d > %d)\n",
+				address + length, spi_flash_drv.num_bytes);
+		return EINVAL;
+	}
+
+	flash_contents = firmware_use_spifi();
+	if (!flash_contents) {
+		return EIO;
+	}
+
+	bulk_read.source    = &flash_contents[address];
+	bulk_read.remaining = length;
+
+	usb_streaming_start_generating_for_host(length, firmware_bulk_generate_data, NULL);
+	comms_response_add_uint8_t(trans, USB_STREAMING_IN_ADDRESS);
+	return 0;
+}
+
+
+/**
+ * Command that reports on the progress of a bulk write.
+ */
+static int firmware_verb_get_bulk_write_status(struct command_transaction *trans)
+{
+	uint32_t bytes_consumed;
+	int status = usb_streaming_from_host_status(&bytes_consumed);
+
+	// If the stream failed, report the failure directly.
+	if (status && (status != EINPROGRESS)) {
+		return status;
+	}
+
+	// We're done once we've consumed everything the host sent, and the flash has finished programming it.
+	bool complete = (status != EINPROGRESS) && !spiflash_busy(&spi_flash_drv);
+
+	comms_response_add_uint8_t(trans, complete);
+	comms_response_add_uint32_t(trans, bytes_consumed);
+	return 0;
+}
+
+
+static struct comms_verb _bulk_verbs[] = {
+		{ .name = "get_sector_crcs", .handler = firmware_verb_get_sector_crcs,
+			.in_signature = "<II", .out_signature = "<*I",
+			.in_param_names = "address, count", .out_param_names = "crcs",
+			.doc =
+				"Returns the CRC32 of each of a run of flash sectors, starting at a sector-aligned address.\n"
+				"\n"
+				"Up to 64 sectors can be checked per request. CRCs match zlib.crc32()." },
+		{ .name = "start_write", .handler = firmware_verb_start_bulk_write,
+			.in_signature = "<II", .out_signature = "<B",
+			.in_param_names = "address, length", .out_param_names = "pipe_id",
+			.doc =
+				"Erases and programs a sector-aligned range of flash with data streamed to the given bulk pipe.\n"
+				"\n"
+				"Each sector is erased as the write reaches it; so partial sectors are left erased past the end of the data." },
+		{ .name = "get_write_status", .handler = firmware_verb_get_bulk_write_status,
+			.in_signature = "", .out_signature = "<?I",
+			.out_param_names = "complete, bytes_written",
+			.doc = "Reports the progress of the active bulk write." },
+		{ .name = "start_read", .handler = firmware_verb_start_bulk_read,
+			.in_signature = "<II", .out_signature = "<B",
+			.in_param_names = "address, length", .out_param_names = "pipe_id",
+			.doc =
+				"Streams the given range of flash to the host on the given bulk pipe.\n"
+				"\n"
+				"The flash is read via the SPIFI, using quad-I/O reads." },
+		{} // Sentinel
+};
+COMMS_DEFINE_SIMPLE_CLASS(firmware_bulk, CLASS_NUMBER_FIRMWARE_BULK, "firmware_bulk", _bulk_verbs,
+		"API for quickly reprogramming the onboard flash; by streaming data, and skipping unchanged sectors.");
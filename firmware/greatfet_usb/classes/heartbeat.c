@@ -11,12 +11,36 @@
 #include <ctype.h>
 
 #include <pins.h>
+#include <wakeable_task.h>
 
 #define CLASS_NUMBER_HEARTBEAT (0x102)
 
+// The heartbeat period was historically a count of main loop iterations; which, with tasks now sleeping
+// until they have work, no longer tracks time. We keep the old units so existing host settings still
+// produce about the same blink rate.
+#define HEARTBEAT_PERIOD_UNITS_PER_MS (5000)
+
 static volatile bool heartbeat_mode_enabled = true;
 static volatile uint32_t heartbeat_period = 2500000;
 
+DECLARE_WAKEABLE_TASK(service_heartbeat);
+
+
+/**
+ * Schedules our next LED toggle, according to the current period.
+ */
+static void heartbeat_update_schedule(void)
+{
+	uint32_t interval_ms = heartbeat_mode_enabled ? (heartbeat_period / HEARTBEAT_PERIOD_UNITS_PER_MS) : 0;
+
+	// Keep the heartbeat running even for tiny periods.
+	if (heartbeat_mode_enabled && !interval_ms) {
+		interval_ms = 1;
+	}
+
+	task_wake_every(WAKEABLE_TASK(service_heartbeat), interval_ms);
+}
+
 
 /**
  * Prepares the system to use heartbeat mode.
@@ -25,6 +49,7 @@ void heartbeat_init(void)
 {
 	// FIXME: resevere the heartbeat LED for this class in the pin manager?
 	led_on(HEARTBEAT_LED);
+	heartbeat_update_schedule();
 }
 
 
@@ -34,6 +59,7 @@ static int heartbeat_verb_stop(struct command_transaction *trans)
 	(void)trans;
 
 	heartbeat_mode_enabled = false;
+	heartbeat_update_schedule();
 	return 0;
 }
 
@@ -43,6 +69,7 @@ static int heartbeat_verb_start(struct command_transaction *trans)
 	(void)trans;
 
 	heartbeat_mode_enabled = true;
+	heartbeat_update_schedule();
 	return 0;
 }
 
@@ -56,6 +83,7 @@ static int heartbeat_verb_set_period(struct command_transaction *trans)
 	}
 
 	heartbeat_period = new_period;
+	heartbeat_update_schedule();
 	return 0;
 }
 
@@ -82,31 +110,17 @@ COMMS_DEFINE_SIMPLE_CLASS(heartbeat, CLASS_NUMBER_HEARTBEAT, "heartbeat", heartb
 
 
 /**
- * Performs a single unit of heartbeat mode's work.
- * This should be called repeatedly from the main loop.
- *
- * Note that we use an iteration count, rather than e.g. our ms timer,
- * as this gives the LED's period the nice property of being proportional
- * to the amount of work being done e.g. in interrupts.
+ * Performs a single unit of heartbeat mode's work: toggling the LED.
+ * Woken once per heartbeat period.
  */
 void service_heartbeat(void)
 {
-	static uint32_t iteration_count = 0;
-
 	// If heartbeat mode is disabled, do nothing.
 	if (!heartbeat_mode_enabled) {
 		return;
 	}
 
-	// Count a heartbeat iteration.
-	iteration_count++;
-
-	// If we've exceeded our heartbeat period, flip the LED,
-	// and start over.
-	if (iteration_count > heartbeat_period) {
-		led_toggle(HEARTBEAT_LED);
-		iteration_count = 0;
-	}
+	led_toggle(HEARTBEAT_LED);
 }
 
-DEFINE_TASK(service_heartbeat);
+DEFINE_WAKEABLE_TASK(service_heartbeat, TASK_PRIORITY_LOW);
@@ -11,8 +11,8 @@
 void heartbeat_init(void);
 
 /**
- * Performs a single unit of heartbeat mode's work.
- * This should be called repeatedly from the main loop.
+ * Performs a single unit of heartbeat mode's work: toggling the LED.
+ * Woken once per heartbeat period.
  */
 void service_heartbeat(void);
 
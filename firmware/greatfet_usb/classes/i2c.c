@@ -6,7 +6,9 @@
 #include <errno.h>
 #include <string.h>
 #include <toolchain.h>
+#include <time.h>
 
+#include <crc32.h>
 #include <greatfet_core.h>
 
 #include <drivers/comms.h>
@@ -37,6 +39,46 @@ typedef struct {
 static i2c_stream_t stream;
 
 
+enum {
+	// Largest EEPROM page we support; and the most word-address bytes we'll prefix to it.
+	EEPROM_MAX_PAGE_SIZE     = 256,
+	EEPROM_MAX_ADDRESS_BYTES = 2,
+
+	// Longest we'll wait for an EEPROM to finish a write cycle. Datasheet maximums are typically 5-10ms.
+	EEPROM_WRITE_CYCLE_TIMEOUT_US = 50000,
+
+	// I2C status codes indicating that a slave acknowledged its address, for a write and for a read.
+	I2C_STATUS_SLAVE_WRITE_ACKED = 0x18,
+	I2C_STATUS_SLAVE_READ_ACKED  = 0x40,
+};
+
+
+/**
+ * State for programming an I2C EEPROM from data streamed over the bulk OUT endpoint.
+ */
+typedef struct {
+	uint8_t  address;
+	uint8_t  address_bytes;
+	uint16_t page_size;
+	bool     verify;
+
+	// The EEPROM address at which the next page will be written, and the data remaining to be written.
+	uint32_t word_address;
+	uint32_t bytes_remaining;
+	uint32_t bytes_programmed;
+
+	// CRC32 of the data programmed so far; computed from read-back data when verifying.
+	uint32_t checksum;
+
+	// Page currently being assembled, prefixed with space for its word address.
+	uint16_t page_fill;
+	uint8_t  page[EEPROM_MAX_ADDRESS_BYTES + EEPROM_MAX_PAGE_SIZE];
+	uint8_t  readback[EEPROM_MAX_PAGE_SIZE];
+} i2c_eeprom_programming_t;
+
+static i2c_eeprom_programming_t eeprom;
+
+
 static int i2c_verb_start(struct command_transaction *trans)
 {
 	uint16_t duty_cycle_count;
@@ -240,6 +282,183 @@ static int i2c_verb_stop_periodic_read(struct command_transaction *trans)
 
 
 
+/**
+ * Waits for an EEPROM to finish its internal write cycle, using ACK polling: the EEPROM won't
+ * acknowledge its address until the write cycle is complete.
+ */
+static int eeprom_wait_for_write_cycle(uint8_t address)
+{
+	uint32_t time_base = get_time();
+
+	while (i2c_bus_write(&i2c0, address, NULL, 0) != I2C_STATUS_SLAVE_WRITE_ACKED) {
+		if (get_time_since(time_base) > EEPROM_WRITE_CYCLE_TIMEOUT_US) {
+			pr_error("error: i2c: EEPROM at %02x did not complete its write cycle!\n", address);
+			return ETIMEDOUT;
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ * Writes the currently assembled page to the EEPROM, waits for it to be committed,
+ * and optionally reads it back for verification.
+ */
+static int eeprom_program_page(void)
+{
+	int rc;
+	uint8_t status;
+	uint8_t *address_prefix = &eeprom.page[EEPROM_MAX_ADDRESS_BYTES - eeprom.address_bytes];
+	uint8_t *page_data      = &eeprom.page[EEPROM_MAX_ADDRESS_BYTES];
+
+	// Place the word address immediately before the page data, MSB first.
+	for (unsigned i = 0; i < eeprom.address_bytes; ++i) {
+		address_prefix[i] = eeprom.word_address >> (8 * (eeprom.address_bytes - i - 1));
+	}
+
+	status = i2c_bus_write(&i2c0, eeprom.address, address_prefix, eeprom.address_bytes + eeprom.page_fill);
+	if (status != I2C_STATUS_SLAVE_WRITE_ACKED) {
+		pr_error("error: i2c: EEPROM at %02x did not acknowledge a page write (%02x)!\n", eeprom.address, status);
+		return EIO;
+	}
+
+	rc = eeprom_wait_for_write_cycle(eeprom.address);
+	if (rc) {
+		return rc;
+	}
+
+	if (eeprom.verify) {
+
+		// If either half of the read-back fails, the buffer holds garbage; don't compare it.
+		status = i2c_bus_write(&i2c0, eeprom.address, address_prefix, eeprom.address_bytes);
+		if (status != I2C_STATUS_SLAVE_WRITE_ACKED) {
+			pr_error("error: i2c: EEPROM at %02x did not acknowledge a verify address (%02x)!\n", eeprom.address, status);
+			return EIO;
+		}
+
+		status = i2c_bus_read(&i2c0, eeprom.address, eeprom.readback, eeprom.page_fill);
+		if (status != I2C_STATUS_SLAVE_READ_ACKED) {
+			pr_error("error: i2c: EEPROM at %02x did not acknowledge a verify read (%02x)!\n", eeprom.address, status);
+			return EIO;
+		}
+
+		if (memcmp(eeprom.readback, page_data, eeprom.page_fill)) {
+			pr_error("error: i2c: EEPROM verification failed for page at %04x!\n", eeprom.word_address);
+			return EIO;
+		}
+
+		eeprom.checksum = crc32_update(eeprom.checksum, eeprom.readback, eeprom.page_fill);
+	} else {
+		eeprom.checksum = crc32_update(eeprom.checksum, page_data, eeprom.page_fill);
+	}
+
+	eeprom.word_address     += eeprom.page_fill;
+	eeprom.bytes_programmed += eeprom.page_fill;
+	eeprom.page_fill = 0;
+
+	return 0;
+}
+
+
+/**
+ * Consumes EEPROM data streamed from the host, programming each page as soon as it's complete.
+ */
+static int eeprom_handle_data_from_host(void *data, uint32_t length, void *user_data)
+{
+	int rc;
+	uint8_t *position = data;
+	(void)user_data;
+
+	while (length) {
+
+		// Fill the page up to the next page boundary, so we never wrap around within a page.
+		uint32_t page_space = eeprom.page_size - ((eeprom.word_address + eeprom.page_fill) % eeprom.page_size);
+		uint32_t to_copy    = (length < page_space) ? length : page_space;
+
+		memcpy(&eeprom.page[EEPROM_MAX_ADDRESS_BYTES + eeprom.page_fill], position, to_copy);
+		eeprom.page_fill       += to_copy;
+		eeprom.bytes_remaining -= to_copy;
+		position += to_copy;
+		length   -= to_copy;
+
+		// Once we have a full page (or the last of our data), program it.
+		if ((to_copy == page_space) || !eeprom.bytes_remaining) {
+			rc = eeprom_program_page();
+			if (rc) {
+				return rc;
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+static int i2c_verb_eeprom_program(struct command_transaction *trans)
+{
+	uint8_t  address       = comms_argument_parse_uint8_t(trans);
+	uint8_t  address_bytes = comms_argument_parse_uint8_t(trans);
+	uint16_t page_size     = comms_argument_parse_uint16_t(trans);
+	uint32_t word_address  = comms_argument_parse_uint32_t(trans);
+	uint32_t length        = comms_argument_parse_uint32_t(trans);
+	bool     verify        = comms_argument_parse_bool(trans);
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	if (!address_bytes || (address_bytes > EEPROM_MAX_ADDRESS_BYTES)) {
+		pr_error("error: i2c: EEPROMs must use one or two word address bytes (not %d)!\n", address_bytes);
+		return EINVAL;
+	}
+	if (!page_size || (page_size > EEPROM_MAX_PAGE_SIZE)) {
+		pr_error("error: i2c: unsupported EEPROM page size %d!\n", page_size);
+		return EINVAL;
+	}
+	if (!length) {
+		return EINVAL;
+	}
+
+	// Stop any periodic reads, as they'd share our bus and our streaming buffers.
+	if (stream.write_data) {
+		usb_streaming_stop_periodic_gathering();
+		free(stream.write_data);
+		stream.write_data = NULL;
+	}
+
+	eeprom.address          = address;
+	eeprom.address_bytes    = address_bytes;
+	eeprom.page_size        = page_size;
+	eeprom.verify           = verify;
+	eeprom.word_address     = word_address;
+	eeprom.bytes_remaining  = length;
+	eeprom.bytes_programmed = 0;
+	eeprom.checksum         = 0;
+	eeprom.page_fill        = 0;
+
+	usb_streaming_start_streaming_from_host(length, eeprom_handle_data_from_host, NULL);
+	comms_response_add_uint8_t(trans, USB_STREAMING_OUT_ADDRESS);
+	return 0;
+}
+
+
+static int i2c_verb_eeprom_program_status(struct command_transaction *trans)
+{
+	int status = usb_streaming_from_host_status(NULL);
+
+	// If programming failed, report the failure directly.
+	if (status && (status != EINPROGRESS)) {
+		return status;
+	}
+
+	comms_response_add_uint8_t(trans, status != EINPROGRESS);
+	comms_response_add_uint32_t(trans, eeprom.bytes_programmed);
+	comms_response_add_uint32_t(trans, eeprom.checksum);
+	return 0;
+}
+
+
 /**
  * Verbs for the firmware API.
  */
@@ -293,6 +512,24 @@ static struct comms_verb _verbs[] = {
 			.in_signature = "", .out_signature = "",
 			.doc = "Stop any active periodic read."},
 
+		// EEPROM programming, with data delivered over a bulk pipe.
+		{ .name = "eeprom_program", .handler = i2c_verb_eeprom_program,
+			.in_signature = "<BBHII?", .out_signature = "<B",
+			.in_param_names = "address, address_bytes, page_size, word_address, length, verify",
+			.out_param_names = "pipe_id",
+			.doc =
+				"Programs an I2C EEPROM with data streamed to the given bulk pipe.\n"
+				"\n"
+				"Data is written a page at a time; write-cycle completion is detected by ACK polling.\n"
+				"Writes must not cross an EEPROM block boundary." },
+		{ .name = "eeprom_program_status", .handler = i2c_verb_eeprom_program_status,
+			.in_signature = "", .out_signature = "<?II",
+			.out_param_names = "complete, bytes_programmed, checksum",
+			.doc =
+				"Reports the progress of an EEPROM programming operation, or fails if programming failed.\n"
+				"\n"
+				"The checksum is a CRC32 of the data programmed so far (as read back, if verifying)." },
+
 		{} // Sentinel
 };
 COMMS_DEFINE_SIMPLE_CLASS(i2c, CLASS_NUMBER_SELF, "i2c", _verbs,
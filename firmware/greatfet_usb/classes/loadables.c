@@ -4,20 +4,88 @@
 
 #include <debug.h>
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <inttypes.h>
 #include <errno.h>
 #include <ctype.h>
 #include <string.h>
 
+#include <crc32.h>
+#include <m0_mailbox.h>
+
 #include <drivers/comms.h>
 #include <drivers/platform_reset.h>
 
+#include "../loadables.h"
+#include "../usb_streaming.h"
+
 #define CLASS_NUMBER_SELF (0x115)
 
 extern uint8_t _m0_data_region[];
 extern uint32_t _m0_data_region_size;
 
 
+/**
+ * State for loading an M0 image streamed over the bulk OUT endpoint.
+ */
+typedef struct {
+	uint32_t offset;
+	uint32_t length;
+	uint32_t checksum;
+} m0_image_upload_t;
+
+static m0_image_upload_t upload;
+
+
+/**
+ * Record of the last image loaded in full, taken as it was loaded. It's only good until anything else
+ * touches the region: once the M0 runs, it's free to modify its own .data, .bss and stack, so an image
+ * that's been started is never considered resident again.
+ */
+typedef struct {
+	bool valid;
+	uint32_t length;
+	uint32_t checksum;
+} m0_loaded_image_t;
+
+static m0_loaded_image_t loaded_image;
+
+
+static void loadables_forget_image(void)
+{
+	loaded_image.valid = false;
+}
+
+
+/**
+ * @return The amount of the M0 region available for loadables; the top of the region is reserved
+ *		for the mailbox shared with the M0.
+ */
+static uint32_t m0_loadable_space(void)
+{
+	return _m0_data_region_size - M0_MAILBOX_RESERVED_SIZE;
+}
+
+
+/**
+ * Notes that a block of memory has been written outside of the loadables class.
+ */
+void loadables_note_memory_write(uint32_t address, uint32_t length)
+{
+	uint32_t region_start = (uintptr_t)_m0_data_region;
+
+	if (!length) {
+		return;
+	}
+
+	// Written in terms of offsets, so an address near the top of memory can't wrap the check.
+	if ((address - region_start < _m0_data_region_size) || (region_start - address < length)) {
+		loadables_forget_image();
+	}
+}
+
+
 static int verb_load_m0_page(struct command_transaction *trans)
 {
 	uint32_t data_length;
@@ -29,11 +97,14 @@ static int verb_load_m0_page(struct command_transaction *trans)
 	}
 
 	// Validate that the loaded data would fit in our buffer.
-	if ((offset + data_length) > _m0_data_region_size) {
+	if ((offset + data_length) > m0_loadable_space()) {
 		pr_error("loadable: error: data would extend beyond loadable region!\n");
 		return EINVAL;
 	}
 
+	// We can't vouch for images loaded page by page; so forget what was resident before.
+	loadables_forget_image();
+
 	// Copy the data.
 	memcpy(&_m0_data_region[offset], data, data_length);
 
@@ -44,9 +115,174 @@ static int verb_load_m0_page(struct command_transaction *trans)
 }
 
 
+/**
+ * Copies a block of image data streamed from the host into the M0's region.
+ */
+static int load_image_data_from_host(void *data, uint32_t length, void *user_data)
+{
+	(void)user_data;
+
+	uint8_t *destination = &_m0_data_region[upload.offset];
+
+	memcpy(destination, data, length);
+
+	// Checksum the data as it landed in the M0 region, so the host can verify our copy.
+	upload.checksum = crc32_update(upload.checksum, destination, length);
+	upload.offset += length;
+
+	// Once the whole image is in place, remember it, so it needn't be uploaded again.
+	if (upload.offset == upload.length) {
+		loaded_image.length   = upload.length;
+		loaded_image.checksum = upload.checksum;
+		loaded_image.valid    = true;
+	}
+
+	return 0;
+}
+
+
+static int verb_load_m0_image(struct command_transaction *trans)
+{
+	uint32_t length = comms_argument_parse_uint32_t(trans);
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	// Validate that the loaded data would fit in our buffer.
+	if (!length || (length > m0_loadable_space())) {
+		pr_error("loadable: error: image of %" PRIu32 " bytes won't fit in the loadable region!\n", length);
+		return EINVAL;
+	}
+
+	upload.offset   = 0;
+	upload.length   = length;
+	upload.checksum = 0;
+	loadables_forget_image();
+
+	usb_streaming_start_streaming_from_host(length, load_image_data_from_host, NULL);
+	comms_response_add_uint8_t(trans, USB_STREAMING_OUT_ADDRESS);
+	return 0;
+}
+
+
+static int verb_load_m0_image_status(struct command_transaction *trans)
+{
+	int status = usb_streaming_from_host_status(NULL);
+
+	// If the upload failed, report the failure directly.
+	if (status && (status != EINPROGRESS)) {
+		return status;
+	}
+
+	comms_response_add_uint8_t(trans, status != EINPROGRESS);
+	comms_response_add_uint32_t(trans, upload.offset);
+	comms_response_add_uint32_t(trans, upload.checksum);
+	return 0;
+}
+
+
+static int verb_loaded_m0_image(struct command_transaction *trans)
+{
+	comms_response_add_uint8_t(trans, loaded_image.valid);
+	comms_response_add_uint32_t(trans, loaded_image.length);
+	comms_response_add_uint32_t(trans, loaded_image.checksum);
+	return 0;
+}
+
+
+static int verb_send_m0_command(struct command_transaction *trans)
+{
+	uint32_t length;
+	void *command = comms_argument_read_buffer(trans, -1, &length);
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	// The mailbox shares the M0's region; don't vouch for anything there once it's been written.
+	loadables_forget_image();
+
+	return m0_mailbox_send_command(command, length);
+}
+
+
+/**
+ * Moves blocks of data produced by the M0 into our stream to the host.
+ */
+static int stream_m0_data_to_host(void *data, uint32_t *length, void *user_data)
+{
+	(void)user_data;
+
+	m0_mailbox_t *mailbox = m0_mailbox_get();
+
+	if (!mailbox) {
+		return ENODEV;
+	}
+
+	// Wait until the M0 has produced a full block for us.
+	if (m0_ring_bytes_used(&mailbox->data) < *length) {
+		return EAGAIN;
+	}
+
+	m0_ring_read(&mailbox->data, data, *length);
+	return 0;
+}
+
+
+static int verb_stream_m0_data(struct command_transaction *trans)
+{
+	uint32_t length = comms_argument_parse_uint32_t(trans);
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	if (!m0_mailbox_get()) {
+		pr_error("loadable: error: can't stream M0 data before the M0 has been started\n");
+		return ENODEV;
+	}
+
+	usb_streaming_start_generating_for_host(length, stream_m0_data_to_host, NULL);
+	comms_response_add_uint8_t(trans, USB_STREAMING_IN_ADDRESS);
+	return 0;
+}
+
+
+static int verb_m0_mailbox_status(struct command_transaction *trans)
+{
+	m0_mailbox_t *mailbox = m0_mailbox_get();
+
+	if (!mailbox) {
+		return ENODEV;
+	}
+
+	comms_response_add_uint32_t(trans, m0_ring_bytes_used(&mailbox->commands));
+	comms_response_add_uint32_t(trans, m0_ring_bytes_used(&mailbox->data));
+	return 0;
+}
+
+
 static int verb_start_m0(struct command_transaction *trans)
 {
+	// The first word of the loadable's vector table is its initial stack pointer.
+	uint32_t initial_sp = *(uint32_t *)_m0_data_region;
+
 	(void)trans;
+
+	// Don't start a loadable whose stack would grow down into the mailbox.
+	if (initial_sp > M0_STACK_TOP_FOR_REGION(_m0_data_region, _m0_data_region_size)) {
+		pr_error("loadable: error: M0 stack at %08" PRIx32 " would overlap the mailbox; it must start at or below %08" PRIxPTR "\n",
+			initial_sp, M0_STACK_TOP_FOR_REGION(_m0_data_region, _m0_data_region_size));
+		return EINVAL;
+	}
+
+	// Once it runs, the image will dirty its own memory; so it'll need to be loaded afresh next time.
+	loadables_forget_image();
+
+	// Give the loadable a fresh mailbox to communicate with us.
+	m0_mailbox_init(_m0_data_region, _m0_data_region_size);
+
 	pr_info("M0 core started.\n");
 	platform_start_m0_core(&_m0_data_region);
 
@@ -77,6 +313,25 @@ static struct comms_verb _verbs[] = {
 				"Copies a page of data into the M0 address space.\n"
 				"\n"
 				"Should be run with the M0 halted. " },
+		{ .name = "load_m0_image", .handler = verb_load_m0_image, .in_signature = "<I",
+			.out_signature = "<B", .in_param_names = "length", .out_param_names = "pipe_id",
+			.doc =
+				"Loads an image of the given length, streamed to the given bulk pipe, into the M0 address space.\n"
+				"\n"
+				"Should be run with the M0 halted. " },
+		{ .name = "load_m0_image_status", .handler = verb_load_m0_image_status, .in_signature = "",
+			.out_signature = "<?II", .out_param_names = "complete, bytes_loaded, checksum",
+			.doc =
+				"Reports the progress of an image load, or fails if the load failed.\n"
+				"\n"
+				"The checksum is a CRC32 of the data loaded so far." },
+		{ .name = "loaded_m0_image", .handler = verb_loaded_m0_image, .in_signature = "",
+			.out_signature = "<?II", .out_param_names = "valid, length, checksum",
+			.doc =
+				"Describes the last image loaded in full over the bulk pipe, as it was when loaded.\n"
+				"\n"
+				"The checksum is a CRC32 of the image. valid is false if no such image is resident: including\n"
+				"once the M0 has been started, or anything else has written to its memory." },
 
 		// Control.
 		{ .name = "start_m0", .handler = verb_start_m0, .in_signature = "", .out_signature = "",
@@ -85,6 +340,21 @@ static struct comms_verb _verbs[] = {
 			.doc = "Starts execution of a loaded program on the device's M0 core.\n" },
 
 
+		// Communication with the running loadable.
+		{ .name = "send_m0_command", .handler = verb_send_m0_command, .in_signature = "<*X",
+			.out_signature = "", .in_param_names = "command",
+			.doc =
+				"Queues a command in the M0 mailbox, and wakes the M0 to handle it.\n"
+				"\n"
+				"Fails if the M0 hasn't yet consumed enough prior commands to fit this one." },
+		{ .name = "stream_m0_data", .handler = verb_stream_m0_data, .in_signature = "<I",
+			.out_signature = "<B", .in_param_names = "length", .out_param_names = "pipe_id",
+			.doc = "Streams the given amount of data produced by the M0 to the host over the given bulk pipe.\n" },
+		{ .name = "m0_mailbox_status", .handler = verb_m0_mailbox_status, .in_signature = "",
+			.out_signature = "<II", .out_param_names = "commands_pending, data_available",
+			.doc = "Reports how many bytes are waiting in each direction of the M0 mailbox.\n" },
+
+
 		// Sentinel.
 		{}
 };
@@ -0,0 +1,321 @@
+/*
+ * This file is part of GreatFET
+ *
+ * 1-Wire temperature sensor API: finds every DS18x20 on the bus, starts all of their conversions
+ * at once, and collects the results in the background; so a string of sensors takes about as long
+ * to read as a single one, and the main loop never waits out a conversion.
+ */
+
+#include <drivers/comms.h>
+#include <debug.h>
+
+#include <stddef.h>
+#include <errno.h>
+#include <string.h>
+
+#include <pins.h>
+#include <one_wire.h>
+#include <wakeable_task.h>
+
+#include <libopencm3/lpc43xx/scu.h>
+
+#define CLASS_NUMBER_SELF (0x11C)
+
+enum {
+	// The most sensors we'll keep track of at once.
+	ONE_WIRE_MAX_SENSORS = 64,
+
+	// DS18x20 function commands.
+	DS18X20_COMMAND_CONVERT_T         = 0x44,
+	DS18X20_COMMAND_READ_SCRATCHPAD   = 0xBE,
+	DS18X20_COMMAND_READ_POWER_SUPPLY = 0xB4,
+
+	DS18X20_SCRATCHPAD_LENGTH = 9,
+
+	// How often we check on a conversion, and the longest one can take (at 12-bit resolution).
+	CONVERSION_POLL_INTERVAL_MS = 10,
+	CONVERSION_TIMEOUT_MS       = 750,
+
+	// How many times we'll retry a disrupted search step before giving up on the search.
+	SEARCH_MAX_RETRIES = 3,
+};
+
+
+/**
+ * Where we are in a measurement. Each step is performed a little at a time, from our task.
+ */
+typedef enum {
+	ONE_WIRE_STATE_IDLE       = 0,
+	ONE_WIRE_STATE_SEARCHING  = 1,
+	ONE_WIRE_STATE_CONVERTING = 2,
+	ONE_WIRE_STATE_READING    = 3,
+} one_wire_state_t;
+
+
+/**
+ * Flags reported for each sensor.
+ */
+typedef enum {
+	// Set if the sensor's scratchpad was read back with a valid CRC; its reading is only meaningful if so.
+	SENSOR_READING_VALID = (1 << 0),
+} one_wire_sensor_flags_t;
+
+
+typedef struct {
+	uint8_t rom[8];
+	int16_t raw_temperature;
+	uint8_t flags;
+} one_wire_sensor_t;
+
+
+static one_wire_sensor_t sensors[ONE_WIRE_MAX_SENSORS];
+static uint8_t sensor_count;
+
+static volatile one_wire_state_t state;
+static one_wire_search_t search;
+static uint8_t search_retries;
+static bool bus_initialized;
+
+// True iff our last search gave up partway; the sensor table is then incomplete, and isn't reported.
+static bool search_failed;
+
+// The sensor we'll read next, and how long the current conversion has been running.
+static uint8_t next_sensor;
+static uint32_t conversion_elapsed_ms;
+
+// True iff any sensor is parasite powered; these need the bus held high for their whole conversion,
+// so we drive it high ourselves, and can't poll them to see when they're done.
+static bool parasite_powered;
+
+DECLARE_WAKEABLE_TASK(service_one_wire);
+
+
+static void one_wire_bus_init(void)
+{
+	if (bus_initialized) {
+		return;
+	}
+
+	scu_pinmux(SCU_PINMUX_GPIO5_8, SCU_GPIO_PUP | SCU_CONF_FUNCTION4);
+	one_wire_init();
+
+	bus_initialized = true;
+}
+
+
+/**
+ * Starts a broadcast conversion on every sensor at once.
+ */
+static void one_wire_start_conversion(void)
+{
+	// Ask whether anyone is parasite powered; those devices hold the bus low in response.
+	one_wire_init_target();
+	one_wire_write(ONE_WIRE_COMMAND_SKIP_ROM);
+	one_wire_write(DS18X20_COMMAND_READ_POWER_SUPPLY);
+	parasite_powered = !one_wire_read_bit();
+
+	one_wire_init_target();
+	one_wire_write(ONE_WIRE_COMMAND_SKIP_ROM);
+	one_wire_write(DS18X20_COMMAND_CONVERT_T);
+
+	// Parasite-powered sensors draw their conversion current from the bus, which the pull-up alone can't
+	// supply; so hold the bus high until the conversion's over. This must start within 10us of the command.
+	if (parasite_powered) {
+		one_wire_strong_pullup(true);
+	}
+
+	conversion_elapsed_ms = 0;
+	state = ONE_WIRE_STATE_CONVERTING;
+
+	// Check back on the conversion periodically, rather than waiting for it.
+	task_set_polling(WAKEABLE_TASK(service_one_wire), false);
+	task_wake_every(WAKEABLE_TASK(service_one_wire), CONVERSION_POLL_INTERVAL_MS);
+}
+
+
+/**
+ * Reads a single sensor's scratchpad.
+ */
+static void one_wire_read_sensor(one_wire_sensor_t *sensor)
+{
+	uint8_t scratchpad[DS18X20_SCRATCHPAD_LENGTH];
+
+	sensor->flags = 0;
+
+	if (!one_wire_select(sensor->rom)) {
+		return;
+	}
+
+	one_wire_write(DS18X20_COMMAND_READ_SCRATCHPAD);
+	for (int i = 0; i < DS18X20_SCRATCHPAD_LENGTH; ++i) {
+		scratchpad[i] = one_wire_read();
+	}
+
+	if (one_wire_crc8(scratchpad, sizeof(scratchpad)) == 0) {
+		sensor->raw_temperature = scratchpad[1] << 8 | scratchpad[0];
+		sensor->flags |= SENSOR_READING_VALID;
+	}
+}
+
+
+/**
+ * Background task that carries out each measurement. Each run performs only a single short
+ * bus operation -- finding one device, or reading one scratchpad -- so other tasks keep running.
+ */
+static void service_one_wire(void)
+{
+	switch (state) {
+
+		case ONE_WIRE_STATE_SEARCHING: {
+			one_wire_search_result_t result = one_wire_search_next(&search);
+
+			if (result == ONE_WIRE_SEARCH_FOUND) {
+				memcpy(sensors[sensor_count].rom, search.rom, sizeof(search.rom));
+				sensors[sensor_count].flags = 0;
+				sensor_count++;
+				search_retries = 0;
+			}
+
+			// A disrupted step leaves the search where it was; so try it again, rather than silently
+			// dropping every device past this point.
+			if (result == ONE_WIRE_SEARCH_FAILED) {
+				if (++search_retries <= SEARCH_MAX_RETRIES) {
+					break;
+				}
+
+				pr_warning("one_wire: search failed after %d retries; giving up\n", SEARCH_MAX_RETRIES);
+				search_failed = true;
+				state = ONE_WIRE_STATE_IDLE;
+				task_set_polling(WAKEABLE_TASK(service_one_wire), false);
+				break;
+			}
+
+			// Once the search has found everyone -- or we have no room for more -- start measuring.
+			if ((result == ONE_WIRE_SEARCH_DONE) || search.last_device_found || (sensor_count == ONE_WIRE_MAX_SENSORS)) {
+				if (sensor_count) {
+					one_wire_start_conversion();
+				} else {
+					pr_info("one_wire: no devices found on the bus\n");
+					state = ONE_WIRE_STATE_IDLE;
+					task_set_polling(WAKEABLE_TASK(service_one_wire), false);
+				}
+			}
+			break;
+		}
+
+		case ONE_WIRE_STATE_CONVERTING:
+			conversion_elapsed_ms += CONVERSION_POLL_INTERVAL_MS;
+
+			// Externally powered sensors read back a 1 once every conversion is done; otherwise, we
+			// have to wait out the worst case.
+			if ((conversion_elapsed_ms >= CONVERSION_TIMEOUT_MS) || (!parasite_powered && one_wire_read_bit())) {
+				one_wire_strong_pullup(false);
+
+				next_sensor = 0;
+				state = ONE_WIRE_STATE_READING;
+
+				task_wake_every(WAKEABLE_TASK(service_one_wire), 0);
+				task_set_polling(WAKEABLE_TASK(service_one_wire), true);
+			}
+			break;
+
+		case ONE_WIRE_STATE_READING:
+			one_wire_read_sensor(&sensors[next_sensor++]);
+
+			if (next_sensor >= sensor_count) {
+				state = ONE_WIRE_STATE_IDLE;
+				task_set_polling(WAKEABLE_TASK(service_one_wire), false);
+			}
+			break;
+
+		default:
+			task_set_polling(WAKEABLE_TASK(service_one_wire), false);
+			break;
+	}
+}
+DEFINE_WAKEABLE_TASK(service_one_wire, TASK_PRIORITY_LOW);
+
+
+static int one_wire_verb_start_measurement(struct command_transaction *trans)
+{
+	bool rescan = comms_argument_parse_bool(trans);
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	if (state != ONE_WIRE_STATE_IDLE) {
+		return EBUSY;
+	}
+
+	one_wire_bus_init();
+
+	// If we don't know about every sensor yet, we'll need to search regardless.
+	if (rescan || !sensor_count || search_failed) {
+		memset(&search, 0, sizeof(search));
+		sensor_count = 0;
+		search_retries = 0;
+		search_failed = false;
+
+		state = ONE_WIRE_STATE_SEARCHING;
+		task_set_polling(WAKEABLE_TASK(service_one_wire), true);
+	} else {
+		one_wire_start_conversion();
+	}
+
+	return 0;
+}
+
+
+static int one_wire_verb_get_status(struct command_transaction *trans)
+{
+	comms_response_add_uint8_t(trans, state);
+	comms_response_add_uint8_t(trans, sensor_count);
+	return 0;
+}
+
+
+static int one_wire_verb_read_sensors(struct command_transaction *trans)
+{
+	// Don't hand out a table that's halfway through being updated.
+	if (state != ONE_WIRE_STATE_IDLE) {
+		return EBUSY;
+	}
+
+	// If the search was cut short, we don't know who we missed.
+	if (search_failed) {
+		return EIO;
+	}
+
+	for (int i = 0; i < sensor_count; ++i) {
+		comms_response_add_raw(trans, sensors[i].rom, sizeof(sensors[i].rom));
+		comms_response_add_raw(trans, &sensors[i].raw_temperature, sizeof(sensors[i].raw_temperature));
+		comms_response_add_uint8_t(trans, sensors[i].flags);
+	}
+
+	return 0;
+}
+
+
+static struct comms_verb _verbs[] = {
+		{ .name = "start_measurement", .handler = one_wire_verb_start_measurement,
+			.in_signature = "<?", .out_signature = "",
+			.in_param_names = "rescan",
+			.doc =
+				"Starts measuring every DS18x20 on the bus, in the background. The bus is searched first\n"
+				"if rescan is set, or if no sensors have been found yet. Use get_status to see when it's done." },
+		{ .name = "get_status", .handler = one_wire_verb_get_status,
+			.in_signature = "", .out_signature = "<BB",
+			.out_param_names = "state, sensor_count",
+			.doc = "Returns the measurement state (0 = idle, 1 = searching, 2 = converting, 3 = reading), and the number of sensors known." },
+		{ .name = "read_sensors", .handler = one_wire_verb_read_sensors,
+			.in_signature = "", .out_signature = "<*(QhB)",
+			.out_param_names = "sensors",
+			.doc =
+				"Returns the results of the last measurement, as a list of (rom_code, raw_temperature, flags).\n"
+				"Readings are only valid if bit 0 of their flags is set. Fails with EBUSY while a measurement is running,\n"
+				"or with EIO if the bus search kept being disrupted; start_measurement will then search again." },
+		{} // Sentinel
+};
+COMMS_DEFINE_SIMPLE_CLASS(one_wire, CLASS_NUMBER_SELF, "one_wire", _verbs,
+		"Finds and reads strings of 1-Wire temperature sensors, without blocking.");
@@ -0,0 +1,280 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Parallel waveform output on a GPIO port, driven by the GPDMA.
+ */
+
+#include <debug.h>
+
+#include <drivers/comms.h>
+#include <drivers/gpio.h>
+
+#include <stddef.h>
+#include <errno.h>
+#include <toolchain.h>
+
+#include <gpio_lpc.h>
+
+#include <libopencm3/lpc43xx/timer.h>
+
+#include "../pin_manager.h"
+#include "../usb_streaming.h"
+#include "../gpio_dma_stream.h"
+
+#define CLASS_NUMBER_SELF (0x117)
+
+enum {
+	// TIMER2 runs directly from the CPU clock; its MR0 match paces our DMA requests.
+	PARALLEL_OUT_TIMER_CLOCK   = 204000000,
+};
+
+
+/**
+ * State for our parallel output engine.
+ */
+typedef struct {
+
+	// Bus configuration.
+	bool configured;
+	uint8_t port;
+	uint8_t first_pin;
+	uint8_t bus_width;
+	uint32_t sample_rate;
+
+	// The port's pin mask from before we narrowed it to our bus; restored when we release the bus.
+	uint32_t saved_port_mask;
+
+} parallel_out_t;
+
+static parallel_out_t parallel_out;
+
+
+/**
+ * Starts issuing one DMA request per sample.
+ */
+static void parallel_out_start_pacing(void)
+{
+	timer_reset(TIMER2);
+	timer_enable_counter(TIMER2);
+}
+
+
+static void parallel_out_stop_pacing(void)
+{
+	timer_disable_counter(TIMER2);
+}
+
+
+static const gpio_dma_stream_pacer_t parallel_out_pacer = {
+	.start = parallel_out_start_pacing,
+	.stop  = parallel_out_stop_pacing,
+};
+
+
+/**
+ * Returns a bus pin to a high-Z input, and gives up our reservation on it.
+ */
+static void parallel_out_release_pin(uint8_t port, uint8_t pin)
+{
+	gpio_pin_t gpio_pin = { .port = port, .pin = pin };
+
+	gpio_set_pin_direction(gpio_pin, false);
+	pin_release_reservation(gpio_get_group_number(gpio_pin), gpio_get_pin_number(gpio_pin));
+}
+
+
+/**
+ * Releases the bus we were configured to drive: restoring its port's mask, and freeing its pins.
+ */
+static void parallel_out_release_bus(void)
+{
+	if (!parallel_out.configured) {
+		return;
+	}
+
+	GPIO_LPC_PORT(parallel_out.port)->mask = parallel_out.saved_port_mask;
+
+	for (uint8_t pin = parallel_out.first_pin; pin < parallel_out.first_pin + parallel_out.bus_width; ++pin) {
+		parallel_out_release_pin(parallel_out.port, pin);
+	}
+
+	parallel_out.configured = false;
+}
+
+
+static int verb_configure(struct command_transaction *trans)
+{
+	uint8_t port        = comms_argument_parse_uint8_t(trans);
+	uint8_t first_pin   = comms_argument_parse_uint8_t(trans);
+	uint8_t bus_width   = comms_argument_parse_uint8_t(trans);
+	uint32_t sample_rate = comms_argument_parse_uint32_t(trans);
+
+	uint32_t divisor;
+	int rc;
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	// Our DMA writes whole bytes or halfwords to the port; so the bus must sit on a matching boundary.
+	if (((bus_width != 8) && (bus_width != 16)) || (first_pin % bus_width) || (first_pin + bus_width > 32) || (port > 7)) {
+		pr_error("parallel_out: can't drive a %d-bit bus starting at GPIO%d[%d]\n", bus_width, port, first_pin);
+		return EINVAL;
+	}
+	if (!sample_rate || (sample_rate > PARALLEL_OUT_TIMER_CLOCK / 2)) {
+		return EINVAL;
+	}
+
+	// Our timer and DMA are shared with sdir's transmit path; don't reconfigure them under a running stream.
+	if (gpio_dma_stream_running() || gpio_dma_stream_in_use_by_other(&parallel_out_pacer)) {
+		return EBUSY;
+	}
+
+	// Let go of any bus we were driving before.
+	parallel_out_release_bus();
+
+	// Claim each of our pins, and set them up as outputs.
+	for (uint8_t pin = first_pin; pin < first_pin + bus_width; ++pin) {
+		gpio_pin_t gpio_pin = { .port = port, .pin = pin };
+
+		uint8_t scu_group = gpio_get_group_number(gpio_pin);
+		uint8_t scu_pin   = gpio_get_pin_number(gpio_pin);
+
+		if ((scu_group == 0xff) || (scu_pin == 0xff)) {
+			pr_error("parallel_out: GPIO%d[%d] isn't available on this board\n", port, pin);
+			rc = EINVAL;
+		} else if (!pin_ensure_reservation(scu_group, scu_pin, CLASS_NUMBER_SELF)) {
+			pr_warning("parallel_out: couldn't reserve busy pin GPIO%d[%d]!\n", port, pin);
+			rc = EBUSY;
+		} else {
+			rc = gpio_configure_pinmux(gpio_pin);
+			if (!rc) {
+				rc = gpio_set_pin_direction(gpio_pin, true);
+			}
+
+			// If we reserved this pin but couldn't set it up, give it back along with the others.
+			if (rc) {
+				pin_release_reservation(scu_group, scu_pin);
+			}
+		}
+
+		// On failure, give back every pin we've claimed so far.
+		if (rc) {
+			for (uint8_t claimed = first_pin; claimed < pin; ++claimed) {
+				parallel_out_release_pin(port, claimed);
+			}
+			return rc;
+		}
+	}
+
+	// Only let our DMA writes touch the bus pins; remembering the mask we found, to restore later.
+	parallel_out.saved_port_mask = GPIO_LPC_PORT(port)->mask;
+	GPIO_LPC_PORT(port)->mask = ~(((1UL << bus_width) - 1) << first_pin);
+
+	// Set up TIMER2 to issue a DMA request once per sample.
+	divisor = PARALLEL_OUT_TIMER_CLOCK / sample_rate;
+
+	timer_disable_counter(TIMER2);
+	TIMER2_MCR = (TIMER_MCR_MR0I | TIMER_MCR_MR0R);
+	TIMER2_MR0 = divisor - 1;
+	timer_set_prescaler(TIMER2, 0);
+	timer_set_mode(TIMER2, TIMER_CTCR_MODE_TIMER);
+	timer_reset(TIMER2);
+
+	parallel_out.port        = port;
+	parallel_out.first_pin   = first_pin;
+	parallel_out.bus_width   = bus_width;
+	parallel_out.sample_rate = PARALLEL_OUT_TIMER_CLOCK / divisor;
+	parallel_out.configured  = true;
+
+	comms_response_add_uint32_t(trans, parallel_out.sample_rate);
+	return 0;
+}
+
+
+static int verb_start_stream(struct command_transaction *trans)
+{
+	uint32_t length = comms_argument_parse_uint32_t(trans);
+	void *port_data;
+	int rc;
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	if (!parallel_out.configured) {
+		pr_error("parallel_out: must be configured before streaming\n");
+		return EINVAL;
+	}
+
+	// Point our DMA ring at the byte lane(s) of the port's masked pin register that hold our bus.
+	port_data = (uint8_t *)&GPIO_LPC_PORT(parallel_out.port)->mpin + (parallel_out.first_pin / 8);
+
+	rc = gpio_dma_stream_start(port_data, parallel_out.bus_width / 8, length, &parallel_out_pacer);
+	if (rc) {
+		return rc;
+	}
+
+	comms_response_add_uint8_t(trans, USB_STREAMING_OUT_ADDRESS);
+	return 0;
+}
+
+
+static int verb_stop(struct command_transaction *trans)
+{
+	(void)trans;
+
+	// Only stop the output stream if it's ours.
+	if (!gpio_dma_stream_in_use_by_other(&parallel_out_pacer)) {
+		gpio_dma_stream_stop();
+	}
+
+	parallel_out_release_bus();
+	return 0;
+}
+
+
+static int verb_get_status(struct command_transaction *trans)
+{
+	bool complete;
+	uint32_t bytes_played, underruns;
+
+	int rc = gpio_dma_stream_status(&complete, &bytes_played, &underruns);
+	if (rc) {
+		return rc;
+	}
+
+	comms_response_add_uint8_t(trans, complete);
+	comms_response_add_uint32_t(trans, bytes_played);
+	comms_response_add_uint32_t(trans, underruns);
+	return 0;
+}
+
+
+static struct comms_verb _verbs[] = {
+		{ .name = "configure", .handler = verb_configure,
+			.in_signature = "<BBBI", .out_signature = "<I",
+			.in_param_names = "port, first_pin, bus_width, sample_rate", .out_param_names = "actual_sample_rate",
+			.doc =
+				"Configures a GPIO port to drive a parallel bus.\n"
+				"\n"
+				"The bus can be 8 or 16 bits wide, and must start on a multiple of its width.\n"
+				"Returns the closest achievable sample rate." },
+		{ .name = "start_stream", .handler = verb_start_stream,
+			.in_signature = "<I", .out_signature = "<B",
+			.in_param_names = "length", .out_param_names = "pipe_id",
+			.doc =
+				"Scans out samples streamed to the given bulk pipe; or until stopped, if length is zero.\n"
+				"\n"
+				"Output begins once the device has buffered enough samples to stay ahead of the DMA." },
+		{ .name = "stop", .handler = verb_stop,
+			.in_signature = "", .out_signature = "",
+			.doc = "Stops any active parallel output, and releases the bus; which must be configured again before reuse." },
+		{ .name = "get_status", .handler = verb_get_status,
+			.in_signature = "", .out_signature = "<?II",
+			.out_param_names = "complete, bytes_played, underruns",
+			.doc = "Reports the progress of the active stream, including how often the host fell behind." },
+		{} // Sentinel
+};
+COMMS_DEFINE_SIMPLE_CLASS(parallel_out, CLASS_NUMBER_SELF, "parallel_out", _verbs,
+		"API for DMA-driven parallel output on a GPIO port.");
@@ -23,6 +23,7 @@
 #include <debug.h>
 #include <string.h>
 #include <toolchain.h>
+#include <wakeable_task.h>
 
 #define CLASS_NUMBER_SELF (0x110)
 #define GENERATOR_TOTAL_BUFFER_SIZE (GENERATOR_NUM_BUFFERS * GENERATOR_BUFFER_SIZE)
@@ -33,6 +34,19 @@ enum {
 	GENERATOR_BUFFER_ORDER             = 15,
 };
 
+enum {
+	// Sequencer segments are stored in their own memory, so they survive between sequences.
+	SEQUENCER_SEGMENT_MEMORY_SIZE      = 0x4000,
+	SEQUENCER_MAX_SEGMENTS             = 16,
+	SEQUENCER_MAX_ENTRIES              = 64,
+
+	// Segments are copied into the scan-out ring a word at a time; so they must be whole words long.
+	SEQUENCER_SEGMENT_ALIGNMENT        = 4,
+
+	// Distance we keep between our writes and SGPIO's reads; so we never touch a word it's about to load.
+	SEQUENCER_GUARD_BYTES              = 64,
+};
+
 volatile bool pattern_generator_enabled = false;
 
 // Set the default frequency for our logic analyzer.
@@ -99,6 +113,9 @@ static sgpio_t generator  = {
 };
 
 
+static void sequencer_stop(void);
+
+
 /**
  * Configures the SGPIO hardware to transmit a fixed pattern repeatedly via SGPIO.
  * Small transfers (up to 64-packed-bytes per eight bits) can be done CPU-less-ly; while larger transfers
@@ -114,6 +131,9 @@ static int start_fixed_pattern_generation(uint32_t sample_rate, uint8_t bus_widt
 {
 	int rc;
 
+	// Our buffer is shared with the sequencer; so make sure it's not still rendering into it.
+	sequencer_stop();
+
 	// Validate that we have enough buffer to store the fixed pattern. If we don't, bail out.
 	if (data_length > (GENERATOR_BUFFER_SIZE * GENERATOR_NUM_BUFFERS)) {
 		pr_error("pattern gen: cannot output a %uB fixed pattern; you may want to stream data instead\n", data_length);
@@ -237,12 +257,391 @@ static int verb_generate_pattern(struct command_transaction *trans)
 }
 
 
+/**
+ * A segment of pattern data stored in sequencer memory.
+ */
+typedef struct {
+	uint32_t offset;
+	uint32_t length;
+} sequencer_segment_t;
+
+
+/**
+ * An entry in a sequence: a segment, and the number of times it's played back to back.
+ */
+typedef struct {
+	uint8_t segment;
+	uint32_t repeat_count;
+} sequencer_entry_t;
+
+
+/**
+ * State for our pattern sequencer, which plays segments back to back by rendering them into the
+ * SGPIO scan-out ring just ahead of the hardware.
+ */
+typedef struct {
+
+	// Segment storage.
+	sequencer_segment_t segments[SEQUENCER_MAX_SEGMENTS];
+	uint8_t segment_count;
+	uint32_t memory_used;
+
+	// The sequence to be played; and whether it should restart once it's done.
+	sequencer_entry_t entries[SEQUENCER_MAX_ENTRIES];
+	uint8_t entry_count;
+	bool loop;
+
+	// Our position in the sequence.
+	uint8_t entry;
+	uint32_t repeat;
+	uint32_t segment_offset;
+	bool sequence_done;
+
+	// Free-running counts of the bytes we've rendered into the ring, and that SGPIO has read out of it.
+	uint32_t bytes_rendered;
+	uint32_t bytes_played;
+	uint32_t last_read_position;
+
+	// The value of bytes_rendered at the end of a one-shot sequence.
+	uint32_t end_of_sequence;
+
+	volatile bool running;
+	uint32_t underruns;
+
+} pattern_sequencer_t;
+
+static pattern_sequencer_t sequencer;
+static uint8_t __attribute__((aligned(4))) sequencer_memory[SEQUENCER_SEGMENT_MEMORY_SIZE];
+
+DECLARE_WAKEABLE_TASK(service_pattern_sequencer);
+
+
+/**
+ * Renders sequence data into the scan-out ring, up to the given number of bytes.
+ *
+ * @return The number of bytes rendered.
+ */
+static uint32_t sequencer_render(uint8_t *ring, uint32_t ring_size, uint32_t max_bytes)
+{
+	uint32_t rendered = 0;
+
+	while ((rendered < max_bytes) && !sequencer.sequence_done) {
+		sequencer_entry_t *entry = &sequencer.entries[sequencer.entry];
+		sequencer_segment_t *segment = &sequencer.segments[entry->segment];
+
+		uint32_t write_position = sequencer.bytes_rendered & (ring_size - 1);
+		uint32_t to_copy = segment->length - sequencer.segment_offset;
+
+		// Copy as much of the segment as fits before the end of the ring, and before our limit.
+		if (to_copy > ring_size - write_position) {
+			to_copy = ring_size - write_position;
+		}
+		if (to_copy > max_bytes - rendered) {
+			to_copy = max_bytes - rendered;
+		}
+
+		memcpy(&ring[write_position], &sequencer_memory[segment->offset + sequencer.segment_offset], to_copy);
+		sequencer.segment_offset += to_copy;
+		sequencer.bytes_rendered += to_copy;
+		rendered                 += to_copy;
+
+		if (sequencer.segment_offset < segment->length) {
+			continue;
+		}
+
+		// Move on to the next repetition; or the next entry.
+		sequencer.segment_offset = 0;
+		if (++sequencer.repeat < entry->repeat_count) {
+			continue;
+		}
+
+		sequencer.repeat = 0;
+		if (++sequencer.entry < sequencer.entry_count) {
+			continue;
+		}
+
+		sequencer.entry = 0;
+		if (!sequencer.loop) {
+			sequencer.sequence_done   = true;
+			sequencer.end_of_sequence = sequencer.bytes_rendered;
+		}
+	}
+
+	return rendered;
+}
+
+
+/**
+ * Once a one-shot sequence has been fully rendered, fills the rest of the ring with the sequence's
+ * final word; so the output holds its last value until we halt the hardware.
+ */
+static uint32_t sequencer_render_hold(uint8_t *ring, uint32_t ring_size, uint32_t max_bytes)
+{
+	uint32_t last_word_position = (sequencer.end_of_sequence - SEQUENCER_SEGMENT_ALIGNMENT) & (ring_size - 1);
+	uint32_t last_word;
+
+	memcpy(&last_word, &ring[last_word_position], sizeof(last_word));
+
+	for (uint32_t rendered = 0; rendered < max_bytes; rendered += sizeof(last_word)) {
+		memcpy(&ring[sequencer.bytes_rendered & (ring_size - 1)], &last_word, sizeof(last_word));
+		sequencer.bytes_rendered += sizeof(last_word);
+	}
+
+	return max_bytes;
+}
+
+
+/**
+ * Keeps the scan-out ring filled ahead of the SGPIO hardware.
+ */
+static void sequencer_fill_ring(void)
+{
+	uint8_t *ring = pattern_generator_functions[0].buffer;
+	uint32_t ring_size = 1UL << pattern_generator_functions[0].buffer_order;
+	uint32_t read_position = pattern_generator_functions[0].position_in_buffer;
+	uint32_t space;
+
+	// Work out how far SGPIO has read since we last looked.
+	sequencer.bytes_played += (read_position - sequencer.last_read_position) & (ring_size - 1);
+	sequencer.last_read_position = read_position;
+
+	// If SGPIO caught up with us, it's replaying stale data. Count it, and skip ahead to where it's reading.
+	if ((int32_t)(sequencer.bytes_rendered - sequencer.bytes_played) < 0) {
+		sequencer.underruns++;
+		sequencer.bytes_rendered = sequencer.bytes_played;
+	}
+
+	space = ring_size - SEQUENCER_GUARD_BYTES - (sequencer.bytes_rendered - sequencer.bytes_played);
+	space &= ~(SEQUENCER_SEGMENT_ALIGNMENT - 1);
+
+	if (!sequencer.sequence_done) {
+		space -= sequencer_render(ring, ring_size, space);
+	}
+	if (sequencer.sequence_done && space) {
+		sequencer_render_hold(ring, ring_size, space);
+	}
+}
+
+
+/**
+ * Halts the sequencer, and the SGPIO hardware it's driving.
+ */
+static void sequencer_stop(void)
+{
+	if (!sequencer.running) {
+		return;
+	}
+
+	sequencer.running = false;
+	task_set_polling(WAKEABLE_TASK(service_pattern_sequencer), false);
+	sgpio_halt(&generator);
+}
+
+
+/**
+ * Task that keeps the sequencer fed while it's running.
+ */
+static void service_pattern_sequencer(void)
+{
+	if (!sequencer.running) {
+		return;
+	}
+
+	sequencer_fill_ring();
+
+	// Once a one-shot sequence has been played out, stop.
+	if (sequencer.sequence_done && ((int32_t)(sequencer.bytes_played - sequencer.end_of_sequence) >= 0)) {
+		sequencer_stop();
+	}
+}
+DEFINE_WAKEABLE_TASK(service_pattern_sequencer, TASK_PRIORITY_HIGH);
+
+
+static int verb_clear_sequencer(struct command_transaction *trans)
+{
+	(void)trans;
+
+	sequencer_stop();
+
+	sequencer.segment_count = 0;
+	sequencer.memory_used   = 0;
+	sequencer.entry_count   = 0;
+	return 0;
+}
+
+
+static int verb_add_segment(struct command_transaction *trans)
+{
+	uint32_t length = comms_argument_parse_uint32_t(trans);
+	sequencer_segment_t *segment;
+
+	if (!comms_transaction_okay(trans)) {
+		return EINVAL;
+	}
+
+	if (!length || (length % SEQUENCER_SEGMENT_ALIGNMENT)) {
+		pr_error("pattern gen: sequencer segments must be a non-zero multiple of %d bytes\n", SEQUENCER_SEGMENT_ALIGNMENT);
+		return EINVAL;
+	}
+	if ((sequencer.segment_count >= SEQUENCER_MAX_SEGMENTS) ||
+			(length > SEQUENCER_SEGMENT_MEMORY_SIZE - sequencer.memory_used)) {
+		pr_error("pattern gen: out of sequencer memory for a %uB segment\n", length);
+		return ENOMEM;
+	}
+
+	if (sequencer.running) {
+		return EBUSY;
+	}
+
+	segment = &sequencer.segments[sequencer.segment_count];
+	segment->offset = sequencer.memory_used;
+	segment->length = length;
+	sequencer.memory_used += length;
+
+	comms_response_add_uint8_t(trans, sequencer.segment_count++);
+	return 0;
+}
+
+
+static int verb_upload_segment_data(struct command_transaction *trans)
+{
+	void *data;
+	uint32_t data_length;
+	uint8_t segment_id = comms_argument_parse_uint8_t(trans);
+	uint32_t offset    = comms_argument_parse_uint32_t(trans);
+	sequencer_segment_t *segment;
+
+	if (!comms_transaction_okay(trans) || (segment_id >= sequencer.segment_count)) {
+		return EINVAL;
+	}
+
+	data = comms_argument_read_buffer(trans, -1, &data_length);
+	if (!data) {
+		pr_error("pattern gen: error: could not read the segment data!\n");
+		return EINVAL;
+	}
+
+	// Check each part separately, so a huge host-provided offset can't wrap the sum around.
+	segment = &sequencer.segments[segment_id];
+	if ((offset > segment->length) || (data_length > segment->length - offset)) {
+		pr_error("pattern gen: error: tried to write past the end of segment %d!\n", segment_id);
+		return EINVAL;
+	}
+
+	memcpy(&sequencer_memory[segment->offset + offset], data, data_length);
+	return 0;
+}
+
+
+static int verb_set_sequence(struct command_transaction *trans)
+{
+	// The new sequence is parsed here in full before it replaces the old; so a bad entry leaves the old intact.
+	static sequencer_entry_t new_entries[SEQUENCER_MAX_ENTRIES];
+
+	bool loop = comms_argument_parse_bool(trans);
+	uint8_t entry_count = 0;
+
+	if (sequencer.running) {
+		return EBUSY;
+	}
+
+	while (comms_argument_data_remaining(trans)) {
+		uint8_t segment       = comms_argument_parse_uint8_t(trans);
+		uint32_t repeat_count = comms_argument_parse_uint32_t(trans);
+
+		if (!comms_transaction_okay(trans)) {
+			return EINVAL;
+		}
+
+		if ((entry_count >= SEQUENCER_MAX_ENTRIES) || (segment >= sequencer.segment_count) || !repeat_count) {
+			pr_error("pattern gen: invalid sequence entry %d\n", entry_count);
+			return EINVAL;
+		}
+
+		new_entries[entry_count].segment      = segment;
+		new_entries[entry_count].repeat_count = repeat_count;
+		++entry_count;
+	}
+
+	if (!comms_transaction_okay(trans) || !entry_count) {
+		return EINVAL;
+	}
+
+	memcpy(sequencer.entries, new_entries, entry_count * sizeof(new_entries[0]));
+	sequencer.entry_count = entry_count;
+	sequencer.loop        = loop;
+	return 0;
+}
+
+
+static int verb_start_sequence(struct command_transaction *trans)
+{
+	int rc;
+	uint32_t sample_rate = comms_argument_parse_uint32_t(trans);
+	uint8_t  bus_width   = comms_argument_parse_uint8_t(trans);
+
+	if (!comms_transaction_okay(trans)) {
+		return EINVAL;
+	}
+
+	if (!sequencer.entry_count) {
+		pr_error("pattern gen: a sequence must be set before it can be started\n");
+		return EINVAL;
+	}
+
+	sequencer_stop();
+
+	// Rewind to the start of the sequence...
+	sequencer.entry              = 0;
+	sequencer.repeat             = 0;
+	sequencer.segment_offset     = 0;
+	sequencer.sequence_done      = false;
+	sequencer.bytes_rendered     = 0;
+	sequencer.bytes_played       = 0;
+	sequencer.last_read_position = 0;
+	sequencer.underruns          = 0;
+
+	// ... and scan out of our full buffer, repeating endlessly; we'll keep it filled ahead of the hardware.
+	pattern_generator_functions[0].buffer                = usb_bulk_buffer;
+	pattern_generator_functions[0].buffer_order          = GENERATOR_BUFFER_ORDER;
+	pattern_generator_functions[0].position_in_buffer    = 0;
+	pattern_generator_functions[0].shift_clock_frequency = sample_rate;
+	pattern_generator_functions[0].bus_width             = bus_width;
+	pattern_generator_functions[0].shift_count_limit     = 0;
+	pattern_generator_functions[0].mode                  = SGPIO_MODE_FIXED_DATA_OUT;
+
+	// Fill the ring before we start, so the hardware has plenty to work with.
+	sequencer_fill_ring();
+
+	rc = sgpio_set_up_functions(&generator);
+	if (rc) {
+		return rc;
+	}
+
+	sequencer.running = true;
+	task_set_polling(WAKEABLE_TASK(service_pattern_sequencer), true);
+
+	sgpio_run(&generator);
+	return 0;
+}
+
+
+static int verb_get_sequence_status(struct command_transaction *trans)
+{
+	comms_response_add_uint8_t(trans, !sequencer.running);
+	comms_response_add_uint32_t(trans, sequencer.bytes_played);
+	comms_response_add_uint32_t(trans, sequencer.underruns);
+	return 0;
+}
+
+
 static int verb_stop(struct command_transaction *trans)
 {
 	(void)trans;
 
 	// Stop emission of the patterns...
 	pattern_generator_enabled = false;
+	sequencer_stop();
 
 	// Disable the USB endpoint. TODO: use the pipe API!
 	//usb_endpoint_disable(&usb0_endpoint_bulk_out);
@@ -300,6 +699,28 @@ static struct comms_verb pattern_generator_verbs[] = {
 			"    repeat -- If set, the pattern will be emitted repeatedly. The pattern must be sized to a binary number of bytes." },
 
 
+	/* Sequencer: plays stored segments back to back, without re-uploading. */
+	{ .name = "clear_sequencer", .handler = verb_clear_sequencer,
+		.in_signature = "", .out_signature = "",
+		.doc = "Stops the sequencer, and discards all of its segments and its sequence." },
+	{ .name = "add_segment", .handler = verb_add_segment,
+		.in_signature = "<I", .out_signature = "<B", .in_param_names = "length", .out_param_names = "segment_id",
+		.doc = "Allocates a segment of sequencer memory; returns its ID.\n\n"
+			"    length -- The length of the segment, in bytes; must be a multiple of four." },
+	{ .name = "upload_segment_data", .handler = verb_upload_segment_data,
+		.in_signature = "<BI*X", .out_signature = "", .in_param_names = "segment_id, offset, data",
+		.doc = "Uploads packed samples into a sequencer segment, starting at the given byte offset." },
+	{ .name = "set_sequence", .handler = verb_set_sequence,
+		.in_signature = "<?*(BI)", .out_signature = "", .in_param_names = "loop, entries",
+		.doc = "Sets the sequence to be played, as a list of (segment_id, repeat_count) entries.\n\n"
+			"    loop -- If set, the sequence restarts from its first entry once it's complete." },
+	{ .name = "start_sequence", .handler = verb_start_sequence,
+		.in_signature = "<IB", .out_signature = "", .in_param_names = "sample_rate_hz, num_channels",
+		.doc = "Starts playing the current sequence; each segment follows the last without a gap." },
+	{ .name = "get_sequence_status", .handler = verb_get_sequence_status,
+		.in_signature = "", .out_signature = "<?II", .out_param_names = "complete, bytes_played, underruns",
+		.doc = "Reports the sequencer's progress, including how often it fell behind the hardware." },
+
 	/* Debug. */
 	{ .name = "dump_sgpio_configuration",  .handler = verb_dump_sgpio_config,
 		.in_signature = "<?", .out_signature="", .in_param_names = "include_unused",
@@ -0,0 +1,112 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Reports the runtime profiles of our scheduler tasks and interrupts.
+ */
+
+#include <drivers/comms.h>
+
+#include <stddef.h>
+#include <errno.h>
+
+#include <task_profile.h>
+
+#define CLASS_NUMBER_SELF (0x119)
+
+
+static int verb_get_profile_count(struct command_transaction *trans)
+{
+	uint8_t count = 0;
+
+	for (task_profile_t *profile = task_profile_first(); profile; profile = profile->next) {
+		++count;
+	}
+
+	comms_response_add_uint8_t(trans, count);
+	comms_response_add_uint32_t(trans, task_profile_cycle_frequency());
+	return 0;
+}
+
+
+static task_profile_t *profile_from_arguments(struct command_transaction *trans)
+{
+	uint8_t index = comms_argument_parse_uint8_t(trans);
+
+	if (!comms_transaction_okay(trans)) {
+		return NULL;
+	}
+
+	return task_profile_get(index);
+}
+
+
+static int verb_get_profile_name(struct command_transaction *trans)
+{
+	task_profile_t *profile = profile_from_arguments(trans);
+
+	if (!profile) {
+		return EINVAL;
+	}
+
+	comms_response_add_string(trans, profile->name);
+	return 0;
+}
+
+
+static int verb_get_profile(struct command_transaction *trans)
+{
+	task_profile_t *profile = profile_from_arguments(trans);
+
+	if (!profile) {
+		return EINVAL;
+	}
+
+	// Take a snapshot first; interrupt profiles can change underneath us.
+	task_profile_t snapshot = *profile;
+
+	comms_response_add_uint32_t(trans, snapshot.calls);
+	comms_response_add_uint32_t(trans, (uint32_t)snapshot.total_cycles);
+	comms_response_add_uint32_t(trans, (uint32_t)(snapshot.total_cycles >> 32));
+	comms_response_add_uint32_t(trans, snapshot.max_cycles);
+
+	for (unsigned i = 0; i < TASK_PROFILE_HISTOGRAM_BINS; ++i) {
+		comms_response_add_uint32_t(trans, snapshot.histogram[i]);
+	}
+
+	return 0;
+}
+
+
+static int verb_reset(struct command_transaction *trans)
+{
+	(void)trans;
+
+	task_profile_reset();
+	return 0;
+}
+
+
+static struct comms_verb _verbs[] = {
+		{ .name = "get_profile_count", .handler = verb_get_profile_count,
+			.in_signature = "", .out_signature = "<BI",
+			.out_param_names = "count, cycle_frequency",
+			.doc = "Returns the number of available profiles, and the frequency of the clock their cycles are counted in." },
+		{ .name = "get_profile_name", .handler = verb_get_profile_name,
+			.in_signature = "<B", .out_signature = "<S",
+			.in_param_names = "index", .out_param_names = "name",
+			.doc = "Returns the name of the task or interrupt described by the given profile." },
+		{ .name = "get_profile", .handler = verb_get_profile,
+			.in_signature = "<B", .out_signature = "<IIII*I",
+			.in_param_names = "index", .out_param_names = "calls, total_cycles_low, total_cycles_high, max_cycles, histogram",
+			.doc =
+				"Returns the statistics for a single profile.\n"
+				"\n"
+				"Bin 0 of the histogram counts runs shorter than 128 cycles; each following bin covers\n"
+				"twice the range of the bin before, and the last bin counts all longer runs." },
+		{ .name = "reset", .handler = verb_reset,
+			.in_signature = "", .out_signature = "",
+			.doc = "Clears all profile statistics." },
+		{} // Sentinel
+};
+COMMS_DEFINE_SIMPLE_CLASS(profile, CLASS_NUMBER_SELF, "profile", _verbs,
+		"Runtime profiling for the firmware's scheduler tasks and interrupts.");
@@ -8,21 +8,67 @@
 
 #include <drivers/comms.h>
 #include <drivers/gpio.h>
+#include <drivers/scu.h>
 #include <drivers/dac/ad970x.h>
 #include <drivers/sgpio.h>
 
+#include <gpio_lpc.h>
+#include <libopencm3/lpc43xx/timer.h>
+
+#include <cic_decimator.h>
+
 #include "../pin_manager.h"
 #include "../usb_streaming.h"
+#include "../gpio_dma_stream.h"
 
 #define CLASS_NUMBER_SELF (0x10E)
 
 // Store the state of the SDIR initialization.
 static bool sdir_initialized = false;
 
+// True iff we've set up our transmit path, and are (or were last) scanning out samples.
+static bool sdir_tx_configured = false;
+static bool sdir_transmitting = false;
+
+// The DAC data port's pin mask from before we narrowed it; restored once we're done transmitting.
+static uint32_t sdir_tx_saved_port_mask;
+
 enum {
-	SDIR_DEFAULT_FREQUENCY = 10200000 // 10.2 MHz
+	SDIR_DEFAULT_FREQUENCY = 10200000, // 10.2 MHz
+
+	// Our DAC clock is generated by toggling a TIMER1 match output; so it runs at most at half the timer clock.
+	SDIR_TX_TIMER_CLOCK    = 204000000,
+	SDIR_TX_DEFAULT_RATE   = 1000000,
+
+	// The DAC's parallel data bus sits on the low byte of GPIO port 1.
+	SDIR_TX_DATA_PORT      = 1,
+	SDIR_TX_DATA_WIDTH     = 8,
 };
 
+// The TIMER1 match value that generates our DAC clock.
+static uint32_t sdir_tx_divisor = ((SDIR_TX_TIMER_CLOCK / 2) / SDIR_TX_DEFAULT_RATE) - 1;
+
+enum {
+	// When decimating, SGPIO captures raw ADC samples into this ring; and we filter them into the USB buffer.
+	SDIR_RAW_BUFFER_ORDER   = 13,
+	SDIR_RAW_BUFFER_SIZE    = (1 << SDIR_RAW_BUFFER_ORDER),
+
+	// The longest we'd like decimated samples to sit on the device before they're sent, in milliseconds.
+	SDIR_DECIMATED_MAX_LATENCY = 10,
+	SDIR_DECIMATED_MIN_BLOCK   = 512,
+};
+
+static uint8_t __attribute__((aligned(4))) sdir_raw_samples[SDIR_RAW_BUFFER_SIZE];
+
+// Receive-side decimation; a ratio of 1 streams raw ADC samples straight from SGPIO to the host.
+static cic_decimator_t sdir_decimator;
+static uint32_t sdir_decimation = 1;
+static uint8_t sdir_dc_time_constant = 0;
+
+// How much decimated data we gather before handing a block to the host; and how much we've gathered so far.
+static uint32_t sdir_decimated_block_size;
+static uint32_t sdir_decimated_fill;
+
 
 /**
  * Data capture pins for the Gladiolus ADC.
@@ -102,6 +148,16 @@ static ad970x_t tx_dac = {
 static gpio_pin_t adc_powerdown  = {5, 3};
 static gpio_pin_t adc_amplifier_enable  = {5, 5};
 
+/**
+ * Pin that carries our DAC clock; which is TIMER1's MAT0 output.
+ */
+static scu_function_mapping_t tx_dac_clock_pin = { .group = 5, .pin = 4, .function = 5 };
+
+static platform_scu_pin_configuration_t tx_dac_clock_pin_configuration = {
+	.pull_resistors = SCU_NO_PULL,
+	.use_fast_slew = true,
+};
+
 
 /**
  * Configures a given GPIO port/pin to be used for SDIR purposes.
@@ -131,6 +187,7 @@ static int set_up_sdir_gpio(gpio_pin_t pin)
 	rc = gpio_configure_pinmux(pin);
 	if (rc) {
 		pr_warning("sdir: couldn't configure pinmux for GPIO%d[%d]!\n", pin.port, pin.pin);
+		pin_release_reservation(scu_group, scu_pin);
 		return rc;
 	}
 
@@ -191,6 +248,132 @@ static void sdir_power_down_adc(void)
 }
 
 
+/**
+ * Sets up the pins used to drive our transmit DAC: its parallel data bus, and its sample clock.
+ */
+static int sdir_set_up_transmit_pins(void)
+{
+	int rc;
+
+	// Claim the DAC clock first; so if it's busy, there's nothing else to undo.
+	if (!pin_ensure_reservation(tx_dac_clock_pin.group, tx_dac_clock_pin.pin, CLASS_NUMBER_SELF)) {
+		pr_warning("sdir: couldn't reserve busy pin P%d_%d for the DAC clock!\n",
+			tx_dac_clock_pin.group, tx_dac_clock_pin.pin);
+		return EBUSY;
+	}
+
+	for (uint8_t pin = 0; pin < SDIR_TX_DATA_WIDTH; ++pin) {
+		gpio_pin_t data_pin = { .port = SDIR_TX_DATA_PORT, .pin = pin };
+
+		rc = set_up_sdir_gpio(data_pin);
+		if (rc) {
+
+			// Give back everything we've claimed so far.
+			for (uint8_t claimed = 0; claimed < pin; ++claimed) {
+				gpio_pin_t claimed_pin = { .port = SDIR_TX_DATA_PORT, .pin = claimed };
+				tear_down_sdir_gpio(claimed_pin);
+			}
+			pin_release_reservation(tx_dac_clock_pin.group, tx_dac_clock_pin.pin);
+
+			return rc;
+		}
+
+		gpio_set_pin_direction(data_pin, true);
+	}
+
+	platform_scu_apply_mapping(tx_dac_clock_pin, tx_dac_clock_pin_configuration);
+
+	// Only let our DMA writes touch the DAC's data bus. Nothing past this point can fail, so the
+	// mask we save is always the one we found.
+	sdir_tx_saved_port_mask = GPIO_LPC_PORT(SDIR_TX_DATA_PORT)->mask;
+	GPIO_LPC_PORT(SDIR_TX_DATA_PORT)->mask = ~((1UL << SDIR_TX_DATA_WIDTH) - 1);
+
+	sdir_tx_configured = true;
+	return 0;
+}
+
+
+/**
+ * Releases the pins used to drive our transmit DAC.
+ */
+static int sdir_tear_down_transmit_pins(void)
+{
+	int rc;
+
+	if (!sdir_tx_configured) {
+		return 0;
+	}
+
+	// Give other users of the port back their view of its masked registers.
+	GPIO_LPC_PORT(SDIR_TX_DATA_PORT)->mask = sdir_tx_saved_port_mask;
+
+	for (uint8_t pin = 0; pin < SDIR_TX_DATA_WIDTH; ++pin) {
+		gpio_pin_t data_pin = { .port = SDIR_TX_DATA_PORT, .pin = pin };
+
+		rc = tear_down_sdir_gpio(data_pin);
+		if (rc) {
+			return rc;
+		}
+	}
+
+	sdir_tx_configured = false;
+	return pin_release_reservation(tx_dac_clock_pin.group, tx_dac_clock_pin.pin);
+}
+
+
+/**
+ * Sets up the timers that clock our DAC, and pace the DMA that feeds it.
+ *
+ * TIMER1 toggles MAT0 (our DAC clock) and MAT3 on each match. MAT3 is routed to TIMER2's CAP3
+ * through the GIMA; TIMER2 counts its edges, and requests a DMA transfer once per DAC clock.
+ */
+static void sdir_configure_transmit_clocks(void)
+{
+	timer_disable_counter(TIMER1);
+	timer_disable_counter(TIMER2);
+
+	TIMER1_MCR = TIMER_MCR_MR0R;
+	TIMER1_MR0 = sdir_tx_divisor;
+	TIMER1_MR3 = sdir_tx_divisor;
+	TIMER1_EMR = (TIMER_EMR_EMC_TOGGLE << TIMER_EMR_EMC0_SHIFT) | (TIMER_EMR_EMC_TOGGLE << TIMER_EMR_EMC3_SHIFT);
+	timer_set_prescaler(TIMER1, 0);
+	timer_set_mode(TIMER1, TIMER_CTCR_MODE_TIMER);
+	timer_reset(TIMER1);
+
+	TIMER2_MCR = (TIMER_MCR_MR0I | TIMER_MCR_MR0R);
+	TIMER2_MR0 = 2;
+	TIMER2_CCR = 0;
+	timer_set_prescaler(TIMER2, 0);
+	timer_set_mode(TIMER2, (TIMER_CTCR_MODE_COUNTER_BOTH | TIMER_CTCR_CINSEL_CAPN_3));
+	timer_reset(TIMER2);
+}
+
+
+/**
+ * Starts clocking the DAC; and thus requesting samples from the DMA.
+ */
+static void sdir_start_transmit_clocks(void)
+{
+	timer_reset(TIMER2);
+	timer_reset(TIMER1);
+	timer_enable_counter(TIMER2);
+	timer_enable_counter(TIMER1);
+}
+
+
+static void sdir_stop_transmit_clocks(void)
+{
+	timer_disable_counter(TIMER1);
+	timer_disable_counter(TIMER2);
+}
+
+
+static const gpio_dma_stream_pacer_t sdir_transmit_pacer = {
+	.start = sdir_start_transmit_clocks,
+	.stop  = sdir_stop_transmit_clocks,
+};
+
+
 /**
  * Set up the SDIR API.
  *
@@ -243,9 +426,20 @@ static int terminate_sdir(void)
 	// Ensure our SDIR functionality is no longer running.
 	sgpio_halt(&sdir);
 
+	// Only stop the output stream if it's still ours.
+	if (sdir_transmitting && !gpio_dma_stream_in_use_by_other(&sdir_transmit_pacer)) {
+		gpio_dma_stream_stop();
+	}
+	sdir_transmitting = false;
+
 	// Stop our capture ADC.
 	sdir_power_down_adc();
 
+	rc = sdir_tear_down_transmit_pins();
+	if (rc) {
+		return rc;
+	}
+
 	// Release each of our GPIO pins.
 	for (unsigned i = 0; i < ARRAY_SIZE(gpio_pins); ++i) {
 		rc = tear_down_sdir_gpio(gpio_pins[i]);
@@ -309,6 +503,115 @@ static int verb_dac_register_read(struct command_transaction *trans)
 	return 0;
 }
 
+/**
+ * Filters raw ADC samples captured by SGPIO into decimated 16-bit samples for the host.
+ */
+static int sdir_generate_decimated_samples(void *data, uint32_t *length, void *user_data)
+{
+	sgpio_function_t *capture = &sdir_functions[0];
+	int16_t *output = (int16_t *)((uint8_t *)data + sdir_decimated_fill);
+
+	uint32_t available = capture->data_in_buffer;
+	uint32_t room, to_consume, read_position, consumed = 0, produced = 0;
+	(void)user_data;
+
+	// If we fell far enough behind for SGPIO to lap us, our raw samples are garbage; drop them and resync.
+	if (available > SDIR_RAW_BUFFER_SIZE) {
+		pr_warning("sdir: decimator couldn't keep up with the ADC; dropping %d samples\n", available);
+
+		__asm__ volatile ("cpsid i" ::: "memory");
+		capture->data_in_buffer -= available;
+		__asm__ volatile ("cpsie i" ::: "memory");
+
+		return EAGAIN;
+	}
+
+	// Consume only as much input as we have room to hold the output for.
+	room = (sdir_decimated_block_size - sdir_decimated_fill) / sizeof(int16_t);
+	to_consume = (room * sdir_decimation) - sdir_decimator.phase;
+	if (to_consume > available) {
+		to_consume = available;
+	}
+
+	// Our raw samples live in a ring; so process them in (up to) two contiguous runs.
+	read_position = (capture->position_in_buffer - available) & (SDIR_RAW_BUFFER_SIZE - 1);
+	while (consumed < to_consume) {
+		uint32_t run = to_consume - consumed;
+
+		if (run > SDIR_RAW_BUFFER_SIZE - read_position) {
+			run = SDIR_RAW_BUFFER_SIZE - read_position;
+		}
+
+		produced += cic_decimator_process(&sdir_decimator, &sdir_raw_samples[read_position], run, &output[produced]);
+
+		consumed     += run;
+		read_position = (read_position + run) & (SDIR_RAW_BUFFER_SIZE - 1);
+	}
+
+	// Release the samples we've used back to SGPIO. Its ISR adds to this count, so don't let it interrupt us.
+	__asm__ volatile ("cpsid i" ::: "memory");
+	capture->data_in_buffer -= consumed;
+	__asm__ volatile ("cpsie i" ::: "memory");
+
+	sdir_decimated_fill += produced * sizeof(int16_t);
+
+	// Keep gathering until we have a full block.
+	if (sdir_decimated_fill < sdir_decimated_block_size) {
+		return EAGAIN;
+	}
+
+	*length = sdir_decimated_fill;
+	sdir_decimated_fill = 0;
+	return 0;
+}
+
+
+static int verb_configure_receive(struct command_transaction *trans)
+{
+	int rc;
+	uint32_t decimation      = comms_argument_parse_uint32_t(trans);
+	uint8_t dc_time_constant = comms_argument_parse_uint8_t(trans);
+	uint32_t block_size;
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	// Validate the configuration before we touch anything.
+	rc = cic_decimator_init(&sdir_decimator, decimation, dc_time_constant);
+	if (rc) {
+		return rc;
+	}
+
+	sdir_decimation       = decimation;
+	sdir_dc_time_constant = dc_time_constant;
+
+	// Size our USB blocks to bound latency at low output rates, while keeping them large at high ones.
+	block_size = (SDIR_DEFAULT_FREQUENCY / decimation) * sizeof(int16_t) / (1000 / SDIR_DECIMATED_MAX_LATENCY);
+	block_size -= block_size % SDIR_DECIMATED_MIN_BLOCK;
+
+	if (block_size < SDIR_DECIMATED_MIN_BLOCK) {
+		block_size = SDIR_DECIMATED_MIN_BLOCK;
+	}
+	if (block_size > USB_STREAMING_BUFFER_SIZE) {
+		block_size = USB_STREAMING_BUFFER_SIZE;
+	}
+	sdir_decimated_block_size = block_size;
+
+	comms_response_add_uint32_t(trans, SDIR_DEFAULT_FREQUENCY / decimation);
+	return 0;
+}
+
+
+/**
+ * @return True iff received samples should be filtered on the device, rather than sent raw.
+ */
+static bool sdir_receive_filtered(void)
+{
+	return (sdir_decimation > 1) || sdir_dc_time_constant;
+}
+
+
 static int verb_start_receive(struct command_transaction *trans)
 {
 	int rc;
@@ -321,13 +624,31 @@ static int verb_start_receive(struct command_transaction *trans)
 		return rc;
 	}
 
+	// If we're filtering on-device, capture into our raw ring; otherwise, straight into the USB buffer.
+	if (sdir_receive_filtered()) {
+		sdir_functions[0].buffer       = sdir_raw_samples;
+		sdir_functions[0].buffer_order = SDIR_RAW_BUFFER_ORDER;
+	} else {
+		sdir_functions[0].buffer       = usb_bulk_buffer;
+		sdir_functions[0].buffer_order = 15;
+	}
+
 	rc = sgpio_set_up_functions(&sdir);
 	if (rc) {
 		return rc;
 	}
 
 	// Finally, start the SGPIO streaming for the relevant buffer.
-	usb_streaming_start_streaming_to_host(&sdir_functions[0].position_in_buffer, &sdir_functions[0].data_in_buffer);
+	if (sdir_receive_filtered()) {
+		sdir_functions[0].position_in_buffer = 0;
+		sdir_functions[0].data_in_buffer     = 0;
+		sdir_decimated_fill                  = 0;
+
+		cic_decimator_init(&sdir_decimator, sdir_decimation, sdir_dc_time_constant);
+		usb_streaming_start_generating_for_host(0, sdir_generate_decimated_samples, NULL);
+	} else {
+		usb_streaming_start_streaming_to_host(&sdir_functions[0].position_in_buffer, &sdir_functions[0].data_in_buffer);
+	}
 	sgpio_run(&sdir);
 
 	comms_response_add_uint8_t(trans, USB_STREAMING_IN_ADDRESS);
@@ -335,19 +656,131 @@ static int verb_start_receive(struct command_transaction *trans)
 }
 
 
+static int verb_configure_transmit(struct command_transaction *trans)
+{
+	int rc;
+	uint32_t sample_rate = comms_argument_parse_uint32_t(trans);
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	if (!sample_rate || (sample_rate > SDIR_TX_TIMER_CLOCK / 2)) {
+		return EINVAL;
+	}
+
+	if (sdir_transmitting && gpio_dma_stream_running()) {
+		return EBUSY;
+	}
+
+	// Ensure that we can use SDIR functionality.
+	if (!sdir_initialized) {
+		rc = initialize_sdir();
+		if (rc) {
+			pr_error("sdir: couldn't initialize SDIR! (%d)\n", rc);
+			return rc;
+		}
+	}
+
+	if (!sdir_tx_configured) {
+		rc = sdir_set_up_transmit_pins();
+		if (rc) {
+			return rc;
+		}
+	}
+
+	sdir_tx_divisor = ((SDIR_TX_TIMER_CLOCK / 2) / sample_rate) - 1;
+
+	comms_response_add_uint32_t(trans, (SDIR_TX_TIMER_CLOCK / 2) / (sdir_tx_divisor + 1));
+	return 0;
+}
+
+
+static int verb_start_transmit(struct command_transaction *trans)
+{
+	int rc;
+	uint32_t length = comms_argument_parse_uint32_t(trans);
+	void *dac_data = (uint8_t *)&GPIO_LPC_PORT(SDIR_TX_DATA_PORT)->mpin;
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	if (!sdir_tx_configured) {
+		pr_error("sdir: transmit must be configured before streaming\n");
+		return EINVAL;
+	}
+
+	// If another class is streaming out over the DMA, its timers are in use; leave them be.
+	if (gpio_dma_stream_in_use_by_other(&sdir_transmit_pacer)) {
+		return EBUSY;
+	}
+
+	// Our timers may have been borrowed by another class since we were configured; so set them up anew.
+	sdir_configure_transmit_clocks();
+
+	rc = gpio_dma_stream_start(dac_data, SDIR_TX_DATA_WIDTH / 8, length, &sdir_transmit_pacer);
+	if (rc) {
+		return rc;
+	}
+
+	sdir_transmitting = true;
+	comms_response_add_uint8_t(trans, USB_STREAMING_OUT_ADDRESS);
+	return 0;
+}
+
+
+static int verb_get_transmit_status(struct command_transaction *trans)
+{
+	bool complete;
+	uint32_t bytes_played, underruns;
+
+	if (!sdir_transmitting) {
+		return EINVAL;
+	}
+
+	int rc = gpio_dma_stream_status(&complete, &bytes_played, &underruns);
+	if (rc) {
+		return rc;
+	}
+
+	comms_response_add_uint8_t(trans, complete);
+	comms_response_add_uint32_t(trans, bytes_played);
+	comms_response_add_uint32_t(trans, underruns);
+	return 0;
+}
+
+
 static int verb_stop(struct command_transaction *trans)
 {
 	(void)trans;
 
 	// Halt transmission / receipt.
 	usb_streaming_stop_streaming_to_host();
+	usb_streaming_stop_generating_for_host();
 	return terminate_sdir();
 }
 
 
 static struct comms_verb _verbs[] = {
+		{  .name = "configure_receive", .handler = verb_configure_receive, .in_signature = "<IB",
+		   .out_signature = "<I", .in_param_names = "decimation, dc_time_constant", .out_param_names = "output_sample_rate",
+		   .doc = "Configures on-device filtering of received samples.\n"
+				"\n"
+				"With a decimation of 1 and a time constant of 0, raw 8-bit ADC samples are streamed.\n"
+				"Otherwise, samples are decimated by a CIC filter, and sent as signed 16-bit values;\n"
+				"a non-zero time constant (log2 of output samples) also removes any DC offset." },
 		{  .name = "start_receive", .handler = verb_start_receive, .in_signature = "", .out_signature = "<B",
 			.out_param_names = "pipe_id", .doc = "Start receipt of SDIR data on the primary bulk comms pipe." },
+		{  .name = "configure_transmit", .handler = verb_configure_transmit, .in_signature = "<I",
+		   .out_signature = "<I", .in_param_names = "sample_rate", .out_param_names = "actual_sample_rate",
+		   .doc = "Sets up the transmit DAC; returns the closest achievable sample rate." },
+		{  .name = "start_transmit", .handler = verb_start_transmit, .in_signature = "<I", .out_signature = "<B",
+		   .in_param_names = "length", .out_param_names = "pipe_id",
+		   .doc = "Scans out DAC samples streamed to the given bulk pipe; or until stopped, if length is zero." },
+		{  .name = "get_transmit_status", .handler = verb_get_transmit_status, .in_signature = "",
+		   .out_signature = "<?II", .out_param_names = "complete, bytes_played, underruns",
+		   .doc = "Reports the progress of the active transmission, including how often the host fell behind." },
 		{  .name = "stop", .handler = verb_stop, .in_signature = "", .out_signature = "",
            .doc = "Halt SDIR communications; termianting any active communications" },
 
@@ -16,6 +16,8 @@
 #include <drivers/scu.h>
 #include <drivers/comms.h>
 
+#include "../usb_streaming.h"
+
 #define CLASS_NUMBER_SELF (0x109)
 
 // Forward declarations.
@@ -122,6 +124,96 @@ static int spi_verb_clock_data(struct command_transaction *trans)
 }
 
 
+/**
+ * @return The size of each SPI frame, in bytes, for the bus's current data size.
+ */
+static uint32_t spi_bytes_per_word(void)
+{
+	const bool word_size_u16 = (SSP_CR0(spi1_target.bus->obj) & 0xf) > SSP_DATA_8BITS;
+	return word_size_u16 ? 2 : 1;
+}
+
+
+/**
+ * Clocks each block of data received from the host out onto the bus, discarding anything received.
+ */
+static int spi_transmit_data_from_host(void *data, uint32_t length, void *user_data)
+{
+	(void)user_data;
+
+	// The SSP driver counts in frames rather than bytes.
+	spi_bus_transmit_data(&spi1_target, data, length / spi_bytes_per_word());
+	return 0;
+}
+
+
+static int spi_verb_stream_data_out(struct command_transaction *trans)
+{
+	uint32_t length = comms_argument_parse_uint32_t(trans);
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	if (!length) {
+		return EINVAL;
+	}
+
+	usb_streaming_start_streaming_from_host(length, spi_transmit_data_from_host, NULL);
+	comms_response_add_uint8_t(trans, USB_STREAMING_OUT_ADDRESS);
+
+	return 0;
+}
+
+
+static int spi_verb_stream_status(struct command_transaction *trans)
+{
+	uint32_t bytes_transmitted;
+	int status = usb_streaming_from_host_status(&bytes_transmitted);
+
+	// If the stream failed, report the failure directly.
+	if (status && (status != EINPROGRESS)) {
+		return status;
+	}
+
+	comms_response_add_uint8_t(trans, status != EINPROGRESS);
+	comms_response_add_uint32_t(trans, bytes_transmitted);
+	return 0;
+}
+
+
+/**
+ * Fills each buffer to be sent to the host with data read from the bus.
+ */
+static int spi_receive_data_for_host(void *data, uint32_t *length, void *user_data)
+{
+	uint8_t fill = (uint32_t)user_data;
+
+	spi_bus_receive_data(&spi1_target, data, *length / spi_bytes_per_word(), fill);
+	return 0;
+}
+
+
+static int spi_verb_stream_data_in(struct command_transaction *trans)
+{
+	uint32_t length = comms_argument_parse_uint32_t(trans);
+	uint8_t  fill   = comms_argument_parse_uint8_t(trans);
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	if (!length) {
+		return EINVAL;
+	}
+
+	usb_streaming_start_generating_for_host(length, spi_receive_data_for_host, (void *)(uint32_t)fill);
+	comms_response_add_uint8_t(trans, USB_STREAMING_IN_ADDRESS);
+
+	return 0;
+}
+
+
 static int spi_verb_enable_drive(struct command_transaction *trans)
 {
 	bool enable_drive = comms_argument_parse_uint8_t(trans);
@@ -183,6 +275,26 @@ static struct comms_verb _verbs[] = {
 			.in_param_names = "read_length, data", .out_param_names = "response",
 			.doc = "Clock data out and in; but don't change the chip select." },
 
+		// Bulk transmit.
+		{ .name = "stream_data_out", .handler = spi_verb_stream_data_out,
+			.in_signature = "<I", .out_signature = "<B",
+			.in_param_names = "length", .out_param_names = "pipe_id",
+			.doc =
+				"Clocks data streamed to the given bulk pipe out onto the bus, discarding any data received.\n"
+				"\n"
+				"Doesn't change the chip select; so large transfers can be framed by the host." },
+		{ .name = "stream_data_in", .handler = spi_verb_stream_data_in,
+			.in_signature = "<IB", .out_signature = "<B",
+			.in_param_names = "length, fill", .out_param_names = "pipe_id",
+			.doc =
+				"Clocks the fill byte out onto the bus, and streams the data received to the given bulk pipe.\n"
+				"\n"
+				"Doesn't change the chip select; so large transfers can be framed by the host." },
+		{ .name = "stream_status", .handler = spi_verb_stream_status,
+			.in_signature = "", .out_signature = "<?I",
+			.out_param_names = "complete, bytes_transmitted",
+			.doc = "Reports the progress of a bulk transmit, or fails if the transmit failed." },
+
 		// Advanced control.
 		{ .name = "enable_drive", .handler = spi_verb_clock_data,
 			.in_signature = "<?", .out_signature = "", .in_param_names = "enable_drive",
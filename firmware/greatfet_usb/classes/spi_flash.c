@@ -54,6 +54,7 @@ static spiflash_driver_t spi_flash_drv = {
 static int spi_flash_verb_initialize(struct command_transaction *trans)
 {
     uint8_t cs_port, cs_pin;
+    int rc;
 
 	// FIXME: allow use of other GPIO ports, where possible, for hold/WP
     spi_flash_drv.page_len  = comms_argument_parse_uint32_t(trans);
@@ -69,7 +70,15 @@ static int spi_flash_verb_initialize(struct command_transaction *trans)
     GPIO_SET(gpio_spiflash_select, cs_port, cs_pin);
 
     spi_bus_start(spi_flash_drv.target, &ssp_config_spi);
-    return spiflash_setup(&spi_flash_drv);
+
+    rc = spiflash_setup(&spi_flash_drv);
+    if (rc) {
+        return rc;
+    }
+
+    // Figure out which erase granularities this flash supports; falling back to the common ones.
+    spiflash_read_erase_types(&spi_flash_drv);
+    return 0;
 }
 
 
@@ -84,6 +93,44 @@ static int spi_flash_verb_full_erase(struct command_transaction *trans)
 }
 
 
+/**
+ * Command to erase a single block of the flash chip; e.g. a 4K sector, or a 32K or 64K block.
+ * Returns once the erase has started; later commands wait for it to complete.
+ */
+static int spi_flash_verb_erase_block(struct command_transaction *trans)
+{
+	uint32_t address = comms_argument_parse_uint32_t(trans);
+	uint32_t length  = comms_argument_parse_uint32_t(trans);
+	int rc;
+
+	if (!comms_transaction_okay(trans)) {
+		return EINVAL;
+	}
+
+	rc = spiflash_erase_block(&spi_flash_drv, address, length);
+	if (rc) {
+		pr_warning("spi_flash: rejecting erase of unsupported block (%d bytes at %08x)\n", length, address);
+	}
+
+	return rc;
+}
+
+
+/**
+ * Command to list the block sizes that erase_block accepts.
+ */
+static int spi_flash_verb_query_erase_sizes(struct command_transaction *trans)
+{
+	for (unsigned i = 0; i < SPIFLASH_MAX_ERASE_TYPES; ++i) {
+		if (spi_flash_drv.erase_types[i].size) {
+			comms_response_add_uint32_t(trans, spi_flash_drv.erase_types[i].size);
+		}
+	}
+
+	return 0;
+}
+
+
 /*?*
  * Command to write a page to the relevant flash chip.
  */
@@ -230,11 +277,15 @@ static struct comms_verb spi_flash_verbs[] = {
             .doc = "Sets up the board to program an external SPI flash." },
 		{ .name = "full_erase", .handler = spi_flash_verb_full_erase,
             .in_signature = "", .out_signature	= "", .doc = "Erases the entire spi_flash flash chip." },
-        /* TODO: implement
-		{ .verb_number = 0x2, .name = "page_erase", .handler = spi_flash_verb_erase_page,
-            .in_signature = "<I", .out_signature = "", .in_param_names = "address",
-            .doc = "Erases the page with the provided address on the fw flash." },
-        */
+		{ .name = "erase_block", .handler = spi_flash_verb_erase_block,
+            .in_signature = "<II", .out_signature = "", .in_param_names = "address, length",
+            .doc =
+				"Erases the block of the given length at the given address; which must be aligned to its length.\n\n"
+				"The length must be one of the sizes returned by query_erase_sizes."
+		},
+		{ .name = "query_erase_sizes", .handler = spi_flash_verb_query_erase_sizes,
+            .in_signature = "", .out_signature = "<*I", .out_param_names = "sizes",
+            .doc = "Returns the block sizes the target flash can erase; read via SFDP where supported." },
 		{ .name = "write_page", .handler = spi_flash_verb_write_page,
             .in_signature = "<I*X", .out_signature = "", .in_param_names = "address, data",
             .doc = "Writes the provided data to a single spi_flash flash page." },
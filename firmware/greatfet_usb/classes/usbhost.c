@@ -0,0 +1,539 @@
+/*
+ * This file is part of GreatFET
+ *
+ * USB host API: lets the host queue several transfers per endpoint on the GreatFET's USB1 port,
+ * and reports their completions -- along with any data read -- over a bulk event pipe.
+ */
+
+#include <drivers/comms.h>
+#include <debug.h>
+
+#include <stddef.h>
+#include <errno.h>
+#include <string.h>
+
+#include <greatfet_core.h>
+
+#include <drivers/usb/usb.h>
+#include <drivers/usb/usb_type.h>
+#include <drivers/usb/usb_host.h>
+#include <drivers/usb/usb_queue_host.h>
+#include <drivers/usb/usb_registers.h>
+
+#include <libopencm3/lpc43xx/m4/nvic.h>
+
+#include "../usb_streaming.h"
+
+#define CLASS_NUMBER_SELF (0x11B)
+
+enum {
+	// The number of transfers that can be outstanding at once, across all endpoints. Must be a power of two.
+	USBHOST_MAX_TRANSFERS = 8,
+
+	// The largest single transfer we'll queue. Our buffers are aligned to their size, so none crosses
+	// a 4K page; which keeps each one within a single qTD buffer page.
+	USBHOST_MAX_TRANSFER_SIZE = 2048,
+
+	// The size of a bulk packet on our event pipe; see usbhost_generate_events.
+	USBHOST_MAX_PACKET_SIZE = 512,
+
+	// Tag used for the padding events we insert to terminate a transfer.
+	USBHOST_PADDING_TAG = 0xFFFF,
+};
+
+
+/**
+ * The outcome of a queued transfer.
+ */
+typedef enum {
+	USBHOST_TRANSFER_OK      = 0,
+	USBHOST_TRANSFER_STALLED = 1,
+	USBHOST_TRANSFER_ERROR   = 2,
+
+	// Retired by flush_endpoint before it completed.
+	USBHOST_TRANSFER_CANCELLED = 3,
+
+	// Not a transfer at all; only present to end a bulk transfer with a short packet.
+	USBHOST_TRANSFER_PADDING = 0xFF,
+} usbhost_transfer_status_t;
+
+
+/**
+ * Endpoint transfer types, as encoded in an endpoint descriptor's bmAttributes.
+ */
+typedef enum {
+	USBHOST_ENDPOINT_CONTROL     = 0,
+	USBHOST_ENDPOINT_ISOCHRONOUS = 1,
+	USBHOST_ENDPOINT_BULK        = 2,
+	USBHOST_ENDPOINT_INTERRUPT   = 3,
+} usbhost_endpoint_type_t;
+
+
+/**
+ * Header for each completion event on our event pipe. For completed IN transfers, the data read
+ * follows the header, padded to a multiple of four bytes.
+ */
+typedef struct __attribute__((packed)) {
+	uint16_t tag;
+	uint8_t endpoint;
+	uint8_t status;
+	uint32_t length;
+} usbhost_event_t;
+
+
+/**
+ * State for each of our transfer slots.
+ */
+typedef struct {
+
+	// The host's identifier for this transfer, which we echo back in its completion event.
+	uint16_t tag;
+	uint8_t endpoint;
+
+	// The endpoint address the transfer was queued on; which identifies its queue head.
+	uint8_t queue_address;
+
+	// True iff this slot holds a transfer that hasn't been reported to the host yet.
+	bool in_use;
+
+	// True once the transfer has completed (or been cancelled), and is waiting to be reported.
+	volatile bool completed;
+
+	// Incremented each time a transfer is cancelled; so a completion that arrives for a cancelled
+	// transfer after its slot has been reused is ignored.
+	uint8_t generation;
+
+	// Filled in by our completion callback.
+	uint32_t transferred;
+	uint8_t status;
+
+} usbhost_transfer_t;
+
+
+static usbhost_transfer_t transfers[USBHOST_MAX_TRANSFERS];
+static uint8_t __attribute__((aligned(USBHOST_MAX_TRANSFER_SIZE)))
+	transfer_buffers[USBHOST_MAX_TRANSFERS][USBHOST_MAX_TRANSFER_SIZE];
+
+// Completed transfers, in the order they completed; filled from interrupt context and drained
+// by our event generator. The counts are free-running.
+static uint8_t completion_ring[USBHOST_MAX_TRANSFERS];
+static volatile uint32_t completions_added;
+static uint32_t completions_reported;
+
+/**
+ * The configuration of an endpoint's queue, as given to set_up_endpoint; kept so the queue can be
+ * set up afresh when it's flushed.
+ */
+typedef struct {
+	uint8_t device_address;
+	uint8_t speed;
+	bool is_control_endpoint;
+	bool handle_data_toggle;
+	uint16_t max_packet_size;
+} usbhost_endpoint_config_t;
+
+// The currently active queue heads for each endpoint, and their configurations.
+static volatile ehci_queue_head_t *endpoint_out_qh[NUM_USB1_ENDPOINTS];
+static volatile ehci_queue_head_t *endpoint_in_qh[NUM_USB1_ENDPOINTS];
+static usbhost_endpoint_config_t endpoint_out_config[NUM_USB1_ENDPOINTS];
+static usbhost_endpoint_config_t endpoint_in_config[NUM_USB1_ENDPOINTS];
+
+// True once we've set up the USB host stack's QH/qTD pools, which only needs doing once.
+static bool storage_pools_initialized;
+
+
+static volatile ehci_queue_head_t **usbhost_queue_head_slot(uint8_t endpoint_address)
+{
+	uint8_t number = endpoint_address & 0x7F;
+
+	if (number >= NUM_USB1_ENDPOINTS) {
+		return NULL;
+	}
+
+	return (endpoint_address & 0x80) ? &endpoint_in_qh[number] : &endpoint_out_qh[number];
+}
+
+
+static usbhost_endpoint_config_t *usbhost_endpoint_config(uint8_t endpoint_address)
+{
+	uint8_t number = endpoint_address & 0x7F;
+	return (endpoint_address & 0x80) ? &endpoint_in_config[number] : &endpoint_out_config[number];
+}
+
+
+/**
+ * Hands a finished transfer to our event generator. Must be called from interrupt context, or with
+ * the USB1 interrupt disabled.
+ */
+static void usbhost_report_completion(uint32_t slot)
+{
+	transfers[slot].completed = true;
+
+	// We only ever have as many transfers in flight as the ring has entries; so it can't overflow.
+	completion_ring[completions_added % USBHOST_MAX_TRANSFERS] = slot;
+	completions_added++;
+}
+
+
+/**
+ * Callback executed, in interrupt context, each time a queued transfer completes.
+ */
+static void usbhost_transfer_complete(void * const user_data, unsigned int transferred, bool stalled, bool error)
+{
+	uint32_t slot       = (uintptr_t)user_data & 0xFF;
+	uint8_t  generation = (uintptr_t)user_data >> 8;
+	usbhost_transfer_t *transfer = &transfers[slot];
+
+	// Ignore completions for transfers that have already been cancelled.
+	if (!transfer->in_use || transfer->completed || (transfer->generation != generation)) {
+		return;
+	}
+
+	transfer->transferred = transferred;
+
+	if (stalled) {
+		transfer->status = USBHOST_TRANSFER_STALLED;
+	} else if (error) {
+		transfer->status = USBHOST_TRANSFER_ERROR;
+	} else {
+		transfer->status = USBHOST_TRANSFER_OK;
+	}
+
+	usbhost_report_completion(slot);
+}
+
+
+/**
+ * @return The number of bytes an event for the given transfer occupies on our event pipe.
+ */
+static uint32_t usbhost_event_size(usbhost_transfer_t *transfer)
+{
+	uint32_t data_length = (transfer->endpoint & 0x80) ? transfer->transferred : 0;
+	return sizeof(usbhost_event_t) + ((data_length + 3) & ~3UL);
+}
+
+
+/**
+ * Moves completion events into the USB streaming buffers.
+ */
+static int usbhost_generate_events(void *data, uint32_t *length, void *user_data)
+{
+	uint8_t *buffer = data;
+	uint32_t position = 0;
+	(void)user_data;
+
+	while (completions_reported != completions_added) {
+		uint32_t slot = completion_ring[completions_reported % USBHOST_MAX_TRANSFERS];
+		usbhost_transfer_t *transfer = &transfers[slot];
+		uint32_t event_size = usbhost_event_size(transfer);
+		usbhost_event_t event = {
+			.tag      = transfer->tag,
+			.endpoint = transfer->endpoint,
+			.status   = transfer->status,
+			.length   = transfer->transferred,
+		};
+
+		// Always leave room to add a padding event, in case we need to end our transfer with a short packet.
+		if ((position + event_size + sizeof(usbhost_event_t)) > *length) {
+			break;
+		}
+
+		memcpy(&buffer[position], &event, sizeof(event));
+		if (transfer->endpoint & 0x80) {
+			memcpy(&buffer[position + sizeof(event)], transfer_buffers[slot], transfer->transferred);
+		}
+
+		position += event_size;
+		completions_reported++;
+		transfer->in_use = false;
+	}
+
+	if (!position) {
+		return EAGAIN;
+	}
+
+	// A transfer that's a whole number of packets doesn't end with a short packet; so the host would
+	// keep waiting for more data. Pad it out with an event the host will skip.
+	if (!(position % USBHOST_MAX_PACKET_SIZE)) {
+		usbhost_event_t padding = { .tag = USBHOST_PADDING_TAG, .status = USBHOST_TRANSFER_PADDING };
+
+		memcpy(&buffer[position], &padding, sizeof(padding));
+		position += sizeof(padding);
+	}
+
+	*length = position;
+	return 0;
+}
+
+
+/**
+ * Sets up the GreatFET to act as a USB host, including providing VBUS on USB1;
+ * and starts our event pipe.
+ */
+static int usbhost_verb_connect(struct command_transaction *trans)
+{
+	usb_streaming_stop_generating_for_host();
+
+	for (int i = 0; i < NUM_USB1_ENDPOINTS; ++i) {
+		endpoint_in_qh[i] = NULL;
+		endpoint_out_qh[i] = NULL;
+	}
+
+	memset(transfers, 0, sizeof(transfers));
+	completions_added    = 0;
+	completions_reported = 0;
+
+	if (!storage_pools_initialized) {
+		usb_host_initialize_storage_pools();
+		storage_pools_initialized = true;
+	}
+
+	// Set up the controller in host mode...
+	usb_controller_reset(&usb_peripherals[1]);
+	usb_host_init(&usb_peripherals[1]);
+
+	// ... provide VBUS to the target...
+	usb_provide_vbus(&usb_peripherals[1]);
+
+	// ... and start the controller; from here, transfer completion interrupts can occur.
+	usb_run(&usb_peripherals[1]);
+
+	usb_streaming_start_generating_for_host(0, usbhost_generate_events, NULL);
+	comms_response_add_uint8_t(trans, USB_STREAMING_IN_ADDRESS);
+	return 0;
+}
+
+
+static int usbhost_verb_disconnect(struct command_transaction *trans)
+{
+	(void)trans;
+
+	usb_streaming_stop_generating_for_host();
+	usb_controller_reset(&usb_peripherals[1]);
+
+	return 0;
+}
+
+
+static int usbhost_verb_bus_reset(struct command_transaction *trans)
+{
+	(void)trans;
+
+	usb_host_reset_device(&usb_peripherals[1]);
+	return 0;
+}
+
+
+static int usbhost_verb_get_port_status(struct command_transaction *trans)
+{
+	comms_response_add_uint32_t(trans, USB_REG(usb_peripherals[1].controller)->PORTSC1);
+	return 0;
+}
+
+
+static int usbhost_verb_set_up_endpoint(struct command_transaction *trans)
+{
+	volatile ehci_queue_head_t **qh;
+
+	uint8_t endpoint_address    = comms_argument_parse_uint8_t(trans);
+	uint8_t device_address      = comms_argument_parse_uint8_t(trans);
+	uint8_t speed               = comms_argument_parse_uint8_t(trans);
+	uint8_t transfer_type       = comms_argument_parse_uint8_t(trans);
+	bool handle_data_toggle     = comms_argument_parse_bool(trans);
+	uint16_t max_packet_size    = comms_argument_parse_uint16_t(trans);
+
+	bool is_control_endpoint = (transfer_type == USBHOST_ENDPOINT_CONTROL);
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	// We only drive the asynchronous schedule; interrupt and isochronous endpoints would need the periodic one.
+	if (!is_control_endpoint && (transfer_type != USBHOST_ENDPOINT_BULK)) {
+		return EINVAL;
+	}
+
+	qh = usbhost_queue_head_slot(endpoint_address);
+	if (!qh) {
+		return EINVAL;
+	}
+
+	*usbhost_endpoint_config(endpoint_address) = (usbhost_endpoint_config_t){
+		.device_address      = device_address,
+		.speed               = speed,
+		.is_control_endpoint = is_control_endpoint,
+		.handle_data_toggle  = handle_data_toggle,
+		.max_packet_size     = max_packet_size,
+	};
+
+	// If we already have a queue head for this endpoint, it's updated in place.
+	*qh = usb_host_set_up_asynchronous_endpoint_queue(&usb_peripherals[1], *qh, device_address,
+			endpoint_address & 0x7F, speed, is_control_endpoint, handle_data_toggle, max_packet_size);
+
+	return 0;
+}
+
+
+/**
+ * Cancels every transfer still pending on an endpoint, and clears any halt; e.g. after a stall,
+ * which leaves the transfers queued behind the stalled one stuck.
+ */
+static int usbhost_verb_flush_endpoint(struct command_transaction *trans)
+{
+	volatile ehci_queue_head_t **qh;
+	usbhost_endpoint_config_t *config;
+	uint8_t endpoint_address = comms_argument_parse_uint8_t(trans);
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	qh = usbhost_queue_head_slot(endpoint_address);
+	if (!qh || !*qh) {
+		return EINVAL;
+	}
+
+	// Keep completions from racing with our cancellations.
+	nvic_disable_irq(NVIC_USB1_IRQ);
+
+	// Retire each pending transfer; the host sees a cancelled completion for each.
+	for (uint32_t slot = 0; slot < USBHOST_MAX_TRANSFERS; ++slot) {
+		usbhost_transfer_t *transfer = &transfers[slot];
+
+		if (!transfer->in_use || transfer->completed || (transfer->queue_address != endpoint_address)) {
+			continue;
+		}
+
+		transfer->generation++;
+		transfer->transferred = 0;
+		transfer->status      = USBHOST_TRANSFER_CANCELLED;
+		usbhost_report_completion(slot);
+	}
+
+	// Set the queue head up afresh; which drops its transfer descriptors, and clears its halted state.
+	config = usbhost_endpoint_config(endpoint_address);
+	*qh = usb_host_set_up_asynchronous_endpoint_queue(&usb_peripherals[1], *qh, config->device_address,
+			endpoint_address & 0x7F, config->speed, config->is_control_endpoint, config->handle_data_toggle,
+			config->max_packet_size);
+
+	nvic_enable_irq(NVIC_USB1_IRQ);
+	return 0;
+}
+
+
+/**
+ * Queues a transfer on an endpoint. Its completion is reported on the event pipe.
+ */
+static int usbhost_verb_queue_transfer(struct command_transaction *trans)
+{
+	volatile ehci_queue_head_t **qh;
+	uint32_t data_length = 0;
+	uint32_t slot;
+	void *data;
+
+	uint8_t endpoint_address = comms_argument_parse_uint8_t(trans);
+	uint8_t pid_token        = comms_argument_parse_uint8_t(trans);
+	uint8_t data_toggle      = comms_argument_parse_uint8_t(trans);
+	uint16_t tag             = comms_argument_parse_uint16_t(trans);
+	uint32_t length          = comms_argument_parse_uint32_t(trans);
+
+	// OUT and SETUP transfers carry their data with them.
+	data = comms_argument_read_buffer(trans, -1, &data_length);
+
+	if (!comms_transaction_okay(trans)) {
+		return EBADMSG;
+	}
+
+	qh = usbhost_queue_head_slot(endpoint_address);
+	if (!qh || !*qh) {
+		pr_warning("usbhost: can't queue a transfer on unconfigured endpoint %02x\n", endpoint_address);
+		return EINVAL;
+	}
+
+	if (pid_token != USB_PID_TOKEN_IN) {
+		length = data_length;
+	}
+	if (length > USBHOST_MAX_TRANSFER_SIZE) {
+		return EMSGSIZE;
+	}
+
+	// Find a free transfer slot; if we have none, the host needs to wait for some completions.
+	for (slot = 0; slot < USBHOST_MAX_TRANSFERS; ++slot) {
+		if (!transfers[slot].in_use) {
+			break;
+		}
+	}
+	if (slot == USBHOST_MAX_TRANSFERS) {
+		return EBUSY;
+	}
+
+	// Events report the direction of each transfer in their endpoint address; which matters for
+	// control endpoints, whose transfers go both ways.
+	transfers[slot].endpoint    = (pid_token == USB_PID_TOKEN_IN) ? (endpoint_address | 0x80) : (endpoint_address & 0x7F);
+	transfers[slot].queue_address = endpoint_address;
+	transfers[slot].tag           = tag;
+	transfers[slot].transferred   = 0;
+	transfers[slot].completed     = false;
+	transfers[slot].in_use        = true;
+
+	if (data_length && data) {
+		memcpy(transfer_buffers[slot], data, data_length);
+	}
+
+	usb_host_transfer_schedule(&usb_peripherals[1], *qh, pid_token, data_toggle,
+			transfer_buffers[slot], length, usbhost_transfer_complete,
+			(void *)(uintptr_t)(slot | (transfers[slot].generation << 8)));
+
+	return 0;
+}
+
+
+static struct comms_verb _verbs[] = {
+		{ .name = "connect", .handler = usbhost_verb_connect,
+			.in_signature = "", .out_signature = "<B",
+			.out_param_names = "pipe_id",
+			.doc =
+				"Puts USB1 into host mode, provides VBUS, and starts reporting transfer completions on the given bulk pipe.\n"
+				"\n"
+				"Each completion is an eight-byte header -- a 16-bit tag, the endpoint address, a status (0 = OK,\n"
+				"1 = stalled, 2 = error, 3 = cancelled, 255 = padding to be skipped), and a 32-bit length -- followed, for IN\n"
+				"transfers, by the data read; padded to a multiple of four bytes." },
+		{ .name = "disconnect", .handler = usbhost_verb_disconnect,
+			.in_signature = "", .out_signature = "",
+			.doc = "Stops host mode, and the event pipe." },
+		{ .name = "bus_reset", .handler = usbhost_verb_bus_reset,
+			.in_signature = "", .out_signature = "",
+			.doc = "Issues a bus reset to the attached device." },
+		{ .name = "get_port_status", .handler = usbhost_verb_get_port_status,
+			.in_signature = "", .out_signature = "<I",
+			.out_param_names = "portsc1",
+			.doc = "Returns the raw value of the host port's PORTSC1 register." },
+		{ .name = "set_up_endpoint", .handler = usbhost_verb_set_up_endpoint,
+			.in_signature = "<BBBB?H", .out_signature = "",
+			.in_param_names = "endpoint_address, device_address, speed, transfer_type, handle_data_toggle, max_packet_size",
+			.doc =
+				"Sets up (or updates) the queue for a device endpoint. Control endpoints use a single queue, at address 0.\n"
+				"\n"
+				"transfer_type is encoded as in an endpoint descriptor. Only control (0) and bulk (2) endpoints\n"
+				"are supported, as they're served by the asynchronous schedule; others fail with EINVAL.\n"
+				"\n"
+				"If handle_data_toggle is set, the controller tracks data toggles itself; which is required to\n"
+				"queue more than one transfer at a time on the endpoint." },
+		{ .name = "flush_endpoint", .handler = usbhost_verb_flush_endpoint,
+			.in_signature = "<B", .out_signature = "",
+			.in_param_names = "endpoint_address",
+			.doc =
+				"Cancels every transfer still queued on an endpoint, and clears its halt; for recovering from a stall or error.\n"
+				"Each cancelled transfer is reported on the event pipe, with status 3." },
+		{ .name = "queue_transfer", .handler = usbhost_verb_queue_transfer,
+			.in_signature = "<BBBHI*X", .out_signature = "",
+			.in_param_names = "endpoint_address, pid_token, data_toggle, tag, length, data",
+			.doc =
+				"Queues a single transfer of up to 2048 bytes, whose completion is reported with the given tag.\n"
+				"\n"
+				"For IN transfers, length is the most data to read; for OUT and SETUP, the data is sent and length\n"
+				"is ignored. Fails with EBUSY if eight transfers are already outstanding." },
+		{} // Sentinel
+};
+COMMS_DEFINE_SIMPLE_CLASS(usbhost, CLASS_NUMBER_SELF, "usbhost", _verbs,
+		"Acts as a USB host on USB1, with queued transfers and a bulk completion pipe.");
@@ -0,0 +1,353 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Streams samples from the host out to a GPIO port, using the GPIO DMA channel.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stddef.h>
+
+#include <drivers/arm_vectors.h>
+#include <libopencm3/lpc43xx/m4/nvic.h>
+
+#include <gpdma.h>
+#include <gpio_dma.h>
+
+#include "gpio_dma_stream.h"
+#include "usb_streaming.h"
+
+enum {
+	// Our samples are played from a ring of segments; each of which is refilled from the host
+	// as soon as the DMA engine has finished playing it.
+	GPIO_DMA_STREAM_SEGMENT_SIZE  = 0x1000,
+	GPIO_DMA_STREAM_SEGMENT_COUNT = 4,
+};
+
+
+/**
+ * State for our output stream.
+ */
+typedef struct {
+
+	const gpio_dma_stream_pacer_t *pacer;
+	uint8_t bytes_per_sample;
+
+	// Segments are filled, in order, from the main loop; and played, in order, by the DMA.
+	// The counts are free-running; the segment index is the count modulo the ring size.
+	uint32_t segments_filled;
+	volatile uint32_t segments_played;
+
+	// How far we are into filling the current segment, and into the host's current block.
+	uint32_t segment_fill;
+	uint32_t block_offset;
+
+	// The total data we'll receive from the host, and how much is left; or 0 if we're streaming until stopped.
+	bool limited_length;
+	uint32_t length;
+	uint32_t bytes_remaining;
+
+	// True iff the DMA engine is currently scanning out samples.
+	volatile bool running;
+
+	// True from when a stream is started until it's stopped; the pacer identifies whose stream it is.
+	bool active;
+
+	// The number of times the DMA engine has run out of samples mid-stream.
+	volatile uint32_t underruns;
+
+} gpio_dma_stream_t;
+
+static gpio_dma_stream_t stream;
+
+static uint8_t __attribute__((aligned(4))) sample_ring[GPIO_DMA_STREAM_SEGMENT_SIZE * GPIO_DMA_STREAM_SEGMENT_COUNT];
+
+// One descriptor per segment. Only filled segments are ever chained together; the last one filled always
+// ends the chain, so once the DMA runs out of samples it stops, rather than replaying stale ones.
+static gpdma_lli_t sample_lli[GPIO_DMA_STREAM_SEGMENT_COUNT];
+
+
+/**
+ * @return True iff there's a segment in our ring that's not waiting to be played.
+ */
+static bool segment_available(void)
+{
+	return (stream.segments_filled - stream.segments_played) < GPIO_DMA_STREAM_SEGMENT_COUNT;
+}
+
+
+/**
+ * @return True iff every sample the host will send us has been queued for the DMA.
+ */
+static bool all_data_queued(void)
+{
+	return stream.limited_length && !stream.bytes_remaining && !stream.segment_fill;
+}
+
+
+static void gpio_dma_stream_halt(void)
+{
+	if (stream.pacer) {
+		stream.pacer->stop();
+	}
+
+	gpio_dma_stop();
+	stream.running = false;
+}
+
+
+/**
+ * Interrupt handler for the DMA; called each time the DMA finishes playing a segment.
+ */
+static void gpio_dma_stream_isr(void)
+{
+	if (gpio_dma_irq_is_error()) {
+		gpio_dma_irq_err_clear();
+		gpio_dma_stream_halt();
+		stream.underruns++;
+		return;
+	}
+
+	gpio_dma_irq_tc_acknowledge();
+	stream.segments_played++;
+
+	// If the DMA engine is still running, it's been chained on to the next filled segment.
+	if (gpio_dma_is_running()) {
+		return;
+	}
+
+	// Otherwise, it's reached the end of its chain. If a segment was filled too late to be chained on,
+	// pick it up directly.
+	if (stream.segments_played < stream.segments_filled) {
+		gpio_dma_tx_start(&sample_lli[stream.segments_played % GPIO_DMA_STREAM_SEGMENT_COUNT]);
+		return;
+	}
+
+	// We've caught up with the main loop; pause output until it has more data for us, or stop,
+	// if we've played everything.
+	gpio_dma_stream_halt();
+
+	if (!all_data_queued()) {
+		stream.underruns++;
+	}
+}
+
+
+/**
+ * Starts (or resumes) scanning out samples, if we have enough queued to keep the DMA busy.
+ */
+static void gpio_dma_stream_start_if_ready(void)
+{
+	uint32_t segments_queued = stream.segments_filled - stream.segments_played;
+	const gpdma_lli_t *first_lli = &sample_lli[stream.segments_played % GPIO_DMA_STREAM_SEGMENT_COUNT];
+
+	if (stream.running || !segments_queued) {
+		return;
+	}
+
+	// Wait until we've filled our whole ring, unless the host has nothing more to give us.
+	if ((segments_queued < GPIO_DMA_STREAM_SEGMENT_COUNT) && !all_data_queued()) {
+		return;
+	}
+
+	stream.running = true;
+
+	gpio_dma_tx_start(first_lli);
+	stream.pacer->start();
+}
+
+
+/**
+ * Hands the segment we've been filling to the DMA engine, by appending it to the end of the DMA's chain.
+ */
+static void commit_segment(void)
+{
+	gpdma_lli_t *lli = &sample_lli[stream.segments_filled % GPIO_DMA_STREAM_SEGMENT_COUNT];
+
+	// Make our segment the new end of the chain before linking it in; so the DMA can never follow it
+	// on into a segment that hasn't been refilled.
+	// The DMA engine reads these descriptors directly, so each write must land in order.
+	gpdma_lli_set_next(lli, NULL);
+	__asm__ volatile ("dmb" ::: "memory");
+
+	if (stream.segments_filled) {
+		gpdma_lli_set_next(&sample_lli[(stream.segments_filled - 1) % GPIO_DMA_STREAM_SEGMENT_COUNT], lli);
+		__asm__ volatile ("dmb" ::: "memory");
+	}
+
+	stream.segment_fill = 0;
+	stream.segments_filled++;
+}
+
+
+/**
+ * Consumes samples streamed from the host, copying them into our ring as space frees up.
+ */
+static int gpio_dma_stream_handle_data(void *data, uint32_t length, void *user_data)
+{
+	uint8_t *block = data;
+	(void)user_data;
+
+	while (stream.block_offset < length) {
+		uint8_t *segment;
+		uint32_t to_copy;
+
+		// If the DMA engine's still using every segment, come back for the rest of this block later.
+		if (!segment_available()) {
+			gpio_dma_stream_start_if_ready();
+			return EAGAIN;
+		}
+
+		segment = &sample_ring[(stream.segments_filled % GPIO_DMA_STREAM_SEGMENT_COUNT) * GPIO_DMA_STREAM_SEGMENT_SIZE];
+		to_copy = length - stream.block_offset;
+
+		if (to_copy > (GPIO_DMA_STREAM_SEGMENT_SIZE - stream.segment_fill)) {
+			to_copy = GPIO_DMA_STREAM_SEGMENT_SIZE - stream.segment_fill;
+		}
+
+		memcpy(&segment[stream.segment_fill], &block[stream.block_offset], to_copy);
+		stream.segment_fill += to_copy;
+		stream.block_offset += to_copy;
+
+		if (stream.limited_length) {
+			stream.bytes_remaining -= to_copy;
+		}
+
+		if (stream.segment_fill == GPIO_DMA_STREAM_SEGMENT_SIZE) {
+			commit_segment();
+		}
+	}
+
+	stream.block_offset = 0;
+
+	// If that was the last of the host's data, pad out our final segment by holding the last sample.
+	if (stream.limited_length && !stream.bytes_remaining && stream.segment_fill) {
+		uint8_t *segment = &sample_ring[(stream.segments_filled % GPIO_DMA_STREAM_SEGMENT_COUNT) * GPIO_DMA_STREAM_SEGMENT_SIZE];
+		uint32_t sample_size = stream.bytes_per_sample;
+
+		for (uint32_t position = stream.segment_fill; position < GPIO_DMA_STREAM_SEGMENT_SIZE; position += sample_size) {
+			memcpy(&segment[position], &segment[stream.segment_fill - sample_size], sample_size);
+		}
+
+		commit_segment();
+	}
+
+	gpio_dma_stream_start_if_ready();
+	return 0;
+}
+
+
+/**
+ * Starts scanning out samples received on the bulk OUT endpoint.
+ */
+int gpio_dma_stream_start(void *target, uint8_t bytes_per_sample, uint32_t length,
+	const gpio_dma_stream_pacer_t *pacer)
+{
+	if ((bytes_per_sample != 1) && (bytes_per_sample != 2)) {
+		return EINVAL;
+	}
+	if (length % bytes_per_sample) {
+		return EINVAL;
+	}
+
+	// Don't take the DMA away from another class's stream.
+	if (gpio_dma_stream_in_use_by_other(pacer)) {
+		return EBUSY;
+	}
+
+	gpio_dma_stream_stop();
+
+	stream.pacer            = pacer;
+	stream.bytes_per_sample = bytes_per_sample;
+	stream.segments_filled  = 0;
+	stream.segments_played  = 0;
+	stream.segment_fill     = 0;
+	stream.block_offset     = 0;
+	stream.limited_length   = (length != 0);
+	stream.length           = length;
+	stream.bytes_remaining  = length;
+	stream.underruns        = 0;
+
+	gpio_dma_config_lli_with_width(sample_lli, GPIO_DMA_STREAM_SEGMENT_COUNT, sample_ring, target,
+		GPIO_DMA_STREAM_SEGMENT_SIZE, bytes_per_sample);
+	gpio_dma_init();
+
+	// Segments are only chained together as they're filled; so start with each standing alone.
+	for (unsigned i = 0; i < GPIO_DMA_STREAM_SEGMENT_COUNT; ++i) {
+		gpdma_lli_set_next(&sample_lli[i], NULL);
+	}
+
+	vector_table.irqs[NVIC_DMA_IRQ] = gpio_dma_stream_isr;
+	nvic_set_priority(NVIC_DMA_IRQ, 0);
+	nvic_enable_irq(NVIC_DMA_IRQ);
+
+	usb_streaming_start_streaming_from_host(length, gpio_dma_stream_handle_data, NULL);
+	stream.active = true;
+	return 0;
+}
+
+
+/**
+ * Stops any active stream, and halts the DMA.
+ */
+void gpio_dma_stream_stop(void)
+{
+	usb_streaming_stop_streaming_from_host();
+	gpio_dma_stream_halt();
+	nvic_disable_irq(NVIC_DMA_IRQ);
+
+	stream.active = false;
+}
+
+
+/**
+ * Reports on the progress of the active stream.
+ */
+int gpio_dma_stream_status(bool *complete, uint32_t *bytes_played, uint32_t *underruns)
+{
+	int status = usb_streaming_from_host_status(NULL);
+
+	// If the stream failed, report the failure directly.
+	if (status && (status != EINPROGRESS)) {
+		return status;
+	}
+
+	// We're done once the host has sent everything, and we've played all of it.
+	*complete = (status != EINPROGRESS) && !stream.running;
+
+	if (bytes_played) {
+		*bytes_played = stream.segments_played * GPIO_DMA_STREAM_SEGMENT_SIZE;
+
+		// Our final segment is padded out by repeating the last sample; don't count the padding.
+		if (stream.limited_length && (*bytes_played > stream.length)) {
+			*bytes_played = stream.length;
+		}
+	}
+	if (underruns) {
+		*underruns = stream.underruns;
+	}
+
+	return 0;
+}
+
+
+/**
+ * @return True iff the DMA is currently scanning out samples.
+ */
+bool gpio_dma_stream_running(void)
+{
+	return stream.running;
+}
+
+
+/**
+ * @return True iff another owner's stream is still receiving or scanning out samples.
+ */
+bool gpio_dma_stream_in_use_by_other(const gpio_dma_stream_pacer_t *owner)
+{
+	if (!stream.active || (stream.pacer == owner)) {
+		return false;
+	}
+
+	return stream.running || (usb_streaming_from_host_status(NULL) == EINPROGRESS);
+}
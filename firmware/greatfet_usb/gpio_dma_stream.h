@@ -0,0 +1,68 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Streams samples from the host out to a GPIO port, using the GPIO DMA channel.
+ */
+
+#ifndef __GPIO_DMA_STREAM_H__
+#define __GPIO_DMA_STREAM_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Callbacks that start and stop the hardware pacing our DMA; which must issue
+ * a GPIO DMA request (a TIMER2 MR0 match) once per sample.
+ */
+typedef struct {
+	void (*start)(void);
+	void (*stop)(void);
+} gpio_dma_stream_pacer_t;
+
+
+/**
+ * Starts scanning out samples received on the bulk OUT endpoint. Output begins once we've
+ * buffered enough samples to stay ahead of the DMA; and pauses whenever the host falls behind.
+ *
+ * @param target The register to which each sample should be written; typically a port's MPIN register.
+ * @param bytes_per_sample The size of each sample; 1 or 2 bytes.
+ * @param length The total number of bytes to scan out; or 0 to stream until stopped.
+ * @param pacer The functions that start and stop our DMA requests; which also identify the stream's owner.
+ *
+ * @return 0 on success; EBUSY if another owner's stream is still in use; or another error code on failure.
+ */
+int gpio_dma_stream_start(void *target, uint8_t bytes_per_sample, uint32_t length,
+	const gpio_dma_stream_pacer_t *pacer);
+
+
+/**
+ * Stops any active stream, and halts the DMA.
+ */
+void gpio_dma_stream_stop(void);
+
+
+/**
+ * Reports on the progress of the active stream.
+ *
+ * @param complete Set to true iff the host has sent all of its data, and we've scanned all of it out.
+ * @param bytes_played If non-NULL, receives the number of bytes scanned out so far.
+ * @param underruns If non-NULL, receives the number of times the DMA ran out of samples mid-stream.
+ * @return 0 if the stream is healthy, or the error that ended it.
+ */
+int gpio_dma_stream_status(bool *complete, uint32_t *bytes_played, uint32_t *underruns);
+
+
+/**
+ * @return True iff the DMA is currently scanning out samples.
+ */
+bool gpio_dma_stream_running(void);
+
+
+/**
+ * @param owner The pacer its owner passed to gpio_dma_stream_start().
+ * @return True iff a stream started by a different owner is still receiving or scanning out samples;
+ *	in which case, that owner's stream (and its pacing hardware) shouldn't be touched.
+ */
+bool gpio_dma_stream_in_use_by_other(const gpio_dma_stream_pacer_t *owner);
+
+#endif
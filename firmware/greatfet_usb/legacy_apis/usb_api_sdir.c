@@ -17,6 +17,7 @@
 #include <gpio.h>
 #include <pins.h>
 #include <gpio_dma.h>
+#include <wakeable_task.h>
 
 #include <libopencm3/lpc43xx/scu.h>
 #include <libopencm3/lpc43xx/m4/nvic.h>
@@ -27,6 +28,9 @@
 volatile bool sdir_rx_enabled = false;
 volatile bool sdir_tx_enabled = false;
 
+DECLARE_WAKEABLE_TASK(sdir_rx_mode);
+DECLARE_WAKEABLE_TASK(sdir_tx_mode);
+
 static const sgpio_config_t sgpio_config = {
 	.slice_mode_multislice = true,
 	.clock_divider = 20,
@@ -258,6 +262,7 @@ usb_request_status_t usb_vendor_request_sdir_rx_start(
 {
 	if (stage == USB_TRANSFER_STAGE_SETUP) {
 		sdir_rx_enabled = true;
+		task_wake(WAKEABLE_TASK(sdir_rx_mode));
 		usb_transfer_schedule_ack(endpoint->in);
 	}
 	return USB_REQUEST_STATUS_OK;
@@ -280,6 +285,7 @@ usb_request_status_t usb_vendor_request_sdir_tx_start(
 		tx_samplerate = ((uint32_t)endpoint->setup.value) << 16
 		             | endpoint->setup.index;
 		sdir_tx_enabled = true;
+		task_wake(WAKEABLE_TASK(sdir_tx_mode));
 		usb_transfer_schedule_ack(endpoint->in);
 	}
 	return USB_REQUEST_STATUS_OK;
@@ -295,5 +301,5 @@ usb_request_status_t usb_vendor_request_sdir_tx_stop(
 	return USB_REQUEST_STATUS_OK;
 }
 
-DEFINE_TASK(sdir_rx_mode);
-DEFINE_TASK(sdir_tx_mode);
+DEFINE_WAKEABLE_TASK(sdir_rx_mode, TASK_PRIORITY_NORMAL);
+DEFINE_WAKEABLE_TASK(sdir_tx_mode, TASK_PRIORITY_NORMAL);
@@ -0,0 +1,21 @@
+/*
+ * This file is part of GreatFET
+ *
+ * Hooks into the loadables class, for other classes that touch the M0's memory.
+ */
+
+#ifndef __LOADABLES_H__
+#define __LOADABLES_H__
+
+#include <stdint.h>
+
+/**
+ * Notes that a block of memory has been written outside of the loadables class. If it overlaps
+ * the M0's region, any image recorded as resident there can no longer be trusted.
+ *
+ * @param address The first address written.
+ * @param length The number of bytes written.
+ */
+void loadables_note_memory_write(uint32_t address, uint32_t length);
+
+#endif
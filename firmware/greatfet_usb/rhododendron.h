@@ -38,6 +38,38 @@ typedef enum {
 
 
 
+/**
+ * Packet types used in the capture stream we send to the host.
+ */
+typedef enum {
+	RHODODENDRON_PACKET_USB_DATA     = 0x00,
+	RHODODENDRON_PACKET_EVENT_START  = 0x80,
+	RHODODENDRON_PACKET_EVENT_END_OK = 0x81,
+
+	// Set on event packets whose timestamp field holds an SCT capture of the NXT/DIR edge that
+	// marked the event; see sct_timestamp.h. Events without it carry no timestamp, and their
+	// data offsets may be a byte off.
+	RHODODENDRON_PACKET_FLAG_TIMESTAMPED = 0x10,
+} rhododendron_packet_type_t;
+
+
+/**
+ * Event packets mark the start and end of USB packets within the stream of USB data packets.
+ */
+typedef struct __attribute__((packed)) {
+
+	// One of the RHODODENDRON_PACKET_EVENT types, optionally with RHODODENDRON_PACKET_FLAG_TIMESTAMPED.
+	uint8_t type;
+
+	// For end events, the offset of the packet's last byte within the next USB data packet.
+	uint8_t data_offset;
+
+	// The SCT count at the event, in ticks of SCT_TIMESTAMP_FREQUENCY; little endian, and wrapping.
+	uint32_t timestamp;
+
+} rhododendron_event_packet_t;
+
+
 /**
  * Register address constants for the registers we'll commonly need to use in ULPI PHYs.
  */
@@ -23,6 +23,7 @@
 #include "usb_endpoint.h"
 
 #include "greatfet_core.h"
+#include <wakeable_task.h>
 
 
 
@@ -45,16 +46,74 @@ volatile uint32_t buffer_content_count;
 // Timer objects used by our "periodic upload" functionality.
 hw_timer_t periodic_event_timer;
 
+// State for streaming data from the host. Each of our buffers is owned by the USB hardware
+// until it's marked full; and then by the streaming task until its data has been consumed.
+static bool usb_streaming_out_enabled = false;
+static usb_streaming_out_handler_t out_handler;
+static void *out_handler_argument;
+
+static uint32_t out_total_length;
+static uint32_t out_bytes_consumed;
+static int out_status;
+
+static unsigned int out_receive_buffer;
+static unsigned int out_consume_buffer;
+
+static volatile bool out_transfer_pending;
+static volatile uint32_t out_bytes_received;
+static volatile bool out_buffer_full[USB_STREAMING_NUM_BUFFERS];
+static volatile uint32_t out_buffer_length[USB_STREAMING_NUM_BUFFERS];
+
+// State for streaming data generated on demand to the host. Each buffer is filled by the generator,
+// then handed to the USB hardware, and then becomes free again once the host has read it.
+typedef enum {
+	GENERATED_BUFFER_FREE = 0,
+	GENERATED_BUFFER_FILLED,
+	GENERATED_BUFFER_IN_FLIGHT,
+} generated_buffer_state_t;
+
+static bool usb_streaming_generator_enabled = false;
+static usb_streaming_in_handler_t in_handler;
+static void *in_handler_argument;
+
+static uint32_t in_total_length;
+static uint32_t in_bytes_generated;
+static int in_status;
+
+static unsigned int in_generate_buffer;
+static unsigned int in_send_buffer;
+
+static volatile bool in_transfer_pending;
+static volatile uint32_t in_bytes_sent;
+static volatile generated_buffer_state_t in_buffer_state[USB_STREAMING_NUM_BUFFERS];
+static uint32_t in_buffer_length[USB_STREAMING_NUM_BUFFERS];
+
+DECLARE_WAKEABLE_TASK(task_usb_streaming);
+
+
+/**
+ * Keeps our streaming task polling for as long as any stream is active; and lets it sleep otherwise.
+ */
+static void usb_streaming_update_task_state(void)
+{
+	bool active = usb_streaming_enabled || usb_streaming_out_enabled || usb_streaming_generator_enabled;
+	task_set_polling(WAKEABLE_TASK(task_usb_streaming), active);
+}
+
 
 // XXX
 static inline void cm_enable_interrupts(void)
 {
+#ifndef __RUNNING_ON_HOST__
         __asm__("CPSIE I\n");
+#endif
 }
 
 static inline void cm_disable_interrupts(void)
 {
+#ifndef __RUNNING_ON_HOST__
         __asm__("CPSID I\n");
+#endif
 }
 
 
@@ -180,6 +239,305 @@ void usb_streaming_start_streaming_to_host(volatile uint32_t *user_position_in_b
 	// And enable USB streaming.
 	// FIXME: support out streaming, too
 	usb_streaming_enabled = true;
+	usb_streaming_update_task_state();
+}
+
+
+/**
+ * Callback executed (in interrupt context) when a generated bulk IN transfer completes.
+ */
+static void streaming_generated_transfer_complete(void *const user_data, unsigned int transferred)
+{
+	uint32_t buffer_number = (uintptr_t)user_data;
+
+	in_buffer_state[buffer_number] = GENERATED_BUFFER_FREE;
+	in_bytes_sent += transferred;
+	in_transfer_pending = false;
+}
+
+
+static void service_usb_streaming_generator(void)
+{
+	int rc;
+
+	// If the host has everything we promised it, we're done.
+	if (in_total_length && (in_bytes_sent >= in_total_length)) {
+		in_status = 0;
+		usb_streaming_stop_generating_for_host();
+		return;
+	}
+
+	// Hand our oldest filled buffer to the USB hardware, if it's idle...
+	if (!in_transfer_pending && (in_buffer_state[in_send_buffer] == GENERATED_BUFFER_FILLED)) {
+		in_transfer_pending = true;
+		in_buffer_state[in_send_buffer] = GENERATED_BUFFER_IN_FLIGHT;
+
+		rc = usb_transfer_schedule(&usb0_endpoint_bulk_in,
+			&usb_bulk_buffer[in_send_buffer * USB_STREAMING_BUFFER_SIZE], in_buffer_length[in_send_buffer],
+			streaming_generated_transfer_complete, (void *)(uintptr_t)in_send_buffer);
+		if (rc) {
+			in_buffer_state[in_send_buffer] = GENERATED_BUFFER_FILLED;
+			in_transfer_pending = false;
+		} else {
+			in_send_buffer = (in_send_buffer + 1) % USB_STREAMING_NUM_BUFFERS;
+		}
+	}
+
+	// ... and generate more data while it's busy.
+	bool more_to_generate = !in_total_length || (in_bytes_generated < in_total_length);
+	if (more_to_generate && (in_buffer_state[in_generate_buffer] == GENERATED_BUFFER_FREE)) {
+		uint32_t length = in_total_length ? (in_total_length - in_bytes_generated) : USB_STREAMING_BUFFER_SIZE;
+
+		if (length > USB_STREAMING_BUFFER_SIZE) {
+			length = USB_STREAMING_BUFFER_SIZE;
+		}
+
+		rc = in_handler(&usb_bulk_buffer[in_generate_buffer * USB_STREAMING_BUFFER_SIZE], &length, in_handler_argument);
+
+		// If the generator isn't ready yet, try again on our next pass.
+		if (rc == EAGAIN) {
+			return;
+		}
+		if (rc) {
+			pr_warning("streaming: could not generate data for the host (%d); aborting stream\n", rc);
+			in_status = rc;
+			usb_streaming_stop_generating_for_host();
+			return;
+		}
+
+		// Handlers may hand back less than we asked for; but an empty block would never be sent.
+		if (!length) {
+			return;
+		}
+
+		in_buffer_length[in_generate_buffer] = length;
+		in_buffer_state[in_generate_buffer]  = GENERATED_BUFFER_FILLED;
+		in_bytes_generated += length;
+		in_generate_buffer = (in_generate_buffer + 1) % USB_STREAMING_NUM_BUFFERS;
+	}
+}
+
+
+/**
+ * Sets up a task thread that will generate data using the provided handler, and stream it to the host.
+ */
+void usb_streaming_start_generating_for_host(uint32_t total_length,
+	usb_streaming_in_handler_t handler, void *user_data)
+{
+	// Ensure we're not already sending from our buffers.
+	usb_streaming_stop_generating_for_host();
+
+	usb_endpoint_init(&usb0_endpoint_bulk_in);
+	usb_endpoint_clear_stall(&usb0_endpoint_bulk_in);
+
+	in_handler          = handler;
+	in_handler_argument = user_data;
+	in_total_length     = total_length;
+	in_bytes_generated  = 0;
+	in_bytes_sent       = 0;
+	in_generate_buffer  = 0;
+	in_send_buffer      = 0;
+	in_transfer_pending = false;
+	in_status           = EINPROGRESS;
+
+	for (unsigned i = 0; i < USB_STREAMING_NUM_BUFFERS; ++i) {
+		in_buffer_state[i] = GENERATED_BUFFER_FREE;
+	}
+
+	usb_streaming_generator_enabled = true;
+	usb_streaming_update_task_state();
+}
+
+
+/**
+ * Halts any active generated stream to the host.
+ */
+void usb_streaming_stop_generating_for_host(void)
+{
+	if (!usb_streaming_generator_enabled) {
+		return;
+	}
+
+	usb_streaming_generator_enabled = false;
+	usb_streaming_update_task_state();
+	usb_endpoint_disable(&usb0_endpoint_bulk_in);
+	in_transfer_pending = false;
+
+	// If we're stopping before the host has all of its data, note that the stream was cut short.
+	if (in_status == EINPROGRESS) {
+		in_status = ECANCELED;
+	}
+}
+
+
+/**
+ * Reports on the state of the most recent generated stream to the host.
+ */
+int usb_streaming_to_host_status(uint32_t *bytes_sent)
+{
+	if (bytes_sent) {
+		*bytes_sent = in_bytes_sent;
+	}
+
+	return in_status;
+}
+
+
+/**
+ * Callback executed (in interrupt context) when a bulk OUT transfer completes.
+ */
+static void streaming_out_transfer_complete(void *const user_data, unsigned int transferred)
+{
+	uint32_t buffer_number = (uintptr_t)user_data;
+
+	out_buffer_length[buffer_number] = transferred;
+	out_buffer_full[buffer_number] = true;
+	out_bytes_received += transferred;
+	out_transfer_pending = false;
+}
+
+
+/**
+ * Primes the bulk OUT endpoint to receive data into our next free buffer, if possible.
+ */
+static void streaming_schedule_usb_transfer_out(void)
+{
+	int rc;
+	uint32_t length = USB_STREAMING_BUFFER_SIZE;
+
+	// If we're already receiving, or the buffer we'd receive into hasn't yet been consumed, we can't schedule.
+	if (out_transfer_pending || out_buffer_full[out_receive_buffer]) {
+		return;
+	}
+
+	// If we know how much data to expect, request only what's left, so the host doesn't have to terminate
+	// the transfer with a short packet.
+	if (out_total_length) {
+		uint32_t remaining = out_total_length - out_bytes_received;
+
+		if (!remaining) {
+			return;
+		}
+		if (remaining < length) {
+			length = remaining;
+		}
+	}
+
+	out_transfer_pending = true;
+	rc = usb_transfer_schedule(&usb0_endpoint_bulk_out,
+		&usb_bulk_buffer[out_receive_buffer * USB_STREAMING_BUFFER_SIZE], length,
+		streaming_out_transfer_complete, (void *)(uintptr_t)out_receive_buffer);
+	if (rc) {
+		out_transfer_pending = false;
+		return;
+	}
+
+	out_receive_buffer = (out_receive_buffer + 1) % USB_STREAMING_NUM_BUFFERS;
+}
+
+
+static void service_usb_streaming_out(void)
+{
+	int rc;
+	uint32_t length;
+
+	// Keep the USB hardware busy receiving while we work...
+	streaming_schedule_usb_transfer_out();
+
+	// ... and hand off any completed buffer to our consumer.
+	if (!out_buffer_full[out_consume_buffer]) {
+		return;
+	}
+
+	length = out_buffer_length[out_consume_buffer];
+	rc = out_handler(&usb_bulk_buffer[out_consume_buffer * USB_STREAMING_BUFFER_SIZE], length, out_handler_argument);
+
+	// If the consumer can't take the whole block yet, hold on to it and offer it again later.
+	if (rc == EAGAIN) {
+		return;
+	}
+
+	out_bytes_consumed += length;
+	out_buffer_full[out_consume_buffer] = false;
+	out_consume_buffer = (out_consume_buffer + 1) % USB_STREAMING_NUM_BUFFERS;
+
+	if (rc) {
+		pr_warning("streaming: handler rejected data from the host (%d); aborting stream\n", rc);
+		out_status = rc;
+		usb_streaming_stop_streaming_from_host();
+		return;
+	}
+
+	// If we've consumed everything the host promised us, we're done.
+	if (out_total_length && (out_bytes_consumed >= out_total_length)) {
+		out_status = 0;
+		usb_streaming_stop_streaming_from_host();
+	}
+}
+
+
+/**
+ * Sets up a task thread that will receive data from the host on the bulk OUT endpoint.
+ */
+void usb_streaming_start_streaming_from_host(uint32_t total_length,
+	usb_streaming_out_handler_t handler, void *user_data)
+{
+	// Ensure we're not already receiving into our buffers.
+	usb_streaming_stop_streaming_from_host();
+
+	usb_endpoint_init(&usb0_endpoint_bulk_out);
+	usb_endpoint_clear_stall(&usb0_endpoint_bulk_out);
+
+	out_handler          = handler;
+	out_handler_argument = user_data;
+	out_total_length     = total_length;
+	out_bytes_received   = 0;
+	out_bytes_consumed   = 0;
+	out_receive_buffer   = 0;
+	out_consume_buffer   = 0;
+	out_transfer_pending = false;
+	out_status           = EINPROGRESS;
+
+	for (unsigned i = 0; i < USB_STREAMING_NUM_BUFFERS; ++i) {
+		out_buffer_full[i] = false;
+	}
+
+	usb_streaming_out_enabled = true;
+	usb_streaming_update_task_state();
+}
+
+
+/**
+ * Halts any active stream from the host.
+ */
+void usb_streaming_stop_streaming_from_host(void)
+{
+	if (!usb_streaming_out_enabled) {
+		return;
+	}
+
+	usb_streaming_out_enabled = false;
+	usb_streaming_update_task_state();
+	usb_endpoint_disable(&usb0_endpoint_bulk_out);
+	out_transfer_pending = false;
+
+	// If we're stopping before our stream completed, note that it was cut short.
+	if (out_status == EINPROGRESS) {
+		out_status = ECANCELED;
+	}
+}
+
+
+/**
+ * Reports on the state of the most recent stream from the host.
+ */
+int usb_streaming_from_host_status(uint32_t *bytes_consumed)
+{
+	if (bytes_consumed) {
+		*bytes_consumed = out_bytes_consumed;
+	}
+
+	return out_status;
 }
 
 
@@ -216,6 +574,7 @@ uint32_t usb_streaming_start_periodic_data_gathering(uint32_t frequency, timer_c
 void usb_streaming_stop_streaming_to_host()
 {
 	usb_streaming_enabled = false;
+	usb_streaming_update_task_state();
 	usb_endpoint_disable(&usb0_endpoint_bulk_in);
 
 	led_off(LED4);
@@ -253,10 +612,9 @@ static uint32_t usb_streaming_submit_data(void *data_in, uint32_t count)
 
 		//... copy from the write pointer to the end...
 		data_after_pointer = space_remaining_to_end;
-		count -= space_remaining_to_end;
 
 		//  and copy the remaining data to the beginning.
-		data_after_start = count;
+		data_after_start = count - space_remaining_to_end;
 	}
 
 
@@ -313,12 +671,19 @@ uint32_t usb_streaming_send_data(void *data_in, uint32_t count)
  */
 void task_usb_streaming(void)
 {
+	if (usb_streaming_out_enabled) {
+		service_usb_streaming_out();
+	}
+
+	if (usb_streaming_generator_enabled) {
+		service_usb_streaming_generator();
+	}
+
 	if(!usb_streaming_enabled) {
 		return;
 	}
 
-	// TODO: support USB streaming out, too
 	service_usb_streaming_in();
 }
 
-DEFINE_TASK(task_usb_streaming);
+DEFINE_WAKEABLE_TASK(task_usb_streaming, TASK_PRIORITY_HIGH);
@@ -27,10 +27,39 @@ enum {
 	USB_STREAMING_OUT_ADDRESS = 0x02,
 };
 
+/**
+ * Callback used to consume data streamed from the host. Called from the main loop (rather than
+ * interrupt context) once for each block received on the bulk OUT endpoint.
+ *
+ * @param data The block of data received from the host.
+ * @param length The length of the received block, in bytes.
+ * @param user_data The argument passed to usb_streaming_start_streaming_from_host.
+ *
+ * @return 0 to continue streaming, EAGAIN if the handler can't finish with the block yet (and it
+ *		should be offered again later), or an error code to abort the stream.
+ */
+typedef int (*usb_streaming_out_handler_t)(void *data, uint32_t length, void *user_data);
+
+
+/**
+ * Callback used to generate data to be streamed to the host. Called from the main loop
+ * whenever a streaming buffer is free, and expected to fill it.
+ *
+ * @param data The buffer to be filled.
+ * @param length On entry, the amount of data to generate, in bytes. Handlers that produce data
+ *		sporadically may reduce this to send a shorter block; which the host will see as a short transfer.
+ * @param user_data The argument passed to usb_streaming_start_generating_for_host.
+ *
+ * @return 0 to continue streaming, EAGAIN if the data isn't available yet (and the handler should
+ *		be called again later), or an error code to abort the stream.
+ */
+typedef int (*usb_streaming_in_handler_t)(void *data, uint32_t *length, void *user_data);
+
+
 /**
  * Core USB streaming service routine: ferries data to or from the host.
  */
-void service_usb_streaming(void);
+void task_usb_streaming(void);
 
 
 /**
@@ -48,6 +77,66 @@ void usb_streaming_start_streaming_to_host(volatile uint32_t *user_position_in_b
 void usb_streaming_stop_streaming_to_host(void);
 
 
+/**
+ * Sets up a task thread that will generate a fixed amount of data using the provided handler,
+ * and stream it to the host on the bulk IN endpoint as it's generated.
+ *
+ * Shares the USB bulk buffer with the other streaming functions; so only one can be active at a time.
+ *
+ * @param total_length The total number of bytes to be generated and sent; or 0 to generate data until stopped.
+ * @param handler The function that will generate each block of data.
+ * @param user_data An argument to be passed to the handler.
+ */
+void usb_streaming_start_generating_for_host(uint32_t total_length,
+	usb_streaming_in_handler_t handler, void *user_data);
+
+
+/**
+ * Halts any active generated stream to the host.
+ */
+void usb_streaming_stop_generating_for_host(void);
+
+
+/**
+ * Reports on the state of the most recent generated stream to the host.
+ *
+ * @param bytes_sent If non-NULL, receives the number of bytes the host has received so far.
+ * @return EINPROGRESS if the stream is still active, 0 if it completed successfully,
+ *		or the error code reported by the stream's handler.
+ */
+int usb_streaming_to_host_status(uint32_t *bytes_sent);
+
+
+/**
+ * Sets up a task thread that will receive data from the host on the bulk OUT endpoint,
+ * and pass each received block to the provided handler.
+ *
+ * Shares the USB bulk buffer with streaming to the host; so only one direction can be active at a time.
+ *
+ * @param total_length The total number of bytes the host will send; or 0 to stream until stopped.
+ * @param handler The function that will consume each block of received data.
+ * @param user_data An argument to be passed to the handler.
+ */
+void usb_streaming_start_streaming_from_host(uint32_t total_length,
+	usb_streaming_out_handler_t handler, void *user_data);
+
+
+/**
+ * Halts any active stream from the host.
+ */
+void usb_streaming_stop_streaming_from_host(void);
+
+
+/**
+ * Reports on the state of the most recent stream from the host.
+ *
+ * @param bytes_consumed If non-NULL, receives the number of bytes consumed by the handler so far.
+ * @return EINPROGRESS if the stream is still active, 0 if it completed successfully,
+ *		or the error code reported by the stream's handler.
+ */
+int usb_streaming_from_host_status(uint32_t *bytes_consumed);
+
+
 /**
  * Sets up a task thread that will periodically call a callback, and then deliver the collected
  * data to the host.
@@ -16,6 +16,9 @@ from .interfaces.gpio import GPIO
 from .interfaces.adc import ADC
 
 from .interfaces.pattern_generator import PatternGenerator
+from .interfaces.parallel_out import ParallelOutput
+from .interfaces.edge_capture import EdgeCapture
+from .interfaces.usb_host import USBHost
 from .interfaces.sdir import SDIRTransceiver
 
 from . import programmers as ProgrammerModules
@@ -71,6 +74,9 @@ class GreatFETBoard(GreatBoard):
         'loadables' : ('m0', M0Coprocessor),
         'firmware': ('onboard_flash', DeviceFirmwareManager),
         'pattern_generator': ('pattern_generator', PatternGenerator),
+        'parallel_out': ('parallel_out', ParallelOutput),
+        'edge_capture': ('edge_capture', EdgeCapture),
+        'usbhost': ('usb_host', USBHost),
         'sdir': ('sdir', SDIRTransceiver),
         'gpio': ('gpio', GPIO),
         'glitchkit': ('glitchkit', GlitchKitCollection)
@@ -13,18 +13,81 @@ import time
 
 from greatfet.protocol import vendor_requests
 
+# The 1-Wire family code of the DS18S20, whose readings have half-degree resolution; other sensors use sixteenths.
+DS18S20_FAMILY_CODE = 0x10
+
+# Measurement states reported by the one_wire class.
+ONE_WIRE_STATE_IDLE = 0
+
+# Set in a sensor's flags iff its reading is valid.
+SENSOR_READING_VALID = 0x01
+
+
+def print_temperature(temp, label=None):
+    """ Prints a temperature, in both Celsius and Fahrenheit. """
+
+    fields = [time.strftime("%H:%M:%S")]
+    if label:
+        fields.append(label)
+
+    print(*fields, temp, '{:.01f}'.format(temp * 9 / 5 + 32))
+
+
+def read_all_sensors(device, rescan):
+    """ Measures every sensor on the bus at once, and returns a list of (rom_code, temperature) tuples. """
+
+    device.apis.one_wire.start_measurement(rescan)
+
+    # The device searches and converts in the background; wait for it to finish.
+    while device.apis.one_wire.get_status()[0] != ONE_WIRE_STATE_IDLE:
+        time.sleep(0.05)
+
+    readings = []
+    for rom_code, raw_temperature, flags in device.apis.one_wire.read_sensors():
+        if not flags & SENSOR_READING_VALID:
+            readings.append((rom_code, None))
+        elif (rom_code & 0xFF) == DS18S20_FAMILY_CODE:
+            readings.append((rom_code, raw_temperature / 2.0))
+        else:
+            readings.append((rom_code, raw_temperature / 16.0))
+
+    return readings
+
 
 def main():
     from greatfet.utils import GreatFETArgumentParser
    
     # Set up a simple argument parser.
     parser = GreatFETArgumentParser(description="Periodically print temperature from DS18B20 sensor")
-    parser.add_argument('-S', dest='s20', action='store_true', help='DS18S20')
+    parser.add_argument('-S', dest='s20', action='store_true', help='DS18S20; only needed with --legacy')
+    parser.add_argument('-r', '--rescan', dest='rescan', action='store_true',
+                        help='search the bus for sensors before every reading, rather than just the first')
+    parser.add_argument('--legacy', dest='legacy', action='store_true',
+                        help='read a single sensor using the legacy vendor request')
 
     args = parser.parse_args()
     log_function = parser.get_log_function()
     device = parser.find_specified_device()
 
+    # If the device supports it, read every sensor on the bus with a single conversion.
+    if not args.legacy and hasattr(device.apis, 'one_wire'):
+        first = True
+
+        while True:
+            readings = read_all_sensors(device, rescan=(args.rescan or first))
+            first = False
+
+            if not readings:
+                log_function("No sensors found.")
+
+            for rom_code, temp in readings:
+                if temp is None:
+                    print(time.strftime("%H:%M:%S"), '{:016x}'.format(rom_code), 'read failed')
+                else:
+                    print_temperature(temp, '{:016x}'.format(rom_code))
+
+            time.sleep(1)
+
     while True:
         data = device.comms._vendor_request_in(vendor_requests.DS18B20_READ, length=2, timeout=2000)
         # temperature data is 16 bit signed
@@ -33,7 +96,7 @@ def main():
             temp /= 2.0
         else:
             temp /= 16.0
-        print(time.strftime("%H:%M:%S"), temp, '{:.01f}'.format(temp * 9 / 5 + 32))
+        print_temperature(temp)
         time.sleep(1)
 
 if __name__ == '__main__':
@@ -48,13 +48,24 @@ def spi_flash_write(device, filename, address, log_function=log_silent):
     """Writes the data from a given file to the SPI flash."""
 
     silent     = (log_function == log_silent)
-    page_size  = device.onboard_flash.page_size
     total_data = os.path.getsize(filename)
 
-    # Read the data from the board's SPI flash to a file.
+    class progress_context:
+        last_update = 0
+
+    def update_progress(offset, total):
+        """ Callback to update our progress bar; which tracks whatever total the write reports. """
+
+        if progress.total != total:
+            progress.reset(total=total)
+            progress_context.last_update = 0
+
+        progress.update(offset - progress_context.last_update)
+        progress_context.last_update = offset
+
+    # Write the data from the file to the board's SPI flash. Boards that support it only rewrite changed sectors.
     with tqdm(total=total_data, ncols=80, unit='B', leave=False, disable=silent) as progress:
-        device.onboard_flash.upload(filename, address, erase_first=True,
-                progress_callback=lambda offset,  len : progress.update(page_size))
+        device.onboard_flash.upload(filename, address, erase_first=True, progress_callback=update_progress)
     log_function('')
 
 
@@ -8,15 +8,13 @@ import argparse
 import errno
 import sys
 import time
-import os
 import array
-import tempfile
 import threading
 
 # Temporary?
 import usb
 
-from zipfile import ZipFile
+from zipfile import ZipFile, ZIP_DEFLATED
 
 import greatfet
 
@@ -96,45 +94,107 @@ def unpack_data(data, bus_width):
         return unpacked
 
 
-def emit_sigrok_file(filename, sample_file_source, bus_width, sample_rate, first_probe_number=0, channel_names=None):
-    """ Generates a sigrok-compatible Session Archive (SR archive) that wraps the given sample file.
+class SigrokSessionWriter(object):
+    """ Writes a sigrok-compatible Session Archive (SR archive) as samples arrive.
 
-    params:
-        filename: The archive file to produce; usually ends in .sr.
+    Samples are compressed straight into the archive, in chunks named logic-1-1, logic-1-2, etc.; so a capture
+    never needs a second, raw copy on disk, and the archive is complete as soon as it's closed.
     """
 
-    # Start building the metadata that describes the Sigrok Archive.
-    metadata = [
-        "[device 1]",
-        "capturefile=logic-1",
-        "total probes={}".format(bus_width),
-        "samplerate={} Hz\n".format(sample_rate),
-        "total analog=0\n"
-    ]
-
-    # Add a description of each of our logic channels.
-    for i in range(bus_width):
-
-        # If we have a known channel name, use it.
-        if channel_names and (i in channel_names):
-            channel_name = channel_names[i]
-        else:
-            channel_name = "SGPIO{}".format(i + first_probe_number)
+    # The amount of sample data stored in each of the archive's chunks; matches what sigrok itself writes.
+    CHUNK_SIZE = 4 * 1024 * 1024
+
+    # Favor speed over size, so compression can keep up with a capture.
+    COMPRESSION_LEVEL = 1
+
+    def __init__(self, filename, bus_width, sample_rate, first_probe_number=0, channel_names=None):
+        """
+        params:
+            filename: The archive file to produce; usually ends in .sr.
+        """
+
+        self.archive = ZipFile(filename, "w", compression=ZIP_DEFLATED, compresslevel=self.COMPRESSION_LEVEL)
+        self.chunk = None
+        self.chunk_number = 0
+        self.chunk_length = 0
+
+        # Write our description of the capture up front; we know everything it contains already.
+        self.archive.writestr("version", "2")
+        self.archive.writestr("metadata", self._build_metadata(bus_width, sample_rate, first_probe_number, channel_names))
+
+
+    @staticmethod
+    def _build_metadata(bus_width, sample_rate, first_probe_number, channel_names):
+        """ Builds the metadata file that describes the Sigrok Archive. """
+
+        metadata = [
+            "[device 1]",
+            "capturefile=logic-1",
+            "total probes={}".format(bus_width),
+            "samplerate={} Hz\n".format(sample_rate),
+            "total analog=0\n"
+        ]
+
+        # Add a description of each of our logic channels.
+        for i in range(bus_width):
+
+            # If we have a known channel name, use it.
+            if channel_names and (i in channel_names):
+                channel_name = channel_names[i]
+            else:
+                channel_name = "SGPIO{}".format(i + first_probe_number)
+
+            metadata.append("probe{}={}\n".format(i + 1, channel_name))
+
+        # Identify how many bytes exist per sample, given our format.
+        unit_size = int((bus_width + 7) / 8)
+        metadata.append("unitsize={}\n".format(unit_size))
+
+        return "\n".join(metadata)
+
+
+    def write(self, samples):
+        """ Adds samples to the archive; accepts bytes, or any other buffer of byte-sized samples. """
 
-        metadata.append("probe{}={}\n".format(i + 1, channel_name))
+        samples = memoryview(samples).cast('B')
 
-    # Identify how many bytes exist per sample, given our format.
-    unit_size = int((bus_width + 7) / 8)
-    metadata.append("unitsize={}\n".format(unit_size))
+        while samples:
 
-    # Finally, build our zip archive with all of the relevant components.
-    with ZipFile(filename, "w") as zip:
-        zip.write(sample_file_source, arcname='logic-1')
-        zip.writestr("metadata", "\n".join(metadata))
-        zip.writestr("version", "2")
+            # If we don't have a chunk with room left in it, start a new one.
+            if not self.chunk:
+                self.chunk_number += 1
+                self.chunk = self.archive.open("logic-1-{}".format(self.chunk_number), "w", force_zip64=True)
+                self.chunk_length = 0
 
+            to_write = min(len(samples), self.CHUNK_SIZE - self.chunk_length)
+            self.chunk.write(samples[:to_write])
+            self.chunk_length += to_write
+            samples = samples[to_write:]
 
-def background_process_data(termination_request, args, bus_width, bin_file, empty_buffers, full_buffers):
+            if self.chunk_length == self.CHUNK_SIZE:
+                self.chunk.close()
+                self.chunk = None
+
+
+    def close(self):
+        """ Finishes the archive. """
+
+        if self.chunk:
+            self.chunk.close()
+            self.chunk = None
+
+        self.archive.close()
+
+
+    def __enter__(self):
+        return self
+
+
+    def __exit__(self, *_):
+        self.close()
+
+
+def background_process_data(termination_request, args, bus_width, bin_file, sigrok_file, empty_buffers, full_buffers):
     """ Thread that handles processing our samples in the background. """
 
     # Process in the background until we're explicitly terminated.
@@ -162,8 +222,10 @@ def background_process_data(termination_request, args, bus_width, bin_file, empt
         samples = unpack_data(active_buffer, bus_width)
 
         # Output the samples to the appropriate targets.
-        if args.pulseview or args.binary:
+        if bin_file:
             bin_file.write(samples)
+        if sigrok_file:
+            sigrok_file.write(samples)
         if args.write_to_stdout:
             sys.stdout.buffer.write(samples)
 
@@ -210,7 +272,6 @@ def main():
     # --quiet flag.
     if args.write_to_stdout:
         log_function = log_silent
-        bin_file = None
     else:
         log_function = parser.get_log_function()
 
@@ -257,19 +318,14 @@ def main():
     log_function("Press Ctrl+C to stop reading data from device.")
 
     # If we have a target binary file, open the target filename and use that to store samples.
-    if args.binary:
-        bin_file = open(args.binary, 'wb')
-        bin_file_name = args.binary
+    bin_file = open(args.binary, 'wb') if args.binary else None
 
-    # Otherwise, create an temporary file and use that. (It's automatically destroyed on close, which is fancy.)
-    elif args.pulseview:
-        try:
-            holding_dir = os.path.dirname(os.path.abspath(args.pulseview))
-        except:
-            holding_dir = None
-
-        bin_file = tempfile.NamedTemporaryFile(dir=holding_dir, delete=False)
-        bin_file_name = bin_file.name
+    # If we're creating a sigrok session, compress our samples straight into it as they're processed;
+    # this happens on our data processing thread, so it doesn't hold up reading from the device.
+    if args.pulseview:
+        sigrok_file = SigrokSessionWriter(args.pulseview, bus_width, sample_rate, args.first_pin, channel_names)
+    else:
+        sigrok_file = None
 
     # Create queues of transfer objects that we'll use as a producer/consumer interface for our comm thread.
     empty_buffers = []
@@ -281,7 +337,7 @@ def main():
 
     # Finally, spawn the thread that will handle our data processing and output.
     termination_request = threading.Event()
-    thread_arguments    = (termination_request, args, bus_width, bin_file, empty_buffers, full_buffers)
+    thread_arguments    = (termination_request, args, bus_width, bin_file, sigrok_file, empty_buffers, full_buffers)
     data_thread         = threading.Thread(target=background_process_data, args=thread_arguments)
 
     # Now that we're done with all of that setup, perform our actual sampling, in a tight loop,
@@ -330,18 +386,13 @@ def main():
     log_function('Capture terminated -- waiting for data processing to complete.')
     data_thread.join()
 
-    # Flush whatever data we've read to disk, so it can be correctly read by subsequent operations.
-    if args.pulseview:
-        bin_file.flush()
+    # Finish writing our output, so it can be correctly read by subsequent operations.
+    if bin_file:
         bin_file.close()
-
-    # Finally, generate our output.
-    if args.binary:
         log_function("Binary data written to file '{}'.".format(args.binary))
-    if args.pulseview:
-        emit_sigrok_file(args.pulseview, bin_file_name, bus_width, sample_rate, args.first_pin, channel_names)
+    if sigrok_file:
+        sigrok_file.close()
         log_function("Sigrok/PulseView compatible session file created: '{}'.".format(args.pulseview))
-        os.unlink(bin_file_name)
 
     # Print how long we sampled for, as a nicety.
     log_function("Sampled for {} seconds.".format(round(elapsed_time, 4)))
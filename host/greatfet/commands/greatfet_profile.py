@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+#
+# This file is part of GreatFET
+
+from __future__ import print_function
+
+import sys
+import time
+
+from greatfet.utils import GreatFETArgumentParser
+
+
+# Matches the firmware's histogram layout: bin 0 holds runs shorter than 2^7 cycles,
+# and each later bin doubles the range of the last.
+HISTOGRAM_FIRST_BIN_LIMIT = 1 << 7
+
+
+def read_profiles(device):
+    """ Reads every profile from the device; returns the cycle frequency and a list of profile dicts. """
+
+    api = device.apis.profile
+    count, cycle_frequency = api.get_profile_count()
+
+    profiles = []
+    for index in range(count):
+        calls, total_low, total_high, max_cycles, histogram = api.get_profile(index)
+
+        profiles.append({
+            'name':         api.get_profile_name(index),
+            'calls':        calls,
+            'total_cycles': (total_high << 32) | total_low,
+            'max_cycles':   max_cycles,
+            'histogram':    list(histogram),
+        })
+
+    return cycle_frequency, profiles
+
+
+def print_histogram(profile, cycle_frequency):
+    """ Prints a profile's histogram of execution times. """
+
+    limit = HISTOGRAM_FIRST_BIN_LIMIT
+    last_bin = len(profile['histogram']) - 1
+
+    for index, count in enumerate(profile['histogram']):
+        if not count:
+            limit *= 2
+            continue
+
+        limit_us = limit * 1e6 / cycle_frequency
+        if index == last_bin:
+            label = ">= {:.2f}us".format(limit_us / 2)
+        else:
+            label = "<  {:.2f}us".format(limit_us)
+
+        print("        {:>16}: {}".format(label, count))
+        limit *= 2
+
+
+def main():
+
+    # Set up a simple argument parser.
+    parser = GreatFETArgumentParser(description="Reports how much time the GreatFET's firmware spends in each task and interrupt.")
+    parser.add_argument('-i', '--interval', dest='interval', type=float, metavar='<seconds>',
+        help="clear the statistics, and report on only the given number of seconds")
+    parser.add_argument('-r', '--reset', dest='reset', action='store_true',
+        help="clear the statistics after reporting them")
+    parser.add_argument('-H', '--histogram', dest='histogram', action='store_true',
+        help="print a histogram of execution times for each task")
+
+    args = parser.parse_args()
+    device = parser.find_specified_device()
+
+    if not device.supports_api('profile'):
+        print("ERROR: This board's firmware doesn't support profiling; try updating it.")
+        sys.exit(-1)
+
+    if args.interval:
+        device.apis.profile.reset()
+        time.sleep(args.interval)
+
+    cycle_frequency, profiles = read_profiles(device)
+    if args.reset:
+        device.apis.profile.reset()
+
+    # Express each task's total time as a fraction of the total time spent across all scheduler passes.
+    elapsed_cycles = sum(profile['total_cycles'] for profile in profiles if profile['name'] == 'scheduler_pass')
+
+    print("{:<24} {:>10} {:>12} {:>12} {:>8}".format("name", "calls", "average (us)", "max (us)", "time"))
+    for profile in profiles:
+        calls = profile['calls']
+        average = (profile['total_cycles'] / calls) * 1e6 / cycle_frequency if calls else 0
+        maximum = profile['max_cycles'] * 1e6 / cycle_frequency
+        share = "{:.1f}%".format(100 * profile['total_cycles'] / elapsed_cycles) if elapsed_cycles else "-"
+
+        print("{:<24} {:>10} {:>12.2f} {:>12.2f} {:>8}".format(profile['name'], calls, average, maximum, share))
+
+        if args.histogram:
+            print_histogram(profile, cycle_frequency)
+
+
+if __name__ == '__main__':
+    main()
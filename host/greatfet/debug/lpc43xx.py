@@ -2,12 +2,14 @@
 # Debug definitions for the LPC43xx.
 #
 
-from cmsis_svd.parser import SVDParser
-from .svd import DebugTarget, DebugPeripheral
+from .svd import DebugTarget, DebugPeripheral, load_svd_device
 
 class VirtualLPC43xxTarget(DebugTarget):
     """ Debug target for working with LPC43xx peripherals. """
 
+    # Move memory in 2048-byte chunks, which fit nicely in a single libgreat command.
+    MEMORY_CHUNK_SIZE = 2048
+
     def __init__(self, device):
         """
         Create a new instance of LPC43xxDebugTarget. Note that this class is empty; and is meant to be
@@ -27,6 +29,47 @@ class VirtualLPC43xxTarget(DebugTarget):
         self.api.poke(address, value)
 
 
+    def _supports_block_access(self):
+        """ Returns true iff the connected GreatFET can read and write memory in blocks. """
+        return self.api.supports_verb('read_memory')
+
+
+    def peek_multiple(self, addresses):
+        if not self._supports_block_access():
+            return super().peek_multiple(addresses)
+
+        values = []
+
+        # Read the addresses in batches that fit comfortably in a single command.
+        for position in range(0, len(addresses), self.MEMORY_CHUNK_SIZE // 4):
+            values.extend(self.api.peek_multiple(addresses[position:position + self.MEMORY_CHUNK_SIZE // 4]))
+
+        return values
+
+
+    def read_memory(self, address, length, access_width=4):
+        if not self._supports_block_access():
+            return super().read_memory(address, length, access_width)
+
+        data = bytearray()
+
+        for position in range(0, length, self.MEMORY_CHUNK_SIZE):
+            chunk_length = min(self.MEMORY_CHUNK_SIZE, length - position)
+            data.extend(self.api.read_memory(address + position, chunk_length, access_width))
+
+        return bytes(data)
+
+
+    def write_memory(self, address, data, access_width=4):
+        if not self._supports_block_access():
+            return super().write_memory(address, data, access_width)
+
+        data = memoryview(data).cast('B')
+
+        for position in range(0, len(data), self.MEMORY_CHUNK_SIZE):
+            self.api.write_memory(address + position, access_width, bytes(data[position:position + self.MEMORY_CHUNK_SIZE]))
+
+
 
 def LPC43xxTarget(device):
     """ Factory function that creates a low-level LPC43xx target. """
@@ -34,6 +77,4 @@ def LPC43xxTarget(device):
     from .. import find_greatfet_asset
 
     svd_file = find_greatfet_asset('LPC43xx_43Sxx.svd')
-    svd = SVDParser.for_xml_file(svd_file)
-
-    return VirtualLPC43xxTarget.from_svd(svd.get_device(), device)
+    return VirtualLPC43xxTarget.from_svd(load_svd_device(svd_file), device)
@@ -3,10 +3,168 @@
 # TODO: decide if this should be in libgreat?
 #
 
+import os
+import json
+import hashlib
+import tempfile
+
+from types import SimpleNamespace
+
 import tabulate
 tabulate.PRESERVE_WHITESPACE = True
 
 
+# Version of our compiled SVD model; bump this whenever the model's layout changes,
+# so stale cache entries are ignored.
+SVD_MODEL_VERSION = 1
+
+
+def _svd_cache_directory():
+    """ Returns the directory in which compiled SVD models are cached. """
+
+    cache_root = os.getenv('XDG_CACHE_HOME', os.path.join(os.path.expanduser('~'), '.cache'))
+    return os.path.join(cache_root, 'greatfet', 'svd')
+
+
+def _compile_svd_device(svd_device):
+    """ Flattens a parsed cmsis_svd device into the plain data our debug objects need. """
+
+    def compile_enumerated_value(value):
+        return {'name': value.name, 'value': value.value, 'description': value.description}
+
+    def compile_field(field):
+        enumerated_values = field.enumerated_values
+        if enumerated_values:
+            enumerated_values = [compile_enumerated_value(value) for value in enumerated_values]
+
+        return {
+            'name':              field.name,
+            'description':       field.description,
+            'access':            field.access,
+            'bit_offset':        field.bit_offset,
+            'bit_width':         field.bit_width,
+            'enumerated_values': enumerated_values
+        }
+
+    def compile_register(register):
+        return {
+            'name':           register.name,
+            'description':    register.description,
+            'access':         register.access,
+            'address_offset': register.address_offset,
+            'fields':         [compile_field(field) for field in register.fields]
+        }
+
+    def compile_peripheral(peripheral):
+        return {
+            'name':         peripheral.name,
+            'description':  peripheral.description,
+            '_description': peripheral._description,
+            'base_address': peripheral.base_address,
+            'registers':    [compile_register(register) for register in peripheral.registers]
+        }
+
+    return {
+        'name':        svd_device.name,
+        'description': svd_device.description,
+        'peripherals': [compile_peripheral(peripheral) for peripheral in svd_device.peripherals]
+    }
+
+
+def load_svd_device(svd_filename):
+    """ Returns a device model for the given SVD file, suitable for passing to DebugTarget.from_svd.
+
+    Parsing a full SVD file is slow; so the parsed model is cached in the user's cache directory,
+    keyed by the SVD file's hash, and re-used until the file changes.
+    """
+
+    with open(svd_filename, 'rb') as f:
+        svd_hash = hashlib.sha256(f.read()).hexdigest()
+
+    cache_directory = _svd_cache_directory()
+    cache_filename = os.path.join(cache_directory, "{}-v{}.json".format(svd_hash, SVD_MODEL_VERSION))
+
+    # If we've already compiled this SVD, use our compiled model.
+    try:
+        with open(cache_filename, 'r') as f:
+            return json.load(f, object_hook=lambda fields: SimpleNamespace(**fields))
+    except (OSError, ValueError):
+        pass
+
+    # Otherwise, parse the SVD itself. We only import the parser here, as it's slow to load.
+    from cmsis_svd.parser import SVDParser
+    model = _compile_svd_device(SVDParser.for_xml_file(svd_filename).get_device())
+
+    # Cache the compiled model for next time. We write to a temporary file and then move it into
+    # place, so concurrent sessions never see a partial model. Failing to cache isn't fatal.
+    temporary_filename = None
+    try:
+        os.makedirs(cache_directory, exist_ok=True)
+
+        with tempfile.NamedTemporaryFile('w', dir=cache_directory, delete=False) as f:
+            temporary_filename = f.name
+            json.dump(model, f, separators=(',', ':'))
+
+        os.replace(temporary_filename, cache_filename)
+        temporary_filename = None
+    except OSError:
+        pass
+    finally:
+        # If we didn't manage to move our temporary file into place, don't leave it behind.
+        if temporary_filename:
+            try:
+                os.remove(temporary_filename)
+            except OSError:
+                pass
+
+    return json.loads(json.dumps(model), object_hook=lambda fields: SimpleNamespace(**fields))
+
+
+class LazyChildren(dict):
+    """ Dictionary of SVD-generated children that only creates each child when it's first accessed.
+
+    Generating types for every register and field of a device is slow; and most are never touched.
+    """
+
+    def __init__(self):
+        super().__init__()
+        self._factories = {}
+
+
+    def add_lazy(self, name, factory):
+        """ Registers a child, which will be created by calling factory() on first access. """
+        self._factories[name] = factory
+
+
+    def __missing__(self, name):
+        value = self[name] = self._factories[name]()
+        return value
+
+
+    def __contains__(self, name):
+        return (name in self._factories) or super().__contains__(name)
+
+
+    def __iter__(self):
+        return iter(self.keys())
+
+
+    def __len__(self):
+        return len(self.keys())
+
+
+    def keys(self):
+        return list(self._factories.keys()) + [name for name in super().keys() if name not in self._factories]
+
+
+    def values(self):
+        return [self[name] for name in self.keys()]
+
+
+    def items(self):
+        return [(name, self[name]) for name in self.keys()]
+
+
 class SVDGenerated(object):
     """ Generic base class for objects generated from SVDs. """
 
@@ -139,15 +297,18 @@ class SVDGenerated(object):
         # Finally, create our relevant instance...
         instance = unique_type(*arguments)
 
-        # ... and populate each of the fields, complete with a parent reference.
+        # ... and populate each of the fields, complete with a parent reference. Each child is only
+        # generated once it's first used, as generating the full tree of types is slow.
+        children = LazyChildren()
         for value in getattr(svd_object, instance._attribute):
 
             if value.name is None:
                 continue
 
             name = cls._normalize_name(value.name)
-            instance._children[name] = child_type.from_svd(value, instance)
+            children.add_lazy(name, lambda value=value : child_type.from_svd(value, instance))
 
+        instance.__dict__['_children'] = children
         return instance
 
 
@@ -207,24 +368,24 @@ class MemoryWindow(SVDGenerated):
     _name = "memory"
     _description = "Full memory address space"
 
-    def __init__(self, peek_function, poke_function):
+    def __init__(self, peek_function, poke_function, peek_multiple_function=None):
         """ Sets up our view into memory. """
 
         # Store our peek and poke functions,
         self.__dict__['peek'] = peek_function
         self.__dict__['poke'] = poke_function
 
+        # ... and, if we have one, a function that can read many addresses at once.
+        if peek_multiple_function is None:
+            peek_multiple_function = lambda addresses : [peek_function(address) for address in addresses]
+        self.__dict__['peek_multiple'] = peek_multiple_function
+
 
     def __getitem__(self, address):
         """ Shortcut that allows us to read memory using the index operator. """
 
         if isinstance(address, slice):
-            result = []
-
-            for i in range(address.start, address.stop, address.step or 1):
-                result.append(self.peek(i))
-
-            return result
+            return self.peek_multiple(list(range(address.start, address.stop, address.step or 1)))
         else:
             return self.peek(address)
 
@@ -261,7 +422,7 @@ class DebugTarget(SVDGenerated):
 
         # Finally, instantiate the unique type to get a register object.
         instance = cls._instantiate_unique_type(unique_type, DebugPeripheral, svd_device, *arguments)
-        instance._children['memory'] = MemoryWindow(instance.peek, instance.poke)
+        instance._children['memory'] = MemoryWindow(instance.peek, instance.poke, instance.peek_multiple)
 
         return instance
 
@@ -288,6 +449,46 @@ class DebugTarget(SVDGenerated):
         return self._poke(address, value)
 
 
+    def peek_multiple(self, addresses):
+        """ Returns a list containing the contents of each of the given target memory addresses.
+
+        Targets that can read several addresses at once should override this; by default, we peek each in turn.
+        """
+        return [self.peek(address) for address in addresses]
+
+
+    def read_memory(self, address, length, access_width=4):
+        """ Reads a block of target memory, and returns it as bytes.
+
+        Params:
+            address: The address at which to start reading.
+            length: The number of bytes to read; must be a multiple of the access width.
+            access_width: The size of each individual read, in bytes; 1, 2, or 4.
+        """
+
+        if access_width != 4:
+            raise NotImplementedError("this target only supports word-sized reads")
+
+        words = self.peek_multiple(list(range(address, address + length, 4)))
+        return b"".join(word.to_bytes(4, byteorder='little') for word in words)
+
+
+    def write_memory(self, address, data, access_width=4):
+        """ Writes a block of data into target memory.
+
+        Params:
+            address: The address at which to start writing.
+            data: The bytes to be written; must be a multiple of the access width in length.
+            access_width: The size of each individual write, in bytes; 1, 2, or 4.
+        """
+
+        if access_width != 4:
+            raise NotImplementedError("this target only supports word-sized writes")
+
+        for offset in range(0, len(data), 4):
+            self.poke(address + offset, int.from_bytes(data[offset:offset + 4], byteorder='little'))
+
+
     def peripherals(self):
         return self._children.keys()
 
@@ -347,15 +548,31 @@ class DebugPeripheral(SVDGenerated):
         return self._children.keys()
 
 
+    def snapshot(self):
+        """ Reads every readable register in the peripheral at once.
+
+        Returns:
+            A dictionary mapping register names to their values.
+        """
+
+        readable = [register for register in self._children.values() if not register.write_only]
+        values = self.parent.peek_multiple([self._base + register._offset for register in readable])
+
+        return {register._name: value for register, value in zip(readable, values)}
+
+
     def __repr__(self, include_fields=False):
 
         headers = ['register', 'dec', 'hex', 'bin', 'note']
         table_entries = []
 
+        # Capture all of our registers at once, rather than reading them one at a time.
+        snapshot = self.snapshot()
+
         # Add each of the registers to this representation.
         for register in self._children.values():
 
-                value = None if register.write_only else int(register)
+                value = snapshot.get(register._name)
 
                 table_entries.append(register._table_row(value))
 
@@ -566,9 +783,13 @@ class DebugField(SVDMemoryAccessible):
         return self.extract_value(raw)
 
 
-    def value_name(self, default=None):
-        """ Returns the name of the given field value, if it has one; by default, the raw value if not. """
-        value = self.peek()
+    def value_name(self, default=None, value=None):
+        """ Returns the name of the given field value, if it has one; by default, the raw value if not.
+
+        If a value isn't provided, the field is read from the target.
+        """
+        if value is None:
+            value = self.peek()
 
         # If we have a name for the value, return it.
         if value in self.value_names:
@@ -619,7 +840,7 @@ class DebugField(SVDMemoryAccessible):
         formatted_hex = "{:0{}x}".format(value, hex_width)
 
         # Finally, if have an enumerated value for the current
-        note = self.value_name(default='')
+        note = self.value_name(default='', value=value)
 
         # Finally, generate the table row for this field.
         return ["    ." + self._name, value, formatted_hex, formatted_binary, note]
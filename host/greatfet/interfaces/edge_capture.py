@@ -0,0 +1,186 @@
+#
+# This file is part of GreatFET
+#
+
+import struct
+import time
+import usb
+
+from collections import namedtuple
+
+from ..interface import GreatFETInterface
+
+
+# A single edge, as seen by the device.
+#   timestamp -- The time of the edge in seconds, relative to the start of capture.
+#   channel   -- The index of the pin on which the edge occurred, in the order the pins were configured.
+#   level     -- The level the pin changed to; True for high.
+Edge = namedtuple('Edge', ['timestamp', 'channel', 'level'])
+
+
+class EdgeCapture(GreatFETInterface):
+    """
+        Class that captures timestamped edges on up to eight of the GreatFET's GPIO pins.
+
+        Rather than sampling its pins continuously, the GreatFET reports only when each pin changes;
+        which makes it well suited to timing PWM, IR and other sparse signals.
+    """
+
+    # The format of each event sent by the device: timestamp, channel, level, flags, reserved.
+    EVENT_FORMAT = struct.Struct("<IBBBB")
+
+    # Event flags.
+    EVENT_HEARTBEAT      = (1 << 0)
+    EVENT_AFTER_OVERFLOW = (1 << 1)
+
+    MAX_CHANNELS      = 8
+    READ_SIZE         = 0x4000
+    USB_TIMEOUT_ERRNO = 110
+
+
+    def __init__(self, board):
+        """ Set up a GreatFET edge capture object. """
+
+        # Grab a reference to the board and its edge-capture API.
+        self.board = board
+        self.api   = board.apis.edge_capture
+
+        self.timestamp_frequency = None
+        self.pipe                = None
+
+        # State used to extend the device's 32-bit timestamps.
+        self._first_timestamp = None
+        self._last_timestamp  = 0
+        self._wraps           = 0
+        self._partial_event   = b""
+
+        # True iff the device has dropped events since we last checked.
+        self.overflowed = False
+
+
+    def _resolve_pin(self, pin):
+        """ Converts a pin name, GPIOPin, or (port, pin) tuple into a (port, pin) tuple. """
+
+        if isinstance(pin, str):
+            return self.board.gpio.pin_mappings[pin]
+
+        if hasattr(pin, 'get_port'):
+            return (pin.get_port(), pin.get_pin())
+
+        return tuple(pin)
+
+
+    def configure(self, *pins):
+        """ Configures the pins to watch for edges.
+
+        Args:
+            pins -- Up to eight pins to watch; each can be a pin name (e.g. 'J1_P3'), a GPIOPin,
+                    or a (port, pin) tuple. Each pin's edges are reported with the channel number
+                    matching its position in this list.
+
+        Returns the frequency of the device's timestamp clock, in Hz.
+        """
+
+        if len(pins) > self.MAX_CHANNELS:
+            raise ValueError("can only capture edges on up to {} pins".format(self.MAX_CHANNELS))
+
+        resolved = [self._resolve_pin(pin) for pin in pins]
+        self.timestamp_frequency = self.api.configure(resolved)
+
+        return self.timestamp_frequency
+
+
+    def start(self):
+        """ Starts capturing edges. """
+
+        self._first_timestamp = None
+        self._last_timestamp  = 0
+        self._wraps           = 0
+        self._partial_event   = b""
+        self.overflowed       = False
+
+        self.pipe = self.api.start()
+
+
+    def stop(self):
+        """ Stops capturing edges. Any events already captured can still be read. """
+        self.api.stop()
+
+
+    def status(self):
+        """ Returns a tuple of (running, events_captured, events_dropped). """
+        return self.api.get_status()
+
+
+    def _extend_timestamp(self, timestamp):
+        """ Converts one of the device's 32-bit timestamps into seconds since the start of capture. """
+
+        # The device guarantees that consecutive events are never more than half a wrap apart,
+        # so any time a timestamp goes backwards, the counter has wrapped.
+        if self._first_timestamp is None:
+            self._first_timestamp = timestamp
+        elif timestamp < self._last_timestamp:
+            self._wraps += 1
+
+        self._last_timestamp = timestamp
+
+        ticks = (self._wraps << 32) + timestamp - self._first_timestamp
+        return ticks / self.timestamp_frequency
+
+
+    def _parse_events(self, data):
+        """ Converts a block of raw event data into a list of Edge objects. """
+
+        edges = []
+
+        # Hold on to any partial event until the rest of it arrives.
+        data = self._partial_event + bytes(data)
+        usable_length = len(data) - (len(data) % self.EVENT_FORMAT.size)
+        self._partial_event = data[usable_length:]
+
+        for timestamp, channel, level, flags, _ in self.EVENT_FORMAT.iter_unpack(data[:usable_length]):
+            seconds = self._extend_timestamp(timestamp)
+
+            if flags & self.EVENT_AFTER_OVERFLOW:
+                self.overflowed = True
+            if flags & self.EVENT_HEARTBEAT:
+                continue
+
+            edges.append(Edge(seconds, channel, bool(level)))
+
+        return edges
+
+
+    def read(self, timeout=1):
+        """ Reads any edges the device has captured.
+
+        Args:
+            timeout -- The maximum time to wait for new edges, in seconds.
+
+        Returns a list of Edge objects; which is empty if no edges arrived before the timeout.
+        """
+
+        try:
+            data = self.board.comms.device.read(self.pipe, self.READ_SIZE, int(timeout * 1000))
+        except usb.core.USBError as e:
+            if e.errno == self.USB_TIMEOUT_ERRNO:
+                return []
+            raise
+
+        return self._parse_events(data)
+
+
+    def capture(self, duration):
+        """ Captures edges for the given number of seconds, and returns a list of the Edges seen. """
+
+        edges = []
+
+        self.start()
+
+        deadline = time.time() + duration
+        while time.time() < deadline:
+            edges.extend(self.read(timeout=min(0.1, max(deadline - time.time(), 0.001))))
+
+        self.stop()
+
+        return edges
@@ -2,6 +2,9 @@
 # This file is part of GreatFET
 #
 
+import time
+import zlib
+
 from ..interface import PirateCompatibleInterface
 
 
@@ -116,6 +119,63 @@ class I2CBus(PirateCompatibleInterface):
         return self.read(address, receive_length)
 
 
+    def supports_eeprom_programming(self):
+        """ Returns true iff the connected GreatFET can program EEPROMs from a bulk data stream. """
+        return self.api.supports_verb("eeprom_program")
+
+
+    def program_eeprom(self, address, word_address, data, page_size, address_bytes, verify=True,
+            write_cycle_timeout=0.05):
+        """
+            Programs an I2C EEPROM using the GreatFET's on-device page programming engine.
+
+            Data is streamed to the GreatFET over its bulk pipe, and written a page at a time;
+            the device detects the end of each write cycle by ACK polling, rather than waiting
+            for a fixed delay.
+
+            Args:
+                address -- The 7-bit I2C address of the EEPROM (or EEPROM block) to program.
+                word_address -- The address within the EEPROM at which to start writing.
+                data -- The data to be written. Must not cross an EEPROM block boundary.
+                page_size -- The EEPROM's page size, in bytes.
+                address_bytes -- The number of bytes used to encode a word address (1 or 2).
+                verify -- If true, the GreatFET will read back and check each page as it's written.
+                write_cycle_timeout -- The longest we expect a single page write to take, in seconds.
+
+            Returns:
+                The number of bytes programmed.
+        """
+
+        data = bytes(data)
+        if not data:
+            return 0
+
+        # Estimate how long the device could take to consume all of our data; as the device
+        # only accepts data as fast as it can program it.
+        pages = (len(data) + page_size - 1) // page_size + 1
+        timeout = 1 + pages * write_cycle_timeout * (2 if verify else 1)
+
+        pipe = self.api.eeprom_program(address, address_bytes, page_size, word_address, len(data), verify)
+        self.board.comms.device.write(pipe, data, int(timeout * 1000))
+
+        # Wait for the device to finish programming the data it's received.
+        deadline = time.time() + timeout
+        while True:
+            complete, bytes_programmed, checksum = self.api.eeprom_program_status()
+
+            if complete:
+                break
+            if time.time() > deadline:
+                raise IOError("timed out waiting for EEPROM programming to complete")
+
+            time.sleep(write_cycle_timeout / 10)
+
+        if bytes_programmed != len(data) or checksum != zlib.crc32(data):
+            raise IOError("EEPROM programming checksum mismatch")
+
+        return bytes_programmed
+
+
     def scan(self):
         """
             TX/RX over the I2C bus, and receives ACK/NAK
@@ -0,0 +1,91 @@
+#
+# This file is part of GreatFET
+#
+
+import time
+
+from ..interface import GreatFETInterface
+
+
+class ParallelOutput(GreatFETInterface):
+    """
+        Class that drives a parallel bus on one of the GreatFET's GPIO ports, using the device's DMA engine.
+
+        Unlike the pattern generator, this can drive any GPIO port; but only 8- or 16-bit buses
+        that start on a byte boundary of their port.
+    """
+
+    def __init__(self, board):
+        """ Set up a GreatFET parallel output object. """
+
+        # Grab a reference to the board and its parallel-output API.
+        self.board = board
+        self.api   = board.apis.parallel_out
+
+        self.bus_width   = None
+        self.sample_rate = None
+
+
+    def configure(self, port, first_pin, bus_width=8, sample_rate=1e6):
+        """ Configures the GPIO port pins that will make up the parallel bus.
+
+        Args:
+            port        -- The number of the GPIO port to drive.
+            first_pin   -- The lowest pin number in the bus; must be a multiple of the bus width.
+            bus_width   -- The width of the bus, in bits; 8 or 16.
+            sample_rate -- The rate at which samples should be scanned out, in samples per second.
+
+        Returns the actual sample rate, which is the closest the device can achieve.
+        """
+
+        self.bus_width   = bus_width
+        self.sample_rate = self.api.configure(port, first_pin, bus_width, int(sample_rate))
+
+        return self.sample_rate
+
+
+    def write(self, samples, timeout=None):
+        """ Scans out the given samples, and waits for the device to finish.
+
+        Args:
+            samples -- The samples to be scanned out. For 16-bit buses, samples are little endian.
+            timeout -- The maximum time to wait, in seconds; or None to pick one based on the sample rate.
+
+        Returns the number of times the device ran out of samples to scan out; or 0 if the output was seamless.
+        """
+
+        samples = memoryview(samples).cast('B')
+
+        if timeout is None:
+            sample_count = len(samples) // (self.bus_width // 8)
+            timeout = 5 + (sample_count / self.sample_rate)
+
+        pipe = self.api.start_stream(len(samples))
+        self.board.comms.device.write(pipe, samples, int(timeout * 1000))
+
+        # Wait for the device to finish scanning out the samples it's received.
+        deadline = time.time() + timeout
+        complete, _, underruns = self.api.get_status()
+        while not complete:
+            if time.time() > deadline:
+                raise IOError("timed out waiting for parallel output to complete")
+
+            time.sleep(0.001)
+            complete, _, underruns = self.api.get_status()
+
+        return underruns
+
+
+    def start_stream(self):
+        """ Starts scanning out samples continuously; returns the bulk pipe to which samples should be written. """
+        return self.api.start_stream(0)
+
+
+    def stop(self):
+        """ Stops the device from scanning out any further samples, and releases the bus's pins.
+
+        The bus must be configured again before it can be used.
+        """
+        self.api.stop()
+        self.bus_width   = None
+        self.sample_rate = None
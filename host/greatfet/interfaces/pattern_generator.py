@@ -2,6 +2,8 @@
 # This file is part of GreatFET
 #
 
+import time
+
 from ..interface import GreatFETInterface
 
 
@@ -25,6 +27,9 @@ class PatternGenerator(GreatFETInterface):
         self.upload_chunk_size = 2048
         self.samples_max       = 32 * 1024
 
+        # Maps the names of sequencer segments to their IDs on the device.
+        self.segments = {}
+
 
     def set_sample_rate(self, sample_rate):
         """ Updates the generator's sample rates. """
@@ -51,6 +56,66 @@ class PatternGenerator(GreatFETInterface):
         self.api.generate_pattern(self.sample_rate, self.bus_width, len(samples), repeat)
 
 
+    def clear_segments(self):
+        """ Stops the sequencer, and discards any segments stored on the device. """
+        self.api.clear_sequencer()
+        self.segments = {}
+
+
+    def add_segment(self, name, samples):
+        """ Stores a segment of packed samples on the device, for later use in sequences.
+
+        Args:
+            name    -- The name by which the segment will be referred to in sequences.
+            samples -- The packed samples that make up the segment; must be a multiple of four bytes long.
+        """
+
+        samples = bytes(samples)
+
+        if name in self.segments:
+            raise ValueError("a segment named '{}' already exists; clear the segments to replace it".format(name))
+
+        segment_id = self.api.add_segment(len(samples))
+
+        for offset in range(0, len(samples), self.upload_chunk_size):
+            self.api.upload_segment_data(segment_id, offset, samples[offset:offset + self.upload_chunk_size])
+
+        self.segments[name] = segment_id
+
+
+    def play_sequence(self, sequence, loop=False, wait=False, timeout=None):
+        """ Plays a sequence of stored segments back to back, without gaps.
+
+        Args:
+            sequence -- A list of (segment_name, repeat_count) tuples; or of bare segment names, which are played once.
+            loop     -- If true, the sequence restarts once it's complete, until stopped.
+            wait     -- If true, waits for a one-shot sequence to complete, and returns the number of underruns.
+            timeout  -- The maximum time to wait, in seconds; or None to wait indefinitely.
+        """
+
+        entries = []
+        for entry in sequence:
+            name, repeat_count = (entry, 1) if isinstance(entry, str) else entry
+            entries.append((self.segments[name], repeat_count))
+
+        self.api.set_sequence(loop, entries)
+        self.api.start_sequence(self.sample_rate, self.bus_width)
+
+        if not wait or loop:
+            return None
+
+        deadline = None if timeout is None else time.time() + timeout
+        complete, _, underruns = self.api.get_sequence_status()
+        while not complete:
+            if deadline and time.time() > deadline:
+                raise IOError("timed out waiting for the sequence to complete")
+
+            time.sleep(0.01)
+            complete, _, underruns = self.api.get_sequence_status()
+
+        return underruns
+
+
     def stop(self):
         """ Stops the board from scanning out any further samples. """
         self.api.stop()
@@ -4,6 +4,7 @@
 #
 
 import array
+import time
 import usb
 
 from ..interface import GreatFETInterface
@@ -33,6 +34,12 @@ class SDIRTransceiver(GreatFETInterface):
         self.coupling_pin = None
         self.running      = False
 
+        self.transmit_sample_rate = None
+
+        # On-device receive filtering; a decimation of 1 with no DC removal streams raw 8-bit samples.
+        self.decimation       = 1
+        self.dc_time_constant = 0
+
 
     def set_coupling(self, ac_coupled):
         """ Sets whether the SDIR sampling is AC or DC coupling. """
@@ -46,6 +53,31 @@ class SDIRTransceiver(GreatFETInterface):
             self.coupling_pin.high()
 
 
+    def configure_receive(self, decimation=1, dc_time_constant=0):
+        """ Configures on-device filtering of received samples.
+
+        Args:
+            decimation       -- The number of ADC samples combined into each sample sent to the host; 1-256.
+            dc_time_constant -- If non-zero, removes any DC offset from the received samples, tracking it with a
+                                time constant of 2^dc_time_constant output samples.
+
+        When either is enabled, the device sends signed 16-bit samples rather than raw 8-bit ADC samples.
+        Returns the sample rate of the data that will be sent to the host.
+        """
+
+        output_rate = self.api.configure_receive(decimation, dc_time_constant)
+
+        self.decimation       = decimation
+        self.dc_time_constant = dc_time_constant
+        return output_rate
+
+
+    @property
+    def filtering(self):
+        """ True iff received samples are filtered on the device, and thus arrive as signed 16-bit samples. """
+        return (self.decimation > 1) or bool(self.dc_time_constant)
+
+
     def start_receive(self):
         self.set_gain(self.gain)
         pipe = self.api.start_receive()
@@ -53,9 +85,62 @@ class SDIRTransceiver(GreatFETInterface):
         return pipe
 
 
+    def configure_transmit(self, sample_rate=1e6):
+        """ Sets up the transmit DAC; returns the closest sample rate the device can achieve. """
+        self.transmit_sample_rate = self.api.configure_transmit(int(sample_rate))
+        return self.transmit_sample_rate
+
+
+    def start_transmit(self):
+        """ Starts transmitting continuously; returns the bulk pipe to which DAC samples should be written. """
+
+        if self.transmit_sample_rate is None:
+            self.configure_transmit()
+
+        pipe = self.api.start_transmit(0)
+        self.running = True
+        return pipe
+
+
+    def write(self, samples, timeout=None):
+        """ Transmits the given 8-bit DAC samples, and waits for the device to finish.
+
+        Args:
+            samples -- The DAC samples to be transmitted.
+            timeout -- The maximum time to wait, in seconds; or None to pick one based on the sample rate.
+
+        Returns the number of times the device ran out of samples to transmit; or 0 if the output was seamless.
+        """
+
+        if self.transmit_sample_rate is None:
+            self.configure_transmit()
+
+        samples = memoryview(samples).cast('B')
+
+        if timeout is None:
+            timeout = 5 + (len(samples) / self.transmit_sample_rate)
+
+        pipe = self.api.start_transmit(len(samples))
+        self.running = True
+        self.board.comms.device.write(pipe, samples, int(timeout * 1000))
+
+        # Wait for the device to finish scanning out the samples it's received.
+        deadline = time.time() + timeout
+        complete, _, underruns = self.api.get_transmit_status()
+        while not complete:
+            if time.time() > deadline:
+                raise IOError("timed out waiting for SDIR transmission to complete")
+
+            time.sleep(0.001)
+            complete, _, underruns = self.api.get_transmit_status()
+
+        return underruns
+
+
     def stop(self):
         self.api.stop()
         self.running = False
+        self.transmit_sample_rate = None
 
 
     def set_gain(self, db_gain):
@@ -82,3 +167,14 @@ class SDIRTransceiver(GreatFETInterface):
             else:
                 raise
 
+
+    def read_samples(self, timeout=1000, max_data=0x4000, autostart=False, allow_timeout=False):
+        """ Reads all available samples from the GreatFET, as signed 16-bit values if we're filtering on-device. """
+
+        data = self.read(timeout=timeout, max_data=max_data, autostart=autostart, allow_timeout=allow_timeout)
+
+        if data is None or not self.filtering:
+            return data
+
+        return array.array('h', data.tobytes())
+
@@ -2,6 +2,8 @@
 # This file is part of GreatFET
 #
 
+import time
+
 from ..interface import PirateCompatibleInterface
 
 
@@ -17,6 +19,9 @@ class SPIBus(PirateCompatibleInterface):
     # Short name for this type of interface.
     INTERFACE_SHORT_NAME = "spi"
 
+    # Transfers at least this long will be streamed over the GreatFET's bulk pipes, when possible.
+    MINIMUM_STREAMING_LENGTH = 1024
+
     class FREQ():
         """
             Set of predefined frequencies used to configure the SPI bus. It
@@ -82,6 +87,9 @@ class SPIBus(PirateCompatibleInterface):
         # Store our chip select.
         self._chip_select = chip_select_gpio
 
+        # We don't yet know whether the bus can stream; we'll find out when we need to.
+        self._supports_streaming = None
+
         # Apply our frequency information.
         if freq_preset:
             clock_prescale_rate, serial_clock_rate = freq_preset
@@ -106,6 +114,51 @@ class SPIBus(PirateCompatibleInterface):
 
 
 
+    def _set_spi_mode(self, spi_mode):
+        """ Applies the given SPI mode to the bus. """
+
+        # We can't cache this: other firmware classes (e.g. spi_flash and firmware) re-initialize the
+        # SSP behind our back, which resets its mode; so we apply it for every transaction.
+        self.api.set_clock_polarity_and_phase(spi_mode)
+
+
+    def _start_transaction(self, chip_select, spi_mode):
+        """ Prepares the bus for a transaction, and returns the chip select that should frame it. """
+
+        # If we weren't provided with a chip-select, use the bus's default.
+        if chip_select is None:
+            chip_select = self._chip_select
+
+        # Set the polarity and phase (the "SPI mode").
+        self._set_spi_mode(spi_mode)
+
+        # Bring the relevant chip select low, to start the transaction.
+        if chip_select:
+            chip_select.low()
+
+        return chip_select
+
+
+    def _end_transaction(self, chip_select, deassert_chip_select):
+        """ Finishes a transaction, unless the caller has asked to keep chip select asserted. """
+
+        if chip_select and deassert_chip_select:
+            chip_select.high()
+
+
+    def _should_stream(self, length):
+        """ Returns true iff a transfer of the given length should use the GreatFET's bulk pipes. """
+        return (length >= self.MINIMUM_STREAMING_LENGTH) and self.supports_streaming()
+
+
+    @staticmethod
+    def _streaming_timeout(length):
+        """ Returns a conservative timeout for streaming the given amount of data, in seconds. """
+
+        # Allow for data to be clocked at as little as 50kB/s, to accommodate slow SPI clocks.
+        return 5 + length / 50e3
+
+
     def transmit(self, data, receive_length=None, chip_select=None, deassert_chip_select=True, spi_mode=0):
         """
         Sends (and typically receives) data over the SPI bus.
@@ -125,46 +178,158 @@ class SPIBus(PirateCompatibleInterface):
         data_to_transmit = bytearray(data)
         data_received = bytearray()
 
-        # If we weren't provided with a chip-select, use the bus's default.
-        if chip_select is None:
-            chip_select = self._chip_select
-
         if receive_length is None:
-            receive_length = len(data)
+            receive_length = len(data_to_transmit)
+
+        # If we're only clocking in data, use our receive-only path, which doesn't need to send padding.
+        if not data_to_transmit:
+            return self.read(receive_length, chip_select=chip_select,
+                deassert_chip_select=deassert_chip_select, spi_mode=spi_mode)
 
         # If we need to receive more than we've transmitted, extend the data out.
-        if receive_length > len(data):
-            padding = receive_length - len(data)
+        if receive_length > len(data_to_transmit):
+            padding = receive_length - len(data_to_transmit)
             data_to_transmit.extend([0] * padding)
 
-        # Set the polarity and phase (the "SPI mode").
-        self.api.set_clock_polarity_and_phase(spi_mode)
-
-        # Bring the relevant chip select low, to start the transaction.
-        if chip_select:
-            chip_select.low()
+        chip_select = self._start_transaction(chip_select, spi_mode)
 
         # Transmit our data in chunks of the buffer size.
-        while data_to_transmit:
+        to_transmit = memoryview(data_to_transmit)
+        for position in range(0, len(to_transmit), self.buffer_size):
 
             # Extract a single data chunk from the transmit buffer.
-            chunk = data_to_transmit[0:self.buffer_size]
-            del data_to_transmit[0:self.buffer_size]
+            chunk = to_transmit[position:position + self.buffer_size]
 
             # Finally, exchange the data.
             response = self.api.clock_data(len(chunk), bytes(chunk))
             data_received.extend(response)
 
-
         # Finally, unless the caller has requested we keep chip-select asserted,
         # finish the transaction by releasing chip select.
-        if chip_select and deassert_chip_select:
-            chip_select.high()
+        self._end_transaction(chip_select, deassert_chip_select)
 
         # Once we're done, return the data received.
         return bytes(data_received)
 
 
+    def write(self, data, chip_select=None, deassert_chip_select=True, spi_mode=0):
+        """
+        Sends data over the SPI bus, without capturing any data in response.
+
+        Large writes are streamed to the GreatFET over its bulk pipe, when the firmware supports it.
+
+        Args:
+            data                 -- the data to be sent to the given device.
+            chip_select          -- the GPIOPin object that will serve as the chip select
+                    for this transaction, None to use the bus's default, or False to not set CS.
+            deassert_chip_select -- if set, the chip-select line will be left low after
+                    communicating; this allows this transcation to be continued in the future
+            spi_mode             -- The SPI mode number [0-3] to use for the communication. Defaults to 0.
+        """
+
+        data = memoryview(data).cast('B')
+
+        if self._should_stream(len(data)):
+            return self.write_stream(data, chip_select=chip_select,
+                deassert_chip_select=deassert_chip_select, spi_mode=spi_mode)
+
+        chip_select = self._start_transaction(chip_select, spi_mode)
+
+        # Send our data in chunks of the buffer size; asking for no data back.
+        for position in range(0, len(data), self.buffer_size):
+            self.api.clock_data(0, bytes(data[position:position + self.buffer_size]))
+
+        self._end_transaction(chip_select, deassert_chip_select)
+
+
+    def read(self, length, fill=0, chip_select=None, deassert_chip_select=True, spi_mode=0):
+        """
+        Receives data over the SPI bus, sending a constant fill byte.
+
+        Large reads are streamed from the GreatFET over its bulk pipe, when the firmware supports it.
+
+        Args:
+            length               -- the amount of data to be read.
+            fill                 -- the byte value to be clocked out while reading.
+            chip_select          -- the GPIOPin object that will serve as the chip select
+                    for this transaction, None to use the bus's default, or False to not set CS.
+            deassert_chip_select -- if set, the chip-select line will be left low after
+                    communicating; this allows this transcation to be continued in the future
+            spi_mode             -- The SPI mode number [0-3] to use for the communication. Defaults to 0.
+        """
+
+        data_received = bytearray()
+        streaming = self._should_stream(length)
+
+        chip_select = self._start_transaction(chip_select, spi_mode)
+
+        if streaming:
+            pipe = self.api.stream_data_in(length, fill)
+            data_received = self.board.comms.device.read(pipe, length, int(self._streaming_timeout(length) * 1000))
+        else:
+            for position in range(0, length, self.buffer_size):
+                chunk_length = min(self.buffer_size, length - position)
+                data_received.extend(self.api.clock_data(chunk_length, bytes([fill]) * chunk_length))
+
+        self._end_transaction(chip_select, deassert_chip_select)
+        return bytes(data_received)
+
+
+    def supports_streaming(self):
+        """ Returns true iff the connected GreatFET can stream SPI data over its bulk pipes. """
+
+        if self._supports_streaming is None:
+            self._supports_streaming = self.api.supports_verb("stream_data_out") and \
+                self.api.supports_verb("stream_data_in")
+
+        return self._supports_streaming
+
+
+    def write_stream(self, data, chip_select=None, deassert_chip_select=True, spi_mode=0, timeout=None):
+        """
+        Sends a large block of data over the SPI bus, discarding any data received.
+
+        Rather than breaking the data up into control transfers, the data is streamed to the
+        GreatFET over its bulk pipe, and clocked out by the device as it arrives.
+
+        Args:
+            data                 -- a bytes-like object containing the data to be sent. It's sent
+                    as-is, without being copied.
+            chip_select          -- the GPIOPin object that will serve as the chip select
+                    for this transaction, None to use the bus's default, or False to not set CS.
+            deassert_chip_select -- if set, the chip-select line will be left low after
+                    communicating; this allows this transcation to be continued in the future
+            spi_mode             -- The SPI mode number [0-3] to use for the communication. Defaults to 0.
+            timeout              -- The maximum time to wait for the transfer to complete, in seconds;
+                    or None to pick a timeout based on the length of the data.
+        """
+
+        data = memoryview(data).cast('B')
+
+        if timeout is None:
+            timeout = self._streaming_timeout(len(data))
+
+        chip_select = self._start_transaction(chip_select, spi_mode)
+
+        if len(data):
+            pipe = self.api.stream_data_out(len(data))
+            self.board.comms.device.write(pipe, data, int(timeout * 1000))
+
+            # Wait for the device to finish clocking out the data it's received.
+            deadline = time.time() + timeout
+            complete, _ = self.api.stream_status()
+            while not complete:
+                if time.time() > deadline:
+                    raise IOError("timed out waiting for SPI stream to complete")
+
+                time.sleep(0.001)
+                complete, _ = self.api.stream_status()
+
+        # Finally, unless the caller has requested we keep chip-select asserted,
+        # finish the transaction by releasing chip select.
+        self._end_transaction(chip_select, deassert_chip_select)
+
+
     def disable_drive(self):
         """ Tristates each of the pins on the given SPI bus. """
         self.api.enable_drive(False)
@@ -183,7 +348,7 @@ class SPIBus(PirateCompatibleInterface):
     def _handle_pirate_read(self, length, ends_transaction=False):
         """ Performs a bus-pirate read of the given length, and returns a list of numeric values. """
 
-        data_bytes = self.transmit(b"", receive_length=length, chip_select=False)
+        data_bytes = self.read(length, chip_select=False)
         return list(data_bytes)
 
 
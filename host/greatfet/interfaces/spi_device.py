@@ -40,3 +40,30 @@ class SPIDevice(GreatFETInterface):
         """
         return self._bus.transmit(data, receive_length, spi_mode=self._spi_mode,
                 chip_select=self._chip_select, deassert_chip_select=deassert_chip_select)
+
+
+    def _write(self, data, deassert_chip_select=True):
+        """
+        Sends data over the SPI bus, discarding any data received.
+
+        Args:
+            data                 -- the data to be sent to the given device.
+            deassert_chip_select -- if set, the chip-select line will be left low after
+                    communicating; this allows this transcation to be continued in the future
+        """
+        return self._bus.write(data, spi_mode=self._spi_mode,
+                chip_select=self._chip_select, deassert_chip_select=deassert_chip_select)
+
+
+    def _read(self, length, fill=0, deassert_chip_select=True):
+        """
+        Receives data over the SPI bus, clocking out a constant fill byte.
+
+        Args:
+            length               -- the amount of data to be read.
+            fill                 -- the byte value to be clocked out while reading.
+            deassert_chip_select -- if set, the chip-select line will be left low after
+                    communicating; this allows this transcation to be continued in the future
+        """
+        return self._bus.read(length, fill, spi_mode=self._spi_mode,
+                chip_select=self._chip_select, deassert_chip_select=deassert_chip_select)
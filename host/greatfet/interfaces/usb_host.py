@@ -0,0 +1,360 @@
+#
+# This file is part of GreatFET
+#
+
+import struct
+import usb
+
+from collections import deque, namedtuple
+
+from ..interface import GreatFETInterface
+
+
+# A single completed transfer, as reported by the device.
+#   tag      -- The tag the transfer was queued with.
+#   endpoint -- The endpoint address the transfer was performed on; its direction bit is set for IN transfers.
+#   status   -- One of the USBHost.STATUS_* constants.
+#   length   -- The number of bytes actually transferred.
+#   data     -- For IN transfers, the data read; otherwise, empty.
+TransferCompletion = namedtuple('TransferCompletion', ['tag', 'endpoint', 'status', 'length', 'data'])
+
+
+class USBHostError(IOError):
+    """ Raised when a transfer stalls or fails. """
+
+
+class USBHost(GreatFETInterface):
+    """
+        Class that lets the GreatFET act as a USB host on its USB1 port.
+
+        Transfers are queued on the device, several at a time, and their completions are reported
+        over a bulk pipe; so transfers larger than the device's buffers are pipelined rather than
+        performed one packet buffer at a time.
+    """
+
+    # Token PIDs, as used by the EHCI controller.
+    PID_OUT   = 0
+    PID_IN    = 1
+    PID_SETUP = 2
+
+    # Port speeds, as used when setting up endpoints.
+    SPEED_FULL = 0
+    SPEED_LOW  = 1
+    SPEED_HIGH = 2
+
+    # Endpoint transfer types, as in an endpoint descriptor. The device only supports control and bulk.
+    TRANSFER_TYPE_CONTROL = 0
+    TRANSFER_TYPE_BULK    = 2
+
+    # Transfer statuses.
+    STATUS_OK      = 0
+    STATUS_STALLED = 1
+    STATUS_ERROR     = 2
+    STATUS_CANCELLED = 3
+    STATUS_PADDING   = 0xFF
+
+    # The header of each completion event: tag, endpoint, status, length.
+    EVENT_FORMAT = struct.Struct("<HBBI")
+
+    # Limits imposed by the device's transfer buffers.
+    MAX_TRANSFER_SIZE = 2048
+    MAX_OUTSTANDING   = 8
+
+    # Tags at or above this are reserved for the device's padding events.
+    TAG_LIMIT = 0xFFFF
+
+    SETUP_FORMAT      = struct.Struct("<BBHHH")
+    READ_SIZE         = 0x4000
+    USB_TIMEOUT_ERRNO = 110
+
+
+    def __init__(self, board):
+        """ Set up a GreatFET USB host object. """
+
+        # Grab a reference to the board and its USB host API.
+        self.board = board
+        self.api   = board.apis.usbhost
+
+        self.pipe = None
+
+        self._next_tag       = 0
+        self._completed      = {}
+        self._partial_event  = b""
+
+        # Transfers the device hasn't reported yet, as tag -> (queue endpoint address, length); and the
+        # tags of those we've given up on after a flush, whose cancellations are still to arrive.
+        self._outstanding    = {}
+        self._abandoned      = set()
+
+        # Per-endpoint state for reads that were pipelined past the end of a short transfer.
+        self._pending_reads  = {}
+        self._leftover_data  = {}
+
+
+    def connect(self):
+        """ Puts the GreatFET into host mode, and provides VBUS to the attached device. """
+
+        self._outstanding.clear()
+        self._abandoned.clear()
+        self._completed.clear()
+        self._pending_reads.clear()
+        self._leftover_data.clear()
+        self._partial_event = b""
+
+        self.pipe = self.api.connect()
+
+
+    def disconnect(self):
+        """ Leaves host mode. """
+        self.api.disconnect()
+
+
+    def bus_reset(self):
+        """ Issues a bus reset to the attached device. """
+        self.api.bus_reset()
+
+
+    def port_status(self):
+        """ Returns the raw value of the host port's PORTSC1 register. """
+        return self.api.get_port_status()
+
+
+    def set_up_endpoint(self, endpoint_address, device_address=0, speed=SPEED_HIGH, transfer_type=TRANSFER_TYPE_BULK,
+                        handle_data_toggle=True, max_packet_size=64):
+        """ Sets up (or updates) the device's queue for an endpoint.
+
+        Args:
+            endpoint_address    -- The endpoint's address, including its direction bit. Control endpoints use 0.
+            device_address      -- The address of the device the endpoint belongs to.
+            speed               -- One of the SPEED_* constants.
+            transfer_type       -- One of the TRANSFER_TYPE_* constants. Interrupt and isochronous
+                                   endpoints aren't supported; the device rejects them.
+            handle_data_toggle  -- True iff the controller should track data toggles itself; required
+                                   for reads and writes larger than MAX_TRANSFER_SIZE.
+            max_packet_size     -- The endpoint's maximum packet size.
+        """
+
+        self.api.set_up_endpoint(endpoint_address, device_address, speed, transfer_type,
+                                 handle_data_toggle, max_packet_size)
+
+
+    def flush_endpoint(self, endpoint_address):
+        """ Cancels every transfer still queued on an endpoint, and clears its halt.
+
+        Called automatically when a transfer stalls or fails, as the device won't perform the
+        transfers queued behind it. Any reads pipelined on the endpoint are discarded.
+        """
+
+        self.api.flush_endpoint(endpoint_address)
+
+        # The device reports each cancelled transfer; but we've no more interest in them.
+        for tag, (queue_address, _) in list(self._outstanding.items()):
+            if queue_address == endpoint_address:
+                del self._outstanding[tag]
+                self._abandoned.add(tag)
+
+        self._pending_reads.pop(endpoint_address, None)
+        self._leftover_data.pop(endpoint_address, None)
+
+
+    def _transfers_in_use(self):
+        """ Returns the number of the device's transfer slots that are currently occupied. """
+        return len(self._outstanding) + len(self._abandoned)
+
+
+    def queue_transfer(self, endpoint_address, pid, data_or_length, data_toggle=0):
+        """ Queues a single transfer of up to MAX_TRANSFER_SIZE bytes; and returns its tag.
+
+        Args:
+            endpoint_address -- The endpoint to perform the transfer on.
+            pid              -- One of the PID_* constants.
+            data_or_length   -- For IN transfers, the most data to read; otherwise, the data to send.
+            data_toggle      -- The data toggle to use, if the endpoint doesn't handle toggles itself.
+        """
+
+        # Never queue more transfers than the device has room for; wait for others to finish first.
+        while self._transfers_in_use() >= self.MAX_OUTSTANDING:
+            self._read_events()
+
+        tag = self._next_tag
+        self._next_tag = (self._next_tag + 1) % self.TAG_LIMIT
+
+        if pid == self.PID_IN:
+            length, data = data_or_length, b""
+        else:
+            length, data = len(data_or_length), bytes(data_or_length)
+
+        if length > self.MAX_TRANSFER_SIZE:
+            raise ValueError("a single transfer can be at most {} bytes".format(self.MAX_TRANSFER_SIZE))
+
+        self.api.queue_transfer(endpoint_address, pid, data_toggle, tag, length, data)
+        self._outstanding[tag] = (endpoint_address, length)
+
+        return tag
+
+
+    def _parse_events(self, data):
+        """ Records each of the completions in a block of raw event data. """
+
+        data = self._partial_event + bytes(data)
+        position = 0
+        failed_queues = set()
+
+        while position + self.EVENT_FORMAT.size <= len(data):
+            tag, endpoint, status, length = self.EVENT_FORMAT.unpack_from(data, position)
+
+            # IN transfers are followed by their data, padded to a multiple of four bytes.
+            data_length = length if (endpoint & 0x80) else 0
+            event_size  = self.EVENT_FORMAT.size + ((data_length + 3) & ~3)
+
+            if position + event_size > len(data):
+                break
+
+            if (status != self.STATUS_PADDING) and (tag in self._abandoned):
+                self._abandoned.discard(tag)
+
+            elif status != self.STATUS_PADDING:
+                start = position + self.EVENT_FORMAT.size
+                self._completed[tag] = TransferCompletion(tag, endpoint, status, length, data[start:start + data_length])
+                queue_address, _ = self._outstanding.pop(tag, (None, None))
+
+                # A stall or error halts the endpoint's queue; so nothing queued behind this transfer will complete.
+                if status in (self.STATUS_STALLED, self.STATUS_ERROR) and (queue_address is not None):
+                    failed_queues.add(queue_address)
+
+            position += event_size
+
+        self._partial_event = data[position:]
+
+        for queue_address in failed_queues:
+            self.flush_endpoint(queue_address)
+
+
+    def _read_events(self, timeout=1):
+        """ Reads any completions from the device; raising an IOError if none arrive before the timeout. """
+
+        try:
+            data = self.board.comms.device.read(self.pipe, self.READ_SIZE, int(timeout * 1000))
+        except usb.core.USBError as e:
+            if e.errno == self.USB_TIMEOUT_ERRNO:
+                raise IOError("timed out waiting for a USB transfer to complete")
+            raise
+
+        self._parse_events(data)
+
+
+    def wait_for_transfer(self, tag, timeout=1):
+        """ Waits for the transfer with the given tag to complete, and returns its TransferCompletion. """
+
+        while tag not in self._completed:
+
+            # If the transfer was abandoned when its endpoint was flushed, it'll never complete.
+            if tag not in self._outstanding:
+                raise USBHostError("transfer {} was cancelled by an endpoint flush".format(tag))
+
+            self._read_events(timeout)
+
+        completion = self._completed.pop(tag)
+
+        if completion.status == self.STATUS_STALLED:
+            raise USBHostError("endpoint {:02x} stalled".format(completion.endpoint))
+        if completion.status == self.STATUS_CANCELLED:
+            raise USBHostError("transfer on endpoint {:02x} was cancelled".format(completion.endpoint))
+        if completion.status != self.STATUS_OK:
+            raise USBHostError("transfer on endpoint {:02x} failed".format(completion.endpoint))
+
+        return completion
+
+
+    def write(self, endpoint_address, data, timeout=1):
+        """ Writes data to an OUT endpoint, pipelining it as transfers of up to MAX_TRANSFER_SIZE bytes. """
+
+        tags = deque()
+        data = bytes(data)
+
+        for offset in range(0, max(len(data), 1), self.MAX_TRANSFER_SIZE):
+
+            # Keep the device's queue as full as we can, but only wait on our oldest transfer once we have to.
+            if self._transfers_in_use() >= self.MAX_OUTSTANDING:
+                self.wait_for_transfer(tags.popleft(), timeout)
+
+            tags.append(self.queue_transfer(endpoint_address, self.PID_OUT, data[offset:offset + self.MAX_TRANSFER_SIZE]))
+
+        while tags:
+            self.wait_for_transfer(tags.popleft(), timeout)
+
+
+    def read(self, endpoint_address, length, timeout=1):
+        """ Reads up to length bytes from an IN endpoint, pipelining transfers of up to MAX_TRANSFER_SIZE bytes.
+
+        The read ends early if the device ends its transfer with a short packet. Any transfers that were
+        already queued past that point stay queued; the data they receive is returned by the next read
+        on the same endpoint.
+        """
+
+        endpoint_address |= 0x80
+
+        pending  = self._pending_reads.setdefault(endpoint_address, deque())
+        data     = self._leftover_data.pop(endpoint_address, b"")
+        in_flight = sum(size for _, size in pending)
+
+        while len(data) < length:
+
+            # Queue as many reads as we need, and have room for...
+            while (len(data) + in_flight < length) and (self._transfers_in_use() < self.MAX_OUTSTANDING):
+                size = min(length - len(data) - in_flight, self.MAX_TRANSFER_SIZE)
+                pending.append((self.queue_transfer(endpoint_address, self.PID_IN, size), size))
+                in_flight += size
+
+            # ... and then collect the oldest. If other endpoints are using all of the device's
+            # transfers, wait for them to make room.
+            if not pending:
+                self._read_events(timeout)
+                continue
+
+            tag, size = pending.popleft()
+            in_flight -= size
+
+            completion = self.wait_for_transfer(tag, timeout)
+            data += completion.data
+
+            if completion.length < size:
+                break
+
+        # If leftover transfers gave us more than was asked for, hang on to the rest.
+        if len(data) > length:
+            self._leftover_data[endpoint_address] = data[length:]
+
+        return data[:length]
+
+
+    def control_transfer(self, request_type, request, value, index, data_or_length=0, timeout=1):
+        """ Performs a control transfer on endpoint zero, which must already be set up as a control endpoint.
+
+        Args:
+            request_type, request, value, index -- The fields of the SETUP packet.
+            data_or_length -- For IN requests, the most data to read; for OUT requests, the data to send.
+
+        Returns the data read, for IN requests; or None otherwise.
+        """
+
+        is_in = bool(request_type & 0x80)
+        length = data_or_length if is_in else len(data_or_length)
+
+        if length > self.MAX_TRANSFER_SIZE:
+            raise ValueError("control transfers can be at most {} bytes".format(self.MAX_TRANSFER_SIZE))
+
+        # Queue all three stages at once; the device's queue performs them in order.
+        setup = self.SETUP_FORMAT.pack(request_type, request, value, index, length)
+        tags = [self.queue_transfer(0, self.PID_SETUP, setup, data_toggle=0)]
+
+        if length:
+            data_pid = self.PID_IN if is_in else self.PID_OUT
+            tags.append(self.queue_transfer(0, data_pid, data_or_length, data_toggle=1))
+
+        # The status stage is always a zero-length packet in the opposite direction to the data.
+        status_pid = self.PID_OUT if (is_in and length) else self.PID_IN
+        tags.append(self.queue_transfer(0, status_pid, b"" if status_pid == self.PID_OUT else 0, data_toggle=1))
+
+        completions = [self.wait_for_transfer(tag, timeout) for tag in tags]
+        return completions[1].data if (is_in and length) else None
@@ -481,6 +481,12 @@ class ECP5SlaveSPI(ECP5CommandBasedProgrammer):
                 function's implementation). Prevents emission of verbose "what we're doing" text.
         """
 
+        # If we're sending a bitstream and our GreatFET supports it, stream the bitstream directly
+        # over the bulk pipe, rather than splitting it into control requests.
+        if (opcode == self.Opcode.LSC_BITSTREAM_BURST) and not isinstance(data_or_length, int) \
+                and self.spi.supports_streaming():
+            return self._execute_bitstream_burst(data_or_length, check_status)
+
         # Start our command stream with our opcode, and our three required padding bytes.
         command_stream = bytearray([opcode, 0x00, 0x00, 0x00])
         prefix_length = len(command_stream)
@@ -524,6 +530,33 @@ class ECP5SlaveSPI(ECP5CommandBasedProgrammer):
             return b""
 
 
+    def _execute_bitstream_burst(self, bitstream, check_status=True):
+        """ Issues an LSC_BITSTREAM_BURST, streaming the bitstream to the device's SPI peripheral in one burst.
+
+        Parameters:
+            bitstream -- The bitstream; any object accepted by bytes()'s constructor is acceptable.
+        """
+
+        # Normalize the bitstream first, so iterables of integers (e.g. lists) are accepted just like
+        # bytes-like objects are; bytes() returns bytes objects as-is, without copying.
+        bitstream = memoryview(bytes(bitstream)).cast('B')
+        self._verbose_print("Executing LSC_BITSTREAM_BURST / [{} bytes, streamed]".format(len(bitstream) + 4))
+
+        # Issue our opcode and padding, holding chip select for the duration of the bitstream...
+        self.spi.transmit(bytes([self.Opcode.LSC_BITSTREAM_BURST, 0x00, 0x00, 0x00]), deassert_chip_select=False)
+
+        # ... and then stream the bitstream itself, without buffering any of the data clocked back in.
+        self.spi.write_stream(bitstream)
+
+        if check_status:
+            status = self._read_status()
+            self._verbose_print("Bitstream burst complete; status is {:08x}{}.".format(status,
+                " (DONE)" if status & self.STATUS_FLAG_DONE else ""))
+            self._validate_status(status)
+
+        return b""
+
+
 class ECP5MasterSerialDirect(ECP5Programmer):
     """ ECP5 Programmer class for programming the SPI flash used for Master SPI.
 
@@ -572,28 +605,23 @@ class ECP5MasterSerialDirect(ECP5Programmer):
         super(ECP5MasterSerialDirect, self)._restart_configuration_process()
 
 
+    # Translation table mapping each byte to its bit-reversed equivalent.
+    BIT_REVERSAL_TABLE = bytes(int("{:08b}".format(byte)[::-1], 2) for byte in range(256))
+
+
     def _generate_bit_reversed_bitstream(self, bitstream):
         """
         Generates a copy of the provided bitstream with the bits in each byte
         reversed -- in the format the FPGA likes them for MSPI mode.
         """
 
-        # Quick helper function to reverse the bits in our bitstream.
-        def reverse_bits(num):
-            binstr = "{:08b}".format(num)
-            return int(binstr[::-1], 2)
-
         # Reverse each of the bits in each byte of the bitstream.
         #
         # This ensures that bits are shifted into the FPGA in the same
         # order as they need to be presented to the configuration logic;
         # even if the FPGA is the one commanding the flash.
         #
-        bit_reversed = bytearray(bitstream)
-        for i in range(len(bit_reversed)):
-            bit_reversed[i] = reverse_bits(bit_reversed[i])
-
-        return bit_reversed
+        return bytes(bitstream).translate(self.BIT_REVERSAL_TABLE)
 
 
     def program(self, bitstream, progress_callback=None):
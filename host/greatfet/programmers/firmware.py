@@ -3,8 +3,12 @@
 #
 
 import sys
+import time
+import zlib
 import array
 
+from pygreat.comms import CommandFailureError
+
 from ..interface import GreatFETInterface
 
 
@@ -14,6 +18,15 @@ class DeviceFirmwareManager(GreatFETInterface):
     Class representing a flash memory used to work with a libgreat device's firmware.
     """
 
+    # The smallest erasable unit of the onboard flash; used for differential writes.
+    SECTOR_SIZE = 0x1000
+
+    # The most sector CRCs the device will return per request.
+    MAX_CRCS_PER_REQUEST = 64
+
+    # The streaming API used for differential writes, if the device supports it.
+    bulk_api = None
+
     def __init__(self, board):
         """Set up a new device firmware management connection.
 
@@ -33,6 +46,9 @@ class DeviceFirmwareManager(GreatFETInterface):
         # Ask the device to perform initialization, and then grab its extents.
         self.page_size, self.maximum_address = self.api.initialize()
 
+        # Newer firmware can stream writes, and checksum sectors to skip unchanged ones.
+        self.bulk_api = board.apis.firmware_bulk if board.supports_api('firmware_bulk') else None
+
 
     def erase(self):
         """Erases the GreatFET's onboard SPI flash, clearing its program.
@@ -68,8 +84,13 @@ class DeviceFirmwareManager(GreatFETInterface):
         if (address + length - 1) > self.maximum_address:
             raise ValueError("Attempting to write past the end of flash!")
 
+        # If we can, rewrite only the sectors that have changed, rather than erasing the whole flash.
+        if erase_first and self.bulk_api and not (address % self.SECTOR_SIZE):
+            self.write_differential(data_array, address, progress_callback)
+            return
+
         if erase_first:
-            self.erase()
+            self._erase_for_write(address, length)
 
         # And execute our write callback on each of the data sections.
         try:
@@ -79,6 +100,117 @@ class DeviceFirmwareManager(GreatFETInterface):
             self.comms.release_exclusive_access()
 
 
+    def _erase_for_write(self, address, length):
+        """ Erases flash ahead of a write to the given range. Subclasses may erase less than the whole chip. """
+        self.erase()
+
+
+    def write_differential(self, data, address=0, progress_callback=None):
+        """ Erases and reprograms only those flash sectors whose contents differ from the given data.
+
+        Sectors are compared by CRC; and each run of changed sectors is streamed to the device in a
+        single bulk write. Flash outside the sectors covered by the data is left untouched; and any
+        part of the final sector past the end of the data is left erased.
+
+        Args:
+            data -- The data to be written.
+            address -- The address at which the data should start; must be sector-aligned.
+            progress_callback -- Optional function that should accept two arguments -- the current progress,
+                in bytes, and the total bytes to be handled. Called as each sector is checked or written.
+
+        Returns the number of bytes actually written.
+        """
+
+        if not self.bulk_api:
+            raise NotImplementedError("This board's firmware doesn't support differential writes; try updating it.")
+
+        if address % self.SECTOR_SIZE:
+            raise ValueError("Differential writes must start on a sector boundary!")
+
+        # Pad our data out to a whole number of sectors with 0xFF, so it matches what an erased sector holds.
+        data = bytearray(data)
+        length = len(data)
+        if length % self.SECTOR_SIZE:
+            data.extend(b"\xFF" * (self.SECTOR_SIZE - (length % self.SECTOR_SIZE)))
+
+        if (address + len(data) - 1) > self.maximum_address:
+            raise ValueError("Attempting to write past the end of flash!")
+
+        try:
+            self.comms.get_exclusive_access()
+
+            changed = self._find_changed_sectors(data, address)
+            total_to_write = len(changed) * self.SECTOR_SIZE
+            written = 0
+
+            for first_sector, sector_count in self._group_into_runs(changed):
+                offset = first_sector * self.SECTOR_SIZE
+                run_length = sector_count * self.SECTOR_SIZE
+
+                self._bulk_write(address + offset, data[offset:offset + run_length])
+                written += run_length
+
+                if progress_callback:
+                    progress_callback(written, total_to_write)
+
+            # Finally, check that everything we wrote made it into the flash intact.
+            if self._find_changed_sectors(data, address):
+                raise IOError("flash contents didn't match after writing!")
+
+        finally:
+            self.comms.release_exclusive_access()
+
+        return written
+
+
+    def _find_changed_sectors(self, data, address):
+        """ Returns the indices of the sectors of data that differ from the flash at the given address. """
+
+        sector_count = len(data) // self.SECTOR_SIZE
+        changed = []
+
+        for first in range(0, sector_count, self.MAX_CRCS_PER_REQUEST):
+            count = min(self.MAX_CRCS_PER_REQUEST, sector_count - first)
+            device_crcs = self.bulk_api.get_sector_crcs(address + first * self.SECTOR_SIZE, count)
+
+            for index, device_crc in enumerate(device_crcs, start=first):
+                sector = data[index * self.SECTOR_SIZE : (index + 1) * self.SECTOR_SIZE]
+                if zlib.crc32(sector) != device_crc:
+                    changed.append(index)
+
+        return changed
+
+
+    @staticmethod
+    def _group_into_runs(indices):
+        """ Groups sorted indices into (first, count) runs of consecutive values. """
+
+        runs = []
+        for index in indices:
+            if runs and (runs[-1][0] + runs[-1][1] == index):
+                runs[-1][1] += 1
+            else:
+                runs.append([index, 1])
+
+        return [tuple(run) for run in runs]
+
+
+    def _bulk_write(self, address, data, timeout=30):
+        """ Streams a sector-aligned run of data to the device, and waits for it to be programmed. """
+
+        pipe = self.bulk_api.start_write(address, len(data))
+        self.comms.device.write(pipe, bytes(data), int(timeout * 1000))
+
+        deadline = time.time() + timeout
+        complete, _ = self.bulk_api.get_write_status()
+        while not complete:
+            if time.time() > deadline:
+                raise IOError("timed out waiting for the flash to finish programming")
+
+            time.sleep(0.001)
+            complete, _ = self.bulk_api.get_write_status()
+
+
     def read(self, address=0, length=None, progress_callback=None):
         """ Reads (and returns) the contents of the target flash memory.
 
@@ -106,11 +238,42 @@ class DeviceFirmwareManager(GreatFETInterface):
         # And execute our write callback on each of the data sections.
         try:
             self.comms.get_exclusive_access()
+
+            # If the device can stream the flash to us, that's much faster than reading it a page at a time.
+            if self.bulk_api and hasattr(self.bulk_api, 'start_read'):
+                try:
+                    pipe = self.bulk_api.start_read(address, length)
+                except CommandFailureError:
+                    # The device may be unable to stream right now -- e.g. if another class has taken the
+                    # pins it streams over -- so fall back to reading a page at a time.
+                    pipe = None
+
+                if pipe is not None:
+                    return self._bulk_read(pipe, length, progress_callback)
+
             return self._run_method_on_flash_pages(perform_read, address, length, progress_callback=progress_callback)
         finally:
             self.comms.release_exclusive_access()
 
 
+    def _bulk_read(self, pipe, length, progress_callback=None, timeout=5):
+        """ Reads a range of flash the device has started streaming to the given pipe. """
+
+        # The most data we'll ask for in a single transfer.
+        MAX_TRANSFER_SIZE = 0x4000
+
+        results = array.array('B')
+
+        while len(results) < length:
+            to_read = min(MAX_TRANSFER_SIZE, length - len(results))
+            results.extend(self.comms.device.read(pipe, to_read, int(timeout * 1000)))
+
+            if progress_callback:
+                progress_callback(len(results), length)
+
+        return results
+
+
     def _run_method_on_flash_pages(self, method, address, length, progress_callback=None):
         """Calls a given method on each 'page' of a range of flash.
 
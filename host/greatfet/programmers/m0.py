@@ -3,6 +3,8 @@
 #
 
 import os
+import time
+import zlib
 
 from ..interface import GreatFETInterface
 
@@ -16,6 +18,9 @@ class M0Coprocessor(GreatFETInterface):
     # unit for uploading.
     UPLOAD_CHUNK_SIZE = 2048
 
+    # The maximum time to wait for a bulk upload to complete, in seconds.
+    BULK_UPLOAD_TIMEOUT = 5
+
 
     def __init__(self, device):
         """ Creates a new M0 coprocessor control object. """
@@ -25,7 +30,11 @@ class M0Coprocessor(GreatFETInterface):
 
 
     def start(self):
-        """ Starts execution of the m0 processor. """
+        """ Starts execution of the m0 processor.
+
+        The top 64 bytes of the M0's memory are reserved for the mailbox it shares with the M4; so a
+        loadable's initial stack pointer must sit below them, or the device will refuse to start it.
+        """
         self.api.start_m0()
 
 
@@ -34,12 +43,13 @@ class M0Coprocessor(GreatFETInterface):
         self.api.halt_m0()
 
 
-    def load_loadable(self, data_or_filename):
+    def load_loadable(self, data_or_filename, force=False):
         """
         Loads (but does not start) an M0 loadable.
 
         Arguments:
             data_or_filename -- The loadable binary file, or the filename where one can be found.
+            force -- If set, the loadable will be uploaded even if it's already resident on the device.
         """
         data = data_or_filename
 
@@ -53,6 +63,32 @@ class M0Coprocessor(GreatFETInterface):
         # Halt the m0 processor before the upload.
         self.halt()
 
+        # If the image is already present in the M0's memory, there's no need to upload it again.
+        if not force and self.is_resident(data):
+            return
+
+        if self.api.supports_verb("load_m0_image"):
+            self._load_over_bulk(data)
+        else:
+            self._load_over_control(data)
+
+
+    def is_resident(self, data):
+        """ Returns true iff the given loadable image is already present in the M0's memory. """
+
+        if not data or not self.api.supports_verb("loaded_m0_image"):
+            return False
+
+        # Compare against the checksum the device took when the image was loaded. The device drops that
+        # record once the M0 is started, or anything else writes to its memory; so an image that has
+        # already run, and dirtied its own data, is always uploaded afresh.
+        valid, length, checksum = self.api.loaded_m0_image()
+        return valid and (length == len(data)) and (checksum == zlib.crc32(data))
+
+
+    def _load_over_control(self, data):
+        """ Uploads a loadable image using one control request per chunk. """
+
         # Iterate over each chunk in the relevant data, and upload it.
         for offset in range(0, len(data), self.UPLOAD_CHUNK_SIZE):
 
@@ -63,6 +99,27 @@ class M0Coprocessor(GreatFETInterface):
             self.api.load_m0_page(offset, to_upload)
 
 
+    def _load_over_bulk(self, data):
+        """ Uploads a loadable image over the GreatFET's bulk pipe, and verifies its checksum. """
+
+        pipe = self.api.load_m0_image(len(data))
+        self.device.comms.device.write(pipe, data, self.BULK_UPLOAD_TIMEOUT * 1000)
+
+        # Wait for the device to finish copying in the data it's received.
+        deadline = time.time() + self.BULK_UPLOAD_TIMEOUT
+        complete, bytes_loaded, checksum = self.api.load_m0_image_status()
+        while not complete:
+            if time.time() > deadline:
+                raise IOError("timed out waiting for the M0 image upload to complete")
+
+            time.sleep(0.001)
+            complete, bytes_loaded, checksum = self.api.load_m0_image_status()
+
+        if (bytes_loaded != len(data)) or (checksum != zlib.crc32(data)):
+            raise IOError("M0 image upload failed verification ({} of {} bytes loaded, CRC {:08x} instead of {:08x})"
+                    .format(bytes_loaded, len(data), checksum, zlib.crc32(data)))
+
+
 
     def run_loadable(self, data_or_filename):
         """
@@ -80,8 +137,31 @@ class M0Coprocessor(GreatFETInterface):
         self.start()
 
 
+    def send_command(self, command):
+        """
+        Sends a command to the running loadable, via the M0's mailbox.
+
+        Arguments:
+            command -- The bytes to be delivered to the loadable; delivered whole, or not at all.
+        """
+        self.api.send_m0_command(bytes(command))
+
 
+    def read_data(self, length, timeout=None):
+        """
+        Reads data produced by the running loadable, streamed from the M0's mailbox over the bulk pipe.
 
+        Arguments:
+            length -- The number of bytes to read. The read completes in blocks of up to 16KiB,
+                      as the loadable produces them.
+            timeout -- The maximum time to wait for the data, in seconds; or None to wait indefinitely.
+        """
+        pipe = self.api.stream_m0_data(length)
+        timeout_ms = 0 if timeout is None else int(timeout * 1000)
 
+        return bytes(self.device.comms.device.read(pipe, length, timeout_ms))
 
 
+    def mailbox_status(self):
+        """ Returns a tuple of (bytes of commands pending, bytes of data available) for the M0's mailbox. """
+        return self.api.m0_mailbox_status()
@@ -313,7 +313,7 @@ class EEPROMDevice(GreatFETProgrammer):
         # What size chunks can we read from the chip?
         buff_size = self.bus.buffer_size
 
-        buff = b''
+        buff = bytearray()
         addr = start_address
 
         # Our read might span multiple blocks, and block boundaries cannot be read through
@@ -331,10 +331,49 @@ class EEPROMDevice(GreatFETProgrammer):
             while addr<=max_addr:
                 bytes_to_read = (max_addr - addr) + 1
                 read_data = device.read(min(bytes_to_read, buff_size))
-                buff = buff + bytes(read_data)
+                buff.extend(read_data)
                 addr = addr + len(read_data)
         
-        return buff
+        return bytes(buff)
+
+
+    def _can_program_on_device(self):
+        """ Returns true iff our bus can program EEPROM pages on the GreatFET itself. """
+        return hasattr(self.bus, 'program_eeprom') and self.bus.supports_eeprom_programming()
+
+
+    def _write_bytes_on_device(self, word_address, data, attempts):
+        """
+            Write bytes using the GreatFET's on-device EEPROM programming engine, which streams
+            whole pages and uses ACK polling instead of fixed write-cycle delays.
+        """
+
+        verify = (attempts != 0)
+        i = 0
+
+        while i < len(data):
+
+            # Each device only understands addresses within its own block, so split our writes
+            # at block boundaries.
+            addr = word_address + i
+            end_of_block = (floor(addr/self.block_size) + 1) * self.block_size
+            l = min(len(data) - i, end_of_block - addr)
+
+            device  = self.device_for_address(addr)
+            retries = max(attempts, 1)
+
+            while True:
+                try:
+                    self.bus.program_eeprom(device.address, addr % self.block_size, data[i:i + l],
+                        self.page_size, self.address_bits // 8, verify=verify)
+                    break
+                except IOError:
+                    retries = retries - 1
+                    if retries == 0:
+                        raise RuntimeError("Could not write to EEPROM.")
+
+            i += l
+
 
     def write_bytes(self, word_address, data, write_cycle_length=0.005, attempts=2):
         """
@@ -352,6 +391,10 @@ class EEPROMDevice(GreatFETProgrammer):
         bytes_to_write = len(data)
         data           = bytes(data)              # What if it's something weird and not a bytestring? What then?
 
+        # If the GreatFET can program pages itself, let it; this avoids a round trip per page.
+        if self._can_program_on_device():
+            return self._write_bytes_on_device(word_address, data, attempts)
+
         # We need to break the bytes up so that each write fits within page boundaries
         # Crossing a page boundary will cause a write cycle to begin, resulting in
         # subsequent bytes being ignored.
@@ -362,8 +405,7 @@ class EEPROMDevice(GreatFETProgrammer):
 
             # Calculate how many bytes we can write out before hitting a page/block boundary
             addr = word_address + i
-            writeable_bytes = addr % self.page_size
-            writeable_bytes = writeable_bytes if writeable_bytes != 0 else self.page_size
+            writeable_bytes = self.page_size - (addr % self.page_size)
             l = min(bytes_to_write - i, writeable_bytes)
 
             # Find appropriate device for this address
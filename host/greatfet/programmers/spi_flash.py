@@ -18,6 +18,9 @@ def create_programmer(board, *args, **kwargs):
 class SPIFlash(DeviceFirmwareManager, GreatFETProgrammer):
     """ Class representing an SPI flash connected to the GreatFET. """
 
+    # Each erase command waits for the previous erase to finish; which, for a 64K block, can take a couple of seconds.
+    ERASE_TIMEOUT_MS = 5000
+
     #
     # Common JEDEC manufacturer IDs for SPI flash chips.
     #
@@ -188,4 +191,46 @@ class SPIFlash(DeviceFirmwareManager, GreatFETProgrammer):
         # TODO: re-initialize the flash if the JEDEC identification updates our capacity?
         # TODO: decide if we want to do ^
 
+        # Find out which block sizes we can erase, if our firmware is new enough to tell us.
+        try:
+            self.erase_sizes = sorted(self.api.query_erase_sizes())
+        except (AttributeError, CommandFailureError):
+            self.erase_sizes = []
+
+
+    def erase_range(self, address, length):
+        """ Erases the blocks of flash that cover the given range.
+
+        Uses the largest erase blocks that fit, so only the blocks the range touches are erased. Any data
+        that shares a block with the start or end of the range is erased along with it.
+
+        Args:
+            address -- The first address to be erased.
+            length -- The number of bytes to be erased.
+        """
+
+        if not self.erase_sizes:
+            raise NotImplementedError("This board's firmware can't erase part of a flash; try updating it.")
+
+        smallest = self.erase_sizes[0]
+
+        # Expand our range out to whole blocks of the smallest size we can erase...
+        position = address - (address % smallest)
+        end = -(-(address + length) // smallest) * smallest
+
+        # ... and then erase it, using the biggest aligned blocks that fit.
+        while position < end:
+            size = max(size for size in self.erase_sizes if (not position % size) and (position + size <= end))
+            self.api.erase_block(position, size, timeout=self.ERASE_TIMEOUT_MS)
+            position += size
+
+
+    def _erase_for_write(self, address, length):
+        """ Erases only the blocks a write will touch, where our firmware supports it. """
+
+        if self.erase_sizes:
+            self.erase_range(address, length)
+        else:
+            self.erase()
+
 
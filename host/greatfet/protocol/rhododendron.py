@@ -0,0 +1,335 @@
+#
+# This file is part of GreatFET
+#
+"""
+    Decoding for the Rhododendron USB analyzer's capture stream; and pcapng output for the packets it contains.
+"""
+
+import collections
+import struct
+import time
+
+
+# Rhododendron packet types.
+PACKET_TYPE_USB_DATA     = 0
+PACKET_TYPE_EVENT_START  = 0x80
+PACKET_TYPE_EVENT_END_OK = 0x81
+
+# Set on event packets that carry a hardware timestamp of the NXT/DIR edge that marked them.
+PACKET_FLAG_TIMESTAMPED  = 0x10
+PACKET_TYPE_EVENT_START_TIMESTAMPED  = PACKET_TYPE_EVENT_START  | PACKET_FLAG_TIMESTAMPED
+PACKET_TYPE_EVENT_END_OK_TIMESTAMPED = PACKET_TYPE_EVENT_END_OK | PACKET_FLAG_TIMESTAMPED
+
+# The size of each packet in the capture stream, including its type byte.
+PACKET_SIZES = {
+    PACKET_TYPE_USB_DATA:                 33,
+    PACKET_TYPE_EVENT_START:              6,
+    PACKET_TYPE_EVENT_END_OK:             6,
+    PACKET_TYPE_EVENT_START_TIMESTAMPED:  6,
+    PACKET_TYPE_EVENT_END_OK_TIMESTAMPED: 6,
+}
+
+# The rate at which hardware timestamps tick; the SCT counts the GreatFET's 204MHz core clock.
+TIMESTAMP_FREQUENCY = 204000000
+TIMESTAMP_WRAP      = 1 << 32
+
+# The pcap link type for raw USB 2.0 packets, starting with their PID.
+LINKTYPE_USB_2_0 = 288
+
+
+def is_valid_pid_byte(byte):
+    """ Returns true iff the given byte could be a valid PID. """
+
+    pid     = byte & 0xf
+    inverse = byte >> 4
+
+    return (pid ^ inverse) == 0xf
+
+
+class RhododendronStreamParser:
+    """
+        Streaming parser for the capture stream produced by a Rhododendron.
+
+        The stream interleaves fixed-size data packets, which carry raw bytes from the USB bus, with event
+        packets that mark where each USB packet ends. Data can be fed in arbitrarily-sized pieces; work is
+        linear in the amount of data, and runs of data packets are unpacked in bulk.
+    """
+
+    DATA_PACKET_SIZE = PACKET_SIZES[PACKET_TYPE_USB_DATA]
+
+    def __init__(self, packet_callback, timestamp_frequency=TIMESTAMP_FREQUENCY):
+        """
+        Args:
+            packet_callback     -- Called with (packet_data, timestamp) for each complete USB packet. The timestamp
+                                   is in integer nanoseconds since the epoch; or None if we have no time for it.
+            timestamp_frequency -- The tick rate of the hardware timestamps in the stream, in Hz.
+        """
+
+        self.packet_callback     = packet_callback
+        self.timestamp_frequency = timestamp_frequency
+
+        # Any trailing bytes of a capture packet that was split across calls to feed().
+        self._partial = bytearray()
+
+        # USB data received, but not yet emitted as part of a packet.
+        self._usb_data = bytearray()
+
+        # The offsets into the next data packet at which USB packets end; each paired with whether that
+        # offset came from a hardware-timestamped event, and so is exact.
+        self._emit_after = []
+
+        # The start times of the packets we've yet to emit, in nanoseconds since the epoch.
+        self._start_times = collections.deque()
+
+        # The host's time for the current buffer, in seconds since the epoch; or None if we weren't given one.
+        self._timestamp = None
+
+        # Our mapping from hardware timestamps to wall-clock time: the unwrapped tick count and host time of
+        # the most recent hardware timestamp, and the tick count and time, in nanoseconds, of the first one.
+        self._last_ticks     = None
+        self._last_host_time = None
+        self._epoch_ticks    = None
+        self._epoch_ns       = None
+
+
+    def feed(self, data, timestamp=None):
+        """ Parses a new buffer of capture data.
+
+        Args:
+            data      -- The captured data.
+            timestamp -- The time at which the data was captured, for packets the stream doesn't timestamp itself.
+        """
+
+        self._timestamp = timestamp if (timestamp is not None) else time.time()
+
+        if self._partial:
+            self._partial.extend(data)
+            buffer = memoryview(bytes(self._partial))
+            self._partial = bytearray()
+        else:
+            buffer = memoryview(data).cast('B')
+
+        position = 0
+        length   = len(buffer)
+
+        while position < length:
+            packet_type = buffer[position]
+
+            # Fast path: if no USB packet ends in the upcoming data, unpack a whole run of data packets at once.
+            if (packet_type == PACKET_TYPE_USB_DATA) and not self._emit_after:
+                run_end = self._consume_data_run(buffer, position)
+
+                # If we don't have a complete data packet, wait for the rest of it.
+                if run_end == position:
+                    break
+
+                position = run_end
+                continue
+
+            size = PACKET_SIZES.get(packet_type)
+            if size is None:
+                raise IOError("unknown packet type {}! stream error?".format(packet_type))
+
+            # If this packet continues in the next buffer, hang on to it until then.
+            if position + size > length:
+                break
+
+            self._handle_packet(packet_type, buffer[position + 1:position + size])
+            position += size
+
+        self._partial.extend(buffer[position:])
+
+
+    def _consume_data_run(self, buffer, position):
+        """ Unpacks consecutive complete data packets starting at the given position; returns the position after them. """
+
+        # Find how many complete data packets start here: their type bytes are spaced a packet apart.
+        complete_packets = (len(buffer) - position) // self.DATA_PACKET_SIZE
+        types = bytes(buffer[position:position + complete_packets * self.DATA_PACKET_SIZE:self.DATA_PACKET_SIZE])
+        run_length = len(types) - len(types.lstrip(b"\x00"))
+
+        # Copy the run, and then strip out each packet's type byte.
+        run = bytearray(buffer[position:position + run_length * self.DATA_PACKET_SIZE])
+        del run[::self.DATA_PACKET_SIZE]
+
+        self._usb_data.extend(run)
+        return position + run_length * self.DATA_PACKET_SIZE
+
+
+    def _handle_packet(self, packet_type, payload):
+        """ Handles a single capture packet. """
+
+        timestamped = bool(packet_type & PACKET_FLAG_TIMESTAMPED)
+        packet_type &= ~PACKET_FLAG_TIMESTAMPED
+
+        # End events tell us where, in the next data packet, the current USB packet ends.
+        if packet_type == PACKET_TYPE_EVENT_END_OK:
+            if timestamped:
+                self._hardware_time(payload)
+
+            if (not self._emit_after) or (self._emit_after[-1][0] != payload[0]):
+                self._emit_after.append((payload[0], timestamped))
+
+        # Start events tell us when the next USB packet began.
+        elif packet_type == PACKET_TYPE_EVENT_START:
+            if timestamped:
+                self._start_times.append(self._hardware_time(payload))
+
+        elif packet_type == PACKET_TYPE_USB_DATA:
+            self._handle_usb_data(payload)
+
+
+    def _hardware_time(self, payload):
+        """ Converts the hardware timestamp in an event payload to nanoseconds since the epoch. """
+
+        ticks = int.from_bytes(payload[1:5], 'little')
+
+        # The first timestamp we see anchors the hardware's clock to the host's.
+        if self._last_ticks is None:
+            self._epoch_ticks = ticks
+            self._epoch_ns    = int(self._timestamp * 1e9)
+
+        else:
+            # Our counter wraps every ~21 seconds. Assume the smallest step consistent with the count, which
+            # can be slightly negative when start and end events arrive out of order -- unless the host saw more
+            # time pass between buffers, in which case account for the whole wraps the bus sat idle through.
+            elapsed_ticks = ((ticks - self._last_ticks + TIMESTAMP_WRAP // 2) % TIMESTAMP_WRAP) - TIMESTAMP_WRAP // 2
+            host_elapsed_ticks = (self._timestamp - self._last_host_time) * self.timestamp_frequency
+            wraps = round((host_elapsed_ticks - elapsed_ticks) / TIMESTAMP_WRAP)
+
+            ticks = self._last_ticks + elapsed_ticks + max(wraps, 0) * TIMESTAMP_WRAP
+
+        self._last_ticks     = ticks
+        self._last_host_time = self._timestamp
+
+        return self._epoch_ns + ((ticks - self._epoch_ticks) * 1000000000) // self.timestamp_frequency
+
+
+    def _packet_time(self):
+        """ Returns the time to report for the packet about to be emitted. """
+
+        if self._start_times:
+            return self._start_times.popleft()
+
+        # If the firmware didn't timestamp this packet, fall back to the time the host received it.
+        return int(self._timestamp * 1e9)
+
+
+    def _handle_usb_data(self, payload):
+        """ Adds a data packet's worth of USB data to our current packet; and emits any packets it completes. """
+
+        existing_length = len(self._usb_data)
+        position_in_packet = 0
+
+        self._usb_data.extend(payload)
+
+        for emit_after, exact in self._emit_after:
+            emit_after_bytes = emit_after - position_in_packet + 1
+            emit_point = existing_length + emit_after_bytes
+
+            # Events that aren't tied to the hardware's NXT/DIR timestamps can be a byte off.
+            # Nudge their split point onto a byte that could start the next packet.
+            if not exact:
+                delta = self._smooth_jitter(emit_point)
+                emit_point       += delta
+                emit_after_bytes += delta
+
+            self.packet_callback(bytes(self._usb_data[0:emit_point]), self._packet_time())
+            del self._usb_data[0:emit_point]
+
+            position_in_packet += emit_after_bytes
+            existing_length = 0
+
+        self._emit_after = []
+
+
+    def _smooth_jitter(self, emit_point):
+        """ Returns the offset from the given split point to the nearest one that's followed by a valid PID. """
+
+        data = self._usb_data
+
+        # If we haven't seen the byte after the split yet, we've nothing to check against; trust the event.
+        if emit_point >= len(data):
+            return 0
+
+        for delta in (0, -1, 1):
+            index = emit_point + delta
+            if 0 <= index < len(data) and is_valid_pid_byte(data[index]):
+                return delta
+
+        return 0
+
+
+
+class PcapngWriter:
+    """ Writes USB packets to a pcapng file, which can be opened in e.g. Wireshark. """
+
+    BLOCK_TYPE_SECTION_HEADER    = 0x0A0D0D0A
+    BLOCK_TYPE_INTERFACE         = 0x00000001
+    BLOCK_TYPE_ENHANCED_PACKET   = 0x00000006
+
+    BYTE_ORDER_MAGIC = 0x1A2B3C4D
+
+    # Option codes.
+    OPTION_END_OF_OPTIONS = 0
+    OPTION_IF_NAME        = 2
+    OPTION_IF_TSRESOL     = 9
+
+    # We record timestamps in nanoseconds; i.e. a resolution of 10^-9 seconds.
+    TIMESTAMP_RESOLUTION_NANOSECONDS = 9
+
+    def __init__(self, stream, interface_name="rhododendron", link_type=LINKTYPE_USB_2_0):
+        """
+        Args:
+            stream         -- The binary stream to write to.
+            interface_name -- The name to record for our capture interface.
+            link_type      -- The link type of the packets to be written.
+        """
+
+        self.stream = stream
+
+        self._write_block(self.BLOCK_TYPE_SECTION_HEADER,
+                struct.pack("<IHHq", self.BYTE_ORDER_MAGIC, 1, 0, -1))
+
+        self._write_block(self.BLOCK_TYPE_INTERFACE,
+                struct.pack("<HHI", link_type, 0, 0) + self._option(self.OPTION_IF_NAME, interface_name.encode()) +
+                self._option(self.OPTION_IF_TSRESOL, bytes([self.TIMESTAMP_RESOLUTION_NANOSECONDS])) +
+                self._option(self.OPTION_END_OF_OPTIONS, b""))
+
+
+    @staticmethod
+    def _pad(data):
+        """ Pads a block of data to a 32-bit boundary. """
+        return data + b"\x00" * (-len(data) % 4)
+
+
+    def _option(self, code, value):
+        return struct.pack("<HH", code, len(value)) + self._pad(value)
+
+
+    def _write_block(self, block_type, body):
+        body = self._pad(body)
+        total_length = len(body) + 12
+
+        self.stream.write(struct.pack("<II", block_type, total_length) + body + struct.pack("<I", total_length))
+
+
+    def write_packet(self, data, timestamp=None):
+        """ Writes a single packet.
+
+        Args:
+            data      -- The raw packet.
+            timestamp -- The time at which the packet was captured, in integer nanoseconds since the epoch;
+                         or None for now.
+        """
+
+        if timestamp is None:
+            timestamp = time.time_ns()
+
+        header = struct.pack("<IIIII", 0, timestamp >> 32, timestamp & 0xFFFFFFFF, len(data), len(data))
+
+        self._write_block(self.BLOCK_TYPE_ENHANCED_PACKET, header + bytes(data))
+
+
+    def flush(self):
+        self.stream.flush()
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+#
+# This file is part of GreatFET
+#
+"""
+Host-side throughput benchmarks, run against the mock GreatFET; so they need no hardware.
+
+These measure only the host's half of each operation -- the firmware is benchmarked separately, by
+firmware/common/tests' `make run_benchmarks`. Run with:
+
+    python3 -m greatfet.support.host_benchmarks
+"""
+
+from __future__ import print_function
+
+import os
+import sys
+import time
+import tempfile
+
+from greatfet.commands.greatfet_logic import unpack_data, allocate_transfer_buffer, SigrokSessionWriter
+from greatfet.programmers.firmware import DeviceFirmwareManager
+from greatfet.programmers.spi_flash import SPIFlash
+from greatfet.support.mock_device import MockGreatFET, MockLogicAnalyzer, MockFlash, MockSPIFlash
+
+# Each benchmark is run for at least this long.
+MINIMUM_RUN_SECONDS = 0.25
+
+# How long we run the logic analyzer for, when checking that we keep up with it.
+KEEP_UP_RUN_SECONDS = 1.0
+
+
+def run_benchmark(name, bytes_per_iteration, body):
+    """ Runs body repeatedly, doubling the run length until it's long enough to time; and reports its throughput. """
+
+    iterations = 1
+
+    # Warm up...
+    body()
+
+    # ... and then time things.
+    while True:
+        start = time.perf_counter()
+        for _ in range(iterations):
+            body()
+        elapsed = time.perf_counter() - start
+
+        if elapsed >= MINIMUM_RUN_SECONDS:
+            break
+        iterations *= 2
+
+    rate = (bytes_per_iteration * iterations) / elapsed
+    print("{:<48} {:12.2f} MB/s".format(name, rate / 1e6))
+    return rate
+
+
+def benchmark_logic_analyzer():
+    """ Reads unthrottled logic analyzer data, as greatfet_logic does; and unpacks it for each bus width. """
+
+    board = MockGreatFET()
+    board.add_class('logic_analyzer', MockLogicAnalyzer(board, realtime=False))
+
+    _, buffer_size, endpoint = board.apis.logic_analyzer.configure(40000000, 8)
+    transfer_buffer = allocate_transfer_buffer(buffer_size)
+
+    board.apis.logic_analyzer.start()
+
+    run_benchmark("logic analyzer: bulk read ({} B)".format(buffer_size), buffer_size,
+        lambda: board.comms.device.read(endpoint, transfer_buffer, 3000))
+
+    for bus_width in (8, 4, 2, 1):
+        run_benchmark("logic analyzer: unpack_data, {} channel(s)".format(bus_width), buffer_size,
+            lambda: unpack_data(transfer_buffer, bus_width))
+
+    board.apis.logic_analyzer.stop()
+
+
+def benchmark_logic_analyzer_keeps_up(sample_rate=17000000, bus_width=8):
+    """ Streams at a real capture rate, and reports whether reading and unpacking keep up with it. """
+
+    board = MockGreatFET()
+    analyzer = board.add_class('logic_analyzer', MockLogicAnalyzer(board))
+
+    _, buffer_size, endpoint = board.apis.logic_analyzer.configure(sample_rate, bus_width)
+    transfer_buffer = allocate_transfer_buffer(buffer_size)
+
+    board.apis.logic_analyzer.start()
+
+    received = 0
+    start = time.perf_counter()
+    while time.perf_counter() - start < KEEP_UP_RUN_SECONDS:
+        length = board.comms.device.read(endpoint, transfer_buffer, 3000)
+        unpack_data(transfer_buffer[:length], bus_width)
+        received += length
+
+    elapsed = time.perf_counter() - start
+    board.apis.logic_analyzer.stop()
+
+    # Anything the device produced that we haven't read yet would be sitting in its buffers.
+    backlog = analyzer.stream.rate * elapsed - received
+    kept_up = backlog < (2 * buffer_size)
+
+    print("{:<48} {:12.2f} MB/s ({})".format(
+        "logic analyzer: {} channel(s) at {} MSPS".format(bus_width, sample_rate / 1e6),
+        received / elapsed / 1e6, "kept up" if kept_up else "fell behind by {} B".format(int(backlog))))
+    return kept_up
+
+
+def benchmark_sigrok_file(length=0x400000):
+    """ Measures compressing samples into a sigrok session file, as greatfet_logic does during a capture. """
+
+    samples = bytes(range(256)) * (length // 256)
+
+    with tempfile.TemporaryDirectory() as directory:
+        with SigrokSessionWriter(os.path.join(directory, 'session.sr'), 8, 17000000) as session:
+            run_benchmark("sigrok session: write ({} MiB)".format(length >> 20), length,
+                lambda: session.write(samples))
+
+
+def benchmark_flash(command_latency=0.0, length=0x10000):
+    """ Measures page-by-page flash programming and readback, for onboard and SPI flash. """
+
+    latency_description = "{} us/command".format(int(command_latency * 1e6))
+
+    for name, model, create in (
+            ('firmware', MockFlash(), DeviceFirmwareManager),
+            ('spi_flash', MockSPIFlash(), SPIFlash)):
+
+        board = MockGreatFET(command_latency=command_latency)
+        board.add_class(name, model)
+        flash = create(board)
+
+        data = bytes(range(256)) * (length // 256)
+
+        run_benchmark("{}: write, {}".format(name, latency_description), length,
+            lambda: flash.write(data, 0, erase_first=True))
+        run_benchmark("{}: read, {}".format(name, latency_description), length,
+            lambda: flash.read(0, length))
+
+
+def main():
+    benchmark_logic_analyzer()
+    kept_up = benchmark_logic_analyzer_keeps_up()
+    benchmark_sigrok_file()
+    benchmark_flash()
+    benchmark_flash(command_latency=0.0002)
+
+    # Fail if we couldn't keep up with a real capture rate, so this can gate CI.
+    sys.exit(0 if kept_up else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,467 @@
+#
+# This file is part of GreatFET
+#
+"""
+In-process stand-in for a GreatFET, for exercising host tools without hardware.
+
+The mock provides the parts of a GreatFETBoard the host tools talk to -- ``board.apis.<class>.<verb>()``,
+``board.supports_api()``, and the streaming endpoints read via ``board.comms.device.read()`` -- backed by
+Python models of each comms class, and by synthetic data streams with configurable rates and latencies.
+This lets host-side throughput and latency be measured in CI, separately from the firmware's.
+
+Example:
+
+    board = MockGreatFET(command_latency=0.0005)
+    board.add_class('logic_analyzer', MockLogicAnalyzer(board))
+
+    sample_rate, buffer_size, endpoint = board.apis.logic_analyzer.configure(40000000, 8)
+    board.apis.logic_analyzer.start()
+    data = board.comms.device.read(endpoint, buffer_size, 3000)
+"""
+
+import array
+import errno
+import itertools
+import threading
+import time
+import zlib
+
+import usb
+
+from pygreat.comms import CommandFailureError
+
+
+class MockVerbError(CommandFailureError):
+    """ Raised when a mocked verb fails; as pygreat raises when a verb returns an error code on the device. """
+
+    def __init__(self, error_number, message=None):
+        IOError.__init__(self, error_number, message or errno.errorcode.get(error_number, str(error_number)))
+
+
+class SyntheticStream(object):
+    """
+    Produces bulk data for a mock streaming endpoint, at a configurable rate.
+
+    Data is delivered as the device would deliver it: each read returns whatever has been "captured"
+    since the last read, up to the size requested, in whole multiples of the transfer granularity; and
+    a read that finds nothing available waits for more, timing out like a real bulk read.
+    """
+
+    def __init__(self, rate=None, pattern=None, source=None, granularity=512, read_latency=0.0, total_length=None):
+        """
+        Args:
+            rate         -- The rate at which data becomes available, in bytes per second; or None for
+                            data that's always available, to measure the host side alone.
+            pattern      -- Bytes that are repeated to form the stream. Defaults to an incrementing pattern.
+            source       -- Alternatively, a function that accepts a length and returns that many bytes.
+            granularity  -- Reads return multiples of this many bytes, as with a device sending full packets.
+            read_latency -- Extra time each read takes, in seconds; models the USB round trip.
+            total_length -- If provided, the stream ends after this many bytes; later reads time out.
+        """
+
+        self.rate         = rate
+        self.source       = source
+        self.granularity  = granularity
+        self.read_latency = read_latency
+        self.total_length = total_length
+
+        pattern = bytes(pattern) if pattern else bytes(range(256))
+
+        # Build a block we can slice any read out of without per-read generation costs.
+        self._pattern_length = len(pattern)
+        self._pattern = pattern * ((0x10000 // len(pattern)) + 2)
+
+        self.running        = False
+        self.bytes_produced = 0
+        self._start_time    = None
+
+
+    def start(self):
+        """ Starts producing data. """
+        self.bytes_produced = 0
+        self._start_time    = time.perf_counter()
+        self.running        = True
+
+
+    def stop(self):
+        """ Stops producing data. """
+        self.running = False
+
+
+    def _bytes_available(self, now):
+        """ Returns the number of bytes that have been produced but not yet read. """
+
+        if self.rate is None:
+            available = float('inf')
+        else:
+            available = int((now - self._start_time) * self.rate) - self.bytes_produced
+
+        if self.total_length is not None:
+            available = min(available, self.total_length - self.bytes_produced)
+
+        return available
+
+
+    def _generate(self, length):
+        """ Returns the next length bytes of the stream. """
+
+        if self.source:
+            return bytes(self.source(length))
+
+        offset = self.bytes_produced % self._pattern_length
+        if length + offset <= len(self._pattern):
+            return self._pattern[offset:offset + length]
+
+        # For reads larger than our precomputed block, build the data up from repeats.
+        repeats = itertools.islice(itertools.cycle(self._pattern[:self._pattern_length]), offset, offset + length)
+        return bytes(repeats)
+
+
+    def read(self, length, timeout_ms):
+        """ Reads up to length bytes from the stream, waiting up to timeout_ms for any to arrive. """
+
+        if self.read_latency:
+            time.sleep(self.read_latency)
+
+        deadline = time.perf_counter() + (timeout_ms / 1000.0)
+        length = length - (length % self.granularity) if length >= self.granularity else length
+
+        while True:
+            now = time.perf_counter()
+            available = min(self._bytes_available(now), length) if self.running else 0
+
+            # Deliver whole packets, unless the stream is ending.
+            if (self.total_length is None) or (available < self.total_length - self.bytes_produced):
+                available -= available % self.granularity
+
+            if available > 0:
+                break
+
+            if now >= deadline:
+                raise usb.core.USBError("Operation timed out", errno=errno.ETIMEDOUT)
+
+            # Sleep until about when the next packet should be ready.
+            wait = (self.granularity / self.rate) if self.rate else 0.001
+            time.sleep(min(wait, max(deadline - now, 0)))
+
+        length = int(available)
+        data = self._generate(length)
+        self.bytes_produced += length
+
+        return data
+
+
+
+class MockUSBDevice(object):
+    """ Stands in for the board's pyusb device; which the host tools use to read streaming endpoints. """
+
+    def __init__(self):
+        self.streams = {}
+        self.sinks   = {}
+
+
+    def read(self, endpoint, size_or_buffer, timeout=None):
+        """ Reads from a mock streaming endpoint; with the same conventions as pyusb's Device.read. """
+
+        try:
+            stream = self.streams[endpoint]
+        except KeyError:
+            raise usb.core.USBError("Pipe error", errno=errno.EPIPE)
+
+        timeout = 1000 if timeout is None else timeout
+
+        # If we were given a buffer to fill, fill it, and return the length read; as pyusb does.
+        if isinstance(size_or_buffer, int):
+            return array.array('B', stream.read(size_or_buffer, timeout))
+
+        data = stream.read(len(size_or_buffer), timeout)
+        size_or_buffer[:len(data)] = array.array('B', data) if isinstance(size_or_buffer, array.array) else data
+        return len(data)
+
+
+    def write(self, endpoint, data, timeout=None):
+        """ Accepts data written to an OUT endpoint; handing it to the endpoint's sink, if it has one. """
+
+        if endpoint in self.sinks:
+            self.sinks[endpoint](bytes(data))
+
+        return len(data)
+
+
+
+class MockComms(object):
+    """ Stands in for the board's comms backend. """
+
+    def __init__(self):
+        self.device = MockUSBDevice()
+        self._lock  = threading.RLock()
+
+
+    def get_exclusive_access(self):
+        self._lock.acquire()
+
+
+    def release_exclusive_access(self):
+        self._lock.release()
+
+
+
+class MockAPIs(object):
+    """ Stands in for board.apis; each attribute is a mock comms class. """
+
+    def __init__(self, board):
+        self._board   = board
+        self._classes = {}
+
+
+    def _add(self, name, model):
+        self._classes[name] = _MockClassProxy(self._board, name, model)
+
+
+    def __getattr__(self, name):
+        try:
+            return self.__dict__['_classes'][name]
+        except KeyError:
+            raise AttributeError("the mock GreatFET doesn't provide the '{}' API".format(name))
+
+
+    def __dir__(self):
+        return list(self._classes.keys())
+
+
+
+class _MockClassProxy(object):
+    """ Presents a class model's verbs as methods; adding a command round trip to each call. """
+
+    def __init__(self, board, name, model):
+        self._board = board
+        self._name  = name
+        self._model = model
+
+
+    def supports_verb(self, verb_name):
+        return hasattr(self.__dict__['_model'], verb_name)
+
+
+    def __getattr__(self, verb_name):
+        verb = getattr(self.__dict__['_model'], verb_name)
+        board = self.__dict__['_board']
+
+        def call_verb(*args, **kwargs):
+
+            # Like pygreat, accept (and ignore) transport-level options.
+            kwargs.pop('timeout', None)
+            kwargs.pop('comms_timeout', None)
+
+            board.commands_issued += 1
+            if board.command_latency:
+                time.sleep(board.command_latency)
+
+            return verb(*args, **kwargs)
+
+        return call_verb
+
+
+
+class MockGreatFET(object):
+    """ In-process stand-in for a GreatFETBoard; see the module documentation. """
+
+    def __init__(self, command_latency=0.0):
+        """
+        Args:
+            command_latency -- The time each verb call takes, in seconds; models a control-transfer round trip.
+        """
+
+        self.command_latency = command_latency
+        self.commands_issued = 0
+
+        self.comms = MockComms()
+        self.apis  = MockAPIs(self)
+
+
+    def add_class(self, name, model):
+        """ Adds a mock comms class; whose public methods act as its verbs. """
+        self.apis._add(name, model)
+        return model
+
+
+    def add_stream(self, endpoint, stream):
+        """ Attaches a SyntheticStream to a bulk IN endpoint. """
+        self.comms.device.streams[endpoint] = stream
+        return stream
+
+
+    def add_sink(self, endpoint, sink):
+        """ Attaches a function that receives each block written to a bulk OUT endpoint. """
+        self.comms.device.sinks[endpoint] = sink
+
+
+    def supports_api(self, class_name):
+        return class_name in self.apis._classes
+
+
+    def read_debug_ring(self, *args, **kwargs):
+        return ""
+
+
+
+class MockLogicAnalyzer(object):
+    """ Model of the logic_analyzer class; streams synthetic samples once started. """
+
+    BUFFER_SIZE = 0x4000
+    ENDPOINT    = 0x81
+
+    def __init__(self, board, realtime=True, rate=None, **stream_options):
+        """
+        Args:
+            board    -- The MockGreatFET to stream from.
+            realtime -- If set, samples are delivered at the configured sample rate and bus width, as
+                        a real capture would deliver them.
+            rate     -- Otherwise, the rate samples are delivered, in bytes per second; or None to
+                        deliver them as fast as they're read.
+            stream_options -- Further options for the SyntheticStream.
+        """
+
+        self.board    = board
+        self.realtime = realtime
+        self.stream   = board.add_stream(self.ENDPOINT, SyntheticStream(rate=rate, **stream_options))
+
+
+    def configure(self, sample_rate, bus_width):
+        if self.realtime:
+            self.stream.rate = (sample_rate * bus_width) / 8
+
+        return sample_rate, self.BUFFER_SIZE, self.ENDPOINT
+
+
+    def configure_alt_mappings(self, rhododendron):
+        pass
+
+
+    def change_first_pin(self, first_pin):
+        pass
+
+
+    def dump_sgpio_configuration(self, include_unused):
+        pass
+
+
+    def start(self):
+        self.stream.start()
+
+
+    def stop(self):
+        self.stream.stop()
+
+
+
+class MockFlash(object):
+    """ Model of the firmware (onboard flash) class, backed by memory. """
+
+    PAGE_SIZE = 256
+
+    def __init__(self, size=0x100000):
+        self.contents = bytearray(b"\xff" * size)
+
+
+    def initialize(self):
+        return self.PAGE_SIZE, len(self.contents) - 1
+
+
+    def full_erase(self):
+        self.contents[:] = b"\xff" * len(self.contents)
+
+
+    def write_page(self, address, data):
+        if (address % self.PAGE_SIZE) + len(data) > self.PAGE_SIZE:
+            raise MockVerbError(errno.EINVAL, "write crosses a page boundary")
+
+        # Like real flash, programming can only clear bits.
+        for i, byte in enumerate(data):
+            self.contents[address + i] &= byte
+
+
+    def read_page(self, address):
+        return bytes(self.contents[address:address + self.PAGE_SIZE])
+
+
+
+class MockSPIFlash(MockFlash):
+    """ Model of the spi_flash class: a memory-backed flash with the usual 4K/32K/64K erase blocks. """
+
+    JEDEC_ID    = (0xEF, 0x4014, 0x14)
+    ERASE_SIZES = [0x1000, 0x8000, 0x10000]
+
+    def initialize(self, page_size, pages, size, chip_select_port, chip_select_pin, device_id):
+        pass
+
+
+    def query_device_id(self):
+        return self.JEDEC_ID
+
+
+    def query_topology(self):
+        return self.PAGE_SIZE, len(self.contents) // self.PAGE_SIZE, len(self.contents)
+
+
+    def query_erase_sizes(self):
+        return list(self.ERASE_SIZES)
+
+
+    def erase_block(self, address, size):
+        if (size not in self.ERASE_SIZES) or (address % size):
+            raise MockVerbError(errno.EINVAL, "unsupported or misaligned erase block")
+
+        self.contents[address:address + size] = b"\xff" * size
+
+
+
+class MockLoadables(object):
+    """ Model of the loadables class: an M0 memory region, and the record of the image last loaded into it. """
+
+    ENDPOINT = 0x02
+
+    def __init__(self, board, size=0x10000):
+        self.board  = board
+        self.memory = bytearray(size)
+
+        self.running       = False
+        self.images_loaded = 0
+
+        self._loaded_image = (False, 0, 0)
+        self._upload       = None
+
+
+    def load_m0_image(self, length):
+        self._loaded_image = (False, 0, 0)
+        self._upload = bytearray()
+        self._upload_length = length
+        self.images_loaded += 1
+        self.board.add_sink(self.ENDPOINT, self._receive_image_data)
+        return self.ENDPOINT
+
+
+    def _receive_image_data(self, data):
+        self._upload.extend(data)
+        self.memory[:len(self._upload)] = self._upload
+
+        if len(self._upload) == self._upload_length:
+            self._loaded_image = (True, len(self._upload), zlib.crc32(self._upload))
+
+
+    def load_m0_image_status(self):
+        return True, len(self._upload), zlib.crc32(self._upload)
+
+
+    def loaded_m0_image(self):
+        return self._loaded_image
+
+
+    def start_m0(self):
+        # Once started, the image is free to modify its own memory; so the device forgets it.
+        self._loaded_image = (False, 0, 0)
+        self.running = True
+
+
+    def halt_m0(self):
+        self.running = False
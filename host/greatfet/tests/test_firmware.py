@@ -0,0 +1,29 @@
+import errno
+import unittest
+
+from greatfet.programmers.firmware import DeviceFirmwareManager
+from greatfet.support.mock_device import MockGreatFET, MockFlash, MockVerbError
+
+
+class UnavailableFirmwareBulk(object):
+    """ A firmware_bulk class whose streaming is unavailable; as when another class holds the SPIFI pins. """
+
+    def start_read(self, address, length):
+        raise MockVerbError(errno.EIO)
+
+
+class TestDeviceFirmwareManager(unittest.TestCase):
+    def test_read_falls_back_when_streaming_fails(self):
+        """Does read() fall back to page-by-page reads if the device can't start a bulk read?"""
+        board = MockGreatFET()
+        flash = board.add_class('firmware', MockFlash())
+        board.add_class('firmware_bulk', UnavailableFirmwareBulk())
+
+        flash.contents[0:1024] = bytes(range(256)) * 4
+        manager = DeviceFirmwareManager(board)
+
+        self.assertEqual(bytes(manager.read(0, 1024)), bytes(range(256)) * 4)
+
+
+if __name__ == '__main__':
+    unittest.main()
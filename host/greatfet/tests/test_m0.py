@@ -0,0 +1,30 @@
+import unittest
+
+from greatfet.programmers.m0 import M0Coprocessor
+from greatfet.support.mock_device import MockGreatFET, MockLoadables
+
+
+class TestM0Coprocessor(unittest.TestCase):
+    IMAGE = bytes(range(256)) * 4
+
+    def setUp(self):
+        self.board = MockGreatFET()
+        self.loadables = self.board.add_class('loadables', MockLoadables(self.board))
+        self.m0 = M0Coprocessor(self.board)
+
+    def test_resident_image_is_not_reloaded(self):
+        """Is an image that's been loaded, but not yet run, left in place?"""
+        self.m0.load_loadable(self.IMAGE)
+        self.m0.load_loadable(self.IMAGE)
+        self.assertEqual(self.loadables.images_loaded, 1)
+
+    def test_image_is_reloaded_after_running(self):
+        """Does running the same image twice upload it afresh, since the first run dirtied its memory?"""
+        self.m0.run_loadable(self.IMAGE)
+        self.m0.run_loadable(self.IMAGE)
+        self.assertEqual(self.loadables.images_loaded, 2)
+        self.assertTrue(self.loadables.running)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -20,6 +20,20 @@ class Fakebus:
          return tuple([0xAA]*l) 
           
 
+class FakeProgrammingBus(Fakebus):
+    """mock for an I2C bus that can program EEPROM pages on the device"""
+    def __init__(self):
+        super().__init__()
+        self.programs = []
+
+    def supports_eeprom_programming(self):
+        return True
+
+    def program_eeprom(self, address, word_address, data, page_size, address_bytes, verify=True):
+        self.programs.append((address, word_address, data, page_size, address_bytes))
+        return len(data)
+
+
 class TestSum(unittest.TestCase):
     def test_creation(self):
         """Can we create an object with specified parameters?"""
@@ -133,6 +147,23 @@ class TestSum(unittest.TestCase):
         self.assertEqual(written_bytes[0x51], 1)
 
 
+    def test_device_programming(self):
+        # Set up two block device again, on a bus that can program pages itself
+        b = FakeProgrammingBus()
+        e = microchipEEPROM.EEPROMDevice(b, 512, 16, bitmask="00B")
+
+        # Write across the block boundary
+        data = bytes(range(256)) + b'\x55'
+        e.write_bytes(0x10, data)
+
+        # Nothing should have gone over the raw bus
+        self.assertEqual(b.writes, [])
+
+        # Writes should be split at the block boundary, with block-relative addresses
+        self.assertEqual(len(b.programs), 2)
+        self.assertEqual(b.programs[0], (0x50, 0x10, data[:0xF0], 16, 1))
+        self.assertEqual(b.programs[1], (0x51, 0x00, data[0xF0:], 16, 1))
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -0,0 +1,57 @@
+import array
+import errno
+import unittest
+
+import usb
+
+from greatfet.programmers.spi_flash import SPIFlash
+from greatfet.support.mock_device import MockGreatFET, MockLogicAnalyzer, MockSPIFlash, SyntheticStream
+
+
+class TestMockDevice(unittest.TestCase):
+    def test_logic_analyzer_stream(self):
+        """Does a started logic analyzer stream its pattern in whole packets?"""
+        board = MockGreatFET()
+        board.add_class('logic_analyzer', MockLogicAnalyzer(board, realtime=False))
+
+        _, buffer_size, endpoint = board.apis.logic_analyzer.configure(17000000, 8)
+        board.apis.logic_analyzer.start()
+
+        buffer = array.array('B', b"\0" * buffer_size)
+        length = board.comms.device.read(endpoint, buffer, 100)
+        self.assertEqual(length, buffer_size)
+        self.assertEqual(list(buffer[:300]), [i & 0xff for i in range(300)])
+
+        # The pattern should pick up where the last read left off.
+        self.assertEqual(board.comms.device.read(endpoint, 512, 100)[0], buffer_size & 0xff)
+
+    def test_stopped_stream_times_out(self):
+        """Does reading from a stream that isn't running time out, like a bulk read?"""
+        board = MockGreatFET()
+        board.add_stream(0x81, SyntheticStream())
+
+        with self.assertRaises(usb.core.USBError) as context:
+            board.comms.device.read(0x81, 512, 10)
+        self.assertEqual(context.exception.errno, errno.ETIMEDOUT)
+
+    def test_bounded_stream(self):
+        """Does a stream with a total length end with a short read?"""
+        stream = SyntheticStream(total_length=1000)
+        stream.start()
+
+        self.assertEqual(len(stream.read(4096, 10)), 1000)
+
+    def test_spi_flash_round_trip(self):
+        """Can the SPIFlash programmer write and read back through the mock?"""
+        board = MockGreatFET()
+        board.add_class('spi_flash', MockSPIFlash())
+        flash = SPIFlash(board)
+
+        data = bytes(range(256)) * 20
+        flash.write(data, 0x1000, erase_first=True)
+        self.assertEqual(bytes(flash.read(0x1000, len(data))), data)
+        self.assertGreater(board.commands_issued, 20)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,35 @@
+import os
+import tempfile
+import unittest
+
+from zipfile import ZipFile
+
+from greatfet.commands.greatfet_logic import SigrokSessionWriter
+
+
+class TestSigrokSession(unittest.TestCase):
+    def test_chunked_samples(self):
+        """Are samples split across logic-1-N chunks, and read back intact?"""
+        samples = bytes(range(256)) * 100
+
+        with tempfile.TemporaryDirectory() as directory:
+            filename = os.path.join(directory, 'capture.sr')
+
+            with SigrokSessionWriter(filename, 8, 1000000, channel_names={0: 'D-'}) as session:
+                session.CHUNK_SIZE = 10000
+                session.write(samples[:5000])
+                session.write(samples[5000:])
+
+            with ZipFile(filename) as archive:
+                chunks = ['logic-1-{}'.format(n) for n in range(1, 4)]
+                self.assertEqual(archive.namelist(), ['version', 'metadata'] + chunks)
+                self.assertEqual(b"".join(archive.read(chunk) for chunk in chunks), samples)
+
+                metadata = archive.read('metadata').decode()
+                self.assertIn("capturefile=logic-1", metadata)
+                self.assertIn("probe1=D-", metadata)
+                self.assertIn("probe2=SGPIO1", metadata)
+
+
+if __name__ == '__main__':
+    unittest.main()
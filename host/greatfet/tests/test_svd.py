@@ -0,0 +1,74 @@
+import os
+import sys
+import types
+import tempfile
+import unittest
+from unittest import mock
+
+from greatfet.debug import svd
+
+
+class FakeSVDParser(object):
+    """ Stand-in for cmsis_svd's parser, which returns a tiny fixed device and counts parses. """
+
+    parses = 0
+
+    @classmethod
+    def for_xml_file(cls, filename):
+        cls.parses += 1
+        return cls()
+
+    def get_device(self):
+        value = types.SimpleNamespace(name='ON', value=1, description='Enabled.')
+        field = types.SimpleNamespace(name='EN', description='Enable.', access='read-write',
+            bit_offset=0, bit_width=1, enumerated_values=[value])
+        register = types.SimpleNamespace(name='CTRL', description='Control.', access='read-write',
+            address_offset=4, fields=[field])
+        peripheral = types.SimpleNamespace(name='TIMER0', description='Timer.', _description='Timer.',
+            base_address=0x40084000, registers=[register])
+        return types.SimpleNamespace(name='TEST', description='Test device.', peripherals=[peripheral])
+
+
+class TestSVDCache(unittest.TestCase):
+
+    def setUp(self):
+        FakeSVDParser.parses = 0
+
+        self.directory = tempfile.TemporaryDirectory()
+        self.cache_directory = os.path.join(self.directory.name, 'greatfet', 'svd')
+        self.svd_filename = os.path.join(self.directory.name, 'test.svd')
+        with open(self.svd_filename, 'w') as f:
+            f.write('<device/>')
+
+        parser_module = types.ModuleType('cmsis_svd.parser')
+        parser_module.SVDParser = FakeSVDParser
+        patches = [
+            mock.patch.dict(os.environ, {'XDG_CACHE_HOME': self.directory.name}),
+            mock.patch.dict(sys.modules, {'cmsis_svd': types.ModuleType('cmsis_svd'), 'cmsis_svd.parser': parser_module}),
+        ]
+        for patch in patches:
+            patch.start()
+            self.addCleanup(patch.stop)
+        self.addCleanup(self.directory.cleanup)
+
+    def test_cached_model_round_trips(self):
+        """Does a second load come from the cache, and match the model the first load compiled?"""
+        compiled = svd.load_svd_device(self.svd_filename)
+        cached = svd.load_svd_device(self.svd_filename)
+
+        self.assertEqual(FakeSVDParser.parses, 1)
+        self.assertEqual(cached, compiled)
+        self.assertEqual(cached.peripherals[0].registers[0].fields[0].enumerated_values[0].name, 'ON')
+        self.assertEqual(len(os.listdir(self.cache_directory)), 1)
+
+    def test_failed_cache_write_leaves_no_temporary_file(self):
+        """Is the temporary file removed when writing the cache fails partway through?"""
+        with mock.patch.object(svd.json, 'dump', side_effect=TypeError):
+            with self.assertRaises(TypeError):
+                svd.load_svd_device(self.svd_filename)
+
+        self.assertEqual(os.listdir(self.cache_directory), [])
+
+
+if __name__ == '__main__':
+    unittest.main()